@@ -11,6 +11,10 @@ static void rtpp_server_get_fin(void *pub) {
     fprintf(stderr, "Method rtpp_server@%p::get (rtpp_server_get) is invoked after destruction\x0a", pub);
     RTPP_AUTOTRAP();
 }
+static void rtpp_server_get_deadline_fin(void *pub) {
+    fprintf(stderr, "Method rtpp_server@%p::get_deadline (rtpp_server_get_deadline) is invoked after destruction\x0a", pub);
+    RTPP_AUTOTRAP();
+}
 static void rtpp_server_get_seq_fin(void *pub) {
     fprintf(stderr, "Method rtpp_server@%p::get_seq (rtpp_server_get_seq) is invoked after destruction\x0a", pub);
     RTPP_AUTOTRAP();
@@ -33,6 +37,7 @@ static void rtpp_server_start_fin(void *pub) {
 }
 static const struct rtpp_server_smethods rtpp_server_smethods_fin = {
     .get = (rtpp_server_get_t)&rtpp_server_get_fin,
+    .get_deadline = (rtpp_server_get_deadline_t)&rtpp_server_get_deadline_fin,
     .get_seq = (rtpp_server_get_seq_t)&rtpp_server_get_seq_fin,
     .get_ssrc = (rtpp_server_get_ssrc_t)&rtpp_server_get_ssrc_fin,
     .set_seq = (rtpp_server_set_seq_t)&rtpp_server_set_seq_fin,
@@ -41,6 +46,7 @@ static const struct rtpp_server_smethods rtpp_server_smethods_fin = {
 };
 void rtpp_server_fin(struct rtpp_server *pub) {
     RTPP_DBG_ASSERT(pub->smethods->get != (rtpp_server_get_t)NULL);
+    RTPP_DBG_ASSERT(pub->smethods->get_deadline != (rtpp_server_get_deadline_t)NULL);
     RTPP_DBG_ASSERT(pub->smethods->get_seq != (rtpp_server_get_seq_t)NULL);
     RTPP_DBG_ASSERT(pub->smethods->get_ssrc != (rtpp_server_get_ssrc_t)NULL);
     RTPP_DBG_ASSERT(pub->smethods->set_seq != (rtpp_server_set_seq_t)NULL);
@@ -73,6 +79,7 @@ rtpp_server_fintest()
     assert(tp->pub.rcnt != NULL);
     static const struct rtpp_server_smethods dummy = {
         .get = (rtpp_server_get_t)((void *)0x1),
+        .get_deadline = (rtpp_server_get_deadline_t)((void *)0x1),
         .get_seq = (rtpp_server_get_seq_t)((void *)0x1),
         .get_ssrc = (rtpp_server_get_ssrc_t)((void *)0x1),
         .set_seq = (rtpp_server_set_seq_t)((void *)0x1),
@@ -84,12 +91,13 @@ rtpp_server_fintest()
       &tp->pub);
     RTPP_OBJ_DECREF(&(tp->pub));
     CALL_TFIN(&tp->pub, get);
+    CALL_TFIN(&tp->pub, get_deadline);
     CALL_TFIN(&tp->pub, get_seq);
     CALL_TFIN(&tp->pub, get_ssrc);
     CALL_TFIN(&tp->pub, set_seq);
     CALL_TFIN(&tp->pub, set_ssrc);
     CALL_TFIN(&tp->pub, start);
-    assert((_naborts - naborts_s) == 6);
+    assert((_naborts - naborts_s) == 7);
 }
 const static void *_rtpp_server_ftp = (void *)&rtpp_server_fintest;
 DATA_SET(rtpp_fintests, _rtpp_server_ftp);
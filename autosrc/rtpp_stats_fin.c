@@ -23,6 +23,18 @@ static void rtpp_stats_nstr_fin(void *pub) {
     fprintf(stderr, "Method rtpp_stats@%p::nstr (rtpp_stats_nstr) is invoked after destruction\x0a", pub);
     RTPP_AUTOTRAP();
 }
+static void rtpp_stats_om_render_fin(void *pub) {
+    fprintf(stderr, "Method rtpp_stats@%p::om_render (rtpp_stats_om_render) is invoked after destruction\x0a", pub);
+    RTPP_AUTOTRAP();
+}
+static void rtpp_stats_set_gauges_fin(void *pub) {
+    fprintf(stderr, "Method rtpp_stats@%p::set_gauges (rtpp_stats_set_gauges) is invoked after destruction\x0a", pub);
+    RTPP_AUTOTRAP();
+}
+static void rtpp_stats_shm_attach_fin(void *pub) {
+    fprintf(stderr, "Method rtpp_stats@%p::shm_attach (rtpp_stats_shm_attach) is invoked after destruction\x0a", pub);
+    RTPP_AUTOTRAP();
+}
 static void rtpp_stats_update_derived_fin(void *pub) {
     fprintf(stderr, "Method rtpp_stats@%p::update_derived (rtpp_stats_update_derived) is invoked after destruction\x0a", pub);
     RTPP_AUTOTRAP();
@@ -44,6 +56,9 @@ static const struct rtpp_stats_smethods rtpp_stats_smethods_fin = {
     .getlvalbyname = (rtpp_stats_getlvalbyname_t)&rtpp_stats_getlvalbyname_fin,
     .getnstats = (rtpp_stats_getnstats_t)&rtpp_stats_getnstats_fin,
     .nstr = (rtpp_stats_nstr_t)&rtpp_stats_nstr_fin,
+    .om_render = (rtpp_stats_om_render_t)&rtpp_stats_om_render_fin,
+    .set_gauges = (rtpp_stats_set_gauges_t)&rtpp_stats_set_gauges_fin,
+    .shm_attach = (rtpp_stats_shm_attach_t)&rtpp_stats_shm_attach_fin,
     .update_derived = (rtpp_stats_update_derived_t)&rtpp_stats_update_derived_fin,
     .updatebyidx = (rtpp_stats_updatebyidx_t)&rtpp_stats_updatebyidx_fin,
     .updatebyname = (rtpp_stats_updatebyname_t)&rtpp_stats_updatebyname_fin,
@@ -54,6 +69,9 @@ void rtpp_stats_fin(struct rtpp_stats *pub) {
     RTPP_DBG_ASSERT(pub->smethods->getlvalbyname != (rtpp_stats_getlvalbyname_t)NULL);
     RTPP_DBG_ASSERT(pub->smethods->getnstats != (rtpp_stats_getnstats_t)NULL);
     RTPP_DBG_ASSERT(pub->smethods->nstr != (rtpp_stats_nstr_t)NULL);
+    RTPP_DBG_ASSERT(pub->smethods->om_render != (rtpp_stats_om_render_t)NULL);
+    RTPP_DBG_ASSERT(pub->smethods->set_gauges != (rtpp_stats_set_gauges_t)NULL);
+    RTPP_DBG_ASSERT(pub->smethods->shm_attach != (rtpp_stats_shm_attach_t)NULL);
     RTPP_DBG_ASSERT(pub->smethods->update_derived != (rtpp_stats_update_derived_t)NULL);
     RTPP_DBG_ASSERT(pub->smethods->updatebyidx != (rtpp_stats_updatebyidx_t)NULL);
     RTPP_DBG_ASSERT(pub->smethods->updatebyname != (rtpp_stats_updatebyname_t)NULL);
@@ -88,6 +106,9 @@ rtpp_stats_fintest()
         .getlvalbyname = (rtpp_stats_getlvalbyname_t)((void *)0x1),
         .getnstats = (rtpp_stats_getnstats_t)((void *)0x1),
         .nstr = (rtpp_stats_nstr_t)((void *)0x1),
+        .om_render = (rtpp_stats_om_render_t)((void *)0x1),
+        .set_gauges = (rtpp_stats_set_gauges_t)((void *)0x1),
+        .shm_attach = (rtpp_stats_shm_attach_t)((void *)0x1),
         .update_derived = (rtpp_stats_update_derived_t)((void *)0x1),
         .updatebyidx = (rtpp_stats_updatebyidx_t)((void *)0x1),
         .updatebyname = (rtpp_stats_updatebyname_t)((void *)0x1),
@@ -101,11 +122,14 @@ rtpp_stats_fintest()
     CALL_TFIN(&tp->pub, getlvalbyname);
     CALL_TFIN(&tp->pub, getnstats);
     CALL_TFIN(&tp->pub, nstr);
+    CALL_TFIN(&tp->pub, om_render);
+    CALL_TFIN(&tp->pub, set_gauges);
+    CALL_TFIN(&tp->pub, shm_attach);
     CALL_TFIN(&tp->pub, update_derived);
     CALL_TFIN(&tp->pub, updatebyidx);
     CALL_TFIN(&tp->pub, updatebyname);
     CALL_TFIN(&tp->pub, updatebyname_d);
-    assert((_naborts - naborts_s) == 8);
+    assert((_naborts - naborts_s) == 11);
 }
 const static void *_rtpp_stats_ftp = (void *)&rtpp_stats_fintest;
 DATA_SET(rtpp_fintests, _rtpp_stats_ftp);
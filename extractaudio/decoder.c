@@ -79,13 +79,103 @@ decoder_new(struct session *sp, int dflags)
     return (void *)dp;
 }
 
-int32_t
-decoder_get(struct decoder_stream *dp)
+void
+decoder_destroy(struct decoder_stream *dp)
+{
+
+#ifdef ENABLE_G729
+    if (dp->g729_ctx != NULL)
+        G729_DCLOSE(dp->g729_ctx);
+#endif
+#ifdef ENABLE_G722
+    if (dp->g722_ctx != NULL)
+        g722_decoder_destroy(dp->g722_ctx);
+#endif
+#ifdef ENABLE_GSM
+    if (dp->ctx_gsm != NULL)
+        gsm_destroy(dp->ctx_gsm);
+#endif
+    free(dp);
+}
+
+/*
+ * Switch decoder into the follow mode. Packets are taken off the head of
+ * the queue and freed once decoded, so that the queue only holds what has
+ * been loaded but not yet consumed. Packets that show up after their turn
+ * has passed are dropped.
+ */
+void
+decoder_set_follow(struct decoder_stream *dp, const struct decoder_follow *fp)
+{
+
+    dp->follow = fp;
+    if (dp->pp != NULL)
+        dp->lptime = dp->pp->pkt->time;
+}
+
+/*
+ * No packets for this long past the horizon and the stream is considered
+ * to be over, seconds.
+ */
+#define DECODER_STALE_TIME 1.0
+
+static int
+decoder_follow_head(struct decoder_stream *dp)
+{
+    const struct decoder_follow *fp;
+    struct packet *pp;
+
+    fp = dp->follow;
+    while ((pp = MYQ_FIRST(dp->sp)) != NULL && dp->nconsumed > 0 &&
+      (int16_t)(pp->parsed.seq - dp->lseq) <= 0) {
+        MYQ_REMOVE(dp->sp, pp);
+        free(pp);
+        dp->nlate++;
+    }
+    dp->pp = pp;
+    if (pp == NULL) {
+        if (fp->eof || dp->lptime < fp->horizon - DECODER_STALE_TIME)
+            return (DECODER_EOF);
+        return (DECODER_AGAIN);
+    }
+    if (pp->pkt->time > fp->horizon)
+        return (DECODER_AGAIN);
+    return (0);
+}
+
+static void
+decoder_follow_pop(struct decoder_stream *dp)
+{
+    struct packet *pp;
+
+    pp = dp->pp;
+    dp->lseq = pp->parsed.seq;
+    dp->lptime = pp->pkt->time;
+    dp->nconsumed++;
+    MYQ_REMOVE(dp->sp, pp);
+    free(pp);
+    dp->pp = NULL;
+}
+
+/*
+ * Refill decoder output buffer with the next portion of samples, either
+ * decoded from the packet at the head of the queue or synthesized to
+ * cover a gap in the stream. Returns 0 when the buffer has been refilled,
+ * DECODER_SKIP when the gap has been skipped over in the no-sync mode,
+ * DECODER_EOF or DECODER_ERROR otherwise.
+ */
+static int
+decoder_refill(struct decoder_stream *dp)
 {
     unsigned int cticks, t;
     int j;
 
-    if (dp->oblen == 0) {
+    for (;;) {
+        if (dp->follow != NULL) {
+            j = decoder_follow_head(dp);
+            if (j != 0)
+                return (j);
+        }
         if (dp->pp == NULL)
             return DECODER_EOF;
         cticks = dp->pp->parsed.ts;
@@ -112,8 +202,6 @@ decoder_get(struct decoder_stream *dp)
                 return DECODER_ERROR;
             dp->nticks += t;
             dp->dticks += t;
-            dp->oblen = j / 2;
-            dp->obp = dp->obuf;
         } else if ((dp->pp->pkt->time - dp->stime - (double)dp->dticks / 8000.0) > 0.2) {
             t = (((dp->pp->pkt->time - dp->stime) * 8000) - dp->dticks) / 2;
             if (t > 4000)
@@ -126,25 +214,113 @@ decoder_get(struct decoder_stream *dp)
             if (j <= 0)
                 return DECODER_ERROR;
             dp->dticks += t;
-            dp->oblen = j / 2;
-            dp->obp = dp->obuf;
         } else {
             j = decode_frame(dp, dp->obuf, RPLOAD(dp->pp), RPLEN(dp->pp), \
               sizeof(dp->obuf));
             if (j > 0)
                 dp->lpt = dp->pp->rpkt->pt;
-            dp->pp = MYQ_NEXT(dp->pp);
+            if (dp->follow != NULL)
+                decoder_follow_pop(dp);
+            else
+                dp->pp = MYQ_NEXT(dp->pp);
             if (j <= 0)
-                return decoder_get(dp);
-            dp->oblen = j / 2;
-            dp->obp = dp->obuf;
+                continue;
         }
+        dp->oblen = j / 2;
+        dp->obp = dp->obuf;
+        return (0);
+    }
+}
+
+int32_t
+decoder_get(struct decoder_stream *dp)
+{
+    int r;
+
+    if (dp->oblen == 0) {
+        r = decoder_refill(dp);
+        if (r != 0)
+            return (r);
     }
     dp->oblen--;
     dp->obp += 1;
     return *(dp->obp - 1);
 }
 
+/*
+ * Block version of the decoder_get(): copies up to nsamples of the decoded
+ * audio into the obuf a frame at a time. Stops early if the stream has
+ * ended or the decoder has failed, setting *status to DECODER_EOF or
+ * DECODER_ERROR respectively, otherwise *status is 0. In the follow mode it
+ * can also stop with DECODER_AGAIN when the horizon has been reached. Gaps
+ * skipped over in the no-sync mode are not reported. Returns the number of
+ * samples stored.
+ */
+unsigned int
+decoder_get_block(struct decoder_stream *dp, int16_t *obuf,
+  unsigned int nsamples, int *status)
+{
+    unsigned int nout, ncopy;
+    int r;
+
+    *status = 0;
+    nout = 0;
+    if (dp->sblen > 0) {
+        nout = (nsamples < dp->sblen) ? nsamples : dp->sblen;
+        memcpy(obuf, dp->sbuf, nout * sizeof(obuf[0]));
+        dp->sblen -= nout;
+        if (dp->sblen > 0)
+            memmove(dp->sbuf, dp->sbuf + nout, dp->sblen * sizeof(obuf[0]));
+    }
+    for (; nout < nsamples; nout += ncopy) {
+        if (dp->oblen == 0) {
+            r = decoder_refill(dp);
+            if (r == DECODER_SKIP) {
+                ncopy = 0;
+                continue;
+            }
+            if (r != 0) {
+                *status = r;
+                break;
+            }
+        }
+        ncopy = nsamples - nout;
+        if (ncopy > dp->oblen)
+            ncopy = dp->oblen;
+        memcpy(obuf + nout, dp->obp, ncopy * sizeof(obuf[0]));
+        dp->obp += ncopy;
+        dp->oblen -= ncopy;
+    }
+    return (nout);
+}
+
+/*
+ * Decode up to nsamples (but no more than DECODER_SBUF_LEN) ahead without
+ * consuming them, so that the caller can find out how much audio is
+ * available before committing to a block size. The samples are handed
+ * out by the next decoder_get_block() call. Returns the number of samples
+ * staged, *status is set the same way decoder_get_block() does.
+ */
+unsigned int
+decoder_peek_block(struct decoder_stream *dp, unsigned int nsamples,
+  int *status)
+{
+    unsigned int nstaged;
+
+    *status = 0;
+    if (nsamples > DECODER_SBUF_LEN)
+        nsamples = DECODER_SBUF_LEN;
+    if (dp->sblen < nsamples) {
+        /* Has to be reset, otherwise decoder_get_block() would drain it */
+        nstaged = dp->sblen;
+        dp->sblen = 0;
+        nstaged += decoder_get_block(dp, dp->sbuf + nstaged,
+          nsamples - nstaged, status);
+        dp->sblen = nstaged;
+    }
+    return (dp->sblen);
+}
+
 int
 decode_frame(struct decoder_stream *dp, int16_t *obuf, unsigned char *ibuf,
   unsigned int ibytes, unsigned int obytes_max)
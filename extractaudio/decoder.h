@@ -51,6 +51,19 @@
 #define	DECODER_EOF	(-(1 << 16))
 #define	DECODER_ERROR	(-(2 << 16))
 #define	DECODER_SKIP	(-(3 << 16))
+#define	DECODER_AGAIN	(-(4 << 16))
+
+/* Staging buffer for the decoder_peek_block(), in samples */
+#define	DECODER_SBUF_LEN	1024
+
+/*
+ * Follow mode: packets are only decoded up to the horizon, which is moved
+ * forward by the caller as more of the recording becomes available.
+ */
+struct decoder_follow {
+    double horizon;
+    int eof;
+};
 
 struct decoder_stream {
     struct session *sp;
@@ -74,6 +87,13 @@ struct decoder_stream {
     double dticks;
     /* FILE *f; */
     int dflags;
+    const struct decoder_follow *follow;
+    uint16_t lseq;
+    double lptime;
+    unsigned long nconsumed;
+    unsigned long nlate;
+    int16_t sbuf[DECODER_SBUF_LEN];
+    unsigned int sblen;
 };
 
 #define D_FLAG_NONE      0x0
@@ -81,7 +101,13 @@ struct decoder_stream {
 #define D_FLAG_ERRFAIL   0x2
 
 void *decoder_new(struct session *, int);
+void decoder_destroy(struct decoder_stream *);
 int32_t decoder_get(struct decoder_stream *);
+void decoder_set_follow(struct decoder_stream *,
+  const struct decoder_follow *);
+unsigned int decoder_get_block(struct decoder_stream *, int16_t *,
+  unsigned int, int *);
+unsigned int decoder_peek_block(struct decoder_stream *, unsigned int, int *);
 int decode_frame(struct decoder_stream *, int16_t *, unsigned char *,
   unsigned int, unsigned int);
 int generate_silence(struct decoder_stream *, int16_t *, unsigned int);
@@ -0,0 +1,317 @@
+/*
+ * Copyright (c) 2024 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Batch mode: extract audio from many recorded sessions in one go, using
+ * a pool of worker threads. Sessions come either from a manifest file,
+ * one "rdir [outfile]" per line, or from a directory, in which case every
+ * *.a.rtp / *.o.rtp pair found there is processed. When the outfile is not
+ * given, it's derived from the rdir by appending the output file format
+ * extension.
+ */
+
+#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "config.h"
+
+#if HAVE_ERR_H
+# include <err.h>
+#endif
+
+#include "rtpp_time.h"
+#include "eaud_extract.h"
+#include "eaud_batch.h"
+
+struct eaud_bjob {
+    const char *aname;
+    const char *bname;
+    const char *oname;
+    char buf[0];
+};
+
+struct eaud_batch {
+    const struct eaud_xopts *xop;
+    struct eaud_bjob **jobs;
+    int njobs;
+    int alen;
+    int next;
+    int nfailed;
+    pthread_mutex_t lock;
+};
+
+static int
+eaud_batch_add(struct eaud_batch *bp, const char *rdir, size_t rlen,
+  const char *oname, size_t olen, const char *ext)
+{
+    struct eaud_bjob *jp, **jobs;
+    size_t elen;
+    char *cp;
+
+    elen = (oname == NULL) ? strlen(ext) + 1 : 0;
+    if (bp->njobs == bp->alen) {
+        jobs = realloc(bp->jobs, sizeof(bp->jobs[0]) * (bp->alen * 2 + 16));
+        if (jobs == NULL)
+            return (-1);
+        bp->jobs = jobs;
+        bp->alen = bp->alen * 2 + 16;
+    }
+    jp = malloc(sizeof(*jp) + (rlen + 7) * 2 + rlen + elen + olen + 1);
+    if (jp == NULL)
+        return (-1);
+    cp = jp->buf;
+    jp->aname = cp;
+    cp += sprintf(cp, "%.*s.a.rtp", (int)rlen, rdir) + 1;
+    jp->bname = cp;
+    cp += sprintf(cp, "%.*s.o.rtp", (int)rlen, rdir) + 1;
+    jp->oname = cp;
+    if (oname == NULL) {
+        sprintf(cp, "%.*s.%s", (int)rlen, rdir, ext);
+    } else {
+        sprintf(cp, "%.*s", (int)olen, oname);
+    }
+    bp->jobs[bp->njobs++] = jp;
+    return (0);
+}
+
+static int
+eaud_batch_load_manifest(struct eaud_batch *bp, const char *mname,
+  const char *ext)
+{
+    FILE *f;
+    char *line, *rdir, *oname;
+    size_t llen, rlen, olen;
+    int rval;
+
+    if (strcmp(mname, "-") == 0) {
+        f = stdin;
+    } else {
+        f = fopen(mname, "r");
+        if (f == NULL) {
+            warn("%s", mname);
+            return (-1);
+        }
+    }
+    line = NULL;
+    llen = 0;
+    rval = 0;
+    while (getline(&line, &llen, f) > 0) {
+        rdir = line + strspn(line, " \t");
+        rlen = strcspn(rdir, " \t\r\n");
+        if (rlen == 0 || rdir[0] == '#')
+            continue;
+        oname = rdir + rlen;
+        oname += strspn(oname, " \t");
+        olen = strcspn(oname, " \t\r\n");
+        if (eaud_batch_add(bp, rdir, rlen, olen > 0 ? oname : NULL, olen,
+          ext) < 0) {
+            warn("eaud_batch_add() failed");
+            rval = -1;
+            break;
+        }
+    }
+    free(line);
+    if (f != stdin)
+        fclose(f);
+    return (rval);
+}
+
+static int
+eaud_batch_rtpfilter(const struct dirent *dep)
+{
+    size_t nlen;
+
+    nlen = strlen(dep->d_name);
+    if (nlen <= 6 || dep->d_name[0] == '.')
+        return (0);
+    return (strcmp(dep->d_name + nlen - 6, ".a.rtp") == 0 ||
+      strcmp(dep->d_name + nlen - 6, ".o.rtp") == 0);
+}
+
+static int
+eaud_batch_load_dir(struct eaud_batch *bp, const char *dname,
+  const char *ext)
+{
+    struct dirent **deps;
+    char path[MAXPATHLEN];
+    const char *lname;
+    size_t blen, lblen;
+    int i, n, rval, plen;
+
+    n = scandir(dname, &deps, eaud_batch_rtpfilter, alphasort);
+    if (n < 0) {
+        warn("%s", dname);
+        return (-1);
+    }
+    rval = 0;
+    lname = NULL;
+    lblen = 0;
+    for (i = 0; i < n; i++) {
+        blen = strlen(deps[i]->d_name) - 6;
+        /* Sorted, so the other leg, if present, is next to this one */
+        if (lname != NULL && lblen == blen &&
+          memcmp(lname, deps[i]->d_name, blen) == 0)
+            continue;
+        lname = deps[i]->d_name;
+        lblen = blen;
+        plen = snprintf(path, sizeof(path), "%s/%.*s", dname, (int)blen,
+          deps[i]->d_name);
+        if (plen >= (int)sizeof(path)) {
+            warnx("%s/%s: path is too long", dname, deps[i]->d_name);
+            continue;
+        }
+        if (eaud_batch_add(bp, path, plen, NULL, 0, ext) < 0) {
+            warn("eaud_batch_add() failed");
+            rval = -1;
+            break;
+        }
+    }
+    for (i = 0; i < n; i++)
+        free(deps[i]);
+    free(deps);
+    return (rval);
+}
+
+static void *
+eaud_batch_worker(void *arg)
+{
+    struct eaud_batch *bp;
+    struct eaud_bjob *jp;
+    FILE *sout;
+    char *obuf;
+    size_t olen;
+    double stime;
+    int rval;
+
+    bp = (struct eaud_batch *)arg;
+    for (;;) {
+        pthread_mutex_lock(&bp->lock);
+        if (bp->next == bp->njobs) {
+            pthread_mutex_unlock(&bp->lock);
+            break;
+        }
+        jp = bp->jobs[bp->next];
+        bp->next += 1;
+        pthread_mutex_unlock(&bp->lock);
+
+        /*
+         * Collect all the per-session output and dump it in one go, so
+         * that reports from different workers don't get interleaved.
+         */
+        obuf = NULL;
+        sout = open_memstream(&obuf, &olen);
+        if (sout == NULL) {
+            warn("open_memstream() failed");
+            rval = 1;
+            goto report;
+        }
+        stime = getdtime();
+        rval = eaud_extract(bp->xop, jp->aname, jp->bname, jp->oname, sout,
+          sout);
+        fclose(sout);
+        flockfile(stdout);
+        fwrite(obuf, olen, 1, stdout);
+        printf("%s: %s, %.3f sec\n", jp->oname, (rval > 0) ? "FAILED" :
+          ((rval < 0) ? "EMPTY" : "OK"), getdtime() - stime);
+        funlockfile(stdout);
+        free(obuf);
+report:
+        if (rval > 0) {
+            pthread_mutex_lock(&bp->lock);
+            bp->nfailed += 1;
+            pthread_mutex_unlock(&bp->lock);
+        }
+    }
+    return (NULL);
+}
+
+/*
+ * Run the batch, returning number of sessions that have failed or -1 if
+ * the batch could not be started at all.
+ */
+int
+eaud_batch_run(const struct eaud_xopts *xop, const char *mname,
+  const char *ext, int nworkers)
+{
+    struct eaud_batch batch;
+    struct stat sb;
+    pthread_t *tids;
+    int i, rval;
+
+    memset(&batch, '\0', sizeof(batch));
+    batch.xop = xop;
+    if (pthread_mutex_init(&batch.lock, NULL) != 0)
+        return (-1);
+    rval = -1;
+
+    if (strcmp(mname, "-") != 0 && stat(mname, &sb) == 0 &&
+      S_ISDIR(sb.st_mode)) {
+        if (eaud_batch_load_dir(&batch, mname, ext) < 0)
+            goto e0;
+    } else if (eaud_batch_load_manifest(&batch, mname, ext) < 0) {
+        goto e0;
+    }
+
+    if (nworkers <= 0)
+        nworkers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nworkers <= 0)
+        nworkers = 1;
+    if (nworkers > batch.njobs)
+        nworkers = batch.njobs;
+    tids = malloc(sizeof(tids[0]) * (nworkers + 1));
+    if (tids == NULL)
+        goto e0;
+    for (i = 0; i < nworkers; i++) {
+        if (pthread_create(&tids[i], NULL, eaud_batch_worker, &batch) != 0) {
+            warnx("pthread_create() failed");
+            break;
+        }
+    }
+    if (i == 0 && nworkers > 0) {
+        free(tids);
+        goto e0;
+    }
+    nworkers = i;
+    for (i = 0; i < nworkers; i++)
+        pthread_join(tids[i], NULL);
+    free(tids);
+    rval = batch.nfailed;
+e0:
+    for (i = 0; i < batch.njobs; i++)
+        free(batch.jobs[i]);
+    free(batch.jobs);
+    pthread_mutex_destroy(&batch.lock);
+    return (rval);
+}
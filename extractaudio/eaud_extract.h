@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2024 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#ifndef _EAUD_EXTRACT_H_
+#define _EAUD_EXTRACT_H_
+
+struct eaud_crypto;
+
+struct eaud_xopts {
+    int dflags;
+    int stereo;
+    int delete;
+    uint32_t sf_format;
+    struct eaud_crypto *alice_crypto;
+    struct eaud_crypto *bob_crypto;
+    /* Follow mode: give up after that many seconds of no growth, or 0 */
+    double follow;
+    /* Follow mode: how far behind the latest packet to stay, seconds */
+    double reorder;
+    /* Portion of the session to extract, seconds from its start */
+    double start;
+    double duration;
+};
+
+int eaud_extract(const struct eaud_xopts *, const char *, const char *,
+  const char *, FILE *, FILE *);
+
+#endif
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2024 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Block mixing kernels used by the extractaudio main loop. Samples from
+ * the channels of the same origin are accumulated into a 32-bit buffer,
+ * each subsequent channel being averaged with what's been accumulated so
+ * far, then both origins are folded into the 16-bit output in one pass.
+ * The SSE2 versions produce bit-exact results with the scalar code,
+ * including rounding towards zero of the C integer division.
+ */
+
+#include <stdint.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "eaud_mix.h"
+
+#if defined(__SSE2__)
+/* Sign-extend 8 16-bit samples into two vectors of 32-bit ones */
+#define EAUD_S16_UNPACK(v, lo, hi) { \
+    (lo) = _mm_srai_epi32(_mm_unpacklo_epi16((v), (v)), 16); \
+    (hi) = _mm_srai_epi32(_mm_unpacklo_epi16(_mm_srli_si128((v), 8), \
+      _mm_srli_si128((v), 8)), 16); \
+}
+
+/* (x / 2) with the C semantics, i.e. rounded towards zero */
+#define EAUD_HALVE(x) \
+  _mm_srai_epi32(_mm_add_epi32((x), _mm_srli_epi32((x), 31)), 1)
+#endif
+
+void
+eaud_mix_set(int32_t *acc, const int16_t *src, unsigned int n)
+{
+    unsigned int i;
+
+    i = 0;
+#if defined(__SSE2__)
+    for (; i + 8 <= n; i += 8) {
+        __m128i s, lo, hi;
+
+        s = _mm_loadu_si128((const __m128i *)(src + i));
+        EAUD_S16_UNPACK(s, lo, hi);
+        _mm_storeu_si128((__m128i *)(acc + i), lo);
+        _mm_storeu_si128((__m128i *)(acc + i + 4), hi);
+    }
+#endif
+    for (; i < n; i++)
+        acc[i] = src[i];
+}
+
+void
+eaud_mix_avg(int32_t *acc, const int16_t *src, unsigned int n)
+{
+    unsigned int i;
+
+    i = 0;
+#if defined(__SSE2__)
+    for (; i + 8 <= n; i += 8) {
+        __m128i s, lo, hi, alo, ahi;
+
+        s = _mm_loadu_si128((const __m128i *)(src + i));
+        EAUD_S16_UNPACK(s, lo, hi);
+        alo = _mm_loadu_si128((const __m128i *)(acc + i));
+        ahi = _mm_loadu_si128((const __m128i *)(acc + i + 4));
+        alo = _mm_add_epi32(alo, lo);
+        ahi = _mm_add_epi32(ahi, hi);
+        _mm_storeu_si128((__m128i *)(acc + i), EAUD_HALVE(alo));
+        _mm_storeu_si128((__m128i *)(acc + i + 4), EAUD_HALVE(ahi));
+    }
+#endif
+    for (; i < n; i++)
+        acc[i] = (acc[i] + src[i]) / 2;
+}
+
+void
+eaud_mix_mono(int16_t *obuf, const int32_t *a, const int32_t *b,
+  unsigned int n)
+{
+    unsigned int i;
+
+    i = 0;
+#if defined(__SSE2__)
+    for (; i + 8 <= n; i += 8) {
+        __m128i lo, hi;
+
+        lo = _mm_add_epi32(_mm_loadu_si128((const __m128i *)(a + i)),
+          _mm_loadu_si128((const __m128i *)(b + i)));
+        hi = _mm_add_epi32(_mm_loadu_si128((const __m128i *)(a + i + 4)),
+          _mm_loadu_si128((const __m128i *)(b + i + 4)));
+        _mm_storeu_si128((__m128i *)(obuf + i),
+          _mm_packs_epi32(EAUD_HALVE(lo), EAUD_HALVE(hi)));
+    }
+#endif
+    for (; i < n; i++)
+        obuf[i] = (a[i] + b[i]) / 2;
+}
+
+void
+eaud_mix_stereo(int16_t *obuf, const int32_t *a, const int32_t *b,
+  unsigned int n)
+{
+    unsigned int i;
+
+    i = 0;
+#if defined(__SSE2__)
+    for (; i + 8 <= n; i += 8) {
+        __m128i a16, b16;
+
+        a16 = _mm_packs_epi32(_mm_loadu_si128((const __m128i *)(a + i)),
+          _mm_loadu_si128((const __m128i *)(a + i + 4)));
+        b16 = _mm_packs_epi32(_mm_loadu_si128((const __m128i *)(b + i)),
+          _mm_loadu_si128((const __m128i *)(b + i + 4)));
+        _mm_storeu_si128((__m128i *)(obuf + i * 2),
+          _mm_unpacklo_epi16(a16, b16));
+        _mm_storeu_si128((__m128i *)(obuf + i * 2 + 8),
+          _mm_unpackhi_epi16(a16, b16));
+    }
+#endif
+    for (; i < n; i++) {
+        obuf[i * 2] = a[i];
+        obuf[i * 2 + 1] = b[i];
+    }
+}
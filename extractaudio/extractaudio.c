@@ -45,6 +45,7 @@
 #include <getopt.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -70,6 +71,8 @@
 #include "rtpp_ssrc.h"
 #include "rtp_analyze.h"
 #include "rtpp_loader.h"
+#include "rtpp_record_index.h"
+#include "rtpp_time.h"
 #include "rtp.h"
 #include "rtpa_stats.h"
 #include "eaud_oformats.h"
@@ -77,19 +80,42 @@
 # include "eaud_crypto.h"
 #endif
 #include "eaud_substreams.h"
+#include "eaud_mix.h"
+#include "eaud_extract.h"
+#include "eaud_batch.h"
 
 /*#define EAUD_DUMPRAW "/tmp/eaud.raw"*/
 
+/* Size of the output buffer, in samples */
+#define EAUD_OBUFLEN 1024
+
 #if ENABLE_SRTP || ENABLE_SRTP2
 #define LOPT_ALICE_CRYPTO 256
 #define LOPT_BOB_CRYPTO   257
 #endif
+#define LOPT_FOLLOW       258
+#define LOPT_REORDER      259
+#define LOPT_START        260
+#define LOPT_DURATION     261
+
+/* Follow mode defaults, seconds */
+#define EAUD_FOLLOW_TOUT  30.0
+/*
+ * The rtpp_record buffers up to 64KB per stream before writing it out,
+ * so the packets might hit the file quite some time after they have been
+ * received, more so with the low bitrate codecs.
+ */
+#define EAUD_REORDER_WIN  10.0
 
 const static struct option longopts[] = {
 #if ENABLE_SRTP || ENABLE_SRTP2
     { "alice-crypto", required_argument, NULL, LOPT_ALICE_CRYPTO },
     { "bob-crypto",   required_argument, NULL, LOPT_BOB_CRYPTO },
 #endif
+    { "follow",         optional_argument, NULL, LOPT_FOLLOW },
+    { "reorder-window", required_argument, NULL, LOPT_REORDER },
+    { "start",          required_argument, NULL, LOPT_START },
+    { "duration",       required_argument, NULL, LOPT_DURATION },
     { NULL,           0,                 NULL, 0 }
 };
 
@@ -101,13 +127,17 @@ const static struct option longopts[] = {
 RTPP_MEMDEB_APP_STATIC;
 #endif
 
-const static char *usage_msg[8] = {
-  "%s\n%s\n%s\n%s\n%s\n%s\n%s\n",
-  "usage: extractaudio [-idsne] [-F file_fmt] [-D data_fmt] rdir outfile",
-  "                    [link1] ... [linkN]",
+const static char *usage_msg[12] = {
+  "%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n",
+  "usage: extractaudio [-idsne] [-F file_fmt] [-D data_fmt] [--start=sec]",
+  "                    [--duration=sec] rdir outfile [link1] ... [linkN]",
+  "       extractaudio [-idse] [-F file_fmt] [-D data_fmt] --follow[=timeout]",
+  "                    [--reorder-window=sec] rdir outfile [link1] ... [linkN]",
   "       extractaudio [-idsne] [-F file_fmt] [-D data_fmt] [-A answer_cap]",
   "                    [-B originate_cap] [--alice-crypto CSPEC]",
   "                    [--bob-crypto CSPEC] outfile [link1] ... [linkN]",
+  "       extractaudio [-idsne] [-F file_fmt] [-D data_fmt] [-j nworkers]",
+  "                    -M manifest|rdir_dir",
   "       extractaudio -S [-A answer_cap] [-B originate_cap]",
   "       extractaudio -S rdir"
 };
@@ -117,7 +147,8 @@ usage(void)
 {
 
     fprintf(stderr, usage_msg[0], usage_msg[1], usage_msg[2], usage_msg[3],
-      usage_msg[4], usage_msg[5], usage_msg[6], usage_msg[7]);
+      usage_msg[4], usage_msg[5], usage_msg[6], usage_msg[7], usage_msg[8],
+      usage_msg[9], usage_msg[10], usage_msg[11]);
     exit(1);
 }
 
@@ -128,7 +159,7 @@ session_lookup(struct channels *channels, uint32_t ssrc, struct channel **cpp)
     struct cnode *cnp;
 
     MYQ_FOREACH(cnp, channels) {
-        if (MYQ_FIRST(&(cnp->cp->session))->rpkt->ssrc == ssrc) {
+        if (cnp->cp->ssrc == ssrc) {
             *cpp = cnp->cp;
             return &(cnp->cp->session);
         }
@@ -149,8 +180,7 @@ channel_insert(struct channels *channels, struct channel *channel)
     nnp->cp = channel;
 
     MYQ_FOREACH_REVERSE(cnp, channels)
-        if (MYQ_FIRST(&(cnp->cp->session))->pkt->time <
-          MYQ_FIRST(&(channel->session))->pkt->time) {
+        if (cnp->cp->btime < channel->btime) {
             MYQ_INSERT_AFTER(channels, cnp, nnp);
             return 0;
         }
@@ -166,42 +196,90 @@ channel_remove(struct channels *channels, struct cnode *cnp)
     free(cnp);
 }
 
+static void
+print_session_stat(struct rtpp_session_stat *stat, FILE *sout)
+{
+    int jc;
+    struct rtpa_stats_jitter jstat;
+
+    update_rtpp_totals(stat, stat);
+    jc = get_jitter_stats(stat->jdata, &jstat, NULL);
+    fprintf(sout, "pcount=%u, min_seq=%u, max_seq=%u, seq_offset=%u, ssrc=0x%.8X, duplicates=%u\n",
+      (unsigned int)stat->last.pcount, (unsigned int)stat->last.min_seq, (unsigned int)stat->last.max_seq,
+      (unsigned int)stat->last.seq_offset, (unsigned int)stat->last.ssrc.val, (unsigned int)stat->last.duplicates);
+    fprintf(sout, "ssrc_changes=%u, psent=%u, precvd=%u, plost=%d\n", stat->ssrc_changes, stat->psent, stat->precvd,
+      stat->psent - stat->precvd);
+    if (jc > 0) {
+        fprintf(sout, "last_jitter=%f,average_jitter=%f,max_jitter=%f\n",
+          jstat.jlast, jstat.javg, jstat.jmax);
+    }
+}
+
+/*
+ * Packets loaded reference the file mapping, so the loader has to stay
+ * around until we are done with them, even if the load has failed
+ * half-way.
+ */
 static int
-load_session(const char *path, struct channels *channels, enum origin origin,
-  struct eaud_crypto *crypto)
+load_session(struct rtpp_loader *loader, struct channels *channels,
+  enum origin origin, struct eaud_crypto *crypto, FILE *sout)
 {
-    int pcount, jc;
+    int pcount;
     struct rtpp_session_stat stat;
-    struct rtpa_stats_jitter jstat;
-    struct rtpp_loader *loader;
 
-    loader = rtpp_load(path);
     if (loader == NULL)
         return -1;
 
     if (rtpp_stats_init(&stat) < 0)
-        goto e0;
+        return -1;
     pcount = loader->load(loader, channels, &stat, origin, crypto);
 
-    update_rtpp_totals(&stat, &stat);
-    jc = get_jitter_stats(stat.jdata, &jstat, NULL);
-    printf("pcount=%u, min_seq=%u, max_seq=%u, seq_offset=%u, ssrc=0x%.8X, duplicates=%u\n",
-      (unsigned int)stat.last.pcount, (unsigned int)stat.last.min_seq, (unsigned int)stat.last.max_seq,
-      (unsigned int)stat.last.seq_offset, (unsigned int)stat.last.ssrc.val, (unsigned int)stat.last.duplicates);
-    printf("ssrc_changes=%u, psent=%u, precvd=%u, plost=%d\n", stat.ssrc_changes, stat.psent, stat.precvd,
-      stat.psent - stat.precvd);
-    if (jc > 0) {
-        printf("last_jitter=%f,average_jitter=%f,max_jitter=%f\n",
-          jstat.jlast, jstat.javg, jstat.jmax);
-    }
-
-    loader->destroy(loader);
+    print_session_stat(&stat, sout);
     rtpp_stats_destroy(&stat);
 
     return pcount;
-e0:
-    loader->destroy(loader);
-    return -1;
+}
+
+/*
+ * Limit loading to the requested portion of the session, which is
+ * relative to the earliest packet in either of the recordings.
+ */
+static void
+set_session_range(const struct eaud_xopts *xop, struct rtpp_loader *aloader,
+  struct rtpp_loader *bloader)
+{
+    double btime, etime, t;
+
+    btime = -1;
+    if (aloader != NULL)
+        btime = rtpp_loader_btime(aloader);
+    if (bloader != NULL) {
+        t = rtpp_loader_btime(bloader);
+        if (t >= 0 && (btime < 0 || t < btime))
+            btime = t;
+    }
+    if (btime < 0)
+        return;
+    btime += xop->start;
+    etime = (xop->duration > 0) ? btime + xop->duration : HUGE_VAL;
+    if (aloader != NULL)
+        rtpp_loader_set_range(aloader, btime, etime);
+    if (bloader != NULL)
+        rtpp_loader_set_range(bloader, btime, etime);
+}
+
+static void
+channel_free(struct channel *cp)
+{
+    struct packet *pp, *npp;
+
+    for (pp = MYQ_FIRST(&cp->session); pp != NULL; pp = npp) {
+        npp = MYQ_NEXT(pp);
+        free(pp);
+    }
+    if (cp->decoder != NULL)
+        decoder_destroy(cp->decoder);
+    free(cp);
 }
 
 static int
@@ -214,7 +292,10 @@ scan_session(const char *path)
     if (loader == NULL)
         goto e0;
 
-    pcount = loader->scan(loader, NULL);
+    if (loader->idx != NULL)
+        pcount = loader->idx->hdr->npkts;
+    else
+        pcount = loader->scan(loader, NULL);
     loader->destroy(loader);
 
     return pcount;
@@ -222,63 +303,612 @@ e0:
     return -1;
 }
 
+/* Follow mode: how long to sleep when waiting for more data, microseconds */
+#define EAUD_FOLLOW_POLL 100000
+
+struct eaud_leg {
+    const char *name;
+    enum origin origin;
+    struct eaud_crypto *crypto;
+    struct rtpp_loader *loader;
+    struct rtpp_session_stat stat;
+    int stat_ok;
+};
+
+/*
+ * Follow mode version of the eaud_extract(): recordings are read while
+ * they are still being written and the audio is written out as soon as
+ * the reorder window allows. Only packets that are within the window are
+ * kept around, consumed ones are released by the decoders right away, so
+ * that the memory usage does not depend on the length of the call. Done
+ * when neither of the files has grown for xop->follow seconds.
+ */
+static int
+eaud_extract_follow(const struct eaud_xopts *xop, const char *aname,
+  const char *bname, const char *oname, FILE *sout, FILE *serr)
+{
+    struct eaud_leg legs[2], *lp;
+    struct decoder_follow df;
+    struct channels channels;
+    struct cnode *cnp, *nnp;
+    struct channel *cp;
+    struct decoder_stream *dp;
+    int16_t obuf[EAUD_OBUFLEN], dbuf[EAUD_OBUFLEN];
+    int32_t amix[EAUD_OBUFLEN], bmix[EAUD_OBUFLEN];
+    unsigned int i, j, jmax, nframes, alen, blen;
+    int nlegs, nch, nlive, oblen, dstat, grown, rval;
+    uint64_t nasamples, nbsamples, nwsamples, nlate;
+    int64_t isample, hsample;
+    double basetime, ltime, lgrow, pgrow, skip;
+    SF_INFO sfinfo;
+    SNDFILE *sffile;
+
+    MYQ_INIT(&channels);
+    memset(legs, '\0', sizeof(legs));
+    legs[0].name = aname;
+    legs[0].origin = A_CH;
+    legs[0].crypto = xop->alice_crypto;
+    legs[1].name = bname;
+    legs[1].origin = B_CH;
+    legs[1].crypto = xop->bob_crypto;
+    sffile = NULL;
+    rval = 1;
+
+    nlegs = 0;
+    for (lp = &legs[0]; lp <= &legs[1]; lp++) {
+        if (lp->name == NULL)
+            continue;
+        lp->loader = rtpp_load_follow(lp->name);
+        if (lp->loader == NULL) {
+            if (xop->dflags & D_FLAG_ERRFAIL) {
+                warn("cannot open %s", lp->name);
+                goto out;
+            }
+            continue;
+        }
+        if (rtpp_stats_init(&lp->stat) < 0) {
+            warnx("rtpp_stats_init() failed");
+            goto out;
+        }
+        lp->stat_ok = 1;
+        nlegs++;
+    }
+    if (nlegs == 0) {
+        warnx("cannot open neither %s nor %s", aname, bname);
+        goto out;
+    }
+
+    memset(&sfinfo, 0, sizeof(sfinfo));
+    sfinfo.samplerate = 8000;
+    sfinfo.channels = (xop->stereo == 0) ? 1 : 2;
+    sfinfo.format = xop->sf_format;
+
+    memset(&df, '\0', sizeof(df));
+    basetime = 0;
+    nch = oblen = 0;
+    isample = 0;
+    nasamples = nbsamples = nwsamples = nlate = 0;
+    for (;;) {
+        ltime = 0;
+        for (lp = &legs[0]; lp <= &legs[1]; lp++) {
+            if (lp->loader != NULL && ltime < lp->loader->ltime)
+                ltime = lp->loader->ltime;
+        }
+        df.horizon = (df.eof != 0) ? HUGE_VAL : ltime - xop->reorder;
+
+        /*
+         * Time zero is that of the earliest channel, so hold off until
+         * the window has moved past it.
+         */
+        if (sffile == NULL) {
+            if (df.eof != 0 && MYQ_EMPTY(&channels))
+                break;
+            if (!MYQ_EMPTY(&channels) &&
+              MYQ_FIRST(&channels)->cp->btime <= df.horizon) {
+                basetime = MYQ_FIRST(&channels)->cp->btime;
+                sffile = sf_open(oname, SFM_WRITE, &sfinfo);
+                if (sffile == NULL) {
+                    warnx("%s: can't open output file", oname);
+                    rval = 2;
+                    goto out;
+                }
+            }
+        }
+        if (sffile != NULL) {
+            MYQ_FOREACH(cnp, &channels) {
+                cp = cnp->cp;
+                if (cp->decoder != NULL || cp->btime > df.horizon)
+                    continue;
+                skip = (cp->btime - basetime) * 8000;
+                cp->skip = (skip > isample) ? skip : isample;
+                cp->decoder = decoder_new(&cp->session, xop->dflags);
+                if (cp->decoder == NULL) {
+                    warn("decoder_new() failed");
+                    goto out;
+                }
+                decoder_set_follow(cp->decoder, &df);
+                nch++;
+            }
+            if (df.eof != 0 && nch == 0)
+                break;
+        }
+
+        /*
+         * Figure out how much of the audio is known to be complete: up
+         * to the horizon, until the next channel kicks in and no further
+         * than any of the active channels can decode right now.
+         */
+        nframes = (EAUD_OBUFLEN - oblen) / sfinfo.channels;
+        if (df.eof == 0) {
+            hsample = (sffile != NULL) ? (df.horizon - basetime) * 8000 : 0;
+            if (hsample < isample)
+                nframes = 0;
+            else if (hsample - isample < nframes)
+                nframes = hsample - isample;
+        }
+        nlive = 0;
+        jmax = 0;
+        MYQ_FOREACH(cnp, &channels) {
+            cp = cnp->cp;
+            if (cp->decoder == NULL) {
+                nlive++;
+                continue;
+            }
+            if (cp->skip > isample) {
+                if (cp->skip - isample < nframes)
+                    nframes = cp->skip - isample;
+                nlive++;
+                continue;
+            }
+            j = decoder_peek_block(cp->decoder, nframes, &dstat);
+            if (dstat == DECODER_AGAIN && j < nframes)
+                nframes = j;
+            if (dstat == 0 || dstat == DECODER_AGAIN)
+                nlive++;
+            else if (jmax < j)
+                jmax = j;
+        }
+        /* Do not pad the output past the end of the last channel */
+        if (df.eof != 0 && nlive == 0 && jmax < nframes)
+            nframes = jmax;
+
+        if (nframes == 0 && df.eof != 0) {
+            /* Every channel has ended right at the block boundary */
+            while (!MYQ_EMPTY(&channels)) {
+                cp = MYQ_FIRST(&channels)->cp;
+                dp = cp->decoder;
+                nlate += dp->nlate;
+                channel_remove(&channels, MYQ_FIRST(&channels));
+                channel_free(cp);
+            }
+            nch = 0;
+            continue;
+        }
+        if (nframes == 0) {
+            if (oblen > 0) {
+                sf_write_short(sffile, obuf, oblen);
+                sf_write_sync(sffile);
+                nwsamples += oblen / sizeof(obuf[0]);
+                oblen = 0;
+            }
+            grown = 0;
+            lgrow = 0;
+            for (lp = &legs[0]; lp <= &legs[1]; lp++) {
+                if (lp->loader == NULL)
+                    continue;
+                pgrow = lp->loader->lgrow;
+                if (lp->loader->poll(lp->loader, &channels, &lp->stat,
+                  lp->origin, lp->crypto) < 0) {
+                    warnx("%s: cannot load", lp->name);
+                    goto out;
+                }
+                if (lp->loader->lgrow != pgrow)
+                    grown = 1;
+                if (lgrow < lp->loader->lgrow)
+                    lgrow = lp->loader->lgrow;
+            }
+            if (grown)
+                continue;
+            if (getdtime() - lgrow >= xop->follow) {
+                df.eof = 1;
+                continue;
+            }
+            usleep(EAUD_FOLLOW_POLL);
+            continue;
+        }
+
+        alen = blen = 0;
+        for (cnp = MYQ_FIRST(&channels); cnp != NULL; cnp = nnp) {
+            nnp = MYQ_NEXT(cnp);
+            cp = cnp->cp;
+            if (cp->decoder == NULL || cp->skip > isample)
+                continue;
+            j = decoder_get_block(cp->decoder, dbuf, nframes, &dstat);
+            if (cp->origin == A_CH) {
+                i = (alen < j) ? alen : j;
+                eaud_mix_avg(amix, dbuf, i);
+                eaud_mix_set(amix + i, dbuf + i, j - i);
+                alen = (alen < j) ? j : alen;
+                nasamples += j;
+            } else {
+                i = (blen < j) ? blen : j;
+                eaud_mix_avg(bmix, dbuf, i);
+                eaud_mix_set(bmix + i, dbuf + i, j - i);
+                blen = (blen < j) ? j : blen;
+                nbsamples += j;
+            }
+            if (dstat == DECODER_EOF || dstat == DECODER_ERROR) {
+                dp = cp->decoder;
+                nlate += dp->nlate;
+                channel_remove(&channels, cnp);
+                channel_free(cp);
+                nch -= 1;
+            }
+        }
+        if (alen < nframes)
+            memset(amix + alen, '\0', (nframes - alen) * sizeof(amix[0]));
+        if (blen < nframes)
+            memset(bmix + blen, '\0', (nframes - blen) * sizeof(bmix[0]));
+        if (xop->stereo == 0) {
+            eaud_mix_mono(obuf + oblen, amix, bmix, nframes);
+            oblen += nframes;
+        } else {
+            eaud_mix_stereo(obuf + oblen, amix, bmix, nframes);
+            oblen += nframes * 2;
+        }
+        if (oblen == EAUD_OBUFLEN) {
+            sf_write_short(sffile, obuf, oblen);
+            nwsamples += oblen / sizeof(obuf[0]);
+            oblen = 0;
+        }
+        isample += nframes;
+    }
+    if (oblen > 0) {
+        sf_write_short(sffile, obuf, oblen);
+        nwsamples += oblen / sizeof(obuf[0]);
+    }
+
+    for (lp = &legs[0]; lp <= &legs[1]; lp++) {
+        if (lp->stat_ok)
+            print_session_stat(&lp->stat, sout);
+    }
+    if (sffile == NULL) {
+        rval = -1;
+    } else {
+        fprintf(serr, "samples decoded: O: %" PRIu64 ", A: %" PRIu64
+          ", written: %" PRIu64 ", late packets: %" PRIu64 "\n", nbsamples,
+          nasamples, nwsamples, nlate);
+        sf_close(sffile);
+        sffile = NULL;
+        rval = 0;
+    }
+    if (xop->delete != 0) {
+        if (aname != NULL) {
+            unlink(aname);
+        }
+        if (bname != NULL) {
+            unlink(bname);
+        }
+    }
+
+out:
+    if (sffile != NULL)
+        sf_close(sffile);
+    while (!MYQ_EMPTY(&channels)) {
+        cp = MYQ_FIRST(&channels)->cp;
+        channel_remove(&channels, MYQ_FIRST(&channels));
+        channel_free(cp);
+    }
+    for (lp = &legs[0]; lp <= &legs[1]; lp++) {
+        if (lp->stat_ok)
+            rtpp_stats_destroy(&lp->stat);
+        if (lp->loader != NULL)
+            lp->loader->destroy(lp->loader);
+    }
+    return (rval);
+}
+
+/*
+ * Extract audio from the session recorded into the aname and/or bname
+ * files and write it into the oname. Returns 0 when the audio has been
+ * written out, -1 when there was nothing to write and the exit code
+ * otherwise.
+ */
 int
-main(int argc, char **argv)
+eaud_extract(const struct eaud_xopts *xop, const char *aname,
+  const char *bname, const char *oname, FILE *sout, FILE *serr)
 {
-    int ch, seen_a, seen_b;
-    int oblen, delete, stereo, idprio, nch, neof;
-    int32_t bsample, asample, csample;
+    int dstat, nosync, rval;
+    int oblen, nch, nch0, neof, nloaded;
+    unsigned int i, j, nframes, nlast, start, alen, blen;
     uint64_t nasamples, nbsamples, nwsamples;
     struct channels channels, act_subset, *ap;
-    struct cnode *cnp;
+    struct cnode *cnp, *nnp, *tnp;
+    struct channel *cp;
+    struct rtpp_loader *aloader, *bloader;
+    int16_t obuf[EAUD_OBUFLEN], dbuf[EAUD_OBUFLEN];
+    int32_t amix[EAUD_OBUFLEN], bmix[EAUD_OBUFLEN];
+    uint16_t nevents[EAUD_OBUFLEN];
+    double basetime;
+    SF_INFO sfinfo;
+    SNDFILE *sffile;
+    int64_t isample, sync_sample;
+
+    if (xop->follow > 0)
+        return (eaud_extract_follow(xop, aname, bname, oname, sout, serr));
+
+    MYQ_INIT(&channels);
+    MYQ_INIT(&act_subset);
+    aloader = bloader = NULL;
+    rval = -1;
+
+    if (aname != NULL)
+        aloader = rtpp_load(aname);
+    if (bname != NULL)
+        bloader = rtpp_load(bname);
+    if (xop->start > 0 || xop->duration > 0)
+        set_session_range(xop, aloader, bloader);
+
+    nloaded = 0;
+    if (aname != NULL) {
+        if (load_session(aloader, &channels, A_CH, xop->alice_crypto,
+          sout) >= 0) {
+            nloaded += 1;
+        } else if (xop->dflags & D_FLAG_ERRFAIL) {
+            warnx("cannot load %s", aname);
+            rval = 1;
+            goto out;
+        }
+    }
+    if (bname != NULL) {
+        if (load_session(bloader, &channels, B_CH, xop->bob_crypto,
+          sout) >= 0) {
+            nloaded += 1;
+        } else if (xop->dflags & D_FLAG_ERRFAIL) {
+            warnx("cannot load %s", bname);
+            rval = 1;
+            goto out;
+        }
+    }
+    if (nloaded == 0) {
+        warnx("cannot load neither %s nor %s", aname, bname);
+        rval = 1;
+        goto out;
+    }
+
+    if (MYQ_EMPTY(&channels))
+        goto theend;
+
+    MYQ_FOREACH(cnp, &channels) {
+        cnp->cp->btime = MYQ_FIRST(&(cnp->cp->session))->pkt->time;
+        cnp->cp->etime = MYQ_LAST(&(cnp->cp->session))->pkt->time;
+    }
+
+    nch = 0;
+    basetime = MYQ_FIRST(&channels)->cp->btime;
+    MYQ_FOREACH(cnp, &channels) {
+        if (basetime > cnp->cp->btime)
+            basetime = cnp->cp->btime;
+    }
+    MYQ_FOREACH(cnp, &channels) {
+        cnp->cp->skip = (cnp->cp->btime - basetime) * 8000;
+        cnp->cp->decoder = decoder_new(&(cnp->cp->session), xop->dflags);
+        if (cnp->cp->decoder == NULL) {
+            warn("decoder_new() failed");
+            rval = 1;
+            goto out;
+        }
+        nch++;
+    }
+
+    oblen = 0;
+    sync_sample = 0;
+
+    memset(&sfinfo, 0, sizeof(sfinfo));
+    sfinfo.samplerate = 8000;
+    sfinfo.channels = (xop->stereo == 0) ? 1 : 2;
+    sfinfo.format = xop->sf_format;
+
+    sffile = sf_open(oname, SFM_WRITE, &sfinfo);
+    if (sffile == NULL) {
+        warnx("%s: can't open output file", oname);
+        rval = 2;
+        goto out;
+    }
+#if defined(EAUD_DUMPRAW)
+    FILE *raw_file = fopen(EAUD_DUMPRAW, "w");
+#endif
+
+    /*
+     * Audio is processed in blocks rather than a sample at a time. Each
+     * channel decodes its share of the block in one go, with the results
+     * mixed using the eaud_mix_XXX() kernels. Block boundaries are placed
+     * at the points where the set of the active channels might change (i.e.
+     * sync points) and at the output buffer boundaries, so that the result
+     * is exactly the same as if the samples were processed one by one. A
+     * channel can reach the EOF or fail in the middle of the block, the
+     * nevents[] keeps track of where that happened, so that we know when
+     * neof catches up with the nch and we are done.
+     */
+    nosync = (xop->dflags & D_FLAG_NOSYNC) != 0;
+    ap = &channels;
+    isample = 0;
+    nasamples = nbsamples = nwsamples = 0;
+    do {
+        if (nosync) {
+            ap = &channels;
+        } else if (sync_sample == isample) {
+            if (eaud_ss_syncactive(&channels, &act_subset, isample, &sync_sample) < 0) {
+                warnx("eaud_ss_syncactive() failed");
+                rval = 1;
+                break;
+            }
+            ap = &act_subset;
+        }
+        nframes = (EAUD_OBUFLEN - oblen) / sfinfo.channels;
+        if (!nosync && sync_sample > isample && sync_sample - isample < nframes)
+            nframes = sync_sample - isample;
+        memset(nevents, '\0', nframes * sizeof(nevents[0]));
+        alen = blen = 0;
+        nch0 = nch;
+        for (cnp = MYQ_FIRST(ap); cnp != NULL; cnp = nnp) {
+            nnp = MYQ_NEXT(cnp);
+            if (!nosync) {
+                if (cnp->cp->skip > isample)
+                    continue;
+                start = 0;
+            } else {
+                /*
+                 * Only one channel per origin is used for each sample,
+                 * the next one takes over where the previous has stopped.
+                 */
+                start = (cnp->cp->origin == A_CH) ? alen : blen;
+                if (start == nframes)
+                    continue;
+            }
+            cp = cnp->cp;
+            j = decoder_get_block(cp->decoder, dbuf, nframes - start, &dstat);
+            /*
+             * Average with what other channels of the same origin have
+             * already put into the [start, alen) and just store the rest.
+             */
+            if (cnp->cp->origin == A_CH) {
+                i = (alen < start + j) ? alen : start + j;
+                eaud_mix_avg(amix + start, dbuf, i - start);
+                eaud_mix_set(amix + i, dbuf + i - start, start + j - i);
+                alen = (alen < start + j) ? start + j : alen;
+                nasamples += j;
+            } else {
+                i = (blen < start + j) ? blen : start + j;
+                eaud_mix_avg(bmix + start, dbuf, i - start);
+                eaud_mix_set(bmix + i, dbuf + i - start, start + j - i);
+                blen = (blen < start + j) ? start + j : blen;
+                nbsamples += j;
+            }
+            if (dstat == 0)
+                continue;
+            if (start + j < nframes)
+                nevents[start + j] += 1;
+            if (dstat == DECODER_EOF) {
+                tnp = eaud_ss_find(&channels, cp);
+                assert(tnp != NULL);
+                channel_remove(&channels, tnp);
+                if (ap != &channels) {
+                    channel_remove(ap, cnp);
+                }
+                channel_free(cp);
+                nch -= 1;
+            }
+        }
+        /*
+         * Find the first sample, if any, at which every channel that has
+         * been around at the beginning of the block has either failed or
+         * reached the EOF.
+         */
+        neof = 0;
+        for (nlast = 0; nlast < nframes; nlast++) {
+            neof += nevents[nlast];
+            if (neof >= nch0)
+                break;
+        }
+        if (alen < nlast)
+            memset(amix + alen, '\0', (nlast - alen) * sizeof(amix[0]));
+        if (blen < nlast)
+            memset(bmix + blen, '\0', (nlast - blen) * sizeof(bmix[0]));
+        if (xop->stereo == 0) {
+            eaud_mix_mono(obuf + oblen, amix, bmix, nlast);
+            oblen += nlast;
+        } else {
+            eaud_mix_stereo(obuf + oblen, amix, bmix, nlast);
+            oblen += nlast * 2;
+        }
+        if (nlast < nframes || oblen == EAUD_OBUFLEN) {
+#if defined(EAUD_DUMPRAW)
+            fwrite(obuf, sizeof(int16_t), oblen, raw_file);
+#endif
+            sf_write_short(sffile, obuf, oblen);
+            nwsamples += oblen / sizeof(obuf[0]);
+            oblen = 0;
+        }
+        isample += nframes;
+    } while (nlast == nframes);
+    fprintf(serr, "samples decoded: O: %" PRIu64 ", A: %" PRIu64
+      ", written: %" PRIu64 "\n", nbsamples, nasamples, nwsamples);
+
+#if defined(EAUD_DUMPRAW)
+    fclose(raw_file);
+#endif
+    sf_close(sffile);
+    if (rval > 0)
+        goto out;
+    rval = 0;
+
+theend:
+    if (xop->delete != 0) {
+        if (aname != NULL) {
+            unlink(aname);
+        }
+        if (bname != NULL) {
+            unlink(bname);
+        }
+    }
+
+out:
+    while (!MYQ_EMPTY(&act_subset))
+        channel_remove(&act_subset, MYQ_FIRST(&act_subset));
+    while (!MYQ_EMPTY(&channels)) {
+        cp = MYQ_FIRST(&channels)->cp;
+        channel_remove(&channels, MYQ_FIRST(&channels));
+        channel_free(cp);
+    }
+    if (aloader != NULL)
+        aloader->destroy(aloader);
+    if (bloader != NULL)
+        bloader->destroy(bloader);
+    return (rval);
+}
+
+int
+main(int argc, char **argv)
+{
+    int ch, idprio, rval, nworkers;
 #if defined(__FreeBSD__)
     struct rtprio rt;
 #endif
-    int16_t obuf[1024];
     char aname_s[MAXPATHLEN], bname_s[MAXPATHLEN];
-    const char *aname, *bname, *uname;
-    double basetime;
-    SF_INFO sfinfo;
-    SNDFILE *sffile;
-    int dflags, nloaded;
+    const char *aname, *bname, *uname, *mname, *file_ext;
     const struct supported_fmt *sf_of;
     uint32_t use_file_fmt, use_data_fmt;
     uint32_t dflt_file_fmt, dflt_data_fmt;
     int option_index;
-    struct eaud_crypto *alice_crypto, *bob_crypto;
-    int64_t isample, sync_sample;
+    struct eaud_xopts xo;
 
 #ifdef RTPP_CHECK_LEAKS
     RTPP_MEMDEB_APP_INIT();
 #endif
 
-    MYQ_INIT(&channels);
-    MYQ_INIT(&act_subset);
-    memset(&sfinfo, 0, sizeof(sfinfo));
-    sfinfo.samplerate = 8000;
-    sfinfo.channels = 1;
+    memset(&xo, 0, sizeof(xo));
     use_file_fmt = use_data_fmt = 0;
     dflt_file_fmt = SF_FORMAT_WAV;
     dflt_data_fmt = SF_FORMAT_GSM610;
 
-    delete = stereo = idprio = 0;
-    dflags = D_FLAG_NONE;
-    aname = bname = NULL;
-    alice_crypto = bob_crypto = NULL;
-    isample = -1;
-    sync_sample = 0;
+    idprio = 0;
+    xo.dflags = D_FLAG_NONE;
+    aname = bname = mname = NULL;
+    file_ext = "wav";
+    nworkers = 0;
+    xo.reorder = EAUD_REORDER_WIN;
     int scanonly = 0;
 
-    while ((ch = getopt_long(argc, argv, "dsSineF:D:A:B:U:", longopts,
+    while ((ch = getopt_long(argc, argv, "dsSineF:D:A:B:U:M:j:", longopts,
       &option_index)) != -1)
         switch (ch) {
         case 'd':
-            delete = 1;
+            xo.delete = 1;
             break;
 
         case 's':
-            stereo = 1;
-            sfinfo.channels = 2;
+            xo.stereo = 1;
             /* GSM+WAV doesn't work with more than 1 channels */
             dflt_data_fmt = SF_FORMAT_MS_ADPCM;
             break;
@@ -288,7 +918,7 @@ main(int argc, char **argv)
             break;
 
         case 'n':
-            dflags |= D_FLAG_NOSYNC;
+            xo.dflags |= D_FLAG_NOSYNC;
             break;
 
         case 'F':
@@ -299,6 +929,7 @@ main(int argc, char **argv)
                 exit(1);
             }
             use_file_fmt = sf_of->id;
+            file_ext = sf_of->name;
             break;
 
         case 'D':
@@ -325,15 +956,15 @@ main(int argc, char **argv)
 
 #if ENABLE_SRTP || ENABLE_SRTP2
         case LOPT_ALICE_CRYPTO:
-            alice_crypto = eaud_crypto_getopt_parse(optarg);
-            if (alice_crypto == NULL) {
+            xo.alice_crypto = eaud_crypto_getopt_parse(optarg);
+            if (xo.alice_crypto == NULL) {
                 exit(1);
             }
             break;
 
         case LOPT_BOB_CRYPTO:
-            bob_crypto = eaud_crypto_getopt_parse(optarg);
-            if (bob_crypto == NULL) {
+            xo.bob_crypto = eaud_crypto_getopt_parse(optarg);
+            if (xo.bob_crypto == NULL) {
                 exit(1);
             }
             break;
@@ -343,8 +974,42 @@ main(int argc, char **argv)
             scanonly = 1;
             break;
 
+        case 'M':
+            mname = optarg;
+            break;
+
+        case 'j':
+            nworkers = atoi(optarg);
+            if (nworkers <= 0)
+                usage();
+            break;
+
         case 'e':
-            dflags |= D_FLAG_ERRFAIL;
+            xo.dflags |= D_FLAG_ERRFAIL;
+            break;
+
+        case LOPT_FOLLOW:
+            xo.follow = (optarg != NULL) ? atof(optarg) : EAUD_FOLLOW_TOUT;
+            if (xo.follow <= 0)
+                usage();
+            break;
+
+        case LOPT_REORDER:
+            xo.reorder = atof(optarg);
+            if (xo.reorder < 0)
+                usage();
+            break;
+
+        case LOPT_START:
+            xo.start = atof(optarg);
+            if (xo.start < 0)
+                usage();
+            break;
+
+        case LOPT_DURATION:
+            xo.duration = atof(optarg);
+            if (xo.duration <= 0)
+                usage();
             break;
 
         case '?':
@@ -354,7 +1019,14 @@ main(int argc, char **argv)
     argc -= optind;
     argv += optind;
 
-    if (aname == NULL && bname == NULL) {
+    if (xo.follow > 0 && (mname != NULL || scanonly ||
+      (xo.dflags & D_FLAG_NOSYNC) != 0 || xo.start > 0 || xo.duration > 0))
+        usage();
+    if (mname != NULL) {
+        if (argc != 0 || scanonly || aname != NULL || bname != NULL ||
+          xo.alice_crypto != NULL || xo.bob_crypto != NULL)
+            usage();
+    } else if (aname == NULL && bname == NULL) {
         if ((argc < 2 && !scanonly) || (scanonly && argc != 1))
             usage();
     } else if ((argc == 0 && !scanonly) || (scanonly && argc != 0)) {
@@ -367,6 +1039,7 @@ main(int argc, char **argv)
     if (use_data_fmt == 0) {
         use_data_fmt = dflt_data_fmt;
     }
+    xo.sf_format = use_file_fmt | use_data_fmt;
 
     if (idprio != 0) {
 #if defined(__FreeBSD__)
@@ -378,6 +1051,11 @@ main(int argc, char **argv)
 #endif
     }
 
+    if (mname != NULL) {
+        rval = eaud_batch_run(&xo, mname, file_ext, nworkers);
+        exit(rval == 0 ? 0 : 1);
+    }
+
     if (aname == NULL && bname == NULL) {
         sprintf(aname_s, "%s.a.rtp", argv[0]);
         aname = aname_s;
@@ -397,167 +1075,14 @@ main(int argc, char **argv)
         exit (0);
     }
 
-    nloaded = 0;
-    if (aname != NULL) {
-        if (load_session(aname, &channels, A_CH, alice_crypto) >= 0) {
-            nloaded += 1;
-        } else if (dflags & D_FLAG_ERRFAIL) {
-            errx(1, "cannot load %s", aname);
-        }
-    }
-    if (bname != NULL) {
-        if (load_session(bname, &channels, B_CH, bob_crypto) >= 0) {
-            nloaded += 1;
-        } else if (dflags & D_FLAG_ERRFAIL) {
-            errx(1, "cannot load %s", bname);
-        }
-    }
-    if (nloaded == 0) {
-       errx(1, "cannot load neither %s nor %s", aname, bname);
-    }
-
-    if (MYQ_EMPTY(&channels))
-        goto theend;
-
-    MYQ_FOREACH(cnp, &channels) {
-        cnp->cp->btime = MYQ_FIRST(&(cnp->cp->session))->pkt->time;
-        cnp->cp->etime = MYQ_LAST(&(cnp->cp->session))->pkt->time;
-    }
-
-    nch = 0;
-    basetime = MYQ_FIRST(&channels)->cp->btime;
-#if 0
-    fprintf(stderr, "%f %f\n", MYQ_FIRST(&(MYQ_FIRST(&channels)->session))->pkt->time, MYQ_FIRST(&channels)->btime);
-#endif
-    MYQ_FOREACH(cnp, &channels) {
-        if (basetime > cnp->cp->btime)
-            basetime = cnp->cp->btime;
-    }
-    MYQ_FOREACH(cnp, &channels) {
-        cnp->cp->skip = (cnp->cp->btime - basetime) * 8000;
-        cnp->cp->decoder = decoder_new(&(cnp->cp->session), dflags);
-        if (cnp->cp->decoder == NULL)
-            err(1, "decoder_new() failed");
-        nch++;
-    }
-
-    oblen = 0;
-
-    sfinfo.format = use_file_fmt | use_data_fmt;
-
-    sffile = sf_open(argv[0], SFM_WRITE, &sfinfo);
-    if (sffile == NULL)
-        errx(2, "%s: can't open output file", argv[0]);
-#if defined(EAUD_DUMPRAW)
-    FILE *raw_file = fopen(EAUD_DUMPRAW, "w");
-#endif
-
-    nasamples = nbsamples = nwsamples = 0;
-    do {
-        neof = 0;
-        asample = bsample = 0;
-        seen_a = seen_b = 0;
-        isample += 1;
-        if ((dflags & D_FLAG_NOSYNC) == 1) {
-            ap = &channels;
-        } else if (sync_sample == isample) {
-            if (eaud_ss_syncactive(&channels, &act_subset, isample, &sync_sample) < 0)
-                errx(1, "eaud_ss_syncactive() failed");
-            ap = &act_subset;
-        }
-        MYQ_FOREACH(cnp, ap) {
-restart:
-            if ((dflags & D_FLAG_NOSYNC) == 0) {
-                if (cnp->cp->skip > isample) {
-                    continue;
-                }
-            } else {
-                if (cnp->cp->origin == A_CH && seen_a != 0)
-                    continue;
-                if (cnp->cp->origin == B_CH && seen_b != 0)
-                    continue;
-            }
-            do {
-                csample = decoder_get(cnp->cp->decoder);
-            } while (csample == DECODER_SKIP);
-            if (csample == DECODER_EOF) {
-                struct cnode *tnp;
-
-                tnp = eaud_ss_find(&channels, cnp->cp);
-                assert(tnp != NULL);
-                channel_remove(&channels, tnp);
-                if (ap != &channels) {
-                    channel_remove(ap, cnp);
-                }
-                nch -= 1;
-                cnp = MYQ_NEXT(cnp);
-                if (cnp == NULL)
-                    goto out;
-                goto restart;
-            }
-            if (csample == DECODER_ERROR) {
-                neof++;
-                continue;
-            }
-            if (cnp->cp->origin == A_CH) {
-                asample += csample;
-                nasamples++;
-                if (seen_a != 0) {
-                    asample /= 2;
-                } else {
-                    seen_a = 1;
-                }
-            } else {
-                bsample += csample;
-                nbsamples++;
-                if (seen_b != 0) {
-                    bsample /= 2;
-                } else {
-                    seen_b = 1;
-                }
-            }
-        }
-out:
-        if (neof < nch) {
-            if (stereo == 0) {
-                obuf[oblen] = (asample + bsample) / 2;
-                oblen += 1;
-            } else {
-                obuf[oblen] = asample;
-                oblen += 1;
-                obuf[oblen] = bsample;
-                oblen += 1;
-            }
-        }
-        if (neof == nch || oblen == sizeof(obuf) / sizeof(obuf[0])) {
-#if defined(EAUD_DUMPRAW)
-            fwrite(obuf, sizeof(int16_t), oblen, raw_file);
-#endif
-            sf_write_short(sffile, obuf, oblen);
-            nwsamples += oblen / sizeof(obuf[0]);
-            oblen = 0;
-        }
-    } while (neof < nch);
-    fprintf(stderr, "samples decoded: O: %" PRIu64 ", A: %" PRIu64
-      ", written: %" PRIu64 "\n", nbsamples, nasamples, nwsamples);
-
-#if defined(EAUD_DUMPRAW)
-    fclose(raw_file);
-#endif
-    sf_close(sffile);
+    rval = eaud_extract(&xo, aname, bname, argv[0], stdout, stderr);
+    if (rval > 0)
+        exit(rval);
 
-    while (argc > 1) {
-        link(argv[0], argv[argc - 1]);
-        argc--;
-    }
-
-theend:
-    if (delete != 0) {
-        if (aname != NULL) {
-            unlink(aname);
-        }
-        if (bname != NULL) {
-            unlink(bname);
+    if (rval == 0) {
+        while (argc > 1) {
+            link(argv[0], argv[argc - 1]);
+            argc--;
         }
     }
 
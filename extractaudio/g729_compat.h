@@ -7,6 +7,7 @@
 #  define G729_EINIT(vad) initBcg729EncoderChannel((vad /* VAT/DTX detection */))
 #  define G729_ECLOSE closeBcg729EncoderChannel
 #  define G729_DINIT initBcg729DecoderChannel
+#  define G729_DCLOSE closeBcg729DecoderChannel
 #  define G729_DECODE(ctx, ibuf, isize) g279_compat_decode((ctx), (ibuf), (isize))
 
 int16_t *g279_compat_decode(G729_DCTX *, uint8_t *, size_t);
@@ -19,6 +20,7 @@ int16_t *g279_compat_decode(G729_DCTX *, uint8_t *, size_t);
 #  define G729_EINIT(vad) g729_encoder_new(/* no VAT/DTX detection*/)
 #  define G729_ECLOSE g729_encoder_destroy
 #  define G729_DINIT g729_decoder_new
+#  define G729_DCLOSE g729_decoder_destroy
 #  define G729_DECODE(ctx, ibuf, isize) g729_decode_frame((ctx), (ibuf), (isize))
 # endif
 
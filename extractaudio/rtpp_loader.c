@@ -26,13 +26,16 @@
  */
 
 #include <sys/types.h>
+#include <sys/param.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
 #include <netinet/ip6.h>
 #include <netinet/udp.h>
 #include <sys/mman.h>
 #include <assert.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -49,6 +52,7 @@
 #include "rtp_info.h"
 #include "rtpp_record_adhoc.h"
 #include "rtpp_record_private.h"
+#include "rtpp_record_index.h"
 #include "session.h"
 #include "rtp_analyze.h"
 #include "rtpp_loader.h"
@@ -66,15 +70,192 @@ static int load_adhoc(struct rtpp_loader *loader, struct channels *,
   struct rtpp_session_stat *, enum origin, struct eaud_crypto *);
 static int load_pcap(struct rtpp_loader *loader, struct channels *,
   struct rtpp_session_stat *, enum origin, struct eaud_crypto *);
+static int poll_stream(struct rtpp_loader *loader, struct channels *,
+  struct rtpp_session_stat *, enum origin, struct eaud_crypto *);
+
+/*
+ * Read buffer for the follow mode, has to fit the largest adhoc record
+ * with some room to spare.
+ */
+#define RTPP_LOADER_SBUF_LEN (128 * 1024)
+
+/* Stream format is not known until the first bytes arrive */
+#define RTPP_LOADER_NET_UNKN  (-1)
+#define RTPP_LOADER_NET_ADHOC (-2)
 
 static void
 rtpp_loader_destroy(struct rtpp_loader *loader)
 {
 
+    if (loader->idx != NULL)
+        free(loader->idx);
+    munmap(loader->mbase, loader->mlen);
+    close(loader->ifd);
+    free(loader);
+}
+
+static void
+rtpp_loader_stream_destroy(struct rtpp_loader *loader)
+{
+
+    free(loader->private.stream_data.buf);
     close(loader->ifd);
     free(loader);
 }
 
+/*
+ * Open recording that might be still being written for incremental
+ * loading via the poll() method. Packets are copied out of the read buffer,
+ * so that memory usage is bound by the number of packets not yet consumed
+ * by the decoders rather than by the file size.
+ */
+struct rtpp_loader *
+rtpp_load_follow(const char *path)
+{
+    struct rtpp_loader *rval;
+
+    rval = malloc(sizeof(*rval));
+    if (rval == NULL)
+        return NULL;
+    memset(rval, '\0', sizeof(*rval));
+
+    rval->private.stream_data.buf = malloc(RTPP_LOADER_SBUF_LEN);
+    if (rval->private.stream_data.buf == NULL)
+        goto e0;
+    rval->private.stream_data.network = RTPP_LOADER_NET_UNKN;
+    rval->ifd = open(path, O_RDONLY);
+    if (rval->ifd == -1)
+        goto e1;
+    rval->poll = poll_stream;
+    rval->destroy = rtpp_loader_stream_destroy;
+    rval->lgrow = getdtime();
+    return rval;
+e1:
+    free(rval->private.stream_data.buf);
+e0:
+    free(rval);
+    return NULL;
+}
+
+/*
+ * Load sidecar index if there is one and it matches the recording, an
+ * index that does not is ignored, so that the recording is simply parsed
+ * in its entirety.
+ */
+static struct rtpp_ridx *
+rtpp_loader_idx_load(struct rtpp_loader *loader, const char *path, int format)
+{
+    char ipath[MAXPATHLEN];
+    struct rtpp_ridx *idx;
+    const struct rtpp_ridx_hdr *hp;
+    struct stat sb;
+    off_t doff;
+    uint32_t i;
+    int fd;
+
+    snprintf(ipath, sizeof(ipath), "%s%s", path, RTPP_RIDX_SUFFIX);
+    fd = open(ipath, O_RDONLY);
+    if (fd == -1)
+        return (NULL);
+    if (fstat(fd, &sb) == -1 || sb.st_size < sizeof(*hp))
+        goto e0;
+    idx = malloc(sizeof(*idx) + sb.st_size);
+    if (idx == NULL)
+        goto e0;
+    hp = idx->hdr = (const struct rtpp_ridx_hdr *)&idx[1];
+    if (read(fd, &idx[1], sb.st_size) != sb.st_size)
+        goto e1;
+    if (hp->magic != RTPP_RIDX_MAGIC || hp->version != RTPP_RIDX_VERSION ||
+      hp->format != format || hp->dlen != loader->mlen ||
+      sizeof(*hp) + hp->nssrcs * sizeof(idx->ssrcs[0]) +
+      hp->nseeks * sizeof(idx->seeks[0]) != sb.st_size)
+        goto e1;
+    idx->ssrcs = (const struct rtpp_ridx_ssrc *)&hp[1];
+    idx->seeks = (const struct rtpp_ridx_seek *)&idx->ssrcs[hp->nssrcs];
+    doff = loader->ibuf - (unsigned char *)loader->mbase;
+    for (i = 0; i < hp->nseeks; i++) {
+        if (idx->seeks[i].off < doff || idx->seeks[i].off > hp->dlen ||
+          (i > 0 && idx->seeks[i].off < idx->seeks[i - 1].off))
+            goto e1;
+    }
+    close(fd);
+    return (idx);
+e1:
+    warnx("%s: index does not match the recording, ignoring", ipath);
+    free(idx);
+e0:
+    close(fd);
+    return (NULL);
+}
+
+/*
+ * Arrival time of the first packet in the recording, or -1 if it's
+ * empty or broken.
+ */
+double
+rtpp_loader_btime(struct rtpp_loader *loader)
+{
+    struct adhoc_dissect ad_data;
+    struct pcap_dissect pd;
+
+    if (loader->idx != NULL)
+        return (loader->idx->hdr->btime);
+    if (loader->private.pcap_data.pcap_hdr == NULL) {
+        if (eaud_adhoc_dissect(loader->ibuf, loader->sb.st_size,
+          &ad_data) != ADH_DSCT_OK)
+            return (-1);
+        return (ad_data.ahp->time);
+    }
+    if (eaud_pcap_dissect(loader->ibuf, loader->sb.st_size,
+      loader->private.pcap_data.pcap_hdr->network, &pd) == PCP_DSCT_TRNK)
+        return (-1);
+    return (ts2dtime(pd.pcaprec_hdr.ts_sec, pd.pcaprec_hdr.ts_usec));
+}
+
+/*
+ * Restrict the load() to packets that have arrived within [btime, etime].
+ * With the index at hand only the relevant portion of the recording is
+ * looked at, otherwise everything is still parsed but packets outside of
+ * the range are ignored.
+ */
+void
+rtpp_loader_set_range(struct rtpp_loader *loader, double btime, double etime)
+{
+    const struct rtpp_ridx_seek *seeks;
+    off_t doff;
+    int lo, hi, mid, nseeks;
+
+    loader->rbtime = btime;
+    loader->retime = etime;
+    if (loader->idx == NULL)
+        return;
+    seeks = loader->idx->seeks;
+    nseeks = loader->idx->hdr->nseeks;
+    doff = loader->ibuf - (unsigned char *)loader->mbase;
+
+    /* Last entry at or before the btime */
+    for (lo = 0, hi = nseeks; lo < hi;) {
+        mid = (lo + hi) / 2;
+        if (seeks[mid].time <= btime)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo > 0)
+        loader->boff = seeks[lo - 1].off - doff;
+
+    /* First entry past the etime */
+    for (hi = nseeks; lo < hi;) {
+        mid = (lo + hi) / 2;
+        if (seeks[mid].time <= etime)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo < nseeks)
+        loader->eoff = seeks[lo].off - doff;
+}
+
 struct rtpp_loader *
 rtpp_load(const char *path)
 {
@@ -112,6 +293,8 @@ rtpp_load(const char *path)
         free(rval);
         return NULL;
     }
+    rval->mbase = rval->ibuf;
+    rval->mlen = rval->sb.st_size;
 
     rval->destroy = rtpp_loader_destroy;
 
@@ -142,6 +325,12 @@ rtpp_load(const char *path)
         rval->ibuf += sizeof(*pcap_hdr);
         rval->sb.st_size -= sizeof(*pcap_hdr);
     }
+    rval->boff = 0;
+    rval->eoff = rval->sb.st_size;
+    rval->rbtime = -HUGE_VAL;
+    rval->retime = HUGE_VAL;
+    rval->idx = rtpp_loader_idx_load(rval, path,
+      (rval->load == load_pcap) ? RTPP_RIDX_FMT_PCAP : RTPP_RIDX_FMT_ADHOC);
     return rval;
 }
 
@@ -158,6 +347,71 @@ channel_alloc(enum origin origin)
     return (channel);
 }
 
+/*
+ * Account the packet and put it into the right channel, keeping packets
+ * ordered. Returns 1 if the packet has been added, 0 if it's been dropped
+ * and -1 on fatal error, the packet is consumed in any case.
+ */
+static int
+channel_add_packet(struct channels *channels, struct rtpp_session_stat *stat,
+  struct packet *pack, enum origin origin)
+{
+    struct packet *pp;
+    struct channel *channel;
+    struct session *sess;
+
+    if (update_rtpp_stats(NULL, stat, pack->rpkt, &(pack->parsed),
+      pack->pkt->time) == UPDATE_ERR) {
+        /* XXX error handling */
+        warnx("update_rtpp_stats() failed");
+        free(pack);
+        return (-1);
+    }
+    if (pack->parsed.nsamples <= 0) {
+        warnx("pack->parsed.nsamples = %d", pack->parsed.nsamples);
+        free(pack);
+        return (0);
+    }
+
+    sess = session_lookup(channels, pack->rpkt->ssrc, &channel);
+    if (sess == NULL) {
+        channel = channel_alloc(origin);
+        if (channel == NULL) {
+            warn("channel_alloc() failed");
+            goto e0;
+        }
+        channel->ssrc = pack->rpkt->ssrc;
+        channel->btime = pack->pkt->time;
+        sess = &(channel->session);
+        MYQ_INIT(sess);
+        MYQ_INSERT_HEAD(sess, pack);
+        if (channel_insert(channels, channel) < 0) {
+            warn("channel_insert() failed");
+            goto e0;
+        }
+        return (1);
+    }
+
+    /* Put packet it order */
+    MYQ_FOREACH_REVERSE(pp, sess) {
+        if (pp->parsed.seq == pack->parsed.seq) {
+            /* Duplicate packet */
+            free(pack);
+            return (0);
+        }
+        if (pp->parsed.ts < pack->parsed.ts ||
+          pp->parsed.seq < pack->parsed.seq) {
+            MYQ_INSERT_AFTER(sess, pp, pack);
+            return (1);
+        }
+    }
+    MYQ_INSERT_HEAD(sess, pack);
+    return (1);
+e0:
+    free(pack);
+    return (-1);
+}
+
 static int
 load_adhoc(struct rtpp_loader *loader, struct channels *channels,
   struct rtpp_session_stat *stat, enum origin origin,
@@ -165,26 +419,25 @@ load_adhoc(struct rtpp_loader *loader, struct channels *channels,
 {
     int pcount, rcode;
     unsigned char *cp, *ep;
-    struct packet *pack, *pp;
-    struct channel *channel;
-    struct session *sess;
-    off_t st_size;
+    struct packet *pack;
     struct adhoc_dissect ad_data;
 
     pcount = 0;
-    st_size = loader->sb.st_size;
-    ep = loader->ibuf + st_size;
-    for (cp = loader->ibuf; cp < ep; cp = ad_data.nextcp) {
+    ep = loader->ibuf + loader->eoff;
+    for (cp = loader->ibuf + loader->boff; cp < ep; cp = ad_data.nextcp) {
         switch (eaud_adhoc_dissect(cp, ep - cp, &ad_data)) {
         case ADH_DSCT_OK:
             break;
 
         case ADH_DSCT_EOF:
-            goto endloop;
+            continue;
 
         default:
             return -1;
         }
+        if (ad_data.ahp->time < loader->rbtime ||
+          ad_data.ahp->time > loader->retime)
+            continue;
         pack = malloc(sizeof(*pack));
         if (pack == NULL) {
             warn("malloc() failed");
@@ -200,63 +453,20 @@ load_adhoc(struct rtpp_loader *loader, struct channels *channels,
         }
         pack->pkt = ad_data.ahp;
         pack->rpkt = RPKT(&ad_data);
-        if (update_rtpp_stats(NULL, stat, pack->rpkt, &(pack->parsed),
-          ad_data.ahp->time) == UPDATE_ERR) {
-            /* XXX error handling */
-            warnx("update_rtpp_stats() failed");
-            free(pack);
+        switch (channel_add_packet(channels, stat, pack, origin)) {
+        case -1:
             return (-1);
-        }
-        if (pack->parsed.nsamples <= 0) {
-            warnx("pack->parsed.nsamples = %d", pack->parsed.nsamples);
-            free(pack);
-            continue;
-        }
 
-        sess = session_lookup(channels, pack->rpkt->ssrc, &channel);
-        if (sess == NULL) {
-            channel = channel_alloc(origin);
-            if (channel == NULL) {
-                goto e0;
-            }
-            sess = &(channel->session);
-            MYQ_INIT(sess);
-            MYQ_INSERT_HEAD(sess, pack);
-            if (channel_insert(channels, channel) < 0) {
-                warn("channel_insert() failed");
-                goto e0;
-            }
+        case 1:
             pcount++;
-            goto endloop;
-        }
-
-        /* Put packet it order */
-        MYQ_FOREACH_REVERSE(pp, sess) {
-            if (pp->parsed.seq == pack->parsed.seq) {
-                /* Duplicate packet */
-                free(pack);
-                goto endloop;
-            }
-            if (pp->parsed.ts < pack->parsed.ts ||
-              pp->parsed.seq < pack->parsed.seq) {
-                MYQ_INSERT_AFTER(sess, pp, pack);
-                goto reg_pack;
-            }
+            break;
         }
-        MYQ_INSERT_HEAD(sess, pack);
-reg_pack:
-        pcount++;
-endloop:
-        continue;
     }
     if (cp != ep) {
         warnx("invalid format, %d packets loaded", pcount);
         return -1;
     }
     return pcount;
-e0:
-    free(pack);
-    return (-1);
 }
 
 static int
@@ -266,20 +476,17 @@ load_pcap(struct rtpp_loader *loader, struct channels *channels,
 {
     int pcount, rcode;
     unsigned char *cp, *ep;
-    struct packet *pack, *pp;
-    struct channel *channel;
-    struct session *sess;
+    struct packet *pack;
     int rtp_pkt_len, rval;
-    off_t st_size;
     int network;
     struct pcap_dissect pd;
+    double ptime;
 
-    st_size = loader->sb.st_size;
     network = loader->private.pcap_data.pcap_hdr->network;
-    ep = loader->ibuf + st_size;
+    ep = loader->ibuf + loader->eoff;
 
     pcount = 0;
-    for (cp = loader->ibuf; cp < ep; cp += PCAP_REC_LEN(&pd)) {
+    for (cp = loader->ibuf + loader->boff; cp < ep; cp += PCAP_REC_LEN(&pd)) {
         rval = eaud_pcap_dissect(cp, ep - cp, network, &pd);
         if (rval < 0) {
             if (rval == PCP_DSCT_UNKN)
@@ -289,6 +496,9 @@ load_pcap(struct rtpp_loader *loader, struct channels *channels,
         }
         if (pd.l5_len < sizeof(rtp_hdr_t))
             continue;
+        ptime = ts2dtime(pd.pcaprec_hdr.ts_sec, pd.pcaprec_hdr.ts_usec);
+        if (ptime < loader->rbtime || ptime > loader->retime)
+            continue;
 
 #if ENABLE_SRTP || ENABLE_SRTP2
         if (crypto != NULL) {
@@ -319,7 +529,7 @@ load_pcap(struct rtpp_loader *loader, struct channels *channels,
         }
         pack->pkt = (struct pkt_hdr_adhoc *)&pack[1];
         pack->rpkt = (rtp_hdr_t *)pd.l5_data;
-        pack->pkt->time = ts2dtime(pd.pcaprec_hdr.ts_sec, pd.pcaprec_hdr.ts_usec);
+        pack->pkt->time = ptime;
         pack->pkt->plen = rtp_pkt_len;
         pack->pkt->addr.in4.sin_family = AF_INET;
         if (origin == B_CH) {
@@ -331,61 +541,220 @@ load_pcap(struct rtpp_loader *loader, struct channels *channels,
             memcpy(&pack->pkt->addr.in4.sin_addr, pd.src,
               sizeof(pack->pkt->addr.in4.sin_addr));
         }
-        if (update_rtpp_stats(NULL, stat, pack->rpkt, &(pack->parsed), pack->pkt->time) == UPDATE_ERR) {
-            /* XXX error handling */
-            warnx("update_rtpp_stats() failed");
-            free(pack);
+        switch (channel_add_packet(channels, stat, pack, origin)) {
+        case -1:
             return (-1);
+
+        case 1:
+            pcount++;
+            break;
         }
-        if (pack->parsed.nsamples <= 0) {
-            warnx("pack->parsed.nsamples = %d", pack->parsed.nsamples);
-            free(pack);
-            continue;
-        }
+    }
+    if (cp != ep) {
+        warnx("invalid format, %d packets loaded", pcount);
+        return -1;
+    }
+    return pcount;
+}
+
+static struct packet *
+packet_copy(const struct pkt_hdr_adhoc *ahp, const unsigned char *pkt)
+{
+    struct packet *pack;
+
+    pack = malloc(sizeof(*pack) + sizeof(*ahp) + ahp->plen);
+    if (pack == NULL) {
+        warn("malloc() failed");
+        return (NULL);
+    }
+    pack->pkt = (struct pkt_hdr_adhoc *)&pack[1];
+    memcpy(pack->pkt, ahp, sizeof(*ahp));
+    pack->rpkt = (rtp_hdr_t *)((unsigned char *)pack->pkt + sizeof(*ahp));
+    memcpy(pack->rpkt, pkt, ahp->plen);
+    return (pack);
+}
 
-        sess = session_lookup(channels, pack->rpkt->ssrc, &channel);
-        if (sess == NULL) {
-            channel = channel_alloc(origin);
-            if (channel == NULL) {
-                warn("channel_alloc() failed");
-                goto e0;
+/*
+ * Parse complete records in the [cp, ep) range, returns number of bytes
+ * consumed or -1 on error. Partial record at the end is left alone to be
+ * completed by the next read.
+ */
+static ssize_t
+parse_stream(struct rtpp_loader *loader, unsigned char *cp, unsigned char *ep,
+  struct channels *channels, struct rtpp_session_stat *stat,
+  enum origin origin, struct eaud_crypto *crypto, int *npkts)
+{
+    unsigned char *bp;
+    struct pkt_hdr_adhoc ahdr;
+    struct pcap_dissect pd;
+    struct packet *pack;
+    pcap_hdr_t *pcap_hdr;
+    size_t minlen;
+    int rtp_pkt_len, rcode, *network;
+
+    bp = cp;
+    network = &loader->private.stream_data.network;
+    if (*network == RTPP_LOADER_NET_UNKN) {
+        if (ep - cp < sizeof(uint32_t))
+            return (0);
+        if (*(uint32_t *)cp != PCAP_MAGIC) {
+            *network = RTPP_LOADER_NET_ADHOC;
+        } else {
+            if (ep - cp < sizeof(*pcap_hdr))
+                return (0);
+            pcap_hdr = (pcap_hdr_t *)cp;
+            if (pcap_hdr->network != DLT_EN10MB && pcap_hdr->network != DLT_NULL) {
+                warnx("unsupported data-link type in the PCAP: %d", pcap_hdr->network);
+                return (-1);
             }
-            sess = &(channel->session);
-            MYQ_INIT(sess);
-            MYQ_INSERT_HEAD(sess, pack);
-            if (channel_insert(channels, channel) < 0) {
-                warn("channel_insert() failed");
-                goto e0;
+            if (pcap_hdr->version_major != PCAP_VER_MAJR || pcap_hdr->version_minor != PCAP_VER_MINR) {
+                warnx("unsupported version of the PCAP: %d.%d", pcap_hdr->version_major, pcap_hdr->version_minor);
+                return (-1);
             }
-            pcount++;
-            goto endloop;
+            *network = pcap_hdr->network;
+            cp += sizeof(*pcap_hdr);
         }
+    }
 
-        /* Put packet it order */
-        MYQ_FOREACH_REVERSE(pp, sess) {
-            if (pp->parsed.seq == pack->parsed.seq) {
-                /* Duplicate packet */
+    if (*network == RTPP_LOADER_NET_ADHOC) {
+        while (ep - cp >= sizeof(ahdr)) {
+            memcpy(&ahdr, cp, sizeof(ahdr));
+            if (ep - cp < sizeof(ahdr) + ahdr.plen)
+                break;
+            cp += sizeof(ahdr) + ahdr.plen;
+            if (ahdr.plen < sizeof(rtp_hdr_t))
+                continue;
+            pack = packet_copy(&ahdr, cp - ahdr.plen);
+            if (pack == NULL)
+                return (-1);
+            rcode = rtp_packet_parse_raw((unsigned char *)pack->rpkt,
+              ahdr.plen, &(pack->parsed));
+            if (rcode != RTP_PARSER_OK) {
+                warnx("rtp_packet_parse_raw() failed: %s", rtp_packet_parse_errstr(rcode));
                 free(pack);
-                goto endloop;
+                continue;
             }
-            if (pp->parsed.ts < pack->parsed.ts ||
-              pp->parsed.seq < pack->parsed.seq) {
-                MYQ_INSERT_AFTER(sess, pp, pack);
-                goto reg_pack;
+            if (ahdr.time > loader->ltime)
+                loader->ltime = ahdr.time;
+            switch (channel_add_packet(channels, stat, pack, origin)) {
+            case -1:
+                return (-1);
+
+            case 1:
+                *npkts += 1;
+                break;
             }
         }
-        MYQ_INSERT_HEAD(sess, pack);
-reg_pack:
-        pcount++;
-endloop:
-        continue;
+        return (cp - bp);
     }
-    if (cp != loader->ibuf + st_size) {
-        warnx("invalid format, %d packets loaded", pcount);
-        return -1;
+
+    minlen = (*network == DLT_NULL) ? sizeof(struct pkt_hdr_pcap_null) :
+      sizeof(struct pkt_hdr_pcap_en10t);
+    while (cp < ep) {
+        rcode = eaud_pcap_dissect(cp, ep - cp, *network, &pd);
+        if (rcode == PCP_DSCT_TRNK) {
+            if (ep - cp < minlen)
+                break;
+            warnx("broken PCAP file");
+            return (-1);
+        }
+        if (ep - cp < PCAP_REC_LEN(&pd))
+            break;
+        cp += PCAP_REC_LEN(&pd);
+        if (rcode == PCP_DSCT_UNKN || pd.l5_len < sizeof(rtp_hdr_t))
+            continue;
+#if ENABLE_SRTP || ENABLE_SRTP2
+        if (crypto != NULL) {
+            rtp_pkt_len = eaud_crypto_decrypt(crypto, pd.l5_data, pd.l5_len);
+            if (rtp_pkt_len <= 0) {
+                warnx("decryption failed");
+                continue;
+            }
+            assert(rtp_pkt_len <= pd.l5_len);
+        } else {
+            rtp_pkt_len = pd.l5_len;
+        }
+#else
+        rtp_pkt_len = pd.l5_len;
+#endif
+        memset(&ahdr, '\0', sizeof(ahdr));
+        ahdr.time = ts2dtime(pd.pcaprec_hdr.ts_sec, pd.pcaprec_hdr.ts_usec);
+        ahdr.plen = rtp_pkt_len;
+        ahdr.addr.in4.sin_family = AF_INET;
+        if (origin == B_CH) {
+            ahdr.addr.in4.sin_port = pd.dport;
+            memcpy(&ahdr.addr.in4.sin_addr, pd.dst,
+              sizeof(ahdr.addr.in4.sin_addr));
+        } else {
+            ahdr.addr.in4.sin_port = pd.sport;
+            memcpy(&ahdr.addr.in4.sin_addr, pd.src,
+              sizeof(ahdr.addr.in4.sin_addr));
+        }
+        pack = packet_copy(&ahdr, pd.l5_data);
+        if (pack == NULL)
+            return (-1);
+        rcode = rtp_packet_parse_raw((unsigned char *)pack->rpkt,
+          rtp_pkt_len, &(pack->parsed));
+        if (rcode != RTP_PARSER_OK) {
+            warnx("rtp_packet_parse_raw() failed: %s", rtp_packet_parse_errstr(rcode));
+            free(pack);
+            continue;
+        }
+        if (ahdr.time > loader->ltime)
+            loader->ltime = ahdr.time;
+        switch (channel_add_packet(channels, stat, pack, origin)) {
+        case -1:
+            return (-1);
+
+        case 1:
+            *npkts += 1;
+            break;
+        }
     }
-    return pcount;
-e0:
-    free(pack);
-    return (-1);
+    return (cp - bp);
+}
+
+/*
+ * Read next chunk of whatever has been appended to the file since the last
+ * call and feed complete records into the channels. At most one buffer
+ * worth of data is consumed per call, so that the caller is in control of
+ * how much is kept in memory. Returns number of packets added or -1 on
+ * error.
+ */
+static int
+poll_stream(struct rtpp_loader *loader, struct channels *channels,
+  struct rtpp_session_stat *stat, enum origin origin,
+  struct eaud_crypto *crypto)
+{
+    unsigned char *buf;
+    size_t *blen;
+    ssize_t rlen, plen;
+    int npkts;
+
+    buf = loader->private.stream_data.buf;
+    blen = &loader->private.stream_data.blen;
+    npkts = 0;
+    do {
+        rlen = read(loader->ifd, buf + *blen, RTPP_LOADER_SBUF_LEN - *blen);
+    } while (rlen < 0 && errno == EINTR);
+    if (rlen < 0) {
+        warn("read() failed");
+        return (-1);
+    }
+    if (rlen == 0)
+        return (0);
+    loader->lgrow = getdtime();
+    *blen += rlen;
+    plen = parse_stream(loader, buf, buf + *blen, channels, stat, origin,
+      crypto, &npkts);
+    if (plen < 0)
+        return (-1);
+    if (plen == 0 && *blen == RTPP_LOADER_SBUF_LEN) {
+        warnx("record is too large");
+        return (-1);
+    }
+    *blen -= plen;
+    if (*blen > 0)
+        memmove(buf, buf + plen, *blen);
+    return (npkts);
 }
@@ -38,6 +38,9 @@ struct sessions;
 struct channels;
 struct rtpp_session_stat;
 struct eaud_crypto;
+struct rtpp_ridx_hdr;
+struct rtpp_ridx_ssrc;
+struct rtpp_ridx_seek;
 
 enum origin;
 
@@ -50,23 +53,54 @@ DEFINE_METHOD(rtpp_loader, rtpp_loader_scan, int, struct sessions *);
 DEFINE_METHOD(rtpp_loader, rtpp_loader_load, int, struct channels *,
   struct rtpp_session_stat *, enum origin, struct eaud_crypto *);
 DEFINE_METHOD(rtpp_loader, rtpp_loader_dtor, void);
+DEFINE_METHOD(rtpp_loader, rtpp_loader_poll, int, struct channels *,
+  struct rtpp_session_stat *, enum origin, struct eaud_crypto *);
+
+/* Sidecar index as loaded from the disk */
+struct rtpp_ridx {
+    const struct rtpp_ridx_hdr *hdr;
+    const struct rtpp_ridx_ssrc *ssrcs;
+    const struct rtpp_ridx_seek *seeks;
+};
 
 struct rtpp_loader {
     int ifd;
     struct stat sb;
     unsigned char *ibuf;
+    void *mbase;
+    size_t mlen;
     rtpp_loader_scan_t scan;
     rtpp_loader_load_t load;
     rtpp_loader_dtor_t destroy;
+    rtpp_loader_poll_t poll;
+    /* Follow mode: arrival time of the latest packet */
+    double ltime;
+    /* Follow mode: when the file has last grown (monotonic) */
+    double lgrow;
+    /* Sidecar index, NULL if there is none */
+    struct rtpp_ridx *idx;
+    /* Part of the recording to load, offsets are relative to the ibuf */
+    off_t boff;
+    off_t eoff;
+    double rbtime;
+    double retime;
 
     union {
         struct {
             pcap_hdr_t *pcap_hdr;
         } pcap_data;
         struct {} adhoc_data;
+        struct {
+            unsigned char *buf;
+            size_t blen;
+            int network;
+        } stream_data;
     } private;
 };
 
 struct rtpp_loader *rtpp_load(const char *);
+struct rtpp_loader *rtpp_load_follow(const char *);
+double rtpp_loader_btime(struct rtpp_loader *);
+void rtpp_loader_set_range(struct rtpp_loader *, double, double);
 
 #endif
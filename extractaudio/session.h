@@ -101,6 +101,7 @@ struct channel {
     void *decoder;
     unsigned int skip;
     enum origin origin;
+    uint32_t ssrc;
     struct eaud_crypto *crypto;
     double btime;
     double etime;
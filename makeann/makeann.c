@@ -31,10 +31,12 @@
 #endif
 
 #include <sys/socket.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #if !defined(NO_ERR_H)
@@ -90,115 +92,145 @@ static void
 usage(void)
 {
 
-    fprintf(stderr, "usage: makeann [-l limit [-L]] infile [outfile_template]\n");
+    fprintf(stderr, "usage: makeann [-v] [-j nworkers] [-m manifest] [-l limit [-L]] "
+      "infile [outfile_template]\n"
+      "       makeann -b [-v] [-j nworkers] [-m manifest] [-o outdir] "
+      "[-l limit [-L]] infile [infile ...]\n");
     exit(1);
 }
 
+struct mkann_opts {
+    int loop;
+    int limit;
+    int vad_enable;
+};
+
+/*
+ * One output file, i.e. one input encoded into one codec. Those are
+ * independent of each other and make up the units of work for the
+ * worker threads.
+ */
 struct efile {
-    FILE *f;
+    const char *ipath;
     rtp_type_t pt;
-    int enabled;
+    int failed;
+    unsigned long long nbytes;
+    unsigned long nframes;
+    uint32_t crc;
     char path[PATH_MAX + 1];
 };
 
-int main(int argc, char **argv)
+struct mkann_batch {
+    const struct mkann_opts *mop;
+    struct efile *efiles;
+    int nfiles;
+    int next;
+    int nfailed;
+    pthread_mutex_t lock;
+};
+
+static const struct {
+    rtp_type_t pt;
+    int enabled;
+} codecs[] = {{RTP_PCMU, 1}, {RTP_GSM, GSM_ENABLED}, {RTP_G729, G729_ENABLED},
+  {RTP_PCMA, 1}, {RTP_G722, G722_ENABLED}, {RTP_UNKN, 0}};
+
+/* CRC-32 (IEEE 802.3), same as the one used by zlib */
+static uint32_t crc32_tbl[256];
+
+static void
+crc32_init(void)
+{
+    uint32_t c;
+    int i, j;
+
+    for (i = 0; i < 256; i++) {
+        c = i;
+        for (j = 0; j < 8; j++)
+            c = (c & 1) ? (0xEDB88320U ^ (c >> 1)) : (c >> 1);
+        crc32_tbl[i] = c;
+    }
+}
+
+static uint32_t
+crc32_update(uint32_t crc, const uint8_t *buf, size_t len)
+{
+
+    crc = ~crc;
+    while (len-- > 0)
+        crc = crc32_tbl[(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+    return (~crc);
+}
+
+static int
+makeann_encode(const struct mkann_opts *mop, struct efile *efp)
 {
-    FILE *infile;
+    FILE *infile, *outfile;
     uint8_t lawbuf[160];
     int16_t slbuf[160];
-    int i, j, k, rsize, wsize, loop, limit, rlimit, ch;
-    int vad_enable;
+    int i, j, rsize, wsize, rlimit, rval;
 #ifdef ENABLE_G729
-    G729_ECTX *ctx_g729;
+    G729_ECTX *ctx_g729 = NULL;
 #endif
 #ifdef ENABLE_GSM
-    gsm ctx_gsm;
+    gsm ctx_gsm = NULL;
 #endif
 #ifdef ENABLE_G722
-    G722_ENC_CTX *ctx_g722;
-#endif
-    const char *template;
-    struct efile efiles[] = {{NULL, RTP_PCMU, 1}, {NULL, RTP_GSM, GSM_ENABLED},
-      {NULL, RTP_G729, G729_ENABLED}, {NULL, RTP_PCMA, 1},
-      {NULL, RTP_G722, G722_ENABLED}, {NULL, RTP_UNKN, 0}};
-
-#ifdef RTPP_CHECK_LEAKS
-    RTPP_MEMDEB_APP_INIT();
+    G722_ENC_CTX *ctx_g722 = NULL;
 #endif
 
-    loop = 0;
-    limit = -1;
-    vad_enable = 0;
-    while ((ch = getopt(argc, argv, "l:Lv")) != -1)
-        switch (ch) {
-        case 'l':
-            limit = atoi(optarg);
-            if (limit <= 0)
-                errx(1, "limit parameter have to be a number greater than zero");
-            break;
-
-        case 'L':
-            loop = 1;
-            break;
-
-        case 'v':
-            vad_enable = 1;
-            warnx("VAD enable (-v) is for debugging purposes only, "
-              "produced stream may not play correctly");
-            break;
-
-        case '?':
-        default:
-            usage();
-        }
-    argc -= optind;
-    argv += optind;
-
-    if (argc < 1 || argc > 2)
-        usage();
-
-    if (loop != 0 && limit == -1)
-        errx(1, "limit have to be specified in the loop mode");
-
-    if (argc == 2)
-        template = argv[1];
-    else
-        template = argv[0];
-
+    rval = -1;
+    switch (efp->pt) {
 #ifdef ENABLE_G729
-    ctx_g729 = G729_EINIT(vad_enable);
-    if (ctx_g729 == NULL)
-        errx(1, "can't create G.729 encoder");
+    case RTP_G729:
+        ctx_g729 = G729_EINIT(mop->vad_enable);
+        if (ctx_g729 == NULL) {
+            warnx("can't create G.729 encoder");
+            goto e0;
+        }
+        break;
 #endif
+
 #ifdef ENABLE_GSM
-    ctx_gsm = gsm_create();
-    if (ctx_gsm == NULL)
-        errx(1, "can't create GSM encoder");
+    case RTP_GSM:
+        ctx_gsm = gsm_create();
+        if (ctx_gsm == NULL) {
+            warnx("can't create GSM encoder");
+            goto e0;
+        }
+        break;
 #endif
+
 #ifdef ENABLE_G722
-    ctx_g722 = g722_encoder_new(64000, G722_SAMPLE_RATE_8000);
-    if (ctx_g722 == NULL)
-        errx(1, "can't create G.722 encoder");
+    case RTP_G722:
+        ctx_g722 = g722_encoder_new(64000, G722_SAMPLE_RATE_8000);
+        if (ctx_g722 == NULL) {
+            warnx("can't create G.722 encoder");
+            goto e0;
+        }
+        break;
 #endif
 
-    infile = fopen(argv[0], "r");
-    if (infile == NULL)
-        err(1, "can't open %s for reading", argv[0]);
+    default:
+        break;
+    }
 
-    for (k = 0; efiles[k].pt != RTP_UNKN; k++) {
-        if (efiles[k].enabled == 0)
-            continue;
-        snprintf(efiles[k].path, sizeof(efiles[k].path), "%s.%d", template,
-          efiles[k].pt);
-        efiles[k].f = fopen(efiles[k].path, "w");
-        if (efiles[k].f == NULL)
-            err(1, "can't open %s for writing", efiles[k].path);
+    infile = fopen(efp->ipath, "r");
+    if (infile == NULL) {
+        warn("can't open %s for reading", efp->ipath);
+        goto e0;
     }
+    outfile = fopen(efp->path, "w");
+    if (outfile == NULL) {
+        warn("can't open %s for writing", efp->path);
+        goto e1;
+    }
+    setvbuf(outfile, NULL, _IOFBF, 64 * 1024);
 
-    for (rlimit = limit; limit == -1 || rlimit > 0; rlimit -= i) {
-        rsize = (limit == -1 || rlimit > 160) ? 160 : rlimit;
+    for (rlimit = mop->limit; mop->limit == -1 || rlimit > 0; rlimit -= i) {
+        rsize = (mop->limit == -1 || rlimit > 160) ? 160 : rlimit;
         i = fread(slbuf, sizeof(slbuf[0]), rsize, infile);
-        if (i < rsize && feof(infile) && loop != 0) {
+        if (i < rsize && feof(infile) && mop->loop != 0) {
             rewind(infile);
             i += fread(slbuf + i, sizeof(slbuf[0]), rsize - i, infile);
         }
@@ -210,66 +242,304 @@ int main(int argc, char **argv)
             else
                 slbuf[j] = 0;
         }
-        for (k = 0; efiles[k].pt != RTP_UNKN; k++) {
-            if (efiles[k].enabled == 0)
-                continue;
-            switch (efiles[k].pt) {
-            case RTP_PCMU:
-                SL2ULAW(lawbuf, slbuf, i);
-                wsize = i;
-                break;
-
-            case RTP_PCMA:
-                SL2ALAW(lawbuf, slbuf, i);
-                wsize = i;
-                break;
+        switch (efp->pt) {
+        case RTP_PCMU:
+            SL2ULAW(lawbuf, slbuf, i);
+            wsize = i;
+            break;
+
+        case RTP_PCMA:
+            SL2ALAW(lawbuf, slbuf, i);
+            wsize = i;
+            break;
 
 #ifdef ENABLE_G729
-            case RTP_G729:
-                wsize = 0;
-                for (j = 0; j < 2; j++) {
-                    uint8_t bl;
-
-                    G729_ENCODE(ctx_g729, &(slbuf[j * 80]), &(lawbuf[j * 10]),
-                        &bl);
-                    wsize += bl;
-                }
-                break;
+        case RTP_G729:
+            wsize = 0;
+            for (j = 0; j < 2; j++) {
+                uint8_t bl;
+
+                G729_ENCODE(ctx_g729, &(slbuf[j * 80]), &(lawbuf[j * 10]),
+                    &bl);
+                wsize += bl;
+            }
+            break;
 #endif
 
 #ifdef ENABLE_GSM
-            case RTP_GSM:
-                gsm_encode(ctx_gsm, slbuf, lawbuf);
-                wsize = 33;
-                break;
+        case RTP_GSM:
+            gsm_encode(ctx_gsm, slbuf, lawbuf);
+            wsize = 33;
+            break;
 #endif
 
 #ifdef ENABLE_G722
-            case RTP_G722:
-                for (j = 0; j < 2; j++)
-                    g722_encode(ctx_g722, &(slbuf[j * 80]), 80, &(lawbuf[j * 80]));
-                wsize = 160;
-                break;
+        case RTP_G722:
+            for (j = 0; j < 2; j++)
+                g722_encode(ctx_g722, &(slbuf[j * 80]), 80, &(lawbuf[j * 80]));
+            wsize = 160;
+            break;
 #endif
 
-            default:
-                abort();
-            }
-            if (fwrite(lawbuf, sizeof(lawbuf[0]), wsize, efiles[k].f) < wsize)
-                errx(1, "can't write to %s", efiles[k].path);
+        default:
+            abort();
         }
+        if (fwrite(lawbuf, sizeof(lawbuf[0]), wsize, outfile) < wsize) {
+            warnx("can't write to %s", efp->path);
+            goto e2;
+        }
+        efp->crc = crc32_update(efp->crc, lawbuf, wsize);
+        efp->nbytes += wsize;
+        efp->nframes += 1;
     }
-
+    rval = 0;
+e2:
+    if (fclose(outfile) != 0 && rval == 0) {
+        warn("can't write to %s", efp->path);
+        rval = -1;
+    }
+e1:
     fclose(infile);
-    for (k = 0; efiles[k].pt != RTP_UNKN; k++) {
-        if (efiles[k].enabled == 0)
+e0:
+#ifdef ENABLE_G729
+    if (ctx_g729 != NULL)
+        G729_ECLOSE(ctx_g729);
+#endif
+#ifdef ENABLE_GSM
+    if (ctx_gsm != NULL)
+        gsm_destroy(ctx_gsm);
+#endif
+#ifdef ENABLE_G722
+    if (ctx_g722 != NULL)
+        g722_encoder_destroy(ctx_g722);
+#endif
+    return (rval);
+}
+
+static void *
+makeann_worker(void *arg)
+{
+    struct mkann_batch *bp;
+    struct efile *efp;
+
+    bp = (struct mkann_batch *)arg;
+    for (;;) {
+        pthread_mutex_lock(&bp->lock);
+        if (bp->next == bp->nfiles) {
+            pthread_mutex_unlock(&bp->lock);
+            break;
+        }
+        efp = &bp->efiles[bp->next];
+        bp->next += 1;
+        pthread_mutex_unlock(&bp->lock);
+
+        if (makeann_encode(bp->mop, efp) != 0) {
+            efp->failed = 1;
+            pthread_mutex_lock(&bp->lock);
+            bp->nfailed += 1;
+            pthread_mutex_unlock(&bp->lock);
+        }
+    }
+    return (NULL);
+}
+
+static int
+makeann_add(struct mkann_batch *bp, const char *ipath, const char *outdir,
+  const char *template)
+{
+    struct efile *efiles;
+    const char *bname;
+    int k, plen;
+
+    if (template == NULL) {
+        template = ipath;
+        if (outdir != NULL) {
+            bname = strrchr(ipath, '/');
+            template = (bname != NULL) ? bname + 1 : ipath;
+        }
+    }
+    for (k = 0; codecs[k].pt != RTP_UNKN; k++) {
+        if (codecs[k].enabled == 0)
             continue;
-        fclose(efiles[k].f);
+        efiles = realloc(bp->efiles, sizeof(bp->efiles[0]) * (bp->nfiles + 1));
+        if (efiles == NULL)
+            return (-1);
+        bp->efiles = efiles;
+        efiles = &bp->efiles[bp->nfiles];
+        memset(efiles, '\0', sizeof(*efiles));
+        efiles->ipath = ipath;
+        efiles->pt = codecs[k].pt;
+        if (outdir != NULL) {
+            plen = snprintf(efiles->path, sizeof(efiles->path), "%s/%s.%d",
+              outdir, template, codecs[k].pt);
+        } else {
+            plen = snprintf(efiles->path, sizeof(efiles->path), "%s.%d",
+              template, codecs[k].pt);
+        }
+        if ((size_t)plen >= sizeof(efiles->path)) {
+            warnx("%s: output path is too long", ipath);
+            return (-1);
+        }
+        bp->nfiles += 1;
     }
+    return (0);
+}
 
-#ifdef ENABLE_G729
-    G729_ECLOSE(ctx_g729);
+/*
+ * The manifest lists every output file with its payload type, size,
+ * number of 20 ms frames and CRC-32 of the content, so that the prompts
+ * can be checked and preloaded without re-reading the source audio.
+ */
+static int
+makeann_manifest(const struct mkann_batch *bp, const char *mname)
+{
+    FILE *f;
+    const struct efile *efp;
+    int k;
+
+    if (strcmp(mname, "-") == 0) {
+        f = stdout;
+    } else {
+        f = fopen(mname, "w");
+        if (f == NULL) {
+            warn("can't open %s for writing", mname);
+            return (-1);
+        }
+    }
+    fprintf(f, "# path pt bytes frames crc32\n");
+    for (k = 0; k < bp->nfiles; k++) {
+        efp = &bp->efiles[k];
+        if (efp->failed != 0)
+            continue;
+        fprintf(f, "%s %d %llu %lu %08x\n", efp->path, efp->pt, efp->nbytes,
+          efp->nframes, efp->crc);
+    }
+    if (f == stdout) {
+        if (fflush(f) != 0)
+            goto e0;
+    } else if (fclose(f) != 0) {
+        goto e0;
+    }
+    return (0);
+e0:
+    warn("can't write to %s", mname);
+    return (-1);
+}
+
+int main(int argc, char **argv)
+{
+    int i, limit, ch, bmode, nworkers, rval;
+    const char *template, *outdir, *mname;
+    struct mkann_opts mo;
+    struct mkann_batch batch;
+    pthread_t *tids;
+
+#ifdef RTPP_CHECK_LEAKS
+    RTPP_MEMDEB_APP_INIT();
 #endif
 
-    return 0;
+    memset(&mo, '\0', sizeof(mo));
+    limit = -1;
+    bmode = 0;
+    nworkers = 0;
+    outdir = mname = NULL;
+    while ((ch = getopt(argc, argv, "bj:l:Lm:o:v")) != -1)
+        switch (ch) {
+        case 'b':
+            bmode = 1;
+            break;
+
+        case 'j':
+            nworkers = atoi(optarg);
+            if (nworkers <= 0)
+                errx(1, "number of workers have to be a number greater than zero");
+            break;
+
+        case 'l':
+            limit = atoi(optarg);
+            if (limit <= 0)
+                errx(1, "limit parameter have to be a number greater than zero");
+            break;
+
+        case 'L':
+            mo.loop = 1;
+            break;
+
+        case 'm':
+            mname = optarg;
+            break;
+
+        case 'o':
+            outdir = optarg;
+            break;
+
+        case 'v':
+            mo.vad_enable = 1;
+            warnx("VAD enable (-v) is for debugging purposes only, "
+              "produced stream may not play correctly");
+            break;
+
+        case '?':
+        default:
+            usage();
+        }
+    argc -= optind;
+    argv += optind;
+
+    if (bmode == 0 && (argc < 1 || argc > 2 || outdir != NULL))
+        usage();
+    if (bmode != 0 && argc < 1)
+        usage();
+
+    if (mo.loop != 0 && limit == -1)
+        errx(1, "limit have to be specified in the loop mode");
+    mo.limit = limit;
+
+    crc32_init();
+    memset(&batch, '\0', sizeof(batch));
+    batch.mop = &mo;
+    if (pthread_mutex_init(&batch.lock, NULL) != 0)
+        errx(1, "pthread_mutex_init() failed");
+
+    if (bmode == 0) {
+        template = (argc == 2) ? argv[1] : NULL;
+        if (makeann_add(&batch, argv[0], NULL, template) != 0)
+            errx(1, "can't allocate memory");
+    } else {
+        for (i = 0; i < argc; i++) {
+            if (makeann_add(&batch, argv[i], outdir, NULL) != 0)
+                errx(1, "can't allocate memory");
+        }
+    }
+
+    if (nworkers == 0)
+        nworkers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nworkers <= 0)
+        nworkers = 1;
+    if (nworkers > batch.nfiles)
+        nworkers = batch.nfiles;
+    tids = malloc(sizeof(tids[0]) * (nworkers + 1));
+    if (tids == NULL)
+        errx(1, "can't allocate memory");
+    for (i = 0; i < nworkers; i++) {
+        if (pthread_create(&tids[i], NULL, makeann_worker, &batch) != 0) {
+            if (i == 0)
+                errx(1, "pthread_create() failed");
+            warnx("pthread_create() failed");
+            break;
+        }
+    }
+    nworkers = i;
+    for (i = 0; i < nworkers; i++)
+        pthread_join(tids[i], NULL);
+    free(tids);
+
+    rval = (batch.nfailed > 0) ? 1 : 0;
+    if (mname != NULL && makeann_manifest(&batch, mname) != 0)
+        rval = 1;
+
+    free(batch.efiles);
+    pthread_mutex_destroy(&batch.lock);
+
+    return (rval);
 }
@@ -32,10 +32,12 @@
 #include <inttypes.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "config_pp.h"
@@ -61,12 +63,28 @@
 
 #define SSRC_STRLEN 11
 
+/*
+ * Records are accumulated in one of the two write buffers and appended
+ * to the file by the flusher thread either when the buffer fill level
+ * crosses ACSV_FLUSH_HWM or when the oldest record in it gets older than
+ * ACSV_FLUSH_IVAL seconds, whichever happens first.
+ */
+#define ACSV_BUF_SIZE   (64 * 1024)
+#define ACSV_FLUSH_HWM  (ACSV_BUF_SIZE / 2)
+#define ACSV_FLUSH_IVAL 1.0
+
 struct rtpp_mod_acct_face {
    char rtp_adr[MAX_AP_STRBUF];
    char rtcp_adr[MAX_AP_STRBUF];
    char ssrc[SSRC_STRLEN];
 };
 
+struct rtpp_acct_csv_wbuf {
+   size_t len;
+   double first_ts;
+   char data[ACSV_BUF_SIZE];
+};
+
 struct rtpp_module_priv {
    int fd;
    pid_t pid;
@@ -76,6 +94,13 @@ struct rtpp_module_priv {
    char node_id[_POSIX_HOST_NAME_MAX + 1];
    struct rtpp_mod_acct_face o;
    struct rtpp_mod_acct_face a;
+   pthread_t flusher_id;
+   pthread_mutex_t wlock;
+   pthread_cond_t fcond;
+   pthread_cond_t wcond;
+   int shutdown;
+   int wbuf_cur;
+   struct rtpp_acct_csv_wbuf wbuf[2];
 };
 
 /* Bump this when some changes are made */
@@ -88,6 +113,7 @@ static void rtpp_acct_csv_dtor(struct rtpp_module_priv *);
 static void rtpp_acct_csv_do(struct rtpp_module_priv *, struct rtpp_acct *);
 static off_t rtpp_acct_csv_lockf(int);
 static void rtpp_acct_csv_unlockf(int, off_t);
+static void rtpp_acct_csv_flusher(struct rtpp_module_priv *);
 
 #ifdef RTPP_CHECK_LEAKS
 #include "rtpp_memdeb_internal.h"
@@ -236,6 +262,7 @@ e2:
     rtpp_acct_csv_unlockf(pvt->fd, pos);
 e1:
     close(pvt->fd);
+    pvt->fd = -1;
 e0:
     return (-1);
 }
@@ -263,8 +290,29 @@ rtpp_acct_csv_ctor(const struct rtpp_cfg *cfsp)
     if (rtpp_acct_csv_open(pvt) == -1) {
         goto e1;
     }
+    if (pthread_mutex_init(&pvt->wlock, NULL) != 0) {
+        goto e2;
+    }
+    if (pthread_cond_init(&pvt->fcond, NULL) != 0) {
+        goto e3;
+    }
+    if (pthread_cond_init(&pvt->wcond, NULL) != 0) {
+        goto e4;
+    }
+    if (pthread_create(&pvt->flusher_id, NULL,
+      (void *(*)(void *))&rtpp_acct_csv_flusher, pvt) != 0) {
+        goto e5;
+    }
     return (pvt);
 
+e5:
+    pthread_cond_destroy(&pvt->wcond);
+e4:
+    pthread_cond_destroy(&pvt->fcond);
+e3:
+    pthread_mutex_destroy(&pvt->wlock);
+e2:
+    close(pvt->fd);
 e1:
     mod_free(pvt);
 e0:
@@ -275,7 +323,17 @@ static void
 rtpp_acct_csv_dtor(struct rtpp_module_priv *pvt)
 {
 
-    close(pvt->fd);
+    /* Flusher drains whatever is still buffered before exiting */
+    pthread_mutex_lock(&pvt->wlock);
+    pvt->shutdown = 1;
+    pthread_cond_signal(&pvt->fcond);
+    pthread_mutex_unlock(&pvt->wlock);
+    pthread_join(pvt->flusher_id, NULL);
+    pthread_cond_destroy(&pvt->wcond);
+    pthread_cond_destroy(&pvt->fcond);
+    pthread_mutex_destroy(&pvt->wlock);
+    if (pvt->fd != -1)
+        close(pvt->fd);
     mod_free(pvt);
     return;
 }
@@ -315,34 +373,16 @@ format_netaddr(struct rtpp_netaddr *nap_rtp, struct rtpp_netaddr *nap_rtcp,
 
 #define FMT_BOOL(x) ((x == 0) ? "f" : "t")
 
-static void
-rtpp_acct_csv_do(struct rtpp_module_priv *pvt, struct rtpp_acct *acct)
+static int
+rtpp_acct_csv_format(struct rtpp_module_priv *pvt, struct rtpp_acct *acct,
+  char *buf, size_t blen)
 {
-    char *buf;
-    int len, pos, rval;
-    struct stat stt;
-
-    buf = NULL;
-    rval = stat(pvt->fname, &stt);
-    if (rval != -1) {
-        if (stt.st_dev != pvt->stt.st_dev || stt.st_ino != pvt->stt.st_ino) {
-            if (rtpp_acct_csv_open(pvt) < 0)
-                return;
-        }
-    } else if (rval == -1 && errno == ENOENT) {
-        if (rtpp_acct_csv_open(pvt) < 0)
-            return;
-    }
-    pos = rtpp_acct_csv_lockf(pvt->fd);
-    if (pos < 0) {
-        return;
-    }
 
     format_ssrc(&acct->rasta->last_ssrc, pvt->a.ssrc, sizeof(pvt->a.ssrc));
     format_ssrc(&acct->rasto->last_ssrc, pvt->o.ssrc, sizeof(pvt->o.ssrc));
     format_netaddr(acct->rtp.a.rem_addr, acct->rtcp.a.rem_addr, &pvt->a);
     format_netaddr(acct->rtp.o.rem_addr, acct->rtcp.o.rem_addr, &pvt->o);
-    len = mod_asprintf(&buf, RVER_FMT SEP NID_FMT SEP PID_FMT SEP SID_FMT SEP
+    return snprintf(buf, blen, RVER_FMT SEP NID_FMT SEP PID_FMT SEP SID_FMT SEP
       "%s,%s,%f,%f,%f,%f,%f,%f,%lu,%lu,"
       "%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu" SEP LSSRC_FMT SEP SNCHG_FMT SEP
       PT_FMT SEP "%lu,%lu,%lu,%lu,%lu" SEP LSSRC_FMT SEP SNCHG_FMT SEP PT_FMT SEP
@@ -364,15 +404,118 @@ rtpp_acct_csv_do(struct rtpp_module_priv *pvt, struct rtpp_acct *acct)
       pvt->o.rtp_adr, pvt->a.rtp_adr, pvt->o.rtcp_adr, pvt->a.rtcp_adr,
       FMT_BOOL(acct->rtp.o.hld_stat.status), FMT_BOOL(acct->rtp.a.hld_stat.status),
       acct->rtp.o.hld_stat.cnt, acct->rtp.a.hld_stat.cnt);
-    if (len <= 0) {
-        if (len == 0 && buf != NULL) {
-            mod_free(buf);
+}
+
+static void
+rtpp_acct_csv_do(struct rtpp_module_priv *pvt, struct rtpp_acct *acct)
+{
+    struct rtpp_acct_csv_wbuf *wbp;
+    size_t space;
+    int len;
+
+    pthread_mutex_lock(&pvt->wlock);
+    for (;;) {
+        wbp = &pvt->wbuf[pvt->wbuf_cur];
+        space = sizeof(wbp->data) - wbp->len;
+        len = rtpp_acct_csv_format(pvt, acct, wbp->data + wbp->len, space);
+        if (len <= 0) {
+            goto out;
+        }
+        if ((size_t)len < space) {
+            break;
+        }
+        if (wbp->len == 0) {
+            mod_elog(RTPP_LOG_ERR, "record is too long: %d bytes", len);
+            goto out;
         }
-        return;
+        /* No room left, kick the flusher and wait for the buffers to swap */
+        pthread_cond_signal(&pvt->fcond);
+        pthread_cond_wait(&pvt->wcond, &pvt->wlock);
     }
-    write(pvt->fd, buf, len);
-    rtpp_acct_csv_unlockf(pvt->fd, pos);
-    mod_free(buf);
+    if (wbp->len == 0) {
+        wbp->first_ts = getdtime();
+    }
+    wbp->len += len;
+    if (wbp->len >= ACSV_FLUSH_HWM) {
+        pthread_cond_signal(&pvt->fcond);
+    }
+out:
+    pthread_mutex_unlock(&pvt->wlock);
+}
+
+static void
+rtpp_acct_csv_write(struct rtpp_module_priv *pvt, struct rtpp_acct_csv_wbuf *wbp)
+{
+    struct stat stt;
+    ssize_t r;
+    int rval;
+
+    rval = stat(pvt->fname, &stt);
+    if (rval != -1) {
+        if (stt.st_dev != pvt->stt.st_dev || stt.st_ino != pvt->stt.st_ino) {
+            rtpp_acct_csv_open(pvt);
+        }
+    } else if (errno == ENOENT || pvt->fd == -1) {
+        rtpp_acct_csv_open(pvt);
+    }
+    if (pvt->fd == -1) {
+        mod_elog(RTPP_LOG_ERR, "'%s' is not open, %d bytes of records lost",
+          pvt->fname, (int)wbp->len);
+        goto out;
+    }
+    /*
+     * The buffer only ever contains complete records, so with O_APPEND
+     * a single write() lands them in one piece even if other processes
+     * are appending to the same file. Short write breaks that, so the
+     * rest is not appended separately, where it could end up interleaved
+     * with someone else's records, but reported as lost instead.
+     */
+    do {
+        r = write(pvt->fd, wbp->data, wbp->len);
+    } while (r < 0 && errno == EINTR);
+    if (r < 0) {
+        mod_elog(RTPP_LOG_ERR, "can't write to '%s', %d bytes of records "
+          "lost", pvt->fname, (int)wbp->len);
+    } else if ((size_t)r < wbp->len) {
+        mod_elog(RTPP_LOG_ERR, "short write to '%s', %d bytes of records "
+          "lost", pvt->fname, (int)(wbp->len - r));
+    }
+out:
+    wbp->len = 0;
+}
+
+static void
+rtpp_acct_csv_flusher(struct rtpp_module_priv *pvt)
+{
+    struct rtpp_acct_csv_wbuf *wbp;
+    struct timespec deadline;
+    double dleft;
+
+    pthread_mutex_lock(&pvt->wlock);
+    for (;;) {
+        wbp = &pvt->wbuf[pvt->wbuf_cur];
+        if (wbp->len == 0) {
+            if (pvt->shutdown)
+                break;
+            pthread_cond_wait(&pvt->fcond, &pvt->wlock);
+            continue;
+        }
+        if (!pvt->shutdown && wbp->len < ACSV_FLUSH_HWM) {
+            dleft = wbp->first_ts + ACSV_FLUSH_IVAL - getdtime();
+            if (dleft > 0) {
+                clock_gettime(CLOCK_REALTIME, &deadline);
+                dtime2mtimespec(timespec2dtime(&deadline) + dleft, &deadline);
+                pthread_cond_timedwait(&pvt->fcond, &pvt->wlock, &deadline);
+                continue;
+            }
+        }
+        pvt->wbuf_cur ^= 1;
+        pthread_cond_signal(&pvt->wcond);
+        pthread_mutex_unlock(&pvt->wlock);
+        rtpp_acct_csv_write(pvt, wbp);
+        pthread_mutex_lock(&pvt->wlock);
+    }
+    pthread_mutex_unlock(&pvt->wlock);
 }
 
 static off_t
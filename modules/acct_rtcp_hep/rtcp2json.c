@@ -113,21 +113,65 @@ static char *rtp_read_sdes(FILE *out, char *b, int len)
 } /* rtp_read_sdes */
 #endif
 
-#define RSW_REST(exitcode, sbc, format, args...)         \
+/*
+ * Upper bounds on the amount of text produced by each JSON fragment,
+ * including all numeric fields at their widest.
+ */
+#define R2J_SR_MAXLEN 320
+#define R2J_RR_MAXLEN 64
+#define R2J_RB_MAXLEN 320
+#define R2J_TL_MAXLEN 64
+
+#define RSB_RESERVE(exitcode, sbc, len)                  \
   {                                                      \
-    int rval;                                            \
-    for (;;) {                                           \
-      rval = rtpp_sbuf_write((sbc), (format), ## args);  \
-      if (rval == SBW_OK)                                \
-          break;                                         \
-      if (rval == SBW_ERR)                               \
-          return (exitcode);                             \
-      assert(rval == SBW_SHRT);                          \
-      if (rtpp_sbuf_extend((sbc), (sbc)->alen * 2) != 0) \
-          return (exitcode);                             \
-    }                                                    \
+    if (rtpp_sbuf_reserve((sbc), (len)) != 0)            \
+      return (exitcode);                                 \
+  }
+
+static int
+rtcp2json_rblocks(struct rtpp_sbuf *out, const rtcp_rr_t *rr, int count)
+{
+  int i;
+
+  if (count == 0)
+    return 0;
+  RSB_RESERVE(-1, out, R2J_TL_MAXLEN);
+  RS_APPEND_LIT(out, " \"report_blocks\": [\n");
+  for (i = 0; i < count; i++) {
+    RSB_RESERVE(-1, out, R2J_RB_MAXLEN);
+    if (i > 0)
+      RS_APPEND_LIT(out, "  ,\n");
+    RS_APPEND_LIT(out, "  {\n   \"source_ssrc\": ");
+    rtpp_sbuf_append_ul(out, ntohl(rr[i].ssrc));
+    RS_APPEND_LIT(out, ",\n   \"fraction_lost\": ");
+    rtpp_sbuf_append_ul(out, rr[i].fraction);
+    RS_APPEND_LIT(out, ",\n   \"packets_lost\": ");
+    rtpp_sbuf_append_l(out, RTCP_GET_LOST(&rr[i]));
+    RS_APPEND_LIT(out, ",\n   \"highest_seq_no\": ");
+    rtpp_sbuf_append_ul(out, ntohl(rr[i].last_seq));
+    RS_APPEND_LIT(out, ",\n   \"ia_jitter\": ");
+    rtpp_sbuf_append_ul(out, ntohl(rr[i].jitter));
+    RS_APPEND_LIT(out, ",\n   \"lsr\": ");
+    rtpp_sbuf_append_ul(out, ntohl(rr[i].lsr));
+    RS_APPEND_LIT(out, ",\n   \"dlsr\": ");
+    rtpp_sbuf_append_ul(out, ntohl(rr[i].dlsr));
+    RS_APPEND_LIT(out, "\n  }\n");
   }
-      
+  RSB_RESERVE(-1, out, R2J_TL_MAXLEN);
+  RS_APPEND_LIT(out, " ],\n");
+  return 0;
+}
+
+static int
+rtcp2json_tail(struct rtpp_sbuf *out, int count)
+{
+
+  RSB_RESERVE(-1, out, R2J_TL_MAXLEN);
+  RS_APPEND_LIT(out, " \"report_count\": ");
+  rtpp_sbuf_append_ul(out, count);
+  RS_APPEND_LIT(out, "\n}");
+  return 0;
+}
 
 /*
 * Return length parsed, -1 on error.
@@ -135,8 +179,8 @@ static char *rtp_read_sdes(FILE *out, char *b, int len)
 int rtcp2json(struct rtpp_sbuf *out, const void *buf, int len)
 {
   const rtcp_t *r;         /* RTCP header */
-  int i;
 #if 0
+  int i;
   char *cp;
 #endif
 
@@ -165,57 +209,39 @@ int rtcp2json(struct rtpp_sbuf *out, const void *buf, int len)
 
     switch (r->common.pt) {
     case RTCP_SR:
-      RSW_REST(-1, out, "{\n \"ssrc\": %lu,\n",
-        (unsigned long)ntohl(r->r.rr.ssrc));
-      RSW_REST(-1, out, " \"sender_information\": {\n  \"ntp_timestamp_sec\": %lu,\n  \"ntp_timestamp_usec\": %lu,\n  \"rtp_timestamp\": %lu,\n  \"packets\": %lu,\n  \"octets\": %lu\n },\n",
-        (unsigned long)ntohl(r->r.sr.ntp_sec),
-        (unsigned long)ntohl(r->r.sr.ntp_frac),
-        (unsigned long)ntohl(r->r.sr.rtp_ts),
-        (unsigned long)ntohl(r->r.sr.psent),
-        (unsigned long)ntohl(r->r.sr.osent));
-      RSW_REST(-1, out, " \"type\": %lu,\n", (unsigned long)r->common.pt);
-      if (r->common.count > 0)
-        RSW_REST(-1, out, " \"report_blocks\": [\n");
-      for (i = 0; i < r->common.count; i++) {
-        if (i > 0)
-          RSW_REST(-1, out, "  ,\n");
-        RSW_REST(-1, out, "  {\n   \"source_ssrc\": %lu,\n   \"fraction_lost\": %lu,\n   \"packets_lost\": %ld,\n   \"highest_seq_no\": %lu,\n   \"ia_jitter\": %lu,\n   \"lsr\": %lu,\n   \"dlsr\": %lu\n  }\n",
-         (unsigned long)ntohl(r->r.sr.rr[i].ssrc),
-         (unsigned long)r->r.sr.rr[i].fraction,
-         (long)RTCP_GET_LOST(&r->r.sr.rr[i]),
-         (unsigned long)ntohl(r->r.sr.rr[i].last_seq),
-         (unsigned long)ntohl(r->r.sr.rr[i].jitter),
-         (unsigned long)ntohl(r->r.sr.rr[i].lsr),
-         (unsigned long)ntohl(r->r.sr.rr[i].dlsr));
-      }
-      if (r->common.count > 0)
-        RSW_REST(-1, out, " ],\n");
-      RSW_REST(-1, out, " \"report_count\": %lu\n", (unsigned long)r->common.count);
-      RSW_REST(-1, out, "}");
+      RSB_RESERVE(-1, out, R2J_SR_MAXLEN);
+      RS_APPEND_LIT(out, "{\n \"ssrc\": ");
+      rtpp_sbuf_append_ul(out, ntohl(r->r.sr.ssrc));
+      RS_APPEND_LIT(out, ",\n \"sender_information\": {\n  \"ntp_timestamp_sec\": ");
+      rtpp_sbuf_append_ul(out, ntohl(r->r.sr.ntp_sec));
+      RS_APPEND_LIT(out, ",\n  \"ntp_timestamp_usec\": ");
+      rtpp_sbuf_append_ul(out, ntohl(r->r.sr.ntp_frac));
+      RS_APPEND_LIT(out, ",\n  \"rtp_timestamp\": ");
+      rtpp_sbuf_append_ul(out, ntohl(r->r.sr.rtp_ts));
+      RS_APPEND_LIT(out, ",\n  \"packets\": ");
+      rtpp_sbuf_append_ul(out, ntohl(r->r.sr.psent));
+      RS_APPEND_LIT(out, ",\n  \"octets\": ");
+      rtpp_sbuf_append_ul(out, ntohl(r->r.sr.osent));
+      RS_APPEND_LIT(out, "\n },\n \"type\": ");
+      rtpp_sbuf_append_ul(out, r->common.pt);
+      RS_APPEND_LIT(out, ",\n");
+      if (rtcp2json_rblocks(out, r->r.sr.rr, r->common.count) != 0)
+        return -1;
+      if (rtcp2json_tail(out, r->common.count) != 0)
+        return -1;
       break;
 
     case RTCP_RR:
-      RSW_REST(-1, out, "{\n \"ssrc\": %lu,\n",
-        (unsigned long)ntohl(r->r.rr.ssrc));
-      RSW_REST(-1, out, " \"type\": %lu,\n", (unsigned long)r->common.pt);
-      if (r->common.count > 0)
-        RSW_REST(-1, out, " \"report_blocks\": [\n");
-      for (i = 0; i < r->common.count; i++) {
-        if (i > 0)
-          RSW_REST(-1, out, "  ,\n");
-        RSW_REST(-1, out, "  {\n   \"source_ssrc\": %lu,\n   \"fraction_lost\": %lu,\n   \"packets_lost\": %ld,\n   \"highest_seq_no\": %lu,\n   \"ia_jitter\": %lu,\n   \"lsr\": %lu,\n   \"dlsr\": %lu\n  }\n",
-          (unsigned long)ntohl(r->r.rr.rr[i].ssrc),
-          (unsigned long)r->r.sr.rr[i].fraction,
-          (long)RTCP_GET_LOST(&r->r.rr.rr[i]),
-          (unsigned long)ntohl(r->r.rr.rr[i].last_seq),
-          (unsigned long)ntohl(r->r.rr.rr[i].jitter),
-          (unsigned long)ntohl(r->r.rr.rr[i].lsr),
-          (unsigned long)ntohl(r->r.rr.rr[i].dlsr));
-      }
-      if (r->common.count > 0)
-        RSW_REST(-1, out, " ],\n");
-      RSW_REST(-1, out, " \"report_count\": %lu\n", (unsigned long)r->common.count);
-      RSW_REST(-1, out, "}");
+      RSB_RESERVE(-1, out, R2J_RR_MAXLEN);
+      RS_APPEND_LIT(out, "{\n \"ssrc\": ");
+      rtpp_sbuf_append_ul(out, ntohl(r->r.rr.ssrc));
+      RS_APPEND_LIT(out, ",\n \"type\": ");
+      rtpp_sbuf_append_ul(out, r->common.pt);
+      RS_APPEND_LIT(out, ",\n");
+      if (rtcp2json_rblocks(out, r->r.rr.rr, r->common.count) != 0)
+        return -1;
+      if (rtcp2json_tail(out, r->common.count) != 0)
+        return -1;
       break;
 
     case RTCP_SDES:
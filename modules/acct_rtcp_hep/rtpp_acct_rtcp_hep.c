@@ -57,17 +57,20 @@
 #include "hep_api.h"
 #include "hepconnector.h"
 #include "rtpp_sbuf.h"
+#include "rtpp_arh_batch.h"
 
 #include "_acct_rtcp_hep_config.h"
 
 struct rtpp_module_priv {
    struct rtpp_sbuf *sbp;
    struct hep_ctx *ctx;
+   struct rtpp_arh_batch *batch;
 };
 
 static struct rtpp_module_priv *rtpp_acct_rtcp_hep_ctor(const struct rtpp_cfg *);
 static void rtpp_acct_rtcp_hep_dtor(struct rtpp_module_priv *);
 static void rtpp_acct_rtcp_hep_do(struct rtpp_module_priv *, struct rtpp_acct_rtcp *);
+static void rtpp_acct_rtcp_hep_batch_end(struct rtpp_module_priv *);
 static struct rtpp_module_conf *rtpp_acct_rtcp_hep_get_mconf(void);
 static int rtpp_acct_rtcp_hep_config(struct rtpp_module_priv *);
 
@@ -80,7 +83,8 @@ RTPP_MEMDEB_APP_STATIC;
 #endif
 
 static const struct rtpp_acct_handlers acct_rtcp_hep_aapi = {
-    .on_rtcp_rcvd = AAPI_FUNC(rtpp_acct_rtcp_hep_do, rtpp_acct_rtcp_OSIZE())
+    .on_rtcp_rcvd = AAPI_FUNC(rtpp_acct_rtcp_hep_do, rtpp_acct_rtcp_OSIZE()),
+    .on_batch_end = rtpp_acct_rtcp_hep_batch_end
 };
 
 struct rtpp_minfo rtpp_module = {
@@ -129,12 +133,26 @@ rtpp_acct_rtcp_hep_config(struct rtpp_module_priv *pvt)
     if (init_hepsocket(pvt->ctx) != 0) {
         return (-1);
     }
+    /*
+     * Plain UDP HEPv3 is encoded and sent in batches by the module itself,
+     * everything else goes through the hepconnector one report at a time.
+     */
+    if (rtpp_arh_batch_eligible(pvt->ctx)) {
+        pvt->batch = rtpp_arh_batch_ctor(pvt->ctx);
+        if (pvt->batch == NULL) {
+            mod_log(RTPP_LOG_ERR, "rtpp_arh_batch_ctor() failed");
+            return (-1);
+        }
+    }
     return (0);
 }
 
 static void
 rtpp_acct_rtcp_hep_dtor(struct rtpp_module_priv *pvt)
 {
+    if (pvt->batch != NULL) {
+        rtpp_arh_batch_dtor(pvt->batch);
+    }
     if (pvt->ctx->capt_host != default_ctx.capt_host && pvt->ctx->capt_host != NULL) {
         mod_free(pvt->ctx->capt_host);
     }
@@ -180,6 +198,21 @@ rtpp_acct_rtcp_hep_do(struct rtpp_module_priv *pvt, struct rtpp_acct_rtcp *rarp)
     dtime2timeval(rarp->pkt->rtime.wall, &rtimeval);
     ri.time_sec = SEC(&rtimeval);
     ri.time_usec = USEC(&rtimeval);
+
+    if (pvt->batch != NULL) {
+        rtpp_sbuf_reset(pvt->sbp);
+        rval = rtcp2json(pvt->sbp, rarp->pkt->data.buf, rarp->pkt->size);
+        if (rval < 0) {
+            mod_log(RTPP_LOG_ERR, "rtcp2json() failed: %d", rval);
+            goto out;
+        }
+        if (rtpp_arh_batch_add(pvt->batch, &ri, rarp->call_id,
+          strlen(rarp->call_id), pvt->sbp->bp, RS_ULEN(pvt->sbp)) != 0) {
+            mod_log(RTPP_LOG_ERR, "rtpp_arh_batch_add() failed");
+        }
+        goto out;
+    }
+
     if (hep_gen_fill(pvt->ctx, &ri) < 0) {
       mod_log(RTPP_LOG_ERR, "hep_gen_fill() failed");
         goto out;
@@ -207,6 +240,20 @@ out:
     return;
 }
 
+static void
+rtpp_acct_rtcp_hep_batch_end(struct rtpp_module_priv *pvt)
+{
+    int nfailed;
+
+    if (pvt->batch == NULL)
+        return;
+    nfailed = rtpp_arh_batch_flush(pvt->batch);
+    if (nfailed > 0) {
+        mod_log(RTPP_LOG_INFO, "rtpp_arh_batch_flush(): %d frames not sent",
+          nfailed);
+    }
+}
+
 static struct rtpp_module_conf *
 rtpp_acct_rtcp_hep_get_mconf(void)
 {
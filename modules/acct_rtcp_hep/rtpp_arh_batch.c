@@ -0,0 +1,389 @@
+/*
+ * Copyright (c) 2024 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#if defined(LINUX_XXX) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* sendmmsg() */
+#endif
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <netdb.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "rtpp_module.h"
+
+#include "core_hep.h"
+#include "hep_api.h"
+#include "hepconnector.h"
+
+#include "rtpp_arh_batch.h"
+
+/*
+ * Batched HEPv3 encoder and sender. Frames are encoded directly into a
+ * single flat buffer and pushed out with one sendmmsg(2) per batch, the
+ * module flushes the batch once the core is done with the current bunch
+ * of queued RTCP reports or whenever the buffer fills up.
+ */
+#define ARH_BATCH_BSIZE  (64 * 1024)
+#define ARH_BATCH_MAXF   64
+
+#define HEP3_HDR_LEN     6
+#define HEP3_CHUNK_HLEN  6
+
+#define HEP3_TID_IPFAM   0x0001
+#define HEP3_TID_IPPROTO 0x0002
+#define HEP3_TID_SRC4    0x0003
+#define HEP3_TID_DST4    0x0004
+#define HEP3_TID_SRC6    0x0005
+#define HEP3_TID_DST6    0x0006
+#define HEP3_TID_SPORT   0x0007
+#define HEP3_TID_DPORT   0x0008
+#define HEP3_TID_TSEC    0x0009
+#define HEP3_TID_TUSEC   0x000a
+#define HEP3_TID_PTYPE   0x000b
+#define HEP3_TID_CAPTID  0x000c
+#define HEP3_TID_PAYLOAD 0x000f
+#define HEP3_TID_CID     0x0011
+
+/* Longest frame header: everything except the payload and call-id data */
+#define HEP3_FIXED_MAX   (HEP3_HDR_LEN + (HEP3_CHUNK_HLEN * 12) + \
+  (sizeof(struct in6_addr) * 2) + 1 + 1 + 2 + 2 + 4 + 4 + 1 + 4)
+
+/*
+ * Per-session chunks (address family and protocol, addresses, ports and
+ * call-id) are the same for every report of a given RTCP stream, so they
+ * are kept pre-encoded in a small direct-mapped cache keyed by all of
+ * those. Call-ids longer than ARH_SCACHE_CIDMAX bypass the cache.
+ */
+#define ARH_SCACHE_SIZE  256
+#define ARH_SCACHE_CIDMAX 128
+#define HEP3_SESS_MAX    ((HEP3_CHUNK_HLEN * 7) + \
+  (sizeof(struct in6_addr) * 2) + 1 + 1 + 2 + 2 + ARH_SCACHE_CIDMAX)
+
+struct arh_sess_ent {
+    uint8_t ip_family;
+    uint8_t ip_proto;
+    uint16_t src_port;
+    uint16_t dst_port;
+    unsigned char src[sizeof(struct in6_addr)];
+    unsigned char dst[sizeof(struct in6_addr)];
+    size_t cid_len;
+    char cid[ARH_SCACHE_CIDMAX];
+    size_t blen;
+    unsigned char blob[HEP3_SESS_MAX];
+};
+
+struct rtpp_arh_batch {
+    int fd;
+    size_t blen;
+    int nframes;
+    /* Pre-encoded proto type and capture id chunks, same for every frame */
+    unsigned char tmpl[(HEP3_CHUNK_HLEN * 2) + 1 + 4];
+    size_t tmpl_len;
+#if defined(MSG_WAITFORONE)
+    struct mmsghdr mmsg[ARH_BATCH_MAXF];
+#endif
+    struct iovec iov[ARH_BATCH_MAXF];
+    unsigned char buf[ARH_BATCH_BSIZE];
+    struct arh_sess_ent scache[ARH_SCACHE_SIZE];
+};
+
+static unsigned char *
+hep3_put_hdr(unsigned char *cp, uint16_t type, size_t dlen)
+{
+    uint16_t v;
+
+    v = htons(HEP_VID_GEN);
+    memcpy(cp, &v, sizeof(v));
+    v = htons(type);
+    memcpy(cp + 2, &v, sizeof(v));
+    v = htons(HEP3_CHUNK_HLEN + dlen);
+    memcpy(cp + 4, &v, sizeof(v));
+    return (cp + HEP3_CHUNK_HLEN);
+}
+
+static unsigned char *
+hep3_put_chunk(unsigned char *cp, uint16_t type, const void *data, size_t dlen)
+{
+
+    cp = hep3_put_hdr(cp, type, dlen);
+    memcpy(cp, data, dlen);
+    return (cp + dlen);
+}
+
+static unsigned char *
+hep3_put_u8(unsigned char *cp, uint16_t type, uint8_t val)
+{
+
+    return (hep3_put_chunk(cp, type, &val, sizeof(val)));
+}
+
+static unsigned char *
+hep3_put_u16(unsigned char *cp, uint16_t type, uint16_t val)
+{
+
+    val = htons(val);
+    return (hep3_put_chunk(cp, type, &val, sizeof(val)));
+}
+
+static unsigned char *
+hep3_put_u32(unsigned char *cp, uint16_t type, uint32_t val)
+{
+
+    val = htonl(val);
+    return (hep3_put_chunk(cp, type, &val, sizeof(val)));
+}
+
+static size_t
+hep3_addr_len(const struct rc_info *ri)
+{
+
+    switch (ri->ip_family) {
+    case AF_INET:
+        return (sizeof(struct in_addr));
+
+    case AF_INET6:
+        return (sizeof(struct in6_addr));
+
+    default:
+        return (0);
+    }
+}
+
+static unsigned char *
+hep3_put_sess(unsigned char *cp, const struct rc_info *ri, size_t alen,
+  const char *cid, size_t cid_len)
+{
+
+    cp = hep3_put_u8(cp, HEP3_TID_IPFAM, ri->ip_family);
+    cp = hep3_put_u8(cp, HEP3_TID_IPPROTO, ri->ip_proto);
+    if (ri->ip_family == AF_INET) {
+        cp = hep3_put_chunk(cp, HEP3_TID_SRC4, ri->src.p4, alen);
+        cp = hep3_put_chunk(cp, HEP3_TID_DST4, ri->dst.p4, alen);
+    } else {
+        cp = hep3_put_chunk(cp, HEP3_TID_SRC6, ri->src.p6, alen);
+        cp = hep3_put_chunk(cp, HEP3_TID_DST6, ri->dst.p6, alen);
+    }
+    cp = hep3_put_u16(cp, HEP3_TID_SPORT, ri->src_port);
+    cp = hep3_put_u16(cp, HEP3_TID_DPORT, ri->dst_port);
+    cp = hep3_put_chunk(cp, HEP3_TID_CID, cid, cid_len);
+    return (cp);
+}
+
+static const struct arh_sess_ent *
+arh_scache_get(struct rtpp_arh_batch *bp, const struct rc_info *ri,
+  size_t alen, const char *cid, size_t cid_len)
+{
+    struct arh_sess_ent *ep;
+    const void *src, *dst;
+    uint32_t h;
+    size_t i;
+
+    if (cid_len > ARH_SCACHE_CIDMAX)
+        return (NULL);
+    src = (ri->ip_family == AF_INET) ? (const void *)ri->src.p4 :
+      (const void *)ri->src.p6;
+    dst = (ri->ip_family == AF_INET) ? (const void *)ri->dst.p4 :
+      (const void *)ri->dst.p6;
+    /* FNV-1a over the call-id and the ports */
+    h = 2166136261U;
+    for (i = 0; i < cid_len; i++)
+        h = (h ^ (unsigned char)cid[i]) * 16777619U;
+    h = (h ^ ri->src_port) * 16777619U;
+    h = (h ^ ri->dst_port) * 16777619U;
+    ep = &bp->scache[h % ARH_SCACHE_SIZE];
+    if (ep->blen != 0 && ep->ip_family == ri->ip_family &&
+      ep->ip_proto == ri->ip_proto && ep->src_port == ri->src_port &&
+      ep->dst_port == ri->dst_port && ep->cid_len == cid_len &&
+      memcmp(ep->src, src, alen) == 0 && memcmp(ep->dst, dst, alen) == 0 &&
+      memcmp(ep->cid, cid, cid_len) == 0)
+        return (ep);
+    ep->ip_family = ri->ip_family;
+    ep->ip_proto = ri->ip_proto;
+    ep->src_port = ri->src_port;
+    ep->dst_port = ri->dst_port;
+    memcpy(ep->src, src, alen);
+    memcpy(ep->dst, dst, alen);
+    ep->cid_len = cid_len;
+    memcpy(ep->cid, cid, cid_len);
+    ep->blen = hep3_put_sess(ep->blob, ri, alen, cid, cid_len) - ep->blob;
+    return (ep);
+}
+
+int
+rtpp_arh_batch_eligible(const struct hep_ctx *ctx)
+{
+
+    if (ctx->hep_version != 3 || ctx->usessl || ctx->pl_compress)
+        return (0);
+    if (ctx->hints->ai_socktype != SOCK_DGRAM)
+        return (0);
+    return (1);
+}
+
+struct rtpp_arh_batch *
+rtpp_arh_batch_ctor(const struct hep_ctx *ctx)
+{
+    struct rtpp_arh_batch *bp;
+    struct addrinfo *ai, *aip;
+    unsigned char *cp;
+
+    assert(rtpp_arh_batch_eligible(ctx));
+    bp = mod_zmalloc(sizeof(struct rtpp_arh_batch));
+    if (bp == NULL)
+        goto e0;
+    if (getaddrinfo(ctx->capt_host, ctx->capt_port, ctx->hints, &ai) != 0)
+        goto e1;
+    bp->fd = -1;
+    for (aip = ai; aip != NULL; aip = aip->ai_next) {
+        bp->fd = socket(aip->ai_family, aip->ai_socktype, aip->ai_protocol);
+        if (bp->fd < 0)
+            continue;
+        if (connect(bp->fd, aip->ai_addr, aip->ai_addrlen) == 0)
+            break;
+        close(bp->fd);
+        bp->fd = -1;
+    }
+    freeaddrinfo(ai);
+    if (bp->fd < 0)
+        goto e1;
+
+    cp = hep3_put_u8(bp->tmpl, HEP3_TID_PTYPE, 5 /* RTCP */);
+    cp = hep3_put_u32(cp, HEP3_TID_CAPTID, ctx->capt_id);
+    bp->tmpl_len = cp - bp->tmpl;
+    assert(bp->tmpl_len == sizeof(bp->tmpl));
+    return (bp);
+
+e1:
+    mod_free(bp);
+e0:
+    return (NULL);
+}
+
+int
+rtpp_arh_batch_add(struct rtpp_arh_batch *bp, const struct rc_info *ri,
+  const char *cid, size_t cid_len, const char *pl, size_t pl_len)
+{
+    const struct arh_sess_ent *ep;
+    unsigned char *fp, *cp;
+    size_t flen, alen;
+    uint16_t v;
+
+    alen = hep3_addr_len(ri);
+    if (alen == 0)
+        return (-1);
+    flen = HEP3_FIXED_MAX + (HEP3_CHUNK_HLEN * 2) + cid_len + pl_len;
+    if (flen > UINT16_MAX)
+        return (-1);
+    if (bp->nframes == ARH_BATCH_MAXF || bp->blen + flen > sizeof(bp->buf))
+        rtpp_arh_batch_flush(bp);
+
+    fp = cp = bp->buf + bp->blen;
+    memcpy(cp, "HEP3", 4);
+    cp += HEP3_HDR_LEN;
+    ep = arh_scache_get(bp, ri, alen, cid, cid_len);
+    if (ep != NULL) {
+        memcpy(cp, ep->blob, ep->blen);
+        cp += ep->blen;
+    } else {
+        cp = hep3_put_sess(cp, ri, alen, cid, cid_len);
+    }
+    cp = hep3_put_u32(cp, HEP3_TID_TSEC, ri->time_sec);
+    cp = hep3_put_u32(cp, HEP3_TID_TUSEC, ri->time_usec);
+    memcpy(cp, bp->tmpl, bp->tmpl_len);
+    cp += bp->tmpl_len;
+    cp = hep3_put_chunk(cp, HEP3_TID_PAYLOAD, pl, pl_len);
+
+    flen = cp - fp;
+    v = htons(flen);
+    memcpy(fp + 4, &v, sizeof(v));
+    bp->iov[bp->nframes].iov_base = fp;
+    bp->iov[bp->nframes].iov_len = flen;
+    bp->nframes += 1;
+    bp->blen += flen;
+    return (0);
+}
+
+/*
+ * Returns number of frames that could not be sent, frames are never
+ * retried since the HEP collector is a best-effort consumer anyway.
+ */
+int
+rtpp_arh_batch_flush(struct rtpp_arh_batch *bp)
+{
+    int i, nsent, nfailed;
+
+    nfailed = 0;
+#if defined(MSG_WAITFORONE)
+    for (i = 0; i < bp->nframes; i++) {
+        memset(&bp->mmsg[i].msg_hdr, '\0', sizeof(bp->mmsg[i].msg_hdr));
+        bp->mmsg[i].msg_hdr.msg_iov = &bp->iov[i];
+        bp->mmsg[i].msg_hdr.msg_iovlen = 1;
+    }
+    for (i = 0; i < bp->nframes; i += nsent) {
+        nsent = sendmmsg(bp->fd, &bp->mmsg[i], bp->nframes - i, 0);
+        if (nsent <= 0) {
+            if (nsent < 0 && errno == EINTR) {
+                nsent = 0;
+                continue;
+            }
+            /* Skip the offending frame and carry on with the rest */
+            nfailed += 1;
+            nsent = 1;
+        }
+    }
+#else
+    for (i = 0; i < bp->nframes; i++) {
+        do {
+            nsent = send(bp->fd, bp->iov[i].iov_base, bp->iov[i].iov_len, 0);
+        } while (nsent < 0 && errno == EINTR);
+        if (nsent < 0)
+            nfailed += 1;
+    }
+#endif
+    bp->nframes = 0;
+    bp->blen = 0;
+    return (nfailed);
+}
+
+void
+rtpp_arh_batch_dtor(struct rtpp_arh_batch *bp)
+{
+
+    rtpp_arh_batch_flush(bp);
+    close(bp->fd);
+    mod_free(bp);
+}
@@ -104,6 +104,53 @@ rtpp_sbuf_extend(struct rtpp_sbuf *sbp, int nlen)
      return (0);
 }
 
+int
+rtpp_sbuf_reserve(struct rtpp_sbuf *sbp, int len)
+{
+    int nlen;
+
+    if (sbp->alen - RS_ULEN(sbp) > len)
+        return (0);
+    for (nlen = sbp->alen * 2; nlen - RS_ULEN(sbp) <= len; nlen *= 2)
+        continue;
+    return (rtpp_sbuf_extend(sbp, nlen));
+}
+
+void
+rtpp_sbuf_append(struct rtpp_sbuf *sbp, const char *s, int len)
+{
+
+    assert(sbp->alen - RS_ULEN(sbp) > len);
+    memcpy(sbp->cp, s, len);
+    sbp->cp += len;
+    sbp->cp[0] = '\0';
+}
+
+void
+rtpp_sbuf_append_ul(struct rtpp_sbuf *sbp, unsigned long val)
+{
+    char tbuf[sizeof(val) * 3], *tcp;
+
+    tcp = tbuf + sizeof(tbuf);
+    do {
+        *--tcp = '0' + (val % 10);
+        val /= 10;
+    } while (val != 0);
+    rtpp_sbuf_append(sbp, tcp, tbuf + sizeof(tbuf) - tcp);
+}
+
+void
+rtpp_sbuf_append_l(struct rtpp_sbuf *sbp, long val)
+{
+
+    if (val < 0) {
+        RS_APPEND_LIT(sbp, "-");
+        rtpp_sbuf_append_ul(sbp, -(unsigned long)val);
+        return;
+    }
+    rtpp_sbuf_append_ul(sbp, val);
+}
+
 #if defined(rtpp_sbuf_selftest)
 #include <stdint.h>
 #include "rtpp_memdeb_internal.h"
@@ -173,6 +220,20 @@ rtpp_sbuf_selftest(void)
     errx_ifnot(sbp->cp == sbp->bp);
     errx_ifnot(sbp->cp[0] == '\0');
     errx_ifnot(sbp->alen == rval + 1);
+    errx_ifnot(rtpp_sbuf_reserve(sbp, 2) == 0);
+    errx_ifnot(sbp->alen == rval + 1);
+    errx_ifnot(rtpp_sbuf_reserve(sbp, rval * 3) == 0);
+    errx_ifnot(sbp->alen > rval * 3);
+    RS_APPEND_LIT(sbp, "x=");
+    rtpp_sbuf_append_ul(sbp, 0);
+    RS_APPEND_LIT(sbp, ",");
+    rtpp_sbuf_append_ul(sbp, 4294967295UL);
+    RS_APPEND_LIT(sbp, ",");
+    rtpp_sbuf_append_l(sbp, -1);
+    RS_APPEND_LIT(sbp, ",");
+    rtpp_sbuf_append_l(sbp, 8388607);
+    errx_ifnot(strcmp(sbp->bp, "x=0,4294967295,-1,8388607") == 0);
+    errx_ifnot(RS_ULEN(sbp) == 25);
     rtpp_sbuf_dtor(sbp);
 
     rval = rtpp_memdeb_dumpstats(MEMDEB_SYM, 0);
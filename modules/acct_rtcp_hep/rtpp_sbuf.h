@@ -37,8 +37,19 @@ struct rtpp_sbuf {
 
 #define RS_ULEN(sbp) ((int)((sbp)->cp - (sbp)->bp))
 
+/*
+ * The rtpp_sbuf_append*() family does no formatting and no bounds
+ * checking, the caller is expected to rtpp_sbuf_reserve() enough space
+ * upfront.
+ */
+#define RS_APPEND_LIT(sbp, lit) rtpp_sbuf_append((sbp), (lit), sizeof(lit) - 1)
+
 int rtpp_sbuf_write(struct rtpp_sbuf *sbp, const char *format, ...) __attribute__ ((format (printf, 2, 3)));
 struct rtpp_sbuf *rtpp_sbuf_ctor(int ilen);
 void rtpp_sbuf_dtor(struct rtpp_sbuf *sbp);
 int rtpp_sbuf_extend(struct rtpp_sbuf *sbp, int nlen);
 void rtpp_sbuf_reset(struct rtpp_sbuf *sbp);
+int rtpp_sbuf_reserve(struct rtpp_sbuf *sbp, int len);
+void rtpp_sbuf_append(struct rtpp_sbuf *sbp, const char *s, int len);
+void rtpp_sbuf_append_ul(struct rtpp_sbuf *sbp, unsigned long val);
+void rtpp_sbuf_append_l(struct rtpp_sbuf *sbp, long val);
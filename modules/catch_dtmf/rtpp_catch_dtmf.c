@@ -66,8 +66,13 @@
 #include "advanced/packet_observer.h"
 #include "advanced/po_manager.h"
 
+#define CATCH_DTMF_BATCH 32
+
 struct rtpp_module_priv {
     struct rtpp_notify *notifier;
+    /* Work items collected by the forwarding thread since the last flush */
+    struct rtpp_wi *batch[CATCH_DTMF_BATCH];
+    int nbatch;
 };
 
 struct catch_dtmf_einfo {
@@ -366,8 +371,7 @@ rtp_packet_is_dtmf(struct po_mgr_pkt_ctx *pktx)
     struct rtpp_refcnt *rtps_cnt;
     _Atomic(struct rtpp_refcnt *) *catch_dtmf_datap;
 
-    if (pktx->strmp->pipe_type != PIPE_RTP)
-        return (0);
+    RTPP_DBG_ASSERT(pktx->strmp->pipe_type == PIPE_RTP);
     RTPP_DBG_ASSERT(rtpp_module.ids->module_idx < pktx->strmp->pmod_datap->nmodules);
     catch_dtmf_datap = &(pktx->strmp->pmod_datap->adp[rtpp_module.ids->module_idx]);
     rtps_cnt = atomic_load(catch_dtmf_datap);
@@ -381,15 +385,25 @@ rtp_packet_is_dtmf(struct po_mgr_pkt_ctx *pktx)
     return (1);
 }
 
+static void
+rtpp_catch_dtmf_flush(void *arg)
+{
+    struct rtpp_module_priv *pvt;
+
+    pvt = (struct rtpp_module_priv *)arg;
+    rtpp_queue_put_items(pvt->batch, pvt->nbatch, rtpp_module.wthr.mod_q);
+    pvt->nbatch = 0;
+}
+
 static void
 rtpp_catch_dtmf_enqueue(void *arg, const struct po_mgr_pkt_ctx *pktx)
 {
-    struct rtpp_catch_dtmf_pvt *pvt;
+    struct rtpp_module_priv *pvt;
     struct rtpp_wi *wi;
     struct wipkt *wip;
     struct catch_dtmf_stream_cfg *rtps_c;
 
-    pvt = (struct rtpp_catch_dtmf_pvt *)arg;
+    pvt = (struct rtpp_module_priv *)arg;
     rtps_c = (struct catch_dtmf_stream_cfg *)pktx->auxp;
     /* we duplicate the tag to make sure it does not vanish */
     wi = rtpp_wi_malloc_udata((void **)&wip, sizeof(struct wipkt));
@@ -402,7 +416,9 @@ rtpp_catch_dtmf_enqueue(void *arg, const struct po_mgr_pkt_ctx *pktx)
     wip->pkt = pktx->pktp;
     RTPP_OBJ_INCREF(rtps_c->rtdp);
     wip->rtdp = rtps_c->rtdp;
-    rtpp_queue_put_item(wi, rtpp_module.wthr.mod_q);
+    pvt->batch[pvt->nbatch++] = wi;
+    if (pvt->nbatch == CATCH_DTMF_BATCH)
+        rtpp_catch_dtmf_flush(pvt);
 }
 
 static struct rtpp_module_priv *
@@ -419,6 +435,9 @@ rtpp_catch_dtmf_ctor(const struct rtpp_cfg *cfsp)
     memset(&dtmf_poi, '\0', sizeof(dtmf_poi));
     dtmf_poi.taste = rtp_packet_is_dtmf;
     dtmf_poi.enqueue = rtpp_catch_dtmf_enqueue;
+    dtmf_poi.flush = rtpp_catch_dtmf_flush;
+    dtmf_poi.pipes = PO_PIPE(PIPE_RTP);
+    dtmf_poi.modids = rtpp_module.ids;
     dtmf_poi.arg = pvt;
     if (CALL_METHOD(cfsp->observers, reg, &dtmf_poi) < 0)
         goto e1;
@@ -433,7 +452,18 @@ e0:
 static void
 rtpp_catch_dtmf_dtor(struct rtpp_module_priv *pvt)
 {
+    int i;
 
+    /* Whatever was not flushed before the shutdown */
+    for (i = 0; i < pvt->nbatch; i++) {
+        struct wipkt *wip;
+
+        wip = rtpp_wi_data_get_ptr(pvt->batch[i], sizeof(*wip), sizeof(*wip));
+        RTPP_OBJ_DECREF(wip->edata);
+        RTPP_OBJ_DECREF(wip->rtdp);
+        RTPP_OBJ_DECREF(wip->pkt);
+        CALL_METHOD(pvt->batch[i], dtor);
+    }
     mod_free(pvt);
     return;
 }
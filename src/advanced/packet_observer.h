@@ -27,14 +27,33 @@
 
 struct packet_observer_if;
 struct po_mgr_pkt_ctx;
+struct rtpp_modids;
 
 DEFINE_RAW_METHOD(po_taste, int, struct po_mgr_pkt_ctx *);
 DEFINE_RAW_METHOD(po_enqueue, void, void *, const struct po_mgr_pkt_ctx *);
+DEFINE_RAW_METHOD(po_flush, void, void *);
 DEFINE_RAW_METHOD(po_control, void);
 
+/* Bits for the packet_observer_if.pipes, 0 stands for "all" */
+#define PO_PIPE(t)      (1U << (t))
+
+/*
+ * The po_manager checks the "pipes" and "modids" filters before calling
+ * into taste(), so that packets that cannot possibly be of interest never
+ * leave the manager. If the "modids" is set, only streams that have per-module
+ * data attached for that module are tasted.
+ *
+ * The enqueue() and flush() are only ever called from the forwarding thread,
+ * the observer is free to accumulate packets in its own batch in enqueue()
+ * and hand them over to the worker in one go when flush() is called at the
+ * end of each processing pass.
+ */
 struct packet_observer_if {
     void *arg;
     po_taste_t taste;
     po_enqueue_t enqueue;
+    po_flush_t flush;
     po_control_t control;
+    unsigned int pipes;
+    const struct rtpp_modids *modids;
 };
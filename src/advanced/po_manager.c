@@ -25,25 +25,46 @@
  *
  */
 
+#include <stdatomic.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 #include "rtpp_types.h"
+#include "rtpp_debug.h"
 #include "rtpp_mallocs.h"
 #include "rtpp_refcnt.h"
+#include "rtpp_module.h"
+#include "rtpp_pipe.h"
+#include "rtpp_stream.h"
 
 #include "advanced/po_manager.h"
 #include "advanced/packet_observer.h"
 
 #define MAX_OBSERVERS 4
 
+/*
+ * List of observers interested in a particular pipe type, built once when
+ * observer is registered so that the per-packet path does not have to
+ * look at the ones that would reject the packet anyway.
+ */
+struct po_mgr_olist {
+    int len;
+    unsigned char idx[MAX_OBSERVERS];
+};
+
 struct po_manager_pvt {
     struct po_manager pub;
     struct packet_observer_if observers[MAX_OBSERVERS + 1];
+    int nobservers;
+    struct po_mgr_olist bypipe[PIPE_RTCP + 1];
+    /* Observers that had something enqueued since the last flush */
+    unsigned int pending;
 };
 
 static int rtpp_po_mgr_register(struct po_manager *, const struct packet_observer_if *);
 static void rtpp_po_mgr_observe(struct po_manager *, struct po_mgr_pkt_ctx *);
+static void rtpp_po_mgr_flush(struct po_manager *);
 
 static void
 rtpp_po_mgr_dtor(struct po_manager_pvt *pvt)
@@ -62,6 +83,7 @@ rtpp_po_mgr_ctor(void)
         return (NULL);
     pvt->pub.reg = rtpp_po_mgr_register;
     pvt->pub.observe = rtpp_po_mgr_observe;
+    pvt->pub.flush = rtpp_po_mgr_flush;
     CALL_SMETHOD(pvt->pub.rcnt, attach, (rtpp_refcnt_dtor_t)&rtpp_po_mgr_dtor,
       pvt);
     return (&(pvt->pub));
@@ -70,35 +92,72 @@ rtpp_po_mgr_ctor(void)
 static int
 rtpp_po_mgr_register(struct po_manager *pub, const struct packet_observer_if *ip)
 {
-    int i;
+    int i, pt;
     struct po_manager_pvt *pvt;
+    struct po_mgr_olist *olp;
 
     PUB2PVT(pub, pvt);
-    for (i = 0; i < MAX_OBSERVERS; i++)
-        if (pvt->observers[i].taste == NULL)
-            break;
+    i = pvt->nobservers;
     if (i >= MAX_OBSERVERS)
         return (-1);
     pvt->observers[i] = *ip;
+    pvt->nobservers += 1;
+    for (pt = PIPE_RTP; pt <= PIPE_RTCP; pt++) {
+        if (ip->pipes != 0 && (ip->pipes & PO_PIPE(pt)) == 0)
+            continue;
+        olp = &pvt->bypipe[pt];
+        olp->idx[olp->len] = i;
+        olp->len += 1;
+    }
     return (0);
 }
 
+static int
+po_mgr_has_mdata(const struct rtpp_stream *strmp, const struct rtpp_modids *mip)
+{
+
+    RTPP_DBG_ASSERT(mip->module_idx < strmp->pmod_datap->nmodules);
+    return (atomic_load_explicit(&(strmp->pmod_datap->adp[mip->module_idx]),
+      memory_order_relaxed) != NULL);
+}
+
 static void
 rtpp_po_mgr_observe(struct po_manager *pub, struct po_mgr_pkt_ctx *pktxp)
+{
+    int i;
+    struct po_manager_pvt *pvt;
+    const struct po_mgr_olist *olp;
+    const struct packet_observer_if *op;
+
+    PUB2PVT(pub, pvt);
+    RTPP_DBG_ASSERT(pktxp->strmp->pipe_type == PIPE_RTP ||
+      pktxp->strmp->pipe_type == PIPE_RTCP);
+    olp = &pvt->bypipe[pktxp->strmp->pipe_type];
+    for (i = 0; i < olp->len; i++) {
+        op = &pvt->observers[olp->idx[i]];
+        if (op->modids != NULL && !po_mgr_has_mdata(pktxp->strmp, op->modids))
+            continue;
+        /* Clean after use */
+        pktxp->auxp = NULL;
+        if (op->taste(pktxp) == 0)
+            continue;
+        op->enqueue(op->arg, pktxp);
+        if (op->flush != NULL)
+            pvt->pending |= 1U << olp->idx[i];
+    }
+}
+
+static void
+rtpp_po_mgr_flush(struct po_manager *pub)
 {
     int i;
     struct po_manager_pvt *pvt;
 
     PUB2PVT(pub, pvt);
-    for (i = 0; i < MAX_OBSERVERS; i++) {
-        if (pvt->observers[i].taste == NULL)
-            break;
-        if (i > 0) {
-            /* Clean after use */
-            pktxp->auxp = NULL;
-        }
-        if (pvt->observers[i].taste(pktxp) == 0)
+    for (i = 0; pvt->pending != 0; i++) {
+        if ((pvt->pending & (1U << i)) == 0)
             continue;
-        pvt->observers[i].enqueue(pvt->observers[i].arg, pktxp);
+        pvt->pending &= ~(1U << i);
+        pvt->observers[i].flush(pvt->observers[i].arg);
     }
 }
@@ -40,11 +40,13 @@ struct po_mgr_pkt_ctx {
 
 DEFINE_METHOD(po_manager, po_manager_reg, int, const struct packet_observer_if *);
 DEFINE_METHOD(po_manager, po_manager_observe, void, struct po_mgr_pkt_ctx *);
+DEFINE_METHOD(po_manager, po_manager_flush, void);
 
 struct po_manager {
     struct rtpp_refcnt *rcnt;
     po_manager_reg_t reg;
     po_manager_observe_t observe;
+    po_manager_flush_t flush;
 };
 
 struct po_manager *rtpp_po_mgr_ctor(void);
@@ -27,8 +27,11 @@
 
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <errno.h>
+#include <limits.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "config.h"
@@ -36,6 +39,7 @@
 #include "rtpp_ssrc.h"
 #include "rtpa_stats.h"
 #include "rtpp_log.h"
+#include "rtpp_cfg.h"
 #include "rtpp_types.h"
 #include "rtpp_log_obj.h"
 #include "rtpp_analyzer.h"
@@ -49,6 +53,9 @@
 #include "rtpp_pcnt_strm.h"
 #include "rtpp_pcnts_strm.h"
 #include "rtpp_pipe.h"
+#include "rtpp_hash_table.h"
+#include "rtpp_refcnt.h"
+#include "rtpp_session.h"
 #include "rtpp_stream.h"
 #include "rtpp_util.h"
 #include "commands/rpcpv1_query.h"
@@ -212,3 +219,200 @@ handle_query(const struct rtpp_cfg *cfsp, struct rtpp_command *cmd,
     rtpc_doreply(cmd, cmd->buf_t, len, 0);
     return (0);
 }
+
+struct query_all_args {
+    const char *cid_pfx;
+    size_t cid_pfx_len;
+    struct rtpp_session **spp;
+    int nsp;
+    int asp;
+    int nomem;
+};
+
+/*
+ * Runs with the sessions table locked, so only do the cheap Call-ID
+ * filtering here and grab a reference to each matching session, the rest
+ * is done on the snapshot after the lock is released.
+ */
+static int
+query_all_snap(void *dp, void *ap)
+{
+    struct rtpp_session *sp;
+    struct query_all_args *qap;
+    struct rtpp_session **tspp;
+
+    sp = (struct rtpp_session *)dp;
+    qap = (struct query_all_args *)ap;
+    if (qap->cid_pfx != NULL &&
+      strncmp(sp->call_id, qap->cid_pfx, qap->cid_pfx_len) != 0) {
+        return (RTPP_HT_MATCH_CONT);
+    }
+    if (qap->nsp == qap->asp) {
+        tspp = realloc(qap->spp, sizeof(qap->spp[0]) * (qap->asp * 2));
+        if (tspp == NULL) {
+            qap->nomem = 1;
+            return (RTPP_HT_MATCH_BRK);
+        }
+        qap->spp = tspp;
+        qap->asp *= 2;
+    }
+    RTPP_OBJ_INCREF(sp);
+    qap->spp[qap->nsp] = sp;
+    qap->nsp += 1;
+    return (RTPP_HT_MATCH_CONT);
+}
+
+static int
+query_all_fmt(char *buf, size_t blen, struct rtpp_session *sp, int age,
+  int verbose)
+{
+    int ttl;
+    struct rtpps_pcount pcnts;
+    struct rtpp_pcnts_strm pst[2];
+    struct rtpp_pipe *spp;
+
+    spp = sp->rtp;
+    ttl = CALL_METHOD(spp, get_ttl);
+    CALL_METHOD(spp->pcount, get_stats, &pcnts);
+    CALL_METHOD(spp->stream[0]->pcnt_strm, get_stats, &pst[0]);
+    CALL_METHOD(spp->stream[1]->pcnt_strm, get_stats, &pst[1]);
+    if (verbose == 0) {
+        return (snprintf(buf, blen, "%s %s %d %d %lu %lu %lu %lu\n",
+          sp->call_id, sp->tag, age, ttl, pst[0].npkts_in, pst[1].npkts_in,
+          pcnts.nrelayed, pcnts.ndropped));
+    }
+    return (snprintf(buf, blen, "call_id=%s tag=%s age=%d ttl=%d "
+      "npkts_ina=%lu npkts_ino=%lu nrelayed=%lu ndropped=%lu\n", sp->call_id,
+      sp->tag, age, ttl, pst[0].npkts_in, pst[1].npkts_in, pcnts.nrelayed,
+      pcnts.ndropped));
+}
+
+static int
+query_all_getarg(const char *cp, int *vp)
+{
+    long v;
+    char *ep;
+
+    errno = 0;
+    v = strtol(cp, &ep, 10);
+    if (ep == cp || *ep != '\0' || errno != 0 || v < 0 || v > INT_MAX)
+        return (-1);
+    *vp = (int)v;
+    return (0);
+}
+
+/*
+ * QA[v] [cid=call_id_prefix] [age=min_age] [ttl=max_ttl]
+ *
+ * Dump statistics for all sessions matching the filters, one line per
+ * session in the same format as the Q command prefixed with Call-ID, tag
+ * and age of the session, terminated with an empty line. Output is
+ * produced incrementally, hence only available on stream control sockets.
+ */
+int
+handle_query_all(const struct rtpp_cfg *cfsp, struct rtpp_command *cmd)
+{
+    struct query_all_args qa;
+    char *cp;
+    char buf[1024 * 8];
+    int i, len, rlen, verbose, min_age, max_ttl, age, rval;
+    struct rtpp_session *sp;
+
+    verbose = 0;
+    for (cp = cmd->args.v[0] + 2; *cp != '\0'; cp++) {
+        switch (*cp) {
+        case 'v':
+        case 'V':
+            verbose = 1;
+            break;
+
+        default:
+            RTPP_LOG(cmd->glog, RTPP_LOG_ERR,
+              "QUERY_ALL: unknown command modifier `%c'", *cp);
+            return (ECODE_PARSE_8);
+        }
+    }
+    if (!rtpc_can_stream(cmd)) {
+        RTPP_LOG(cmd->glog, RTPP_LOG_ERR,
+          "QUERY_ALL: not supported on datagram control sockets");
+        return (ECODE_QRYFAIL);
+    }
+    memset(&qa, '\0', sizeof(qa));
+    min_age = 0;
+    max_ttl = -1;
+    for (i = 1; i < cmd->args.c; i++) {
+        cp = cmd->args.v[i];
+        if (strncmp(cp, "cid=", 4) == 0 && cp[4] != '\0') {
+            qa.cid_pfx = cp + 4;
+            qa.cid_pfx_len = strlen(qa.cid_pfx);
+            continue;
+        }
+        if (strncmp(cp, "age=", 4) == 0) {
+            if (query_all_getarg(cp + 4, &min_age) == 0)
+                continue;
+        } else if (strncmp(cp, "ttl=", 4) == 0) {
+            if (query_all_getarg(cp + 4, &max_ttl) == 0)
+                continue;
+        }
+        RTPP_LOG(cmd->glog, RTPP_LOG_ERR,
+          "QUERY_ALL: invalid filter `%s'", cp);
+        return (ECODE_INVLARG_1);
+    }
+
+    qa.asp = CALL_METHOD(cfsp->sessions_ht, get_length) + 16;
+    qa.spp = malloc(sizeof(qa.spp[0]) * qa.asp);
+    if (qa.spp == NULL) {
+        return (ECODE_NOMEM_1);
+    }
+    CALL_METHOD(cfsp->sessions_ht, foreach, query_all_snap, &qa);
+    if (qa.nomem != 0) {
+        RTPP_LOG(cmd->glog, RTPP_LOG_ERR,
+          "QUERY_ALL: can't allocate memory for the sessions snapshot");
+        for (i = 0; i < qa.nsp; i++) {
+            RTPP_OBJ_DECREF(qa.spp[i]);
+        }
+        free(qa.spp);
+        return (ECODE_NOMEM_2);
+    }
+
+    rval = 0;
+    len = 0;
+    for (i = 0; i < qa.nsp; i++) {
+        sp = qa.spp[i];
+        age = (int)(cmd->dtime->mono - sp->init_ts->mono);
+        if (age < min_age)
+            goto next;
+        if (max_ttl >= 0 && CALL_METHOD(sp->rtp, get_ttl) > max_ttl)
+            goto next;
+        rlen = query_all_fmt(buf + len, sizeof(buf) - len, sp, age, verbose);
+        if (rlen >= (int)(sizeof(buf) - len) && len > 0) {
+            if (rtpc_doreply_part(cmd, buf, len) != 0) {
+                rval = -1;
+                goto next;
+            }
+            len = 0;
+            rlen = query_all_fmt(buf, sizeof(buf), sp, age, verbose);
+        }
+        if (rlen >= (int)sizeof(buf)) {
+            RTPP_LOG(sp->log, RTPP_LOG_ERR, "QUERY_ALL: output buffer overflow");
+            goto next;
+        }
+        len += rlen;
+next:
+        RTPP_OBJ_DECREF(sp);
+        if (rval != 0) {
+            for (i += 1; i < qa.nsp; i++) {
+                RTPP_OBJ_DECREF(qa.spp[i]);
+            }
+            break;
+        }
+    }
+    free(qa.spp);
+    if (rval != 0) {
+        /* Peer is gone or not reading, nothing to reply to */
+        return (0);
+    }
+    buf[len++] = '\n';
+    rtpc_doreply(cmd, buf, len, 0);
+    return (0);
+}
@@ -26,8 +26,10 @@
  */
 
 #define RTPP_QUERY_NSTATS    5
+#define RTPP_QUERY_ALL_NFILTS 3
 
 struct rtpp_pipe;
 
 int handle_query(const struct rtpp_cfg *, struct rtpp_command *,
   struct rtpp_pipe *, int);
+int handle_query_all(const struct rtpp_cfg *, struct rtpp_command *);
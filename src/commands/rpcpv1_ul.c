@@ -508,10 +508,7 @@ rtpp_command_ul_handle(const struct rtpp_cfg *cfsp, struct rtpp_command *cmd, in
             reply_error(cmd, ECODE_SLOWSHTDN);
             goto err_undo_0;
         }
-        if (cfsp->overload_prot.ecode != 0 &&
-          CALL_METHOD(cfsp->rtpp_cmd_cf, chk_overload) != 0) {
-            RTPP_LOG(cmd->glog, RTPP_LOG_ERR,
-              "proxy is overloaded, new session rejected");
+        if (rtpc_ovl_shed(cfsp, cmd, OVL_NEWSESS)) {
             reply_error(cmd, cfsp->overload_prot.ecode);
             goto err_undo_0;
         }
@@ -657,7 +654,10 @@ rtpp_command_ul_handle(const struct rtpp_cfg *cfsp, struct rtpp_command *cmd, in
             ulop->reply.ia_ov = cfsp->advaddr[0];
         }
     }
-    if (ulop->after_success.handler != NULL) {
+    if (ulop->after_success.handler != NULL &&
+      rtpc_ovl_shed(cfsp, cmd, OVL_OBSRVS)) {
+        ulop->reply.subc_res = cfsp->overload_prot.ecode;
+    } else if (ulop->after_success.handler != NULL) {
         struct rtpp_subc_ctx rsc = {.sessp = spa, .strmp = spa->rtp->stream[pidx],
           .subc_args = &(cmd->subc_args)};
         ulop->reply.subc_res = ulop->after_success.handler(ulop->after_success.arg, &rsc);
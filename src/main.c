@@ -87,9 +87,11 @@
 #include "rtpp_port_table.h"
 #include "rtpp_proc_async.h"
 #include "rtpp_proc_ttl.h"
+#include "rtpp_proc_servers.h"
 #include "rtpp_bindaddrs.h"
 #include "rtpp_network.h"
 #include "rtpp_notify.h"
+#include "rtpp_record.h"
 #include "rtpp_math.h"
 #include "rtpp_mallocs.h"
 #include "rtpp_list.h"
@@ -98,6 +100,10 @@
 #include "rtpp_modman.h"
 #endif
 #include "rtpp_stats.h"
+#include "rtpp_stats_shm.h"
+#include "rtpp_metrics.h"
+#include "rtpp_netio_async.h"
+#include "rtpp_ovl.h"
 #include "rtpp_sessinfo.h"
 #include "rtpp_time.h"
 #include "rtpp_timed.h"
@@ -122,6 +128,7 @@
 #endif
 
 #define PRIO_UNSET (PRIO_MIN - 1)
+#define RCACHE_MEM_DEF 64
 
 static void usage(void);
 
@@ -225,6 +232,11 @@ rtpp_rlim_max(const struct rtpp_cfg *cfsp)
 #define LOPT_OVL_PROT 259
 #define LOPT_CONFIG   260
 #define LOPT_FORC_ASM 261
+#define LOPT_REC_SPL  262
+#define LOPT_REC_IDX  263
+#define LOPT_STATS_SHM 264
+#define LOPT_METRICS  265
+#define LOPT_RCACHE_MEM 266
 
 const static struct option longopts[] = {
     { "dso", required_argument, NULL, LOPT_DSO },
@@ -233,6 +245,11 @@ const static struct option longopts[] = {
     { "overload_prot", optional_argument, NULL, LOPT_OVL_PROT },
     { "config", required_argument, NULL, LOPT_CONFIG },
     { "force_asymmetric", no_argument, NULL, LOPT_FORC_ASM },
+    { "record_spool", no_argument, NULL, LOPT_REC_SPL },
+    { "record_index", no_argument, NULL, LOPT_REC_IDX },
+    { "stats_shm", required_argument, NULL, LOPT_STATS_SHM },
+    { "metrics_sock", required_argument, NULL, LOPT_METRICS },
+    { "rcache_mem", required_argument, NULL, LOPT_RCACHE_MEM },
     { NULL,  0,                 NULL, 0 }
 };
 
@@ -299,6 +316,7 @@ init_config(struct rtpp_cfg *cfsp, int argc, char **argv)
     cfsp->sched_hz = rtpp_get_sched_hz();
     cfsp->sched_policy = SCHED_OTHER;
     cfsp->sched_nice = PRIO_UNSET;
+    cfsp->rcache_mem = RCACHE_MEM_DEF;
     cfsp->target_pfreq = MIN(POLL_RATE, cfsp->sched_hz);
     RTPP_DBGCODE() {
         if (cfsp->target_pfreq != cfsp->sched_hz)
@@ -375,11 +393,16 @@ init_config(struct rtpp_cfg *cfsp, int argc, char **argv)
             break;
 
         case LOPT_OVL_PROT:
-            cfsp->overload_prot.low_trs = 0.85;
-            cfsp->overload_prot.high_trs = 0.90;
+            rtpp_ovl_setdefaults(&cfsp->overload_prot);
             cfsp->overload_prot.ecode = ECODE_OVERLOAD;
             break;
 
+        case LOPT_RCACHE_MEM:
+            if (atoi_saferange(optarg, &cfsp->rcache_mem, 1, 65535))
+                errx(1, "%s: reply cache memory limit argument is invalid",
+                  optarg);
+            break;
+
         case LOPT_CONFIG:
             cfsp->cfile = optarg;
             break;
@@ -388,6 +411,31 @@ init_config(struct rtpp_cfg *cfsp, int argc, char **argv)
             cfsp->aforce = 1;
             break;
 
+        case LOPT_REC_SPL:
+            cfsp->record_spool = 1;
+            break;
+
+        case LOPT_REC_IDX:
+            cfsp->record_index = 1;
+            break;
+
+        case LOPT_STATS_SHM:
+            cfsp->stats_shm = optarg;
+            break;
+
+        case LOPT_METRICS:
+            cfsp->metrics_sock = rtpp_ctrl_sock_parse(optarg);
+            if (cfsp->metrics_sock == NULL) {
+                errx(1, "can't parse metrics socket argument");
+            }
+            if (cfsp->metrics_sock->type != RTPC_IFSUN &&
+              cfsp->metrics_sock->type != RTPC_TCP4 &&
+              cfsp->metrics_sock->type != RTPC_TCP6) {
+                errx(1, "%s: metrics socket should be unix:, tcp: or tcp6:",
+                  optarg);
+            }
+            break;
+
         case 'c':
             if (strcmp(optarg, "fifo") == 0) {
                  cfsp->sched_policy = SCHED_FIFO;
@@ -685,6 +733,12 @@ init_config(struct rtpp_cfg *cfsp, int argc, char **argv)
     if (cfsp->rdir == NULL && cfsp->sdir != NULL)
 	errx(1, "-S switch requires -r switch");
 
+    if (cfsp->rdir == NULL && cfsp->record_spool != 0)
+	errx(1, "--record_spool switch requires -r switch");
+
+    if (cfsp->rdir == NULL && cfsp->record_index != 0)
+	errx(1, "--record_index switch requires -r switch");
+
     if (cfsp->nodaemon == 0 && stdio_mode != 0)
         errx(1, "stdio command mode requires -f switch");
 
@@ -771,13 +825,35 @@ init_config(struct rtpp_cfg *cfsp, int argc, char **argv)
     }
 }
 
+static void
+update_shm_gauges(const struct rtpp_cfg *cfsp)
+{
+    struct rtpp_stats_shm_gauges g;
+    int i, nqlens, qlens[RTPP_STATS_SHM_NSNDRS];
+
+    memset(&g, '\0', sizeof(g));
+    if (cfsp->rtpp_cmd_cf != NULL)
+        g.cmd_aload = CALL_METHOD(cfsp->rtpp_cmd_cf, get_aload);
+    if (cfsp->rtpp_proc_cf != NULL) {
+        g.proc_aload = CALL_METHOD(cfsp->rtpp_proc_cf, get_aload);
+        nqlens = rtpp_anetio_get_qlens(cfsp->rtpp_proc_cf->netio, qlens,
+          RTPP_STATS_SHM_NSNDRS);
+        for (i = 0; i < nqlens; i++)
+            g.sndr_qlen[i] = qlens[i];
+        g.nsndrs = nqlens;
+    }
+    CALL_SMETHOD(cfsp->rtpp_stats, set_gauges, &g);
+}
+
 static enum rtpp_timed_cb_rvals
 update_derived_stats(double dtime, void *argp)
 {
-    struct rtpp_stats *rtpp_stats;
+    const struct rtpp_cfg *cfsp;
 
-    rtpp_stats = (struct rtpp_stats *)argp;
-    CALL_SMETHOD(rtpp_stats, update_derived, dtime);
+    cfsp = (const struct rtpp_cfg *)argp;
+    if (cfsp->stats_shm != NULL)
+        update_shm_gauges(cfsp);
+    CALL_SMETHOD(cfsp->rtpp_stats, update_derived, dtime);
     return (CB_MORE);
 }
 
@@ -874,6 +950,11 @@ main(int argc, char **argv)
         err(1, "can't allocate memory for the servers weakref table");
          /* NOTREACHED */
     }
+    cfs.proc_servers = rtpp_proc_servers_ctor();
+    if (cfs.proc_servers == NULL) {
+        err(1, "can't allocate memory for the players scheduler");
+         /* NOTREACHED */
+    }
     cfs.sessinfo = rtpp_sessinfo_ctor(&cfs);
     if (cfs.sessinfo == NULL) {
         errx(1, "cannot construct rtpp_sessinfo structure");
@@ -884,6 +965,11 @@ main(int argc, char **argv)
         err(1, "can't allocate memory for the stats data");
          /* NOTREACHED */
     }
+    if (cfs.stats_shm != NULL &&
+      CALL_SMETHOD(cfs.rtpp_stats, shm_attach, cfs.stats_shm) != 0) {
+        err(1, "%s: can't create stats page", cfs.stats_shm);
+         /* NOTREACHED */
+    }
 
     for (i = 0; i <= RTPP_PT_MAX; i++) {
         cfs.port_table[i] = rtpp_port_table_ctor(cfs.port_min,
@@ -899,6 +985,13 @@ main(int argc, char **argv)
           cfs.ctrl_socks->len > 1 ? "s" : "");
     }
 
+    if (cfs.metrics_sock != NULL) {
+        cfs.metrics = rtpp_metrics_ctor(&cfs, cfs.metrics_sock);
+        if (cfs.metrics == NULL) {
+            err(1, "can't initialize metrics socket");
+        }
+    }
+
     if (cfs.nodaemon == 0) {
         if (cfs.no_chdir == 0) {
             cfs.cwd_orig = getcwd(NULL, 0);
@@ -974,8 +1067,7 @@ main(int argc, char **argv)
     }
 
     tp = CALL_SMETHOD(cfs.rtpp_timed_cf, schedule_rc, 1.0,
-      cfs.rtpp_stats->rcnt, update_derived_stats, NULL,
-      cfs.rtpp_stats);
+      cfs.rtpp_stats->rcnt, update_derived_stats, NULL, &cfs);
     if (tp == NULL) {
         RTPP_ELOG(cfs.glog, RTPP_LOG_ERR,
           "can't schedule notification to derive stats");
@@ -990,6 +1082,13 @@ main(int argc, char **argv)
         exit(1);
     }
 
+    cfs.rtpp_recwr_cf = rtpp_record_writer_ctor(&cfs);
+    if (cfs.rtpp_recwr_cf == NULL) {
+        RTPP_ELOG(cfs.glog, RTPP_LOG_ERR,
+          "can't init session recording subsystem");
+        exit(1);
+    }
+
     cfs.observers = rtpp_po_mgr_ctor();
     if (cfs.observers == NULL) {
         RTPP_LOG(cfs.glog, RTPP_LOG_ERR,
@@ -1013,6 +1112,12 @@ main(int argc, char **argv)
         exit(1);
     }
 
+    if (cfs.metrics != NULL && CALL_METHOD(cfs.metrics, start) != 0) {
+        RTPP_ELOG(cfs.glog, RTPP_LOG_ERR,
+          "can't start metrics exporter");
+        exit(1);
+    }
+
     signal(SIGHUP, sighup);
     signal(SIGINT, fatsignal);
     signal(SIGKILL, fatsignal);
@@ -1083,11 +1188,16 @@ main(int argc, char **argv)
     }
     prdic_free(elp);
 
+    if (cfs.metrics != NULL) {
+        CALL_METHOD(cfs.metrics, dtor);
+        free(cfs.metrics_sock);
+    }
     CALL_METHOD(cfs.rtpp_cmd_cf, dtor);
     RTPP_OBJ_DECREF(cfs.modules_cf);
     RTPP_OBJ_DECREF(cfs.observers)
     free(cfs.runcreds);
     CALL_METHOD(cfs.rtpp_notify_cf, dtor);
+    RTPP_OBJ_DECREF(cfs.rtpp_recwr_cf);
     CALL_METHOD(cfs.bindaddrs_cf, dtor);
     free(cfs.locks);
     CALL_METHOD(cfs.rtpp_tnset_cf, dtor);
@@ -1095,6 +1205,7 @@ main(int argc, char **argv)
     RTPP_OBJ_DECREF(cfs.rtpp_timed_cf);
     CALL_METHOD(cfs.rtpp_proc_ttl_cf, dtor);
     CALL_METHOD(cfs.rtpp_proc_cf, dtor);
+    CALL_METHOD(cfs.proc_servers, dtor);
     RTPP_OBJ_DECREF(cfs.sessinfo);
     RTPP_OBJ_DECREF(cfs.rtpp_stats);
     for (i = 0; i <= RTPP_PT_MAX; i++) {
@@ -30,6 +30,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "config.h"
 
@@ -44,21 +47,26 @@
 #include "rtp.h"
 #include "rtp_analyze.h"
 #include "rtpp_math.h"
-#include "rtpp_refcnt.h"
-#include "rtpp_ringbuf.h"
 
 #define FIX_TIMESTAMP_RESET    1
 #define DEBUG_TIMESTAMP_RESET  1
 
-struct rtp_analyze_jdata;
+#define RTPC_JDATA_MAX 10
+#define RTPC_JHASH_SIZE 16      /* power of 2, > RTPC_JDATA_MAX */
+#define RTPC_JHASH(ssrc) (((uint32_t)(ssrc) * 0x9E3779B1U) >> 28)
 
-struct rtp_analyze_jitter {
-    int jdlen;
-    double jmax_acum;
-    double jtotal_acum;
-    long long jvcount_acum;
-    long long pcount_acum;
-    struct rtp_analyze_jdata *first;
+#define RTPC_TSDEDUP_LEN 10
+#define RTPC_TSDEDUP_SLOTS 12   /* RTPC_TSDEDUP_LEN rounded up to 4 lanes */
+
+/*
+ * Last RTPC_TSDEDUP_LEN timestamps seen on the SSRC, used to detect
+ * duplicate audio frames. Checked on every packet, so it is a fixed
+ * array compared in one go instead of an element-by-element scan.
+ */
+struct rtp_analyze_tsdedup {
+    uint32_t ts[RTPC_TSDEDUP_SLOTS] __attribute__((aligned(16)));
+    int c_elem;
+    int len;
 };
 
 struct rtp_analyze_jdata_ssrc {
@@ -78,11 +86,65 @@ struct rtp_analyze_jdata_ssrc {
 
 struct rtp_analyze_jdata {
     struct rtp_analyze_jdata_ssrc jss;
-    struct rtpp_ringbuf *ts_dedup;
+    struct rtp_analyze_tsdedup ts_dedup;
     struct rtpp_ssrc ssrc;
-    struct rtp_analyze_jdata *next;
 };
 
+/*
+ * Per-SSRC jitter state lives in a fixed array used as a FIFO: jdnext
+ * is the slot to be taken by the next new SSRC, which once all of them
+ * are in use is also the oldest one that gets recycled. The jdhash is an
+ * open-addressed (linear probing) index of the slots by SSRC, holding
+ * slot number + 1, with 0 marking an empty bucket.
+ */
+struct rtp_analyze_jitter {
+    int jdlen;
+    int jdnext;
+    double jmax_acum;
+    double jtotal_acum;
+    long long jvcount_acum;
+    long long pcount_acum;
+    uint8_t jdhash[RTPC_JHASH_SIZE];
+    struct rtp_analyze_jdata jdata[RTPC_JDATA_MAX];
+};
+
+static void
+tsdedup_push(struct rtp_analyze_tsdedup *tdp, uint32_t ts)
+{
+
+    tdp->ts[tdp->c_elem] = ts;
+    tdp->c_elem++;
+    if (tdp->c_elem == RTPC_TSDEDUP_LEN)
+        tdp->c_elem = 0;
+    if (tdp->len < RTPC_TSDEDUP_LEN)
+        tdp->len++;
+}
+
+static int
+tsdedup_locate(const struct rtp_analyze_tsdedup *tdp, uint32_t ts)
+{
+#if defined(__SSE2__)
+    __m128i v;
+    unsigned int m;
+
+    v = _mm_set1_epi32((int)ts);
+    m = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v,
+      _mm_load_si128((const __m128i *)&tdp->ts[0]))));
+    m |= _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v,
+      _mm_load_si128((const __m128i *)&tdp->ts[4])))) << 4;
+    m |= _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v,
+      _mm_load_si128((const __m128i *)&tdp->ts[8])))) << 8;
+    return ((m & ((1U << tdp->len) - 1)) != 0);
+#else
+    int i, r;
+
+    r = 0;
+    for (i = 0; i < tdp->len; i++)
+        r |= (tdp->ts[i] == ts);
+    return (r);
+#endif
+}
+
 static double
 rtp_ts2dtime(int ts_rate, uint32_t ts)
 {
@@ -111,8 +173,6 @@ rtp_dtime2time_ts64(int ts_rate, double dtime)
 #define RTP_SEQ_RESET  1
 #define RTP_SSRC_RESET 2
 
-#define RTPC_JDATA_MAX 10
-
 static void
 update_jitter_stats(struct rtp_analyze_jdata *jdp, struct rtp_info *rinfo,
   double rtime, int hint, struct rtpp_log *rlog)
@@ -125,7 +185,7 @@ update_jitter_stats(struct rtp_analyze_jdata *jdp, struct rtp_info *rinfo,
 
     rtime_ts = rtp_dtime2time_ts64(rinfo->rtp_profile->ts_rate, rtime);
     if (rinfo->rtp_profile->pt_kind == RTP_PTK_AUDIO &&
-      CALL_METHOD(jdp->ts_dedup, locate, &rinfo->ts) >= 0) {
+      tsdedup_locate(&jdp->ts_dedup, rinfo->ts)) {
         jdp->jss.ts_dcount++;
         if (jdp->jss.pcount == 1) {
             jdp->jss.prev_rtime_ts = rtime_ts;
@@ -195,7 +255,7 @@ update_jitter_stats(struct rtp_analyze_jdata *jdp, struct rtp_info *rinfo,
     jdp->jss.pcount++;
 saveandexit:
     if (rinfo->rtp_profile->pt_kind == RTP_PTK_AUDIO) {
-        CALL_METHOD(jdp->ts_dedup, push, &rinfo->ts);
+        tsdedup_push(&jdp->ts_dedup, rinfo->ts);
     }
     jdp->jss.prev_rtime_ts = rtime_ts;
     jdp->jss.prev_ts = rinfo->ts;
@@ -216,27 +276,6 @@ rtpp_stats_init(struct rtpp_session_stat *stat)
     return (0);
 }
 
-static struct rtp_analyze_jdata *
-rtp_analyze_jdata_ctor()
-{
-    struct rtp_analyze_jdata *jdp;
-
-    jdp = rtpp_zmalloc(sizeof(*jdp));
-    if (jdp == NULL) {
-        goto e0;
-    }
-    jdp->ts_dedup = rtpp_ringbuf_ctor(sizeof(jdp->jss.prev_ts), 10);
-    if (jdp->ts_dedup == NULL) {
-        goto e1;
-    }
-    return (jdp);
-
-e1:
-    free(jdp);
-e0:
-    return (NULL);
-}
-
 static struct rtp_analyze_jitter *
 rtp_analyze_jt_ctor()
 {
@@ -244,19 +283,9 @@ rtp_analyze_jt_ctor()
 
     jp = rtpp_zmalloc(sizeof(*jp));
     if (jp == NULL) {
-        goto e0;
-    }
-    jp->first = rtp_analyze_jdata_ctor();
-    if (jp->first == NULL) {
-        goto e1;
+        return (NULL);
     }
-    jp->jdlen = 1;
     return (jp);
-
-e1:
-    free(jp);
-e0:
-    return (NULL);
 }
 
 
@@ -272,48 +301,42 @@ rtpp_stats_destroy(struct rtpp_session_stat *stat)
 static void
 rtp_analyze_jt_destroy(struct rtp_analyze_jitter *jp)
 {
-    struct rtp_analyze_jdata *jdp, *jdp_next;
 
-    for (jdp = jp->first; jdp != NULL; jdp = jdp_next) {
-        jdp_next = jdp->next;
-        RTPP_OBJ_DECREF(jdp->ts_dedup);
-        free(jdp);
-        jp->jdlen -= 1;
-    }
-    RTPP_DBG_ASSERT(jp->jdlen == 0);
     free(jp);
 }
 
+static void
+jdata_hash_insert(struct rtp_analyze_jitter *jp, int jdi)
+{
+    unsigned int h;
+
+    h = RTPC_JHASH(jp->jdata[jdi].ssrc.val);
+    while (jp->jdhash[h] != 0)
+        h = (h + 1) & (RTPC_JHASH_SIZE - 1);
+    jp->jdhash[h] = jdi + 1;
+}
+
 static struct rtp_analyze_jdata *
 jdata_by_ssrc(struct rtp_analyze_jitter *jp, uint32_t ssrc)
 {
-    struct rtp_analyze_jdata *rjdp, *jdp_last, *jdp_prelast;
-
-    if (jp->first->ssrc.inited == 0) {
-        jp->first->ssrc.val = ssrc;
-        jp->first->ssrc.inited = 1;
-        return (jp->first);
-    }
+    struct rtp_analyze_jdata *rjdp;
+    unsigned int h;
+    int i, jdi;
 
-    jdp_last = jdp_prelast = NULL;
-    for (rjdp = jp->first; rjdp != NULL; rjdp = rjdp->next) {
+    for (h = RTPC_JHASH(ssrc); jp->jdhash[h] != 0;
+      h = (h + 1) & (RTPC_JHASH_SIZE - 1)) {
+        rjdp = &jp->jdata[jp->jdhash[h] - 1];
         if (rjdp->ssrc.val == ssrc) {
             return (rjdp);
         }
-        jdp_prelast = jdp_last;
-        jdp_last = rjdp;
     }
 
+    jdi = jp->jdnext;
+    rjdp = &jp->jdata[jdi];
+    jp->jdnext = (jdi + 1) % RTPC_JDATA_MAX;
     if (jp->jdlen == RTPC_JDATA_MAX) {
-        /* Re-use the last per-ssrc data */
-        rjdp = jdp_last;
-        if (jdp_prelast != NULL) {
-            RTPP_DBG_ASSERT(jdp_prelast->next == jdp_last);
-            jdp_prelast->next = NULL;
-        } else {
-            jp->first = NULL;
-        }
-        CALL_METHOD(rjdp->ts_dedup, flush);
+        /* Re-use the oldest per-ssrc data */
+        RTPP_DBG_ASSERT(rjdp->ssrc.inited == 1);
         if (rjdp->jss.pcount >= 2) {
             if (jp->jmax_acum < rjdp->jss.jmax) {
                 jp->jmax_acum = rjdp->jss.jmax;
@@ -323,19 +346,19 @@ jdata_by_ssrc(struct rtp_analyze_jitter *jp, uint32_t ssrc)
             jp->pcount_acum += rjdp->jss.pcount;
         }
         memset(&rjdp->jss, '\0', sizeof(rjdp->jss));
-        RTPP_DBG_ASSERT(rjdp->ssrc.inited == 1);
-    } else {
-        /* Allocate per-ssrc data */
-        rjdp = rtp_analyze_jdata_ctor();
-        if (rjdp == NULL) {
-            return (NULL);
+        memset(&rjdp->ts_dedup, '\0', sizeof(rjdp->ts_dedup));
+        rjdp->ssrc.val = ssrc;
+        /* Eviction is rare, simply rebuild the index */
+        memset(jp->jdhash, '\0', sizeof(jp->jdhash));
+        for (i = 0; i < RTPC_JDATA_MAX; i++) {
+            jdata_hash_insert(jp, i);
         }
+    } else {
+        rjdp->ssrc.val = ssrc;
         rjdp->ssrc.inited = 1;
+        jp->jdhash[h] = jdi + 1;
         jp->jdlen += 1;
     }
-    rjdp->ssrc.val = ssrc;
-    rjdp->next = jp->first;
-    jp->first = rjdp;
     return (rjdp);
 }
 
@@ -351,8 +374,6 @@ update_rtpp_stats(struct rtpp_log *rlog, struct rtpp_session_stat *stat, rtp_hdr
 
     rpp = rinfo->rtp_profile;
     jdp = jdata_by_ssrc(stat->jdata, rinfo->ssrc);
-    if (jdp == NULL)
-        return (UPDATE_ERR);
     if (stat->ssrc_changes == 0) {
         RTPP_DBG_ASSERT(stat->last.pcount == 0);
         RTPP_DBG_ASSERT(stat->psent == 0);
@@ -521,12 +542,14 @@ int
 get_jitter_stats(struct rtp_analyze_jitter *jp, struct rtpa_stats_jitter *jst,
   struct rtpp_log *rlog)
 {
-    int i;
+    int i, k;
     struct rtp_analyze_jdata *rjdp;
     double jtotal;
 
     i = 0;
-    for (rjdp = jp->first; rjdp != NULL && rjdp->ssrc.inited == 1; rjdp = rjdp->next) {
+    /* Walk from the most recently added SSRC to the oldest one */
+    for (k = 1; k <= jp->jdlen; k++) {
+        rjdp = &jp->jdata[(jp->jdnext + RTPC_JDATA_MAX - k) % RTPC_JDATA_MAX];
         if (rjdp->jss.pcount < 2) {
             continue;
         }
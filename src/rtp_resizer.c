@@ -60,12 +60,36 @@ struct rtp_resizer {
     int         output_nsamples;
     int         max_buf_nsamples;
 
+    /*
+     * Packets waiting to be repacketized, sorted by the RTP timestamp and
+     * kept in a ring of (power of 2) qsize slots starting at qhead.
+     */
     struct {
-        struct rtp_packet *first;
-        struct rtp_packet *last;
+        struct rtp_resizer_qent *ents;
+        unsigned int qsize;
+        unsigned int qhead;
+        unsigned int qlen;
     } queue;
 };
 
+/*
+ * A partially consumed packet keeps its header in place and only has
+ * parsed->data_offset advanced past the bytes already taken out of it,
+ * so no memmove() is done on every split. The original header length is
+ * remembered to be able to compact the packet if it ends up being used
+ * as the output container.
+ */
+struct rtp_resizer_qent {
+    struct rtp_packet *pkt;
+    int hlen;
+};
+
+#define RESIZER_QINIT   16
+#define RESIZER_QENT(this, i) \
+  (&(this)->queue.ents[((this)->queue.qhead + (i)) & ((this)->queue.qsize - 1)])
+#define RESIZER_QFIRST(this) \
+  ((this)->queue.qlen > 0 ? RESIZER_QENT(this, 0)->pkt : NULL)
+
 static int
 min_nsamples(int codec_id)
 {
@@ -96,18 +120,15 @@ rtp_resizer_new(int output_ptime)
 void 
 rtp_resizer_free(struct rtpp_stats *rtpp_stats, struct rtp_resizer *this)
 {
-    struct rtp_packet *p;
-    struct rtp_packet *p1;
+    unsigned int i;
     int nfree;
 
     nfree = 0;
-    p = this->queue.first;
-    while (p != NULL) {
-        p1 = p;
-        p = p->next;
-        RTPP_OBJ_DECREF(p1);
+    for (i = 0; i < this->queue.qlen; i++) {
+        RTPP_OBJ_DECREF(RESIZER_QENT(this, i)->pkt);
         nfree++;
     }
+    free(this->queue.ents);
     free(this);
     if (nfree > 0) {
         CALL_SMETHOD(rtpp_stats, updatebyname, "npkts_resizer_discard", nfree);
@@ -135,6 +156,25 @@ rtp_resizer_set_ptime(struct rtp_resizer *this, int ptime_new)
     return (ptime_old);
 }
 
+static int
+rtp_resizer_qgrow(struct rtp_resizer *this)
+{
+    struct rtp_resizer_qent *ents;
+    unsigned int i, qsize;
+
+    qsize = (this->queue.qsize == 0) ? RESIZER_QINIT : this->queue.qsize * 2;
+    ents = malloc(qsize * sizeof(ents[0]));
+    if (ents == NULL)
+        return (-1);
+    for (i = 0; i < this->queue.qlen; i++)
+        ents[i] = *RESIZER_QENT(this, i);
+    free(this->queue.ents);
+    this->queue.ents = ents;
+    this->queue.qsize = qsize;
+    this->queue.qhead = 0;
+    return (0);
+}
+
 void
 rtp_resizer_enqueue(struct rtp_resizer *this, struct rtp_packet **pkt,
   struct rtpp_proc_rstats *rsp)
@@ -142,6 +182,7 @@ rtp_resizer_enqueue(struct rtp_resizer *this, struct rtp_packet **pkt,
     struct rtp_packet   *p;
     uint32_t            ref_ts, internal_ts;
     int                 delta;
+    unsigned int        i;
 
     p = *pkt;
     if (rtp_packet_parse(p) != RTP_PARSER_OK)
@@ -150,6 +191,9 @@ rtp_resizer_enqueue(struct rtp_resizer *this, struct rtp_packet **pkt,
     if ((*pkt)->parsed->nsamples == RTP_NSAMPLES_UNKNOWN)
         return;
 
+    if (this->queue.qlen == this->queue.qsize && rtp_resizer_qgrow(this) != 0)
+        return;
+
     if (!this->ssrc.inited) {
         this->ssrc.val = p->parsed->ssrc;
         this->ssrc.inited = 1;
@@ -186,37 +230,16 @@ rtp_resizer_enqueue(struct rtp_resizer *this, struct rtp_packet **pkt,
 /*            printf("Sync backward\n"); */
         }
     }
-    if (this->queue.last != NULL) 
-    {
-        p = this->queue.last; 
-        while (p != NULL && ts_less((*pkt)->parsed->ts, p->parsed->ts))
-             p = p->prev;
-
-        if (p == NULL) /* head reached */
-        {
-            (*pkt)->next = this->queue.first;
-            (*pkt)->prev = NULL;
-            this->queue.first->prev = *pkt;
-            this->queue.first = *pkt;
-        }
-        else if (p == this->queue.last) /* tail of the queue */
-        {
-            (*pkt)->prev = this->queue.last;
-            (*pkt)->next = NULL;
-            this->queue.last->next = *pkt;
-            this->queue.last = *pkt;
-        }
-        else { /* middle of the queue */
-            (*pkt)->next = p->next;
-            (*pkt)->prev = p;
-            (*pkt)->next->prev = (*pkt)->prev->next = *pkt;
-        }
-    }
-    else {
-        this->queue.first = this->queue.last = *pkt;
-        (*pkt)->prev = NULL;
-	(*pkt)->next = NULL;
+    /* Find the insertion point, normally it's the tail of the queue */
+    for (i = this->queue.qlen; i > 0; i--) {
+        p = RESIZER_QENT(this, i - 1)->pkt;
+        if (!ts_less((*pkt)->parsed->ts, p->parsed->ts))
+            break;
+        *RESIZER_QENT(this, i) = *RESIZER_QENT(this, i - 1);
     }
+    RESIZER_QENT(this, i)->pkt = *pkt;
+    RESIZER_QENT(this, i)->hlen = (*pkt)->parsed->data_offset;
+    this->queue.qlen++;
     this->nsamples_total += (*pkt)->parsed->nsamples;
     *pkt = NULL; /* take control over the packet */
 }
@@ -225,11 +248,30 @@ static void
 detach_queue_head(struct rtp_resizer *this)
 {
 
-    this->queue.first = this->queue.first->next;
-    if (this->queue.first == NULL)
-	this->queue.last = NULL;
-    else
-	this->queue.first->prev = NULL;
+    this->queue.qhead = (this->queue.qhead + 1) & (this->queue.qsize - 1);
+    this->queue.qlen--;
+}
+
+/*
+ * Move remaining payload of the partially consumed queue head back
+ * next to its header, so that the packet can be used as is.
+ */
+static void
+compact_queue_head(struct rtp_resizer *this)
+{
+    struct rtp_resizer_qent *qep;
+    struct rtp_packet *p;
+    int skip;
+
+    qep = RESIZER_QENT(this, 0);
+    p = qep->pkt;
+    skip = p->parsed->data_offset - qep->hlen;
+    if (skip == 0)
+        return;
+    memmove(&p->data.buf[qep->hlen], &p->data.buf[p->parsed->data_offset],
+      p->parsed->data_size);
+    p->parsed->data_offset = qep->hlen;
+    p->size -= skip;
 }
 
 static void
@@ -244,6 +286,17 @@ append_packet(struct rtp_packet *dst, struct rtp_packet *src)
     dst->parsed->appendable = src->parsed->appendable;
 }
 
+/* Take the chunk off the head of the source packet, no data is moved */
+static void
+consume_chunk(struct rtp_packet *src, const struct rtp_packet_chunk *chunk)
+{
+
+    src->parsed->nsamples -= chunk->nsamples;
+    rtp_packet_set_ts(src, src->parsed->ts + chunk->nsamples);
+    src->parsed->data_offset += chunk->bytes;
+    src->parsed->data_size -= chunk->bytes;
+}
+
 static void 
 append_chunk(struct rtp_packet *dst, struct rtp_packet *src, const struct rtp_packet_chunk *chunk)
 {
@@ -255,13 +308,7 @@ append_chunk(struct rtp_packet *dst, struct rtp_packet *src, const struct rtp_pa
     dst->parsed->data_size += chunk->bytes;
     dst->size += chunk->bytes;
 
-    /* Truncate the source packet */
-    src->parsed->nsamples -= chunk->nsamples;
-    rtp_packet_set_ts(src, src->parsed->ts + chunk->nsamples);
-    src->parsed->data_size -= chunk->bytes;
-    src->size -= chunk->bytes;
-    memmove(&src->data.buf[src->parsed->data_offset],
-      &src->data.buf[src->parsed->data_offset + chunk->bytes], src->parsed->data_size);
+    consume_chunk(src, chunk);
 }
 
 static void 
@@ -274,13 +321,7 @@ move_chunk(struct rtp_packet *dst, struct rtp_packet *src, const struct rtp_pack
     dst->parsed->data_size = chunk->bytes;
     dst->size = dst->parsed->data_size + dst->parsed->data_offset;
 
-    /* Truncate the source packet */
-    src->parsed->nsamples -= chunk->nsamples;
-    rtp_packet_set_ts(src, src->parsed->ts + chunk->nsamples);
-    src->parsed->data_size -= chunk->bytes;
-    src->size -= chunk->bytes;
-    memmove(&src->data.buf[src->parsed->data_offset],
-      &src->data.buf[src->parsed->data_offset + chunk->bytes], src->parsed->data_size);
+    consume_chunk(src, chunk);
 }
 
 struct rtp_packet *
@@ -296,20 +337,20 @@ rtp_resizer_get(struct rtp_resizer *this, double dtime)
     int         min;
     struct      rtp_packet_chunk chunk;
 
-    if (this->queue.first == NULL)
+    if (this->queue.qlen == 0)
         return NULL;
 
     ref_ts = (dtime * 8000.0) + this->tsdelta;
 
     /* Wait untill enough data has arrived or timeout occured */
     if (this->nsamples_total < this->output_nsamples &&
-        ts_less(ref_ts, this->queue.first->parsed->ts + this->max_buf_nsamples))
+        ts_less(ref_ts, RESIZER_QFIRST(this)->parsed->ts + this->max_buf_nsamples))
     {
         return NULL;
     }
 
     output_nsamples = this->output_nsamples;
-    min = min_nsamples(this->queue.first->data.header.pt);
+    min = min_nsamples(RESIZER_QFIRST(this)->data.header.pt);
     if (output_nsamples < min) {
         output_nsamples = min;
     } else if (output_nsamples % min != 0) {
@@ -317,15 +358,16 @@ rtp_resizer_get(struct rtp_resizer *this, double dtime)
     }
 
     /* Aggregate the output packet */
-    while ((ret == NULL || ret->parsed->nsamples < output_nsamples) && this->queue.first != NULL)
+    while ((ret == NULL || ret->parsed->nsamples < output_nsamples) && this->queue.qlen > 0)
     {
-        p = this->queue.first;
+        p = RESIZER_QFIRST(this);
         if (ret == NULL) 
         {
             /* Look if the first packet is to be split */
             if (p->parsed->nsamples > output_nsamples) {
 		rtp_packet_first_chunk_find(p, &chunk, output_nsamples);
 		if (chunk.whole_packet_matched) {
+		    compact_queue_head(this);
 		    ret = p;
 		    detach_queue_head(this);
 		} else {
@@ -333,6 +375,8 @@ rtp_resizer_get(struct rtp_resizer *this, double dtime)
 		    if (ret == NULL)
 			break;
 		    rtp_packet_dup(ret, p, RTPP_DUP_HDRONLY);
+		    /* Payload goes right after the header */
+		    ret->parsed->data_offset = RESIZER_QENT(this, 0)->hlen;
                     /* Reset MBT if it happens to be set */
                     p->data.header.mbt = 0;
 		    move_chunk(ret, p, &chunk);
@@ -388,13 +432,13 @@ rtp_resizer_get(struct rtp_resizer *this, double dtime)
         if (ret != NULL && (ret->size + p->parsed->data_size) > sizeof(ret->data.buf))
             break;
 
-        /* Detach head packet from the queue */
-	detach_queue_head(this);
-
         /*
          * Add the packet to the output
          */
         if (ret == NULL) {
+            compact_queue_head(this);
+            /* Detach head packet from the queue */
+            detach_queue_head(this);
             ret = p; /* use the first packet as the result container */
             if (!this->seq_initialized) {
                 this->seq = p->parsed->seq;
@@ -402,6 +446,8 @@ rtp_resizer_get(struct rtp_resizer *this, double dtime)
             }
         }
         else {
+            /* Detach head packet from the queue */
+            detach_queue_head(this);
 	    append_packet(ret, p);
             RTPP_OBJ_DECREF(p);
         }
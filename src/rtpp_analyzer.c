@@ -58,35 +58,73 @@ static void rtpp_analyzer_get_stats(struct rtpp_analyzer *,
 static int rtpp_analyzer_get_jstats(struct rtpp_analyzer *,
   struct rtpa_stats_jitter *);
 static void rtpp_analyzer_dtor(struct rtpp_analyzer_priv *);
+static void rtpp_analyzer_dtor_pa(struct rtpp_analyzer_priv *);
 
-struct rtpp_analyzer *
-rtpp_analyzer_ctor(struct rtpp_log *log)
+static int
+rtpp_analyzer_init(struct rtpp_analyzer_priv *pvt, struct rtpp_log *log)
 {
-    struct rtpp_analyzer_priv *pvt;
     struct rtpp_analyzer *rap;
 
-    pvt = rtpp_rzmalloc(sizeof(struct rtpp_analyzer_priv), PVT_RCOFFS(pvt));
-    if (pvt == NULL) {
-        return (NULL);
-    }
     rap = &pvt->pub;
     if (rtpp_stats_init(&pvt->rstat) != 0) {
-        goto e0;
+        return (-1);
     }
     pvt->log = log;
     rap->update = &rtpp_analyzer_update;
     rap->get_stats = &rtpp_analyzer_get_stats;
     rap->get_jstats = &rtpp_analyzer_get_jstats;
     RTPP_OBJ_INCREF(log);
+    return (0);
+}
+
+struct rtpp_analyzer *
+rtpp_analyzer_ctor(struct rtpp_log *log)
+{
+    struct rtpp_analyzer_priv *pvt;
+
+    pvt = rtpp_rzmalloc(sizeof(struct rtpp_analyzer_priv), PVT_RCOFFS(pvt));
+    if (pvt == NULL) {
+        return (NULL);
+    }
+    if (rtpp_analyzer_init(pvt, log) != 0) {
+        goto e0;
+    }
     CALL_SMETHOD(pvt->pub.rcnt, attach, (rtpp_refcnt_dtor_t)&rtpp_analyzer_dtor,
       pvt);
-    return (rap);
+    return (&pvt->pub);
 e0:
     RTPP_OBJ_DECREF(&(pvt->pub));
     free(pvt);
     return (NULL);
 }
 
+size_t
+rtpp_analyzer_osize(void)
+{
+
+    return (rtpp_rzmalloc_psize(sizeof(struct rtpp_analyzer_priv)));
+}
+
+/*
+ * Construct object in the memory provided by the caller, which has to be
+ * at least rtpp_analyzer_osize() bytes and outlive the object.
+ */
+struct rtpp_analyzer *
+rtpp_analyzer_ctor_pa(void *pap, struct rtpp_log *log)
+{
+    struct rtpp_analyzer_priv *pvt;
+
+    pvt = rtpp_rzmalloc_pa(pap, sizeof(struct rtpp_analyzer_priv),
+      PVT_RCOFFS(pvt));
+    if (rtpp_analyzer_init(pvt, log) != 0) {
+        RTPP_OBJ_DECREF(&(pvt->pub));
+        return (NULL);
+    }
+    CALL_SMETHOD(pvt->pub.rcnt, attach,
+      (rtpp_refcnt_dtor_t)&rtpp_analyzer_dtor_pa, pvt);
+    return (&pvt->pub);
+}
+
 static enum update_rtpp_stats_rval
 rtpp_analyzer_update(struct rtpp_analyzer *rap, struct rtp_packet *pkt)
 {
@@ -144,10 +182,17 @@ rtpp_analyzer_get_jstats(struct rtpp_analyzer *rap,
 }
 
 static void
-rtpp_analyzer_dtor(struct rtpp_analyzer_priv *pvt)
+rtpp_analyzer_dtor_pa(struct rtpp_analyzer_priv *pvt)
 {
 
     rtpp_stats_destroy(&pvt->rstat);
     RTPP_OBJ_DECREF(pvt->log);
+}
+
+static void
+rtpp_analyzer_dtor(struct rtpp_analyzer_priv *pvt)
+{
+
+    rtpp_analyzer_dtor_pa(pvt);
     free(pvt);
 }
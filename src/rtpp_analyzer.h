@@ -52,5 +52,7 @@ struct rtpp_analyzer {
 };
 
 struct rtpp_analyzer * rtpp_analyzer_ctor(struct rtpp_log *);
+size_t rtpp_analyzer_osize(void);
+struct rtpp_analyzer *rtpp_analyzer_ctor_pa(void *, struct rtpp_log *);
 
 #endif
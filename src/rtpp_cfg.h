@@ -50,6 +50,9 @@ struct po_manager;
 struct rtpp_locking;
 struct rtpp_nofile;
 struct rtpp_modman;
+struct rtpp_record_writer;
+struct rtpp_ctrl_sock;
+struct rtpp_metrics;
 
 #define RTPP_PT_INET	0
 #define	RTPP_PT_INET6	1
@@ -58,9 +61,18 @@ struct rtpp_modman;
 #define	RTPP_PT_SELECT(cp, af) (((af) == AF_INET) ? \
   (cp)->port_table[RTPP_PT_INET] : (cp)->port_table[RTPP_PT_INET6])
 
+/*
+ * Overload protection grades, each one sheds the work of all the grades
+ * below it as well: new sessions first, then recording and players, then
+ * packet observers requested via U/L subcommands.
+ */
+enum rtpp_ovl_grade {OVL_NONE = 0, OVL_NEWSESS, OVL_MEDIA, OVL_OBSRVS};
+#define	OVL_NGRADES	OVL_OBSRVS
+
 struct overload_prot {
-    double low_trs;
-    double high_trs;
+    /* Enter/leave thresholds, index 0 corresponds to the OVL_NEWSESS */
+    double low_trs[OVL_NGRADES];
+    double high_trs[OVL_NGRADES];
     int ecode;
 };
 
@@ -90,6 +102,9 @@ struct rtpp_cfg {
     const char *rdir;
     const char *sdir;
     int record_pcap;                /* Record in the PCAP format? */
+    int record_spool;               /* Record via shared spool segments? */
+    int record_index;               /* Write sidecar index for recordings? */
+    const char *stats_shm;          /* Path of the mmap'ed stats page */
     int record_all;                 /* Record everything */
 
     int rrtcp;                      /* Whether or not to relay RTCP? */
@@ -110,18 +125,23 @@ struct rtpp_cfg {
     struct rtpp_hash_table *sessions_ht;
     struct rtpp_weakref_obj *sessions_wrt;
     struct rtpp_weakref_obj *servers_wrt;
+    struct rtpp_proc_servers *proc_servers;
     struct rtpp_weakref_obj *rtp_streams_wrt;
     struct rtpp_weakref_obj *rtcp_streams_wrt;
 
     int sched_policy;
     int sched_hz;
     int sched_nice;
+    int rcache_mem;
     double target_pfreq;
     struct rtpp_cmd_async *rtpp_cmd_cf;
     struct rtpp_proc_async *rtpp_proc_cf;
+    struct rtpp_ctrl_sock *metrics_sock;
+    struct rtpp_metrics *metrics;
     struct rtpp_proc_ttl *rtpp_proc_ttl_cf;
     struct rtpp_tnotify_set *rtpp_tnset_cf;
     struct rtpp_notify *rtpp_notify_cf;
+    struct rtpp_record_writer *rtpp_recwr_cf;
     struct rtpp_bindaddrs *bindaddrs_cf;
     int slowshutdown;
     int fastshutdown;
@@ -32,8 +32,11 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <errno.h>
+#include <poll.h>
+#include <pthread.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -60,6 +63,7 @@
 #include "commands/rpcpv1_record.h"
 #include "commands/rpcpv1_norecord.h"
 #include "rtpp_command_rcache.h"
+#include "rtpp_command_stream.h"
 #include "commands/rpcpv1_query.h"
 #include "commands/rpcpv1_stats.h"
 #include "commands/rpcpv1_ul.h"
@@ -79,6 +83,8 @@
 #include "rtpp_weakref.h"
 #include "rtpp_proc_async.h"
 
+#define RTPC_REPLY_PART_TMO 1.0
+
 struct rtpp_command_priv {
     struct rtpp_command pub;
     const struct rtpp_cfg *cfs;
@@ -88,6 +94,8 @@ struct rtpp_command_priv {
     char buf_r[256];
     struct rtpp_cmd_rcache *rcache_obj;
     struct rtpp_timestamp dtime;
+    struct rtpp_cmd_connection *rcc;
+    struct rtpp_command **spare;
 };
 
 struct d_opts;
@@ -180,6 +188,62 @@ rtpp_create_listener(const struct rtpp_cfg *cfsp, const struct sockaddr *ia, int
       &cta));
 }
 
+static int
+rtpc_writev_all(int fd, struct iovec *iov, int iovcnt)
+{
+    ssize_t rval;
+
+    while (iovcnt > 0) {
+        rval = writev(fd, iov, iovcnt);
+        if (rval < 0) {
+            if (errno == EINTR)
+                continue;
+            return (-1);
+        }
+        while (iovcnt > 0 && (size_t)rval >= iov->iov_len) {
+            rval -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + rval;
+            iov->iov_len -= rval;
+        }
+    }
+    return (0);
+}
+
+/*
+ * In the pipelined mode replies can be produced by several command workers
+ * at the same time, so each one is written as a whole under the connection
+ * lock and is prefixed with the cookie to let the client match it to the
+ * request.
+ */
+static void
+rtpc_doreply_pipelined(struct rtpp_command_priv *pvt, const char *buf, int len)
+{
+    struct iovec iov[2];
+    int iovcnt;
+
+    iovcnt = 0;
+    if (pvt->cookie != NULL) {
+        iov[iovcnt].iov_base = pvt->buf_r;
+        iov[iovcnt].iov_len = snprintf(pvt->buf_r, sizeof(pvt->buf_r), "%s ",
+          pvt->cookie);
+        if (iov[iovcnt].iov_len >= sizeof(pvt->buf_r))
+            iov[iovcnt].iov_len = sizeof(pvt->buf_r) - 1;
+        iovcnt++;
+    }
+    iov[iovcnt].iov_base = (void *)buf;
+    iov[iovcnt].iov_len = len;
+    iovcnt++;
+    pthread_mutex_lock(&pvt->rcc->wlock);
+    if (rtpc_writev_all(pvt->controlfd, iov, iovcnt) < 0) {
+        RTPP_DBG_ASSERT(!IS_WEIRD_ERRNO(errno));
+    }
+    pthread_mutex_unlock(&pvt->rcc->wlock);
+}
+
 void
 rtpc_doreply(struct rtpp_command *cmd, char *buf, int len, int errd)
 {
@@ -194,7 +258,9 @@ rtpc_doreply(struct rtpp_command *cmd, char *buf, int len, int errd)
         RTPP_LOG(pvt->cfs->glog, RTPP_LOG_DBUG, "sending reply \"%.*s\"",
           len, buf);
     }
-    if (pvt->umode == 0) {
+    if (pvt->rcc != NULL) {
+        rtpc_doreply_pipelined(pvt, buf, len);
+    } else if (pvt->umode == 0) {
         if (write(pvt->controlfd, buf, len) < 0) {
             RTPP_DBG_ASSERT(!IS_WEIRD_ERRNO(errno));
         }
@@ -217,6 +283,119 @@ rtpc_doreply(struct rtpp_command *cmd, char *buf, int len, int errd)
     }
 }
 
+/*
+ * Check if work of the given overload grade has to be shed at the moment,
+ * account and log it if so. Sending an error is left to the caller.
+ */
+int
+rtpc_ovl_shed(const struct rtpp_cfg *cfsp, struct rtpp_command *cmd, int grade)
+{
+    struct rtpp_command_stat *stp;
+    const char *what;
+
+    if (cfsp->overload_prot.ecode == 0 ||
+      CALL_METHOD(cfsp->rtpp_cmd_cf, chk_overload) < grade)
+        return (0);
+    switch (grade) {
+    case OVL_NEWSESS:
+        stp = &cmd->csp->ncmds_shed_newsess;
+        what = "new session";
+        break;
+
+    case OVL_MEDIA:
+        stp = &cmd->csp->ncmds_shed_media;
+        what = "recording/playback";
+        break;
+
+    case OVL_OBSRVS:
+        stp = &cmd->csp->ncmds_shed_obsrvs;
+        what = "subcommand";
+        break;
+
+    default:
+        abort();
+    }
+    stp->cnt++;
+    RTPP_LOG(cmd->glog, RTPP_LOG_ERR, "proxy is overloaded, %s rejected",
+      what);
+    return (1);
+}
+
+int
+rtpc_can_stream(const struct rtpp_command *cmd)
+{
+    const struct rtpp_command_priv *pvt;
+
+    PUB2PVT(cmd, pvt);
+    return (pvt->umode == 0 && pvt->rcc == NULL);
+}
+
+/*
+ * Switch command received over a pipelined stream connection into the
+ * cookie mode, must be called before rtpp_command_split().
+ */
+void
+rtpc_set_pipelined(struct rtpp_command *cmd, struct rtpp_cmd_connection *rcc)
+{
+    struct rtpp_command_priv *pvt;
+
+    PUB2PVT(cmd, pvt);
+    RTPP_OBJ_INCREF(rcc);
+    pvt->rcc = rcc;
+}
+
+/*
+ * Send out a partial reply for commands that produce output larger than
+ * what fits into a single reply buffer. Only works on stream control
+ * sockets, the command is expected to finish with a rtpc_doreply() call,
+ * which is what gets counted in the command stats. The socket is written
+ * in a non-blocking manner, peer that does not drain it within
+ * RTPC_REPLY_PART_TMO is treated as gone, so that the command thread does
+ * not get stuck on it.
+ */
+int
+rtpc_doreply_part(struct rtpp_command *cmd, const char *buf, int len)
+{
+    struct rtpp_command_priv *pvt;
+    struct pollfd pfd;
+    ssize_t rval;
+    double tleft, deadline;
+
+    PUB2PVT(cmd, pvt);
+    RTPP_DBG_ASSERT(pvt->umode == 0);
+    deadline = getdtime() + RTPC_REPLY_PART_TMO;
+    while (len > 0) {
+        rval = send(pvt->controlfd, buf, len, MSG_DONTWAIT);
+        if (rval < 0 && errno == ENOTSOCK) {
+            /* stdio: */
+            rval = write(pvt->controlfd, buf, len);
+        }
+        if (rval < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                RTPP_DBG_ASSERT(!IS_WEIRD_ERRNO(errno));
+                return (-1);
+            }
+            tleft = deadline - getdtime();
+            if (tleft <= 0) {
+                RTPP_LOG(pvt->cfs->glog, RTPP_LOG_ERR, "timeout sending "
+                  "partial reply, %d bytes left", len);
+                return (-1);
+            }
+            pfd.fd = pvt->controlfd;
+            pfd.events = POLLOUT;
+            pfd.revents = 0;
+            if (poll(&pfd, 1, (int)(tleft * 1000) + 1) < 0 && errno != EINTR)
+                return (-1);
+            continue;
+        }
+        buf += rval;
+        len -= rval;
+    }
+    return (0);
+}
+
 void
 reply_number(struct rtpp_command *cmd, int number)
 {
@@ -255,21 +434,59 @@ free_command(struct rtpp_command *cmd)
     if (cmd->sp != NULL) {
         RTPP_OBJ_DECREF(cmd->sp);
     }
+    if (pvt->rcc != NULL) {
+        RTPP_OBJ_DECREF(pvt->rcc);
+    }
+    if (pvt->spare != NULL && *pvt->spare == NULL) {
+        *pvt->spare = cmd;
+        return;
+    }
     free(pvt);
 }
 
+void
+free_command_spare(struct rtpp_command **spare)
+{
+
+    if (*spare != NULL) {
+        free(*spare);
+        *spare = NULL;
+    }
+}
+
+/*
+ * If the spare slot is not NULL the object left there by the previous
+ * free_command() is reused and the new one is parked there when done, so
+ * that a command thread allocates only once. Only the part that follows
+ * the I/O buffers has to be cleared, the buffers are always written before
+ * being read.
+ */
 struct rtpp_command *
 rtpp_command_ctor(const struct rtpp_cfg *cfsp, int controlfd,
-  const struct rtpp_timestamp *dtime, struct rtpp_command_stats *csp, int umode)
+  const struct rtpp_timestamp *dtime, struct rtpp_command_stats *csp, int umode,
+  struct rtpp_command **spare)
 {
     struct rtpp_command_priv *pvt;
     struct rtpp_command *cmd;
 
-    pvt = rtpp_zmalloc(sizeof(struct rtpp_command_priv));
-    if (pvt == NULL) {
-        return (NULL);
+    if (spare != NULL && *spare != NULL) {
+        cmd = *spare;
+        *spare = NULL;
+        PUB2PVT(cmd, pvt);
+        memset(&cmd->args, '\0', sizeof(*cmd) -
+          offsetof(struct rtpp_command, args));
+        memset(&pvt->cfs, '\0', offsetof(struct rtpp_command_priv, buf_r) -
+          offsetof(struct rtpp_command_priv, cfs));
+        memset(&pvt->rcache_obj, '\0', sizeof(*pvt) -
+          offsetof(struct rtpp_command_priv, rcache_obj));
+    } else {
+        pvt = rtpp_zmalloc(sizeof(struct rtpp_command_priv));
+        if (pvt == NULL) {
+            return (NULL);
+        }
+        cmd = &(pvt->pub);
     }
-    cmd = &(pvt->pub);
+    pvt->spare = spare;
     pvt->controlfd = controlfd;
     pvt->cfs = cfsp;
     pvt->dtime.wall = dtime->wall;
@@ -284,7 +501,7 @@ rtpp_command_ctor(const struct rtpp_cfg *cfsp, int controlfd,
 struct rtpp_command *
 get_command(const struct rtpp_cfg *cfsp, struct rtpp_ctrl_sock *rcsp, int controlfd, int *rval,
   const struct rtpp_timestamp *dtime, struct rtpp_command_stats *csp,
-  struct rtpp_cmd_rcache *rcache_obj)
+  struct rtpp_cmd_rcache *rcache_obj, struct rtpp_command **spare)
 {
     char *bp;
     int len;
@@ -295,7 +512,7 @@ get_command(const struct rtpp_cfg *cfsp, struct rtpp_ctrl_sock *rcsp, int contro
     socklen_t asize, *lp;
     struct sockaddr *raddr;
 
-    cmd = rtpp_command_ctor(cfsp, controlfd, dtime, csp, umode);
+    cmd = rtpp_command_ctor(cfsp, controlfd, dtime, csp, umode, spare);
     if (cmd == NULL) {
         bp = rcsp->emrg.buf;
         bsize = sizeof(rcsp->emrg.buf);
@@ -346,7 +563,7 @@ get_command(const struct rtpp_cfg *cfsp, struct rtpp_ctrl_sock *rcsp, int contro
     }
     cmd->buf[len] = '\0';
 
-    if (rtpp_command_split(cmd, len, rval, rcache_obj) != 0) {
+    if (rtpp_command_split(cmd, cmd->buf, len, rval, rcache_obj) != 0) {
         /* Error reply is handled by the rtpp_command_split() */
         free_command(cmd);
         return (NULL);
@@ -378,8 +595,12 @@ rtpp_command_guard_retrans(struct rtpp_command *cmd,
     return (0);
 }
 
+/*
+ * Tokenize the command in place, buf must be nul-terminated and stay
+ * intact for as long as the command is being handled.
+ */
 int
-rtpp_command_split(struct rtpp_command *cmd, int len, int *rval,
+rtpp_command_split(struct rtpp_command *cmd, char *buf, int len, int *rval,
   struct rtpp_cmd_rcache *rcache_obj)
 {
     char **ap;
@@ -388,24 +609,26 @@ rtpp_command_split(struct rtpp_command *cmd, int len, int *rval,
     struct rtpp_command_args *cap;
 
     PUB2PVT(cmd, pvt);
-    if (len > 0 && cmd->buf[len - 1] == '\n') {
+    if (len > 0 && buf[len - 1] == '\n') {
         RTPP_LOG(pvt->cfs->glog, RTPP_LOG_DBUG, "received command \"%.*s\\n\"",
-          len - 1, cmd->buf);
+          len - 1, buf);
     } else {
         RTPP_LOG(pvt->cfs->glog, RTPP_LOG_DBUG, "received command \"%s\"",
-          cmd->buf);
+          buf);
     }
     cmd->csp->ncmds_rcvd.cnt++;
 
-    cp = cmd->buf;
+    cp = buf;
     cap = &cmd->args;
     for (ap = cap->v; (*ap = rtpp_strsep(&cp, "\r\n\t ")) != NULL;) {
         if (**ap != '\0') {
             if (cap == &cmd->args) {
-                /* Stream communication mode doesn't use cookie */
-                if (pvt->umode != 0 && cap->c == 0 && pvt->cookie == NULL) {
+                /* Stream communication mode doesn't use cookie, unless pipelined */
+                if ((pvt->umode != 0 || pvt->rcc != NULL) && cap->c == 0 &&
+                  pvt->cookie == NULL) {
                     pvt->cookie = *ap;
-                    if (rtpp_command_guard_retrans(cmd, rcache_obj)) {
+                    if (rcache_obj != NULL &&
+                      rtpp_command_guard_retrans(cmd, rcache_obj)) {
                         *rval = GET_CMD_OK;
                         return (1);
                     }
@@ -423,7 +646,8 @@ rtpp_command_split(struct rtpp_command *cmd, int len, int *rval,
                 goto etoomany;
         }
     }
-    if (cmd->args.c < 1 || (pvt->umode != 0 && pvt->cookie == NULL) ||
+    if (cmd->args.c < 1 ||
+      ((pvt->umode != 0 || pvt->rcc != NULL) && pvt->cookie == NULL) ||
       (cap == &cmd->subc_args && cap->c < 1)) {
 etoomany:
         RTPP_LOG(pvt->cfs->glog, RTPP_LOG_ERR, "command syntax error");
@@ -457,6 +681,12 @@ handle_command(const struct rtpp_cfg *cfsp, struct rtpp_command *cmd)
     norecord_all = 0;
     record_single_file = 0;
 
+    if ((cmd->cca.op == RECORD || cmd->cca.op == COPY || cmd->cca.op == PLAY) &&
+      rtpc_ovl_shed(cfsp, cmd, OVL_MEDIA)) {
+        reply_error(cmd, cfsp->overload_prot.ecode);
+        return 0;
+    }
+
     /* Step II: parse parameters that are specific to a particular op and run simple ops */
     switch (cmd->cca.op) {
     case VER_FEATURE:
@@ -552,6 +782,13 @@ handle_command(const struct rtpp_cfg *cfsp, struct rtpp_command *cmd)
         }
 	break;
 
+    case QUERY_ALL:
+        rval = handle_query_all(cfsp, cmd);
+        if (rval != 0) {
+            reply_error(cmd, rval);
+        }
+        return 0;
+
     case GET_STATS:
         verbose = 0;
         for (cp = cmd->args.v[0] + 1; *cp != '\0'; cp++) {
@@ -36,6 +36,7 @@ struct rtpp_cmd_rcache;
 struct rtpp_socket;
 struct rtpp_ctrl_sock;
 struct rtpp_timestamp;
+struct rtpp_cmd_connection;
 
 #define GET_CMD_OK     (0)
 #define GET_CMD_IOERR  (-1)
@@ -49,9 +50,10 @@ struct rtpp_timestamp;
 
 int handle_command(const struct rtpp_cfg *, struct rtpp_command *);
 void free_command(struct rtpp_command *);
+void free_command_spare(struct rtpp_command **);
 struct rtpp_command *get_command(const struct rtpp_cfg *, struct rtpp_ctrl_sock *, int, int *,
   const struct rtpp_timestamp *, struct rtpp_command_stats *csp,
-  struct rtpp_cmd_rcache *);
+  struct rtpp_cmd_rcache *, struct rtpp_command **);
 void reply_error(struct rtpp_command *cmd, int ecode);
 void reply_ok(struct rtpp_command *cmd);
 void reply_port(struct rtpp_command *cmd, int lport,
@@ -60,9 +62,14 @@ void reply_number(struct rtpp_command *cmd, int number);
 int rtpp_create_listener(const struct rtpp_cfg *, const struct sockaddr *, int *,
   struct rtpp_socket **);
 struct rtpp_command *rtpp_command_ctor(const struct rtpp_cfg *, int, const struct rtpp_timestamp *,
-  struct rtpp_command_stats *, int);
-int rtpp_command_split(struct rtpp_command *, int, int *, struct rtpp_cmd_rcache *);
+  struct rtpp_command_stats *, int, struct rtpp_command **);
+int rtpp_command_split(struct rtpp_command *, char *, int, int *,
+  struct rtpp_cmd_rcache *);
 
 void rtpc_doreply(struct rtpp_command *, char *, int, int);
+int rtpc_can_stream(const struct rtpp_command *);
+int rtpc_ovl_shed(const struct rtpp_cfg *, struct rtpp_command *, int);
+void rtpc_set_pipelined(struct rtpp_command *, struct rtpp_cmd_connection *);
+int rtpc_doreply_part(struct rtpp_command *, const char *, int);
 
 #endif
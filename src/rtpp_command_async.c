@@ -32,6 +32,7 @@
 #include <errno.h>
 #include <poll.h>
 #include <pthread.h>
+#include <signal.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
@@ -56,11 +57,24 @@
 #include "rtpp_mallocs.h"
 #include "rtpp_stats.h"
 #include "rtpp_list.h"
+#include "rtpp_math.h"
 #include "rtpp_controlfd.h"
 #include "rtpp_locking.h"
+#include "rtpp_pearson.h"
 #include "rtpp_proc_async.h"
+#include "rtpp_queue.h"
+#include "rtpp_wi.h"
+#include "rtpp_wi_data.h"
+#include "rtpp_wi_sgnl.h"
 
 #define RTPC_MAX_CONNECTIONS 100
+#define RTPC_PL_NWORKERS 4
+/*
+ * Command latency older than that is stale, i.e. nothing has been
+ * processed recently and the command processing is idle.
+ */
+#define RTPC_LAT_IDLE_TMO 1.0
+#define RTPC_LAT_FCOEF 0.9
 
 struct rtpp_cmd_pollset {
     struct pollfd *pfds;
@@ -75,6 +89,19 @@ struct rtpp_cmd_accptset {
     int pfds_used;
 };
 
+/*
+ * Worker executing commands received over pipelined stream connections.
+ * Commands are assigned to workers by the Call-ID hash, so that requests
+ * for the same call are still executed in the order received.
+ */
+struct rtpp_cmd_plworker {
+    pthread_t thread_id;
+    struct rtpp_queue *queue;
+    struct rtpp_wi *sigterm;
+    struct rtpp_command_stats cstats;
+    struct rtpp_cmd_async_cf *cmd_cf;
+};
+
 struct rtpp_cmd_async_cf {
     struct rtpp_cmd_async pub;
     pthread_t thread_id;
@@ -90,17 +117,27 @@ struct rtpp_cmd_async_cf {
 #if 0
     struct recfilter average_load;
 #endif
+    /* Smoothed time it takes to get a command processed once received */
+    struct recfilter cmd_latency;
+    double cmd_latency_ts;
     struct rtpp_command_stats cstats;
     struct rtpp_cmd_pollset pset;
     struct rtpp_cmd_accptset aset;
     struct rtpp_cfg *cf_save;
     struct rtpp_cmd_rcache *rcache;
+    /* Command object recycled between commands, only used by the worker */
+    struct rtpp_command *cmd_spare;
+    struct rtpp_pearson rp;
+    int nplworkers;
+    unsigned int plworker_next;
+    struct rtpp_cmd_plworker plworkers[RTPC_PL_NWORKERS];
 };
 
 #define TSTATE_RUN   0x0
 #define TSTATE_CEASE 0x1
 
 static double rtpp_command_async_get_aload(struct rtpp_cmd_async *);
+static double rtpp_command_async_get_latency(struct rtpp_cmd_async *);
 static int rtpp_command_async_wakeup(struct rtpp_cmd_async *);
 static void rtpp_command_async_reg_overload(struct rtpp_cmd_async *, int);
 static int rtpp_command_async_chk_overload(struct rtpp_cmd_async *);
@@ -121,6 +158,10 @@ init_cstats(struct rtpp_stats *sobj, struct rtpp_command_stats *csp)
 
     csp->nplrs_created.cnt_idx = CALL_SMETHOD(sobj, getidxbyname, "nplrs_created");
     csp->nplrs_destroyed.cnt_idx = CALL_SMETHOD(sobj, getidxbyname, "nplrs_destroyed");
+
+    csp->ncmds_shed_newsess.cnt_idx = CALL_SMETHOD(sobj, getidxbyname, "ncmds_shed_newsess");
+    csp->ncmds_shed_media.cnt_idx = CALL_SMETHOD(sobj, getidxbyname, "ncmds_shed_media");
+    csp->ncmds_shed_obsrvs.cnt_idx = CALL_SMETHOD(sobj, getidxbyname, "ncmds_shed_obsrvs");
 }
 
 #define FLUSH_CSTAT(sobj, st)    { \
@@ -145,6 +186,10 @@ flush_cstats(struct rtpp_stats *sobj, struct rtpp_command_stats *csp)
 
     FLUSH_CSTAT(sobj, csp->nplrs_created);
     FLUSH_CSTAT(sobj, csp->nplrs_destroyed);
+
+    FLUSH_CSTAT(sobj, csp->ncmds_shed_newsess);
+    FLUSH_CSTAT(sobj, csp->ncmds_shed_media);
+    FLUSH_CSTAT(sobj, csp->ncmds_shed_obsrvs);
 }
 
 static int
@@ -167,20 +212,58 @@ accept_connection(const struct rtpp_cfg *cfsp, struct rtpp_ctrl_sock *rcsp,
     return (controlfd);
 }
 
+static void
+reg_latency(struct rtpp_cmd_async_cf *cmd_cf, const struct rtpp_timestamp *dtime)
+{
+    double now;
+
+    now = getdtime();
+    pthread_mutex_lock(&cmd_cf->cmd_mutex);
+    if (now - cmd_cf->cmd_latency_ts > RTPC_LAT_IDLE_TMO) {
+        /* Don't let the history from before the idle period linger */
+        recfilter_init(&cmd_cf->cmd_latency, RTPC_LAT_FCOEF, 0.0, 0);
+    }
+    recfilter_apply(&cmd_cf->cmd_latency, now - dtime->mono);
+    cmd_cf->cmd_latency_ts = now;
+    pthread_mutex_unlock(&cmd_cf->cmd_mutex);
+}
+
 static int
-process_commands(struct rtpp_ctrl_sock *csock, const struct rtpp_cfg *cfsp, int controlfd,
-  const struct rtpp_timestamp *dtime, struct rtpp_command_stats *csp,
-  struct rtpp_stats *rsc, struct rtpp_cmd_rcache *rcp)
+exec_command(struct rtpp_cmd_async_cf *cmd_cf, struct rtpp_command *cmd)
 {
+    const struct rtpp_cfg *cfsp;
+    int rval;
+
+    cfsp = CONST(cmd_cf->cf_save);
+    if (cmd->no_glock == 0) {
+        pthread_mutex_lock(&(cfsp->locks->glob));
+    }
+    rval = handle_command(cfsp, cmd);
+    if (cmd->no_glock == 0) {
+        pthread_mutex_unlock(&(cfsp->locks->glob));
+    }
+    reg_latency(cmd_cf, cmd->dtime);
+    free_command(cmd);
+    return (rval);
+}
+
+static int
+process_commands(struct rtpp_cmd_async_cf *cmd_cf, struct rtpp_ctrl_sock *csock,
+  int controlfd, const struct rtpp_timestamp *dtime, struct rtpp_command_stats *csp,
+  struct rtpp_stats *rsc, struct rtpp_command **spare)
+{
+    const struct rtpp_cfg *cfsp;
     int i, rval;
     struct rtpp_command *cmd;
     int umode;
 
+    cfsp = CONST(cmd_cf->cf_save);
     umode = RTPP_CTRL_ISDG(csock);
     i = 0;
     do {
 again:
-        cmd = get_command(cfsp, csock, controlfd, &rval, dtime, csp, rcp);
+        cmd = get_command(cfsp, csock, controlfd, &rval, dtime, csp,
+          cmd_cf->rcache, spare);
         if (cmd == NULL) {
             switch (rval) {
             case GET_CMD_OK:
@@ -200,14 +283,7 @@ again:
             if (cmd->cca.op == GET_STATS || cmd->cca.op == INFO) {
                 flush_cstats(rsc, csp);
             }
-            if (cmd->no_glock == 0) {
-                pthread_mutex_lock(&(cfsp->locks->glob));
-            }
-            i = handle_command(cfsp, cmd);
-            if (cmd->no_glock == 0) {
-                pthread_mutex_unlock(&(cfsp->locks->glob));
-            }
-            free_command(cmd);
+            i = exec_command(cmd_cf, cmd);
         }
     } while (i == 0 && umode != 0);
 out:
@@ -215,19 +291,114 @@ out:
 }
 
 static int
-process_commands_stream(const struct rtpp_cfg *cfsp, struct rtpp_cmd_connection *rcc,
-  const struct rtpp_timestamp *dtime, struct rtpp_command_stats *csp, struct rtpp_stats *rsc)
+rtpp_cmd_pipeline(struct rtpp_cmd_async_cf *cmd_cf, struct rtpp_command *cmd)
+{
+    struct rtpp_cmd_plworker *wp;
+    struct rtpp_wi *wi;
+    unsigned int widx;
+
+    if (cmd->cca.call_id != NULL) {
+        widx = rtpp_pearson_hash8(&cmd_cf->rp, cmd->cca.call_id, NULL);
+    } else {
+        widx = cmd_cf->plworker_next++;
+    }
+    wp = &cmd_cf->plworkers[widx % cmd_cf->nplworkers];
+    wi = rtpp_wi_malloc_data(&cmd, sizeof(cmd));
+    if (wi == NULL) {
+        return (-1);
+    }
+    rtpp_queue_put_item(wi, wp->queue);
+    return (0);
+}
+
+static void
+rtpp_cmd_plworker_run(void *arg)
+{
+    struct rtpp_cmd_plworker *wp;
+    struct rtpp_command *cmd;
+    struct rtpp_wi *wi;
+
+    wp = (struct rtpp_cmd_plworker *)arg;
+    for (;;) {
+        wi = rtpp_queue_get_item(wp->queue, 0);
+        if (rtpp_wi_get_type(wi) == RTPP_WI_TYPE_SGNL) {
+            CALL_METHOD(wi, dtor);
+            break;
+        }
+        cmd = *(struct rtpp_command **)rtpp_wi_data_get_ptr(wi, sizeof(cmd),
+          sizeof(cmd));
+        CALL_METHOD(wi, dtor);
+        /* Received command is accounted by the reader thread already */
+        cmd->csp = &wp->cstats;
+        /* Latency includes the time spent waiting in the worker queue */
+        exec_command(wp->cmd_cf, cmd);
+        flush_cstats(wp->cmd_cf->cf_save->rtpp_stats, &wp->cstats);
+    }
+}
+
+static int
+rtpp_cmd_plworkers_start(struct rtpp_cmd_async_cf *cmd_cf)
 {
+    struct rtpp_cmd_plworker *wp;
+    int i;
+
+    for (i = 0; i < RTPC_PL_NWORKERS; i++) {
+        wp = &cmd_cf->plworkers[i];
+        wp->cmd_cf = cmd_cf;
+        init_cstats(cmd_cf->cf_save->rtpp_stats, &wp->cstats);
+        wp->queue = rtpp_queue_init(RTPQ_SMALL_CB_LEN, "rtpp_cmd_pl%d", i);
+        if (wp->queue == NULL)
+            goto e0;
+        wp->sigterm = rtpp_wi_malloc_sgnl(SIGTERM, NULL, 0);
+        if (wp->sigterm == NULL)
+            goto e1;
+        if (pthread_create(&wp->thread_id, NULL,
+          (void *(*)(void *))&rtpp_cmd_plworker_run, wp) != 0)
+            goto e2;
+        cmd_cf->nplworkers++;
+    }
+    return (0);
+e2:
+    CALL_METHOD(wp->sigterm, dtor);
+e1:
+    rtpp_queue_destroy(wp->queue);
+e0:
+    return (-1);
+}
+
+static void
+rtpp_cmd_plworkers_stop(struct rtpp_cmd_async_cf *cmd_cf)
+{
+    struct rtpp_cmd_plworker *wp;
+    int i;
+
+    for (i = 0; i < cmd_cf->nplworkers; i++) {
+        wp = &cmd_cf->plworkers[i];
+        /* Anything queued before the signal gets processed */
+        rtpp_queue_put_item(wp->sigterm, wp->queue);
+        pthread_join(wp->thread_id, NULL);
+        rtpp_queue_destroy(wp->queue);
+    }
+    cmd_cf->nplworkers = 0;
+}
+
+static int
+process_commands_stream(struct rtpp_cmd_async_cf *cmd_cf, struct rtpp_cmd_connection *rcc,
+  const struct rtpp_timestamp *dtime, struct rtpp_command_stats *csp, struct rtpp_stats *rsc,
+  struct rtpp_command **spare)
+{
+    const struct rtpp_cfg *cfsp;
     int rval;
     struct rtpp_command *cmd;
 
+    cfsp = CONST(cmd_cf->cf_save);
     rval = rtpp_command_stream_doio(cfsp, rcc);
     if (rval <= 0) {
         return (-1);
     }
     do {
 again:
-        cmd = rtpp_command_stream_get(cfsp, rcc, &rval, dtime, csp);
+        cmd = rtpp_command_stream_get(cfsp, rcc, &rval, dtime, csp, spare);
         if (cmd == NULL) {
             switch (rval) {
             case GET_CMD_EAGAIN:
@@ -244,28 +415,34 @@ again:
         if (cmd->cca.op == GET_STATS || cmd->cca.op == INFO) {
             flush_cstats(rsc, csp);
         }
-        if (cmd->no_glock == 0) {
-            pthread_mutex_lock(&(cfsp->locks->glob));
-        }
-        rval = handle_command(cfsp, cmd);
-        if (cmd->no_glock == 0) {
-            pthread_mutex_unlock(&(cfsp->locks->glob));
+        if (RTPP_CTRL_ISPIPELINED(rcc->csock) &&
+          rtpp_cmd_pipeline(cmd_cf, cmd) == 0) {
+            rval = 0;
+            continue;
         }
-        free_command(cmd);
+        rval = exec_command(cmd_cf, cmd);
     } while (rval == 0);
     return (rval);
 }
 
+static void rtpp_cmd_connection_dtor(struct rtpp_cmd_connection *);
+
 static struct rtpp_cmd_connection *
 rtpp_cmd_connection_ctor(int controlfd_in, int controlfd_out,
   struct rtpp_ctrl_sock *csock, struct sockaddr *rap)
 {
     struct rtpp_cmd_connection *rcc;
 
-    rcc = rtpp_zmalloc(sizeof(struct rtpp_cmd_connection));
+    rcc = rtpp_rzmalloc(sizeof(struct rtpp_cmd_connection),
+      offsetof(struct rtpp_cmd_connection, rcnt));
     if (rcc == NULL) {
         return (NULL);
     }
+    if (pthread_mutex_init(&rcc->wlock, NULL) != 0) {
+        RTPP_OBJ_DECREF(rcc);
+        free(rcc);
+        return (NULL);
+    }
     rcc->controlfd_in = controlfd_in;
     rcc->controlfd_out = controlfd_out;
     rcc->csock = csock;
@@ -273,13 +450,21 @@ rtpp_cmd_connection_ctor(int controlfd_in, int controlfd_out,
         rcc->rlen = SA_LEN(rap);
         memcpy(&rcc->raddr, rap, rcc->rlen);
     }
+    CALL_SMETHOD(rcc->rcnt, attach, (rtpp_refcnt_dtor_t)&rtpp_cmd_connection_dtor,
+      rcc);
     return (rcc);
 }
 
-void
+/*
+ * Invoked when the last reference is gone, commands that are still being
+ * executed by the pipelined workers keep the connection open.
+ */
+static void
 rtpp_cmd_connection_dtor(struct rtpp_cmd_connection *rcc)
 {
 
+    pthread_mutex_destroy(&rcc->wlock);
+
     if (rcc->controlfd_in != rcc->csock->controlfd_in) {
         close(rcc->controlfd_in);
         if (rcc->controlfd_out != rcc->controlfd_in) {
@@ -400,8 +585,6 @@ rtpp_cmd_queue_run(void *arg)
     psp = &cmd_cf->pset;
 
     for (;;) {
-        rtpp_timestamp_get(&sptime);
-
         pthread_mutex_lock(&psp->pfds_mutex);
         if (psp->pfds_used == 0) {
             pthread_mutex_unlock(&psp->pfds_mutex);
@@ -423,6 +606,7 @@ rtpp_cmd_queue_run(void *arg)
             continue;
         }
         if (nready > 0) {
+            rtpp_timestamp_get(&sptime);
             for (i = 0; i < psp->pfds_used; i++) {
 again:
                 if ((psp->pfds[i].revents & (POLLERR | POLLHUP)) != 0) {
@@ -437,10 +621,11 @@ again:
                     continue;
                 }
                 if (RTPP_CTRL_ISSTREAM(psp->rccs[i]->csock)) {
-                    rval = process_commands_stream(CONST(cmd_cf->cf_save), psp->rccs[i], &sptime, csp, rtpp_stats_cf);
+                    rval = process_commands_stream(cmd_cf, psp->rccs[i], &sptime, csp, rtpp_stats_cf,
+                      &cmd_cf->cmd_spare);
                 } else {
-                    rval = process_commands(psp->rccs[i]->csock, CONST(cmd_cf->cf_save), psp->pfds[i].fd,
-                      &sptime, csp, rtpp_stats_cf, cmd_cf->rcache);
+                    rval = process_commands(cmd_cf, psp->rccs[i]->csock, psp->pfds[i].fd,
+                      &sptime, csp, rtpp_stats_cf, &cmd_cf->cmd_spare);
                 }
                 /*
                  * Shut down non-datagram sockets that got I/O error
@@ -452,7 +637,7 @@ closefd:
                     if (psp->rccs[i]->csock->type == RTPC_STDIO && psp->rccs[i]->csock->exit_on_close != 0) {
                         cmd_cf->cf_save->slowshutdown = 1;
                     }
-                    rtpp_cmd_connection_dtor(psp->rccs[i]);
+                    RTPP_OBJ_DECREF(psp->rccs[i]);
                     psp->pfds_used--;
                     if (psp->pfds_used > 0 && i < psp->pfds_used) {
                         memmove(&psp->pfds[i], &psp->pfds[i + 1],
@@ -491,6 +676,24 @@ rtpp_command_async_get_aload(struct rtpp_cmd_async *pub)
 #endif
 }
 
+static double
+rtpp_command_async_get_latency(struct rtpp_cmd_async *pub)
+{
+    double lat;
+    struct rtpp_cmd_async_cf *cmd_cf;
+
+    PUB2PVT(pub, cmd_cf);
+
+    pthread_mutex_lock(&cmd_cf->cmd_mutex);
+    lat = cmd_cf->cmd_latency.lastval;
+    if (getdtime() - cmd_cf->cmd_latency_ts > RTPC_LAT_IDLE_TMO) {
+        lat = 0.0;
+    }
+    pthread_mutex_unlock(&cmd_cf->cmd_mutex);
+
+    return (lat);
+}
+
 static int
 rtpp_command_async_wakeup(struct rtpp_cmd_async *pub)
 {
@@ -576,7 +779,7 @@ init_pollset(const struct rtpp_cfg *cfsp, struct rtpp_cmd_pollset *psp)
             int j;
 
             for (j = i - 1; j >= 0; j --)
-                rtpp_cmd_connection_dtor(psp->rccs[j]);
+                RTPP_OBJ_DECREF(psp->rccs[j]);
             goto e1;
         }
         i++;
@@ -596,7 +799,7 @@ free_pollset(struct rtpp_cmd_pollset *psp)
     int i;
 
     for (i = 0; i < psp->pfds_used; i ++) {
-        rtpp_cmd_connection_dtor(psp->rccs[i]);
+        RTPP_OBJ_DECREF(psp->rccs[i]);
     }
     free(psp->pfds);
 }
@@ -654,6 +857,7 @@ struct rtpp_cmd_async *
 rtpp_command_async_ctor(struct rtpp_cfg *cfsp)
 {
     struct rtpp_cmd_async_cf *cmd_cf;
+    struct rtpp_ctrl_sock *ctrl_sock;
     int need_acptr, i;
 
     cmd_cf = rtpp_zmalloc(sizeof(*cmd_cf));
@@ -678,7 +882,7 @@ rtpp_command_async_ctor(struct rtpp_cfg *cfsp)
     }
     assert(cfsp->rtpp_timed_cf != NULL);
     cmd_cf->rcache = rtpp_cmd_rcache_ctor(cfsp->rtpp_timed_cf,
-      32.0 + 3.0);
+      cfsp->rtpp_stats, 32.0 + 3.0, (size_t)cfsp->rcache_mem * 1024 * 1024);
     if (cmd_cf->rcache == NULL) {
         goto e5;
     }
@@ -686,8 +890,18 @@ rtpp_command_async_ctor(struct rtpp_cfg *cfsp)
 #if 0
     recfilter_init(&cmd_cf->average_load, 0.999, 0.0, 1);
 #endif
+    recfilter_init(&cmd_cf->cmd_latency, RTPC_LAT_FCOEF, 0.0, 0);
 
     cmd_cf->cf_save = cfsp;
+    rtpp_pearson_shuffle(&cmd_cf->rp);
+    for (ctrl_sock = RTPP_LIST_HEAD(cfsp->ctrl_socks); ctrl_sock != NULL;
+      ctrl_sock = RTPP_ITER_NEXT(ctrl_sock)) {
+        if (RTPP_CTRL_ISPIPELINED(ctrl_sock))
+            break;
+    }
+    if (ctrl_sock != NULL && rtpp_cmd_plworkers_start(cmd_cf) != 0) {
+        goto e6;
+    }
     if (need_acptr != 0) {
         if (pthread_create(&cmd_cf->acpt_thread_id, NULL,
           (void *(*)(void *))&rtpp_cmd_acceptor_run, cmd_cf) != 0) {
@@ -702,6 +916,7 @@ rtpp_command_async_ctor(struct rtpp_cfg *cfsp)
     cmd_cf->pub.dtor = &rtpp_command_async_dtor;
     cmd_cf->pub.wakeup = &rtpp_command_async_wakeup;
     cmd_cf->pub.get_aload = &rtpp_command_async_get_aload;
+    cmd_cf->pub.get_latency = &rtpp_command_async_get_latency;
     cmd_cf->pub.reg_overload = &rtpp_command_async_reg_overload;
     cmd_cf->pub.chk_overload = &rtpp_command_async_chk_overload;
     return (&cmd_cf->pub);
@@ -717,6 +932,7 @@ e7:
         pthread_join(cmd_cf->acpt_thread_id, NULL);
     }
 e6:
+    rtpp_cmd_plworkers_stop(cmd_cf);
     CALL_METHOD(cmd_cf->rcache, shutdown);
     RTPP_OBJ_DECREF(cmd_cf->rcache);
 e5:
@@ -757,6 +973,8 @@ rtpp_command_async_dtor(struct rtpp_cmd_async *pub)
     if (cmd_cf->acceptor_started != 0) {
         pthread_join(cmd_cf->acpt_thread_id, NULL);
     }
+    rtpp_cmd_plworkers_stop(cmd_cf);
+    free_command_spare(&cmd_cf->cmd_spare);
     CALL_METHOD(cmd_cf->rcache, shutdown);
     RTPP_OBJ_DECREF(cmd_cf->rcache);
     pthread_cond_destroy(&cmd_cf->cmd_cond);
@@ -46,6 +46,9 @@
 #include "rtpp_log_obj.h"
 
 struct cmd_props {
+    enum rtpp_cmd_op op;
+    const char *rname;
+    const char *hint;
     int max_argc;
     int min_argc;
     int has_cmods;
@@ -53,229 +56,203 @@ struct cmd_props {
     int has_subc;
     int fpos;
     int tpos;
-    char *cmods;
+    int no_glock;
+    /* Variant selected by the first modifier, i.e. "VF" vs "V" */
+    char sub_cmod;
+    const struct cmd_props *sub_props;
 };
 
-static int 
-fill_cmd_props(const struct rtpp_cfg *cfsp, struct rtpp_command *cmd,
-  struct cmd_props *cpp)
-{
+/* Marks commands that accept as many arguments as there are stats counters */
+#define	MAX_ARGC_NSTATS	(-1)
 
-    cpp->has_call_id = 1;
-    cpp->has_subc = 0;
-    cpp->fpos = -1;
-    cpp->tpos = -1;
-    cpp->cmods = &(cmd->args.v[0][1]);
-    switch (cmd->args.v[0][0]) {
-    case 'u':
-    case 'U':
-        cmd->cca.op = UPDATE;
-        cmd->cca.rname = "update/create";
-        cmd->cca.hint = "U[opts] callid remote_ip remote_port from_tag [to_tag] [notify_socket notify_tag]";
-        cpp->max_argc = 8;
-        cpp->min_argc = 5;
-        cpp->has_cmods = 1;
-        cpp->fpos = 4;
-        cpp->tpos = 5;
-        cpp->has_subc = 1;
-        break;
+static const struct cmd_props update_props = {
+    .op = UPDATE, .rname = "update/create",
+    .hint = "U[opts] callid remote_ip remote_port from_tag [to_tag] [notify_socket notify_tag]",
+    .max_argc = 8, .min_argc = 5, .has_cmods = 1, .has_call_id = 1,
+    .has_subc = 1, .fpos = 4, .tpos = 5
+};
 
-    case 'l':
-    case 'L':
-        cmd->cca.op = LOOKUP;
-        cmd->cca.rname = "lookup";
-        cmd->cca.hint = "L[opts] callid remote_ip remote_port from_tag [to_tag]";
-        cpp->max_argc = 6;
-        cpp->min_argc = 5;
-        cpp->has_cmods = 1;
-        cpp->fpos = 4;
-        cpp->tpos = 5;
-        cpp->has_subc = 1;
-        break;
+static const struct cmd_props lookup_props = {
+    .op = LOOKUP, .rname = "lookup",
+    .hint = "L[opts] callid remote_ip remote_port from_tag [to_tag]",
+    .max_argc = 6, .min_argc = 5, .has_cmods = 1, .has_call_id = 1,
+    .has_subc = 1, .fpos = 4, .tpos = 5
+};
 
-    case 'd':
-    case 'D':
-        cmd->cca.op = DELETE;
-        cmd->cca.rname = "delete";
-        cmd->cca.hint = "D[w] callid from_tag [to_tag]";
-        cpp->max_argc = 4;
-        cpp->min_argc = 3;
-        cpp->has_cmods = 1;
-        cpp->fpos = 2;
-        cpp->tpos = 3;
-        break;
+static const struct cmd_props delete_props = {
+    .op = DELETE, .rname = "delete", .hint = "D[w] callid from_tag [to_tag]",
+    .max_argc = 4, .min_argc = 3, .has_cmods = 1, .has_call_id = 1,
+    .fpos = 2, .tpos = 3
+};
 
-    case 'p':
-    case 'P':
-        cmd->cca.op = PLAY;
-        cmd->cca.rname = "play";
-        cmd->cca.hint = "P[n] callid pname codecs from_tag [to_tag]";
-        cpp->max_argc = 6;
-        cpp->min_argc = 5;
-        cpp->has_cmods = 1;
-        cpp->fpos = 4;
-        cpp->tpos = 5;
-        break;
+static const struct cmd_props play_props = {
+    .op = PLAY, .rname = "play",
+    .hint = "P[n] callid pname codecs from_tag [to_tag]",
+    .max_argc = 6, .min_argc = 5, .has_cmods = 1, .has_call_id = 1,
+    .fpos = 4, .tpos = 5
+};
 
-    case 'r':
-    case 'R':
-        cmd->cca.op = RECORD;
-        cmd->cca.rname = "record";
-        if (cfsp->record_pcap != 0) {
-            cmd->cca.hint = "R[s] call_id from_tag [to_tag]";
-        } else {
-            cmd->cca.hint = "R call_id from_tag [to_tag]";
-        }
-        cpp->max_argc = 4;
-        cpp->min_argc = 3;
-        cpp->has_cmods = 1;
-        cpp->fpos = 2;
-        cpp->tpos = 3;
-        break;
+static const struct cmd_props record_props = {
+    .op = RECORD, .rname = "record", .hint = "R call_id from_tag [to_tag]",
+    .max_argc = 4, .min_argc = 3, .has_cmods = 1, .has_call_id = 1,
+    .fpos = 2, .tpos = 3
+};
 
-    case 'c':
-    case 'C':
-        cmd->cca.op = COPY;
-        cmd->cca.rname = "copy";
-        cmd->cca.hint = "C[-xxx-] call_id -XXX- from_tag [to_tag]";
-        cpp->max_argc = 5;
-        cpp->min_argc = 4;
-        cpp->has_cmods = 1;
-        cpp->fpos = 3;
-        cpp->tpos = 4;
-        break;
+static const struct cmd_props copy_props = {
+    .op = COPY, .rname = "copy",
+    .hint = "C[-xxx-] call_id -XXX- from_tag [to_tag]",
+    .max_argc = 5, .min_argc = 4, .has_cmods = 1, .has_call_id = 1,
+    .fpos = 3, .tpos = 4
+};
 
-    case 's':
-    case 'S':
-        cmd->cca.op = NOPLAY;
-        cmd->cca.rname = "noplay";
-        cmd->cca.hint = "S call_id from_tag [to_tag]";
-        cpp->max_argc = 4;
-        cpp->min_argc = 3;
-        cpp->has_cmods = 0;
-        cpp->fpos = 2;
-        cpp->tpos = 3;
-        break;
+static const struct cmd_props noplay_props = {
+    .op = NOPLAY, .rname = "noplay", .hint = "S call_id from_tag [to_tag]",
+    .max_argc = 4, .min_argc = 3, .has_cmods = 0, .has_call_id = 1,
+    .fpos = 2, .tpos = 3
+};
 
-    case 'n':
-    case 'N':
-        cmd->cca.op = NORECORD;
-        cmd->cca.rname = "norecord";
-        cmd->cca.hint = "N[a] call_id from_tag [to_tag]";
-        cpp->max_argc = 4;
-        cpp->min_argc = 3;
-        cpp->has_cmods = 1;
-        cpp->fpos = 2;
-        cpp->tpos = 3;
-        break;
+static const struct cmd_props norecord_props = {
+    .op = NORECORD, .rname = "norecord", .hint = "N[a] call_id from_tag [to_tag]",
+    .max_argc = 4, .min_argc = 3, .has_cmods = 1, .has_call_id = 1,
+    .fpos = 2, .tpos = 3
+};
 
-    case 'v':
-    case 'V':
-        if (cpp->cmods[0] == 'F' || cpp->cmods[0] == 'f') {
-            cpp->cmods += 1;
-            cmd->cca.op = VER_FEATURE;
-            cmd->cca.rname = "feature_check";
-            cmd->cca.hint = "VF feature_num";
-            cmd->no_glock = 1;
-            cpp->max_argc = 2;
-            cpp->min_argc = 2;
-            cpp->has_cmods = 0;
-            cpp->has_call_id = 0;
-            break;
-        }
-        cmd->cca.op = GET_VER;
-        cmd->cca.rname = "get_version";
-        cmd->cca.hint = "V";
-        cmd->no_glock = 1;
-        cpp->max_argc = 1;
-        cpp->min_argc = 1;
-        cpp->has_cmods = 0;
-        cpp->has_call_id = 0;
-        break;
+static const struct cmd_props ver_feature_props = {
+    .op = VER_FEATURE, .rname = "feature_check", .hint = "VF feature_num",
+    .max_argc = 2, .min_argc = 2, .has_cmods = 0, .has_call_id = 0,
+    .fpos = -1, .tpos = -1, .no_glock = 1
+};
 
-    case 'i':
-    case 'I':
-        cmd->cca.op = INFO;
-        cmd->cca.rname = "get_info";
-        cmd->cca.hint = "I[b]";
-        cpp->max_argc = 1;
-        cpp->min_argc = 1;
-        cpp->has_cmods = 1;
-        cpp->has_call_id = 0;
-        break;
+static const struct cmd_props get_ver_props = {
+    .op = GET_VER, .rname = "get_version", .hint = "V",
+    .max_argc = 1, .min_argc = 1, .has_cmods = 0, .has_call_id = 0,
+    .fpos = -1, .tpos = -1, .no_glock = 1,
+    .sub_cmod = 'f', .sub_props = &ver_feature_props
+};
 
-    case 'q':
-    case 'Q':
-        cmd->cca.op = QUERY;
-        cmd->cca.rname = "query";
-        cmd->cca.hint = "Q[v] call_id from_tag [to_tag [stat_name1 ...[stat_nameN]]]";
-        cpp->max_argc = 4 + RTPP_QUERY_NSTATS;
-        cpp->min_argc = 3;
-        cpp->has_cmods = 1;
-        cpp->fpos = 2;
-        cpp->tpos = 3;
-        break;
+static const struct cmd_props info_props = {
+    .op = INFO, .rname = "get_info", .hint = "I[b]",
+    .max_argc = 1, .min_argc = 1, .has_cmods = 1, .has_call_id = 0,
+    .fpos = -1, .tpos = -1
+};
 
-    case 'x':
-    case 'X':
-        cmd->cca.op = DELETE_ALL;
-        cmd->cca.rname = "delete_all";
-        cmd->cca.hint = "X";
-        cpp->max_argc = 1;
-        cpp->min_argc = 1;
-        cpp->has_cmods = 0;
-        cpp->has_call_id = 0;
-        break;
+static const struct cmd_props query_all_props = {
+    .op = QUERY_ALL, .rname = "query_all",
+    .hint = "QA[v] [cid=call_id_prefix] [age=min_age] [ttl=max_ttl]",
+    .max_argc = 1 + RTPP_QUERY_ALL_NFILTS, .min_argc = 1, .has_cmods = 1,
+    .has_call_id = 0, .fpos = -1, .tpos = -1,
+    /* Works off a snapshot of the session table */
+    .no_glock = 1
+};
 
-    case 'g':
-    case 'G':
-        cmd->cca.op = GET_STATS;
-        cmd->cca.rname = "get_stats";
-        cmd->cca.hint = "G[v] [stat_name1 [stat_name2 [stat_name3 ...[stat_nameN]]]]";
-        cmd->no_glock = 1;
-        cpp->max_argc = CALL_SMETHOD(cfsp->rtpp_stats, getnstats) + 1;
-        cpp->min_argc = 1;
-        cpp->has_cmods = 1;
-        cpp->has_call_id = 0;
-        break;
+static const struct cmd_props query_props = {
+    .op = QUERY, .rname = "query",
+    .hint = "Q[v] call_id from_tag [to_tag [stat_name1 ...[stat_nameN]]]",
+    .max_argc = 4 + RTPP_QUERY_NSTATS, .min_argc = 3, .has_cmods = 1,
+    .has_call_id = 1, .fpos = 2, .tpos = 3,
+    .sub_cmod = 'a', .sub_props = &query_all_props
+};
 
-    default:
-        return (-1);
+static const struct cmd_props delete_all_props = {
+    .op = DELETE_ALL, .rname = "delete_all", .hint = "X",
+    .max_argc = 1, .min_argc = 1, .has_cmods = 0, .has_call_id = 0,
+    .fpos = -1, .tpos = -1
+};
+
+static const struct cmd_props get_stats_props = {
+    .op = GET_STATS, .rname = "get_stats",
+    .hint = "G[v] [stat_name1 [stat_name2 [stat_name3 ...[stat_nameN]]]]",
+    .max_argc = MAX_ARGC_NSTATS, .min_argc = 1, .has_cmods = 1,
+    .has_call_id = 0, .fpos = -1, .tpos = -1, .no_glock = 1
+};
+
+#define	CMD_PROPS_ENT(lc, uc, props) [(lc)] = &(props), [(uc)] = &(props)
+
+/* Indexed directly by the first character of the command */
+static const struct cmd_props *const cmd_props_tbl[128] = {
+    CMD_PROPS_ENT('u', 'U', update_props),
+    CMD_PROPS_ENT('l', 'L', lookup_props),
+    CMD_PROPS_ENT('d', 'D', delete_props),
+    CMD_PROPS_ENT('p', 'P', play_props),
+    CMD_PROPS_ENT('r', 'R', record_props),
+    CMD_PROPS_ENT('c', 'C', copy_props),
+    CMD_PROPS_ENT('s', 'S', noplay_props),
+    CMD_PROPS_ENT('n', 'N', norecord_props),
+    CMD_PROPS_ENT('v', 'V', get_ver_props),
+    CMD_PROPS_ENT('i', 'I', info_props),
+    CMD_PROPS_ENT('q', 'Q', query_props),
+    CMD_PROPS_ENT('x', 'X', delete_all_props),
+    CMD_PROPS_ENT('g', 'G', get_stats_props),
+};
+
+static const struct cmd_props *
+fill_cmd_props(const struct rtpp_cfg *cfsp, struct rtpp_command *cmd,
+  const char **cmodsp)
+{
+    const struct cmd_props *cpp;
+    const char *cmods;
+    unsigned char c;
+
+    c = cmd->args.v[0][0];
+    if (c >= sizeof(cmd_props_tbl) / sizeof(cmd_props_tbl[0]))
+        return (NULL);
+    cpp = cmd_props_tbl[c];
+    if (cpp == NULL)
+        return (NULL);
+    cmods = &(cmd->args.v[0][1]);
+    if (cpp->sub_props != NULL && (cmods[0] | 0x20) == cpp->sub_cmod) {
+        cmods += 1;
+        cpp = cpp->sub_props;
     }
-    return (0);
+    cmd->cca.op = cpp->op;
+    cmd->cca.rname = cpp->rname;
+    if (cpp->op == RECORD && cfsp->record_pcap != 0) {
+        cmd->cca.hint = "R[s] call_id from_tag [to_tag]";
+    } else {
+        cmd->cca.hint = cpp->hint;
+    }
+    cmd->no_glock = cpp->no_glock;
+    *cmodsp = cmods;
+    return (cpp);
 }
 
 int
 rtpp_command_pre_parse(const struct rtpp_cfg *cfsp, struct rtpp_command *cmd)
 {
-    struct cmd_props cprops;
+    const struct cmd_props *cpp;
+    const char *cmods;
+    int max_argc;
 
-    if (fill_cmd_props(cfsp, cmd, &cprops) != 0) {
+    cpp = fill_cmd_props(cfsp, cmd, &cmods);
+    if (cpp == NULL) {
         RTPP_LOG(cfsp->glog, RTPP_LOG_ERR, "unknown command \"%c\"",
           cmd->args.v[0][0]);
         reply_error(cmd, ECODE_CMDUNKN);
         return (-1);
     }
-    if (cmd->args.c < cprops.min_argc || cmd->args.c > cprops.max_argc) {
+    max_argc = cpp->max_argc;
+    if (max_argc == MAX_ARGC_NSTATS)
+        max_argc = CALL_SMETHOD(cfsp->rtpp_stats, getnstats) + 1;
+    if (cmd->args.c < cpp->min_argc || cmd->args.c > max_argc) {
         RTPP_LOG(cfsp->glog, RTPP_LOG_ERR, "%s command syntax error"
           ": invalid number of arguments (%d)", cmd->cca.rname, cmd->args.c);
         reply_error(cmd, ECODE_PARSE_NARGS);
         return (-1);
     }
-    if (cprops.has_cmods == 0 && cprops.cmods[0] != '\0') {
+    if (cpp->has_cmods == 0 && cmods[0] != '\0') {
         RTPP_LOG(cfsp->glog, RTPP_LOG_ERR, "%s command syntax error"
           ": modifiers are not supported by the command", cmd->cca.rname);
         reply_error(cmd, ECODE_PARSE_MODS);
         return (-1);
     }
-    if (cprops.has_subc == 0 && cmd->subc_args.c > 0) {
+    if (cpp->has_subc == 0 && cmd->subc_args.c > 0) {
         RTPP_LOG(cfsp->glog, RTPP_LOG_ERR, "%s command syntax error"
           ": subcommand is not supported", cmd->cca.rname);
         reply_error(cmd, ECODE_PARSE_SUBC);
         return (-1);
     }
-    cmd->cca.call_id = cprops.has_call_id ? cmd->args.v[1] : NULL;
-    cmd->cca.from_tag = cprops.fpos > 0 ? cmd->args.v[cprops.fpos] : NULL;
-    cmd->cca.to_tag = cprops.tpos > 0 ? cmd->args.v[cprops.tpos] : NULL;
+    cmd->cca.call_id = cpp->has_call_id ? cmd->args.v[1] : NULL;
+    cmd->cca.from_tag = cpp->fpos > 0 ? cmd->args.v[cpp->fpos] : NULL;
+    cmd->cca.to_tag = cpp->tpos > 0 ? cmd->args.v[cpp->tpos] : NULL;
     return (0);
 }
@@ -48,10 +48,14 @@ struct rtpp_command_stats {
 
     struct rtpp_command_stat nplrs_created;
     struct rtpp_command_stat nplrs_destroyed;
+
+    struct rtpp_command_stat ncmds_shed_newsess;
+    struct rtpp_command_stat ncmds_shed_media;
+    struct rtpp_command_stat ncmds_shed_obsrvs;
 };
 
 enum rtpp_cmd_op {DELETE, RECORD, PLAY, NOPLAY, COPY, UPDATE, LOOKUP, INFO,
-  QUERY, VER_FEATURE, GET_VER, DELETE_ALL, GET_STATS, NORECORD};
+  QUERY, VER_FEATURE, GET_VER, DELETE_ALL, GET_STATS, NORECORD, QUERY_ALL};
 
 struct common_cmd_args {
     enum rtpp_cmd_op op;
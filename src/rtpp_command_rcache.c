@@ -29,35 +29,86 @@
 #include "config_pp.h"
 #endif
 
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "rtpp_types.h"
 #include "rtpp_command_rcache.h"
 #include "rtpp_command_rcache_fin.h"
-#include "rtpp_hash_table.h"
+#include "rtpp_debug.h"
 #include "rtpp_mallocs.h"
+#include "rtpp_pearson.h"
 #include "rtpp_refcnt.h"
+#include "rtpp_stats.h"
 #include "rtpp_timed.h"
 #include "rtpp_timed_task.h"
 #include "rtpp_util.h"
 
 #define	RTPP_RCACHE_CPERD	3.0
 
+/*
+ * The cache is split into independently locked shards selected by the top
+ * bits of the cookie hash, so that the command threads and the periodic
+ * cleanup do not all serialize on a single lock during retransmit storms.
+ * Each shard is an open-addressed (linear probing) table of entry pointers
+ * plus a FIFO list of the same entries in insertion order. Since all
+ * entries share the same TTL, the FIFO order is also the expiration order,
+ * so that both timeout processing and eviction under memory pressure only
+ * ever touch the head of the list.
+ */
+#define	RTPP_RCACHE_NSHARDS_LOG2	3
+#define	RTPP_RCACHE_NSHARDS	(1 << RTPP_RCACHE_NSHARDS_LOG2)
+#define	RTPP_RCACHE_HT_LEN	64
+
+/*
+ * Typical reply is a cookie followed by a port number or an error code,
+ * entries that fit into RTPP_RCACHE_SLAB_OBJSZ bytes are carved out of
+ * larger slabs and recycled via the free list instead of malloc()/free()
+ * on every command.
+ */
+#define	RTPP_RCACHE_SLAB_OBJSZ	256
+#define	RTPP_RCACHE_SLAB_NOBJS	64
+
+struct rtpp_cmd_rcache_entry {
+    struct rtpp_cmd_rcache_entry *next;
+    double etime;
+    uint32_t hash;
+    uint32_t slot;
+    size_t asize;
+    const char *reply;
+    char cookie[0];
+};
+
+struct rtpp_cmd_rcache_slab {
+    struct rtpp_cmd_rcache_slab *next;
+    char objs[RTPP_RCACHE_SLAB_NOBJS][RTPP_RCACHE_SLAB_OBJSZ];
+};
+
+struct rtpp_cmd_rcache_shard {
+    pthread_mutex_t lock;
+    struct rtpp_cmd_rcache_entry **ht;
+    uint32_t ht_mask;
+    uint32_t nents;
+    struct rtpp_cmd_rcache_entry *head;
+    struct rtpp_cmd_rcache_entry *tail;
+    struct rtpp_cmd_rcache_entry *free_objs;
+    struct rtpp_cmd_rcache_slab *slabs;
+    size_t mem;
+};
+
 struct rtpp_cmd_rcache_pvt {
     struct rtpp_cmd_rcache pub;
     double min_ttl;
-    struct rtpp_hash_table *ht;
+    size_t shard_max_mem;
+    struct rtpp_pearson rp;
+    struct rtpp_stats *rtpp_stats;
+    int nevicted_idx;
     struct rtpp_timed_task *timeout;
     int timeout_rval;
-};
-
-struct rtpp_cmd_rcache_entry {
-    char *reply;
-    double etime;
-    struct {
-        struct rtpp_refcnt *rcnt;
-    } pub;
+    struct rtpp_cmd_rcache_shard shards[RTPP_RCACHE_NSHARDS];
 };
 
 static enum rtpp_timed_cb_rvals rtpp_cmd_rcache_cleanup(double, void *);
@@ -67,31 +118,44 @@ int rtpp_cmd_rcache_lookup(struct rtpp_cmd_rcache *, const char *,
   char *, int);
 static void rtpp_cmd_rcache_dtor(struct rtpp_cmd_rcache_pvt *);
 static void rtpp_cmd_rcache_shutdown(struct rtpp_cmd_rcache *);
+static void rtpp_cmd_rcache_shard_fini(struct rtpp_cmd_rcache_shard *);
 
 struct rtpp_cmd_rcache *
-rtpp_cmd_rcache_ctor(struct rtpp_timed *rtpp_timed_cf, double min_ttl)
+rtpp_cmd_rcache_ctor(struct rtpp_timed *rtpp_timed_cf,
+  struct rtpp_stats *rtpp_stats, double min_ttl, size_t max_mem)
 {
     struct rtpp_cmd_rcache_pvt *pvt;
+    struct rtpp_cmd_rcache_shard *shp;
+    int i;
 
     pvt = rtpp_rzmalloc(sizeof(struct rtpp_cmd_rcache_pvt), PVT_RCOFFS(pvt));
     if (pvt == NULL) {
         return (NULL);
     }
-#if !defined(RTPP_DEBUG)
-    pvt->ht = rtpp_hash_table_ctor(rtpp_ht_key_str_t, RTPP_HT_NODUPS);
-#else
-    pvt->ht = rtpp_hash_table_ctor(rtpp_ht_key_str_t, RTPP_HT_NODUPS |
-      RTPP_HT_DUP_ABRT);
-#endif
-    if (pvt->ht == NULL) {
-        goto e0;
+    for (i = 0; i < RTPP_RCACHE_NSHARDS; i++) {
+        shp = &pvt->shards[i];
+        shp->ht = rtpp_zmalloc(sizeof(shp->ht[0]) * RTPP_RCACHE_HT_LEN);
+        if (shp->ht == NULL) {
+            goto e1;
+        }
+        if (pthread_mutex_init(&shp->lock, NULL) != 0) {
+            free(shp->ht);
+            goto e1;
+        }
+        shp->ht_mask = RTPP_RCACHE_HT_LEN - 1;
     }
     pvt->timeout = CALL_SMETHOD(rtpp_timed_cf, schedule_rc, RTPP_RCACHE_CPERD,
       pvt->pub.rcnt, rtpp_cmd_rcache_cleanup, NULL, pvt);
     if (pvt->timeout == NULL) {
-        goto e2;
+        goto e1;
     }
+    rtpp_pearson_shuffle(&pvt->rp);
     pvt->min_ttl = min_ttl;
+    pvt->shard_max_mem = max_mem / RTPP_RCACHE_NSHARDS;
+    pvt->rtpp_stats = rtpp_stats;
+    RTPP_OBJ_INCREF(rtpp_stats);
+    pvt->nevicted_idx = CALL_SMETHOD(rtpp_stats, getidxbyname,
+      "nrcache_evicted");
     pvt->timeout_rval = CB_MORE;
     pvt->pub.insert = &rtpp_cmd_rcache_insert;
     pvt->pub.lookup = &rtpp_cmd_rcache_lookup;
@@ -100,22 +164,147 @@ rtpp_cmd_rcache_ctor(struct rtpp_timed *rtpp_timed_cf, double min_ttl)
       pvt);
     return (&pvt->pub);
 
-e2:
-    CALL_METHOD(pvt->ht, dtor);
-e0:
+e1:
+    while (i-- > 0) {
+        rtpp_cmd_rcache_shard_fini(&pvt->shards[i]);
+    }
     RTPP_OBJ_DECREF(&(pvt->pub));
     free(pvt);
     return (NULL);
 }
 
+static struct rtpp_cmd_rcache_entry *
+rtpp_cmd_rcache_ent_alloc(struct rtpp_cmd_rcache_shard *shp, size_t asize)
+{
+    struct rtpp_cmd_rcache_entry *rep;
+    struct rtpp_cmd_rcache_slab *slp;
+    int i;
+
+    if (asize > RTPP_RCACHE_SLAB_OBJSZ) {
+        return (malloc(asize));
+    }
+    if (shp->free_objs == NULL) {
+        slp = malloc(sizeof(struct rtpp_cmd_rcache_slab));
+        if (slp == NULL) {
+            return (NULL);
+        }
+        slp->next = shp->slabs;
+        shp->slabs = slp;
+        for (i = RTPP_RCACHE_SLAB_NOBJS - 1; i >= 0; i--) {
+            rep = (struct rtpp_cmd_rcache_entry *)slp->objs[i];
+            rep->next = shp->free_objs;
+            shp->free_objs = rep;
+        }
+    }
+    rep = shp->free_objs;
+    shp->free_objs = rep->next;
+    return (rep);
+}
+
 static void
-rtpp_cmd_rcache_entry_free(void *p)
+rtpp_cmd_rcache_ent_free(struct rtpp_cmd_rcache_shard *shp,
+  struct rtpp_cmd_rcache_entry *rep)
+{
+
+    if (rep->asize > RTPP_RCACHE_SLAB_OBJSZ) {
+        free(rep);
+        return;
+    }
+    rep->next = shp->free_objs;
+    shp->free_objs = rep;
+}
+
+static struct rtpp_cmd_rcache_entry *
+rtpp_cmd_rcache_ht_find(struct rtpp_cmd_rcache_shard *shp, const char *cookie,
+  uint32_t hash)
 {
     struct rtpp_cmd_rcache_entry *rep;
+    uint32_t i;
 
-    rep = (struct rtpp_cmd_rcache_entry *)p;
-    free(rep->reply);
-    free(rep);
+    for (i = hash & shp->ht_mask; (rep = shp->ht[i]) != NULL;
+      i = (i + 1) & shp->ht_mask) {
+        if (rep->hash == hash && strcmp(rep->cookie, cookie) == 0)
+            return (rep);
+    }
+    return (NULL);
+}
+
+static void
+rtpp_cmd_rcache_ht_link(struct rtpp_cmd_rcache_shard *shp,
+  struct rtpp_cmd_rcache_entry *rep)
+{
+    uint32_t i;
+
+    for (i = rep->hash & shp->ht_mask; shp->ht[i] != NULL;
+      i = (i + 1) & shp->ht_mask)
+        continue;
+    shp->ht[i] = rep;
+    rep->slot = i;
+}
+
+/*
+ * Backward-shift deletion: pull the following entries of the same probe
+ * run into the hole, so that the table never accumulates tombstones.
+ */
+static void
+rtpp_cmd_rcache_ht_unlink(struct rtpp_cmd_rcache_shard *shp,
+  struct rtpp_cmd_rcache_entry *rep)
+{
+    struct rtpp_cmd_rcache_entry *nrep;
+    uint32_t i, j, k;
+
+    i = j = rep->slot;
+    RTPP_DBG_ASSERT(shp->ht[i] == rep);
+    shp->ht[i] = NULL;
+    for (;;) {
+        j = (j + 1) & shp->ht_mask;
+        nrep = shp->ht[j];
+        if (nrep == NULL)
+            break;
+        k = nrep->hash & shp->ht_mask;
+        if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j))
+            continue;
+        shp->ht[i] = nrep;
+        nrep->slot = i;
+        shp->ht[j] = NULL;
+        i = j;
+    }
+}
+
+static int
+rtpp_cmd_rcache_ht_grow(struct rtpp_cmd_rcache_shard *shp)
+{
+    struct rtpp_cmd_rcache_entry **new_ht, *rep;
+    uint32_t new_len;
+
+    new_len = (shp->ht_mask + 1) * 2;
+    new_ht = rtpp_zmalloc(sizeof(new_ht[0]) * new_len);
+    if (new_ht == NULL) {
+        return (-1);
+    }
+    free(shp->ht);
+    shp->ht = new_ht;
+    shp->ht_mask = new_len - 1;
+    for (rep = shp->head; rep != NULL; rep = rep->next) {
+        rtpp_cmd_rcache_ht_link(shp, rep);
+    }
+    return (0);
+}
+
+/* Remove the oldest entry, must be called with the shard locked. */
+static void
+rtpp_cmd_rcache_expire_head(struct rtpp_cmd_rcache_shard *shp)
+{
+    struct rtpp_cmd_rcache_entry *rep;
+
+    rep = shp->head;
+    shp->head = rep->next;
+    if (shp->head == NULL)
+        shp->tail = NULL;
+    rtpp_cmd_rcache_ht_unlink(shp, rep);
+    shp->nents--;
+    shp->mem -= rep->asize;
+    rtpp_cmd_rcache_ent_free(shp, rep);
 }
 
 static void
@@ -123,30 +312,63 @@ rtpp_cmd_rcache_insert(struct rtpp_cmd_rcache *pub, const char *cookie,
   const char *reply, double ctime)
 {
     struct rtpp_cmd_rcache_pvt *pvt;
+    struct rtpp_cmd_rcache_shard *shp;
     struct rtpp_cmd_rcache_entry *rep;
+    size_t clen, rlen, asize;
+    uint32_t hash;
+    int nevicted;
 
     pvt = (struct rtpp_cmd_rcache_pvt *)pub;
-    rep = rtpp_rzmalloc(sizeof(struct rtpp_cmd_rcache_entry), PVT_RCOFFS(rep));
-    if (rep == NULL) {
+    hash = rtpp_pearson_hash32(&pvt->rp, cookie, NULL);
+    shp = &pvt->shards[hash >> (32 - RTPP_RCACHE_NSHARDS_LOG2)];
+    clen = strlen(cookie) + 1;
+    rlen = strlen(reply) + 1;
+    asize = sizeof(struct rtpp_cmd_rcache_entry) + clen + rlen;
+    if (asize <= RTPP_RCACHE_SLAB_OBJSZ)
+        asize = RTPP_RCACHE_SLAB_OBJSZ;
+    if (asize > pvt->shard_max_mem)
         return;
+    nevicted = 0;
+
+    pthread_mutex_lock(&shp->lock);
+    if (rtpp_cmd_rcache_ht_find(shp, cookie, hash) != NULL) {
+        /* Reply to the first copy has already been cached, keep it */
+        goto out;
     }
-    rep->reply = strdup(reply);
-    if (rep->reply == NULL) {
-        goto e1;
+    while (shp->mem + asize > pvt->shard_max_mem) {
+        rtpp_cmd_rcache_expire_head(shp);
+        nevicted++;
     }
+    if ((shp->nents + 1) * 2 > shp->ht_mask + 1 &&
+      rtpp_cmd_rcache_ht_grow(shp) != 0) {
+        goto out;
+    }
+    rep = rtpp_cmd_rcache_ent_alloc(shp, asize);
+    if (rep == NULL) {
+        goto out;
+    }
+    rep->next = NULL;
     rep->etime = ctime + pvt->min_ttl;
-    CALL_SMETHOD(rep->pub.rcnt, attach, rtpp_cmd_rcache_entry_free, rep);
-    CALL_METHOD(pvt->ht, append_refcnt, cookie, rep->pub.rcnt);
-    /*
-     * append_refcnt() either takes ownership in which case it incs refcount
-     * or it drops the ball in which it does not, so we release rco and set
-     * it free.
-     */
-    RTPP_OBJ_DECREF(&(rep->pub));
-    return;
-e1:
-    RTPP_OBJ_DECREF(&(rep->pub));
-    free(rep);
+    rep->hash = hash;
+    rep->asize = asize;
+    memcpy(rep->cookie, cookie, clen);
+    rep->reply = rep->cookie + clen;
+    memcpy((char *)rep->reply, reply, rlen);
+    rtpp_cmd_rcache_ht_link(shp, rep);
+    if (shp->tail == NULL) {
+        shp->head = rep;
+    } else {
+        shp->tail->next = rep;
+    }
+    shp->tail = rep;
+    shp->nents++;
+    shp->mem += asize;
+out:
+    pthread_mutex_unlock(&shp->lock);
+    if (nevicted > 0) {
+        CALL_SMETHOD(pvt->rtpp_stats, updatebyidx, pvt->nevicted_idx,
+          nevicted);
+    }
 }
 
 int
@@ -154,21 +376,21 @@ rtpp_cmd_rcache_lookup(struct rtpp_cmd_rcache *pub, const char *cookie,
   char *rbuf, int rblen)
 {
     struct rtpp_cmd_rcache_pvt *pvt;
+    struct rtpp_cmd_rcache_shard *shp;
     struct rtpp_cmd_rcache_entry *rep;
-    struct rtpp_refcnt *rco;
+    uint32_t hash;
 
     pvt = (struct rtpp_cmd_rcache_pvt *)pub;
-    rco = CALL_METHOD(pvt->ht, find, cookie);
-    if (rco == NULL) {
+    hash = rtpp_pearson_hash32(&pvt->rp, cookie, NULL);
+    shp = &pvt->shards[hash >> (32 - RTPP_RCACHE_NSHARDS_LOG2)];
+    pthread_mutex_lock(&shp->lock);
+    rep = rtpp_cmd_rcache_ht_find(shp, cookie, hash);
+    if (rep == NULL) {
+        pthread_mutex_unlock(&shp->lock);
         return (0);
     }
-    /*
-     * "find" method returns object that has been incref'ed, so make sure
-     * to decref when we've done with it.
-     */
-    rep = CALL_SMETHOD(rco, getdata);
     strlcpy(rbuf, rep->reply, rblen);
-    RC_DECREF(rco);
+    pthread_mutex_unlock(&shp->lock);
     return (1);
 }
 
@@ -184,39 +406,53 @@ rtpp_cmd_rcache_shutdown(struct rtpp_cmd_rcache *pub)
     pvt->timeout = NULL;
 }
 
+static void
+rtpp_cmd_rcache_shard_fini(struct rtpp_cmd_rcache_shard *shp)
+{
+    struct rtpp_cmd_rcache_entry *rep, *rep_next;
+    struct rtpp_cmd_rcache_slab *slp, *slp_next;
+
+    for (rep = shp->head; rep != NULL; rep = rep_next) {
+        rep_next = rep->next;
+        if (rep->asize > RTPP_RCACHE_SLAB_OBJSZ)
+            free(rep);
+    }
+    for (slp = shp->slabs; slp != NULL; slp = slp_next) {
+        slp_next = slp->next;
+        free(slp);
+    }
+    free(shp->ht);
+    pthread_mutex_destroy(&shp->lock);
+}
+
 void
 rtpp_cmd_rcache_dtor(struct rtpp_cmd_rcache_pvt *pvt)
 {
+    int i;
 
     rtpp_cmd_rcache_fin(&pvt->pub);
-    CALL_METHOD(pvt->ht, dtor);
+    for (i = 0; i < RTPP_RCACHE_NSHARDS; i++) {
+        rtpp_cmd_rcache_shard_fini(&pvt->shards[i]);
+    }
+    RTPP_OBJ_DECREF(pvt->rtpp_stats);
     free(pvt);
 }
 
-static int
-rtpp_cmd_rcache_ematch(void *dp, void *ap)
-{
-    struct rtpp_cmd_rcache_entry *rep;
-    double *ctimep;
-
-    /*
-     * This method does not need us to bump ref, since we are in the
-     * context of the rtpp_hash_table, which hold its own ref.
-     */
-    ctimep = (double *)ap;
-    rep = (struct rtpp_cmd_rcache_entry *)dp;
-    if (rep->etime < *ctimep) {
-        return (RTPP_HT_MATCH_DEL);
-    }
-    return (RTPP_HT_MATCH_CONT);
-}
-
 static enum rtpp_timed_cb_rvals
 rtpp_cmd_rcache_cleanup(double ctime, void *p)
 {
     struct rtpp_cmd_rcache_pvt *pvt;
+    struct rtpp_cmd_rcache_shard *shp;
+    int i;
 
     pvt = (struct rtpp_cmd_rcache_pvt *)p;
-    CALL_METHOD(pvt->ht, foreach, rtpp_cmd_rcache_ematch, &ctime);
+    for (i = 0; i < RTPP_RCACHE_NSHARDS; i++) {
+        shp = &pvt->shards[i];
+        pthread_mutex_lock(&shp->lock);
+        while (shp->head != NULL && shp->head->etime < ctime) {
+            rtpp_cmd_rcache_expire_head(shp);
+        }
+        pthread_mutex_unlock(&shp->lock);
+    }
     return (pvt->timeout_rval);
 }
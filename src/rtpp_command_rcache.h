@@ -40,5 +40,7 @@ struct rtpp_cmd_rcache {
 };
 
 struct rtpp_timed;
+struct rtpp_stats;
 
-struct rtpp_cmd_rcache *rtpp_cmd_rcache_ctor(struct rtpp_timed *, double);
+struct rtpp_cmd_rcache *rtpp_cmd_rcache_ctor(struct rtpp_timed *,
+  struct rtpp_stats *, double, size_t);
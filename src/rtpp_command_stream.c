@@ -28,6 +28,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <errno.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <string.h>
 #include <unistd.h>
@@ -45,6 +46,7 @@
 #include "rtpp_command_private.h"
 #include "rtpp_command_stream.h"
 #include "rtpp_command_ecodes.h"
+#include "rtpp_controlfd.h"
 #include "rtpp_util.h"
 
 static void
@@ -114,10 +116,11 @@ rcs_reply_nomem(struct rtpp_log *log, int controlfd, struct rtpp_command_stats *
 
 struct rtpp_command *
 rtpp_command_stream_get(const struct rtpp_cfg *cfsp, struct rtpp_cmd_connection *rcs,
-  int *rval, const struct rtpp_timestamp *dtime, struct rtpp_command_stats *csp)
+  int *rval, const struct rtpp_timestamp *dtime, struct rtpp_command_stats *csp,
+  struct rtpp_command **spare)
 {
     char *cp, *cp1;
-    int len;
+    int len, pipelined;
     struct rtpp_command *cmd;
 
     if (rcs->inbuf_epos == rcs->inbuf_ppos) {
@@ -134,7 +137,13 @@ rtpp_command_stream_get(const struct rtpp_cfg *cfsp, struct rtpp_cmd_connection
 
     len = cp1 - cp;
 
-    cmd = rtpp_command_ctor(cfsp, rcs->controlfd_out, dtime, csp, 0);
+    /*
+     * Pipelined commands are handed over to the workers and released
+     * there, so they can't use the spare object of this thread.
+     */
+    pipelined = RTPP_CTRL_ISPIPELINED(rcs->csock);
+    cmd = rtpp_command_ctor(cfsp, rcs->controlfd_out, dtime, csp, 0,
+      pipelined ? NULL : spare);
     if (cmd == NULL) {
         *rval = GET_CMD_ENOMEM;
         RTPP_LOG(cfsp->glog, RTPP_LOG_ERR, "ENOMEM: command \"%.*s\""
@@ -149,11 +158,21 @@ rtpp_command_stream_get(const struct rtpp_cfg *cfsp, struct rtpp_cmd_connection
         memcpy(&cmd->raddr, &rcs->raddr, rcs->rlen);
     }
 
-    memcpy(cmd->buf, cp, len);
-    cmd->buf[len] = '\0';
+    cp[len] = '\0';
     rcs->inbuf_ppos += len + 1;
 
-    if (rtpp_command_split(cmd, len, rval, NULL) != 0) {
+    if (pipelined) {
+        /* Command can outlive the content of the input buffer */
+        memcpy(cmd->buf, cp, len + 1);
+        cp = cmd->buf;
+        rtpc_set_pipelined(cmd, rcs);
+    }
+    /*
+     * Otherwise parse command right in the input buffer, it is not touched
+     * until the next rtpp_command_stream_doio() call, which only happens
+     * after all complete commands have been handled.
+     */
+    if (rtpp_command_split(cmd, cp, len, rval, NULL) != 0) {
         /* Error reply is handled by the rtpp_command_split() */
         free_command(cmd);
         return (NULL);
@@ -26,8 +26,12 @@
  */
 
 struct rtpp_timestamp;
+struct rtpp_refcnt;
 
 struct rtpp_cmd_connection {
+    struct rtpp_refcnt *rcnt;
+    /* Serializes replies written by the pipelined command workers */
+    pthread_mutex_t wlock;
     int controlfd_in;
     int controlfd_out;
     char inbuf[1024 * 8];
@@ -42,4 +46,4 @@ int rtpp_command_stream_doio(const struct rtpp_cfg *,
   struct rtpp_cmd_connection *);
 struct rtpp_command *rtpp_command_stream_get(const struct rtpp_cfg *,
   struct rtpp_cmd_connection *rcs, int *rval, const struct rtpp_timestamp *,
-  struct rtpp_command_stats *csp);
+  struct rtpp_command_stats *csp, struct rtpp_command **);
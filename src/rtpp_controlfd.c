@@ -263,6 +263,28 @@ rtpp_controlfd_init(const struct rtpp_cfg *cfsp)
     return (0);
 }
 
+/*
+ * Create listening socket for auxiliary (non-command) stream services,
+ * only unix: and tcp:/tcp6: socket types are supported.
+ */
+int
+rtpp_controlfd_listen(const struct rtpp_cfg *cfsp, struct rtpp_ctrl_sock *csp)
+{
+
+    switch (csp->type) {
+    case RTPC_IFSUN:
+        return (controlfd_init_ifsun(cfsp, csp));
+
+    case RTPC_TCP4:
+    case RTPC_TCP6:
+        return (controlfd_init_tcp(cfsp, csp));
+
+    default:
+        errno = EPROTONOSUPPORT;
+        return (-1);
+    }
+}
+
 socklen_t
 rtpp_csock_addrlen(struct rtpp_ctrl_sock *ctrl_sock)
 {
@@ -325,6 +347,10 @@ rtpp_ctrl_sock_parse(const char *optarg)
     } else if (strncmp("cunix:", optarg, 6) == 0) {
         rcsp->type= RTPC_IFSUN_C;
         optarg += 6;
+    } else if (strncmp("pcunix:", optarg, 7) == 0) {
+        rcsp->type= RTPC_IFSUN_C;
+        rcsp->pipelined = 1;
+        optarg += 7;
     } else if (strncmp("systemd:", optarg, 8) == 0) {
         rcsp->type= RTPC_SYSD;
         optarg += 8;
@@ -341,6 +367,14 @@ rtpp_ctrl_sock_parse(const char *optarg)
     } else if (strncmp("tcp6:", optarg, 5) == 0) {
         rcsp->type= RTPC_TCP6;
         optarg += 5;
+    } else if (strncmp("ptcp:", optarg, 5) == 0) {
+        rcsp->type= RTPC_TCP4;
+        rcsp->pipelined = 1;
+        optarg += 5;
+    } else if (strncmp("ptcp6:", optarg, 6) == 0) {
+        rcsp->type= RTPC_TCP6;
+        rcsp->pipelined = 1;
+        optarg += 6;
     }
     rcsp->cmd_sock = optarg;
 
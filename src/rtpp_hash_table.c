@@ -40,7 +40,13 @@
 
 enum rtpp_hte_types {rtpp_hte_naive_t = 0, rtpp_hte_refcnt_t};
 
+/*
+ * Initial number of buckets, the table doubles in size every time average
+ * chain length goes above RTPP_HT_MAXLOAD, so that key lookup stays O(1)
+ * regardless of the number of entries.
+ */
 #define	RTPP_HT_LEN	256
+#define	RTPP_HT_MAXLOAD	2
 
 struct rtpp_hash_table_entry {
     struct rtpp_hash_table_entry *prev;
@@ -52,7 +58,7 @@ struct rtpp_hash_table_entry {
         uint32_t u32;
         uint16_t u16;
     } key;
-    uint8_t hash;
+    uint32_t hash;
     enum rtpp_hte_types hte_type;
     char chstor[0];
 };
@@ -60,7 +66,8 @@ struct rtpp_hash_table_entry {
 struct rtpp_hash_table_priv
 {
     struct rtpp_pearson rp;
-    struct rtpp_hash_table_entry *hash_table[RTPP_HT_LEN];
+    struct rtpp_hash_table_entry **hash_table;
+    uint32_t ht_mask;
     pthread_mutex_t hash_table_lock;
     int hte_num;
     enum rtpp_ht_key_types key_type;
@@ -104,8 +111,12 @@ rtpp_hash_table_ctor(enum rtpp_ht_key_types key_type, int flags)
         goto e0;
     }
     pvt = &(rp->pvt);
-    if (pthread_mutex_init(&pvt->hash_table_lock, NULL) != 0)
+    pvt->hash_table = rtpp_zmalloc(sizeof(pvt->hash_table[0]) * RTPP_HT_LEN);
+    if (pvt->hash_table == NULL)
         goto e1;
+    pvt->ht_mask = RTPP_HT_LEN - 1;
+    if (pthread_mutex_init(&pvt->hash_table_lock, NULL) != 0)
+        goto e2;
     pvt->key_type = key_type;
     pvt->flags = flags;
     pub = &(rp->pub);
@@ -129,6 +140,8 @@ rtpp_hash_table_ctor(enum rtpp_ht_key_types key_type, int flags)
     rtpp_pearson_shuffle(&pvt->rp);
     pub->pvt = pvt;
     return (pub);
+e2:
+    free(pvt->hash_table);
 e1:
     free(rp);
 e0:
@@ -140,10 +153,10 @@ hash_table_dtor(struct rtpp_hash_table *self)
 {
     struct rtpp_hash_table_entry *sp, *sp_next;
     struct rtpp_hash_table_priv *pvt;
-    int i;
+    uint32_t i;
 
     pvt = self->pvt;
-    for (i = 0; i < RTPP_HT_LEN; i++) {
+    for (i = 0; i <= pvt->ht_mask; i++) {
         sp = pvt->hash_table[i];
         if (sp == NULL)
             continue;
@@ -159,26 +172,27 @@ hash_table_dtor(struct rtpp_hash_table *self)
     }
     pthread_mutex_destroy(&pvt->hash_table_lock);
     RTPP_DBG_ASSERT(pvt->hte_num == 0);
+    free(pvt->hash_table);
 
     free(self);
 }
 
-static inline uint8_t
+static inline uint32_t
 rtpp_ht_hashkey(struct rtpp_hash_table_priv *pvt, const void *key)
 {
 
     switch (pvt->key_type) {
     case rtpp_ht_key_str_t:
-        return rtpp_pearson_hash8(&pvt->rp, key, NULL);
+        return rtpp_pearson_hash32(&pvt->rp, key, NULL);
 
     case rtpp_ht_key_u16_t:
-        return rtpp_pearson_hash8b(&pvt->rp, key, sizeof(uint16_t));
+        return rtpp_pearson_hash32b(&pvt->rp, key, sizeof(uint16_t));
 
     case rtpp_ht_key_u32_t:
-        return rtpp_pearson_hash8b(&pvt->rp, key, sizeof(uint32_t));
+        return rtpp_pearson_hash32b(&pvt->rp, key, sizeof(uint32_t));
 
     case rtpp_ht_key_u64_t:
-        return rtpp_pearson_hash8b(&pvt->rp, key, sizeof(uint64_t));
+        return rtpp_pearson_hash32b(&pvt->rp, key, sizeof(uint64_t));
 
     default:
 	abort();
@@ -187,11 +201,12 @@ rtpp_ht_hashkey(struct rtpp_hash_table_priv *pvt, const void *key)
 
 static inline int
 rtpp_ht_cmpkey(struct rtpp_hash_table_priv *pvt,
-  struct rtpp_hash_table_entry *sp, const void *key)
+  struct rtpp_hash_table_entry *sp, const void *key, uint32_t hash)
 {
     switch (pvt->key_type) {
     case rtpp_ht_key_str_t:
-        return (strcmp(sp->key.ch, key) == 0);
+        /* Full hash is stored in the entry, avoid strcmp() on mismatch */
+        return (sp->hash == hash && strcmp(sp->key.ch, key) == 0);
 
     case rtpp_ht_key_u16_t:
         return (sp->key.u16 == *(const uint16_t *)key);
@@ -213,7 +228,7 @@ rtpp_ht_cmpkey2(struct rtpp_hash_table_priv *pvt,
 {
     switch (pvt->key_type) {
     case rtpp_ht_key_str_t:
-        return (strcmp(sp1->key.ch, sp2->key.ch) == 0);
+        return (sp1->hash == sp2->hash && strcmp(sp1->key.ch, sp2->key.ch) == 0);
 
     case rtpp_ht_key_u16_t:
         return (sp1->key.u16 == sp2->key.u16);
@@ -229,6 +244,51 @@ rtpp_ht_cmpkey2(struct rtpp_hash_table_priv *pvt,
     }
 }
 
+static inline struct rtpp_hash_table_entry **
+rtpp_ht_bucket(struct rtpp_hash_table_priv *pvt, uint32_t hash)
+{
+
+    return (&pvt->hash_table[hash & pvt->ht_mask]);
+}
+
+/*
+ * Double number of buckets and re-link existing entries. Called with the
+ * table locked, failure to allocate is not fatal, the table just stays at
+ * its current size and gets slower.
+ */
+static void
+hash_table_grow_locked(struct rtpp_hash_table_priv *pvt)
+{
+    struct rtpp_hash_table_entry **nht, *sp, *sp_next, **bp;
+    uint32_t i, nmask;
+
+    nmask = (pvt->ht_mask << 1) | 1;
+    nht = rtpp_zmalloc(sizeof(nht[0]) * ((size_t)nmask + 1));
+    if (nht == NULL)
+        return;
+    for (i = 0; i <= pvt->ht_mask; i++) {
+        /*
+         * Walk each chain backwards and prepend, so that entries sharing
+         * the same key keep their insertion order.
+         */
+        for (sp = pvt->hash_table[i]; sp != NULL && sp->next != NULL;
+          sp = sp->next)
+            continue;
+        for (; sp != NULL; sp = sp_next) {
+            sp_next = sp->prev;
+            bp = &nht[sp->hash & nmask];
+            sp->prev = NULL;
+            sp->next = *bp;
+            if (*bp != NULL)
+                (*bp)->prev = sp;
+            *bp = sp;
+        }
+    }
+    free(pvt->hash_table);
+    pvt->hash_table = nht;
+    pvt->ht_mask = nmask;
+}
+
 static struct rtpp_hash_table_entry *
 hash_table_append_raw(struct rtpp_hash_table *self, const void *key,
   void *sptr, enum rtpp_hte_types htype)
@@ -273,9 +333,12 @@ hash_table_append_raw(struct rtpp_hash_table *self, const void *key,
     }
 
     pthread_mutex_lock(&pvt->hash_table_lock);
-    tsp = pvt->hash_table[sp->hash];
+    if (pvt->hte_num >= (pvt->ht_mask + 1) * RTPP_HT_MAXLOAD) {
+        hash_table_grow_locked(pvt);
+    }
+    tsp = *rtpp_ht_bucket(pvt, sp->hash);
     if (tsp == NULL) {
-       	pvt->hash_table[sp->hash] = sp;
+        *rtpp_ht_bucket(pvt, sp->hash) = sp;
     } else {
         for (tsp1 = tsp; tsp1 != NULL; tsp1 = tsp1->next) {
             tsp = tsp1;
@@ -327,7 +390,7 @@ hash_table_append_refcnt(struct rtpp_hash_table *self, const void *key,
 
 static inline void
 hash_table_remove_locked(struct rtpp_hash_table_priv *pvt,
-  struct rtpp_hash_table_entry *sp, uint8_t hash)
+  struct rtpp_hash_table_entry *sp)
 {
 
     if (sp->prev != NULL) {
@@ -337,8 +400,8 @@ hash_table_remove_locked(struct rtpp_hash_table_priv *pvt,
         }
     } else {
         /* Make sure we are removing the right session */
-        RTPP_DBG_ASSERT(pvt->hash_table[hash] == sp);
-        pvt->hash_table[hash] = sp->next;
+        RTPP_DBG_ASSERT(*rtpp_ht_bucket(pvt, sp->hash) == sp);
+        *rtpp_ht_bucket(pvt, sp->hash) = sp->next;
         if (sp->next != NULL) {
             sp->next->prev = NULL;
         }
@@ -350,13 +413,12 @@ static void
 hash_table_remove(struct rtpp_hash_table *self, const void *key,
   struct rtpp_hash_table_entry * sp)
 {
-    uint8_t hash;
     struct rtpp_hash_table_priv *pvt;
 
     pvt = self->pvt;
-    hash = rtpp_ht_hashkey(pvt, key);
+    RTPP_DBG_ASSERT(sp->hash == rtpp_ht_hashkey(pvt, key));
     pthread_mutex_lock(&pvt->hash_table_lock);
-    hash_table_remove_locked(pvt, sp, hash);
+    hash_table_remove_locked(pvt, sp);
     pthread_mutex_unlock(&pvt->hash_table_lock);
     if (sp->hte_type == rtpp_hte_refcnt_t) {
         RC_DECREF((struct rtpp_refcnt *)sp->sptr);
@@ -372,7 +434,7 @@ hash_table_remove_nc(struct rtpp_hash_table *self, struct rtpp_hash_table_entry
 
     pvt = self->pvt;
     pthread_mutex_lock(&pvt->hash_table_lock);
-    hash_table_remove_locked(pvt, sp, sp->hash);
+    hash_table_remove_locked(pvt, sp);
     pthread_mutex_unlock(&pvt->hash_table_lock);
     if (sp->hte_type == rtpp_hte_refcnt_t) {
         RC_DECREF((struct rtpp_refcnt *)sp->sptr);
@@ -384,7 +446,7 @@ hash_table_remove_nc(struct rtpp_hash_table *self, struct rtpp_hash_table_entry
 static struct rtpp_refcnt *
 hash_table_remove_by_key(struct rtpp_hash_table *self, const void *key)
 {
-    uint8_t hash;
+    uint32_t hash;
     struct rtpp_hash_table_entry *sp;
     struct rtpp_hash_table_priv *pvt;
     struct rtpp_refcnt *rptr;
@@ -392,8 +454,8 @@ hash_table_remove_by_key(struct rtpp_hash_table *self, const void *key)
     pvt = self->pvt;
     hash = rtpp_ht_hashkey(pvt, key);
     pthread_mutex_lock(&pvt->hash_table_lock);
-    for (sp = pvt->hash_table[hash]; sp != NULL; sp = sp->next) {
-        if (rtpp_ht_cmpkey(pvt, sp, key)) {
+    for (sp = *rtpp_ht_bucket(pvt, hash); sp != NULL; sp = sp->next) {
+        if (rtpp_ht_cmpkey(pvt, sp, key, hash)) {
             break;
         }
     }
@@ -401,7 +463,7 @@ hash_table_remove_by_key(struct rtpp_hash_table *self, const void *key)
         pthread_mutex_unlock(&pvt->hash_table_lock);
         return (NULL);
     }
-    hash_table_remove_locked(pvt, sp, hash);
+    hash_table_remove_locked(pvt, sp);
     pthread_mutex_unlock(&pvt->hash_table_lock);
     if (sp->hte_type == rtpp_hte_refcnt_t) {
         RC_DECREF((struct rtpp_refcnt *)sp->sptr);
@@ -415,15 +477,15 @@ hash_table_remove_by_key(struct rtpp_hash_table *self, const void *key)
 static struct rtpp_hash_table_entry *
 hash_table_findfirst(struct rtpp_hash_table *self, const void *key, void **sptrp)
 {
-    uint8_t hash;
+    uint32_t hash;
     struct rtpp_hash_table_entry *sp;
     struct rtpp_hash_table_priv *pvt;
 
     pvt = self->pvt;
     hash = rtpp_ht_hashkey(pvt, key);
     pthread_mutex_lock(&pvt->hash_table_lock);
-    for (sp = pvt->hash_table[hash]; sp != NULL; sp = sp->next) {
-	if (rtpp_ht_cmpkey(pvt, sp, key)) {
+    for (sp = *rtpp_ht_bucket(pvt, hash); sp != NULL; sp = sp->next) {
+	if (rtpp_ht_cmpkey(pvt, sp, key, hash)) {
             *sptrp = sp->sptr;
 	    break;
 	}
@@ -457,13 +519,13 @@ hash_table_find(struct rtpp_hash_table *self, const void *key)
     struct rtpp_refcnt *rptr;
     struct rtpp_hash_table_priv *pvt;
     struct rtpp_hash_table_entry *sp;
-    uint8_t hash;
+    uint32_t hash;
 
     pvt = self->pvt;
     hash = rtpp_ht_hashkey(pvt, key);
     pthread_mutex_lock(&pvt->hash_table_lock);
-    for (sp = pvt->hash_table[hash]; sp != NULL; sp = sp->next) {
-        if (rtpp_ht_cmpkey(pvt, sp, key)) {
+    for (sp = *rtpp_ht_bucket(pvt, hash); sp != NULL; sp = sp->next) {
+        if (rtpp_ht_cmpkey(pvt, sp, key, hash)) {
             break;
         }
     }
@@ -487,7 +549,8 @@ hash_table_foreach(struct rtpp_hash_table *self,
     struct rtpp_hash_table_entry *sp, *sp_next;
     struct rtpp_hash_table_priv *pvt;
     struct rtpp_refcnt *rptr;
-    int i, mval;
+    uint32_t i;
+    int mval;
 
     pvt = self->pvt;
     pthread_mutex_lock(&pvt->hash_table_lock);
@@ -495,7 +558,7 @@ hash_table_foreach(struct rtpp_hash_table *self,
         pthread_mutex_unlock(&pvt->hash_table_lock);
         return;
     }
-    for (i = 0; i < RTPP_HT_LEN; i++) {
+    for (i = 0; i <= pvt->ht_mask; i++) {
         for (sp = pvt->hash_table[i]; sp != NULL; sp = sp_next) {
             RTPP_DBG_ASSERT(sp->hte_type == rtpp_hte_refcnt_t);
             rptr = (struct rtpp_refcnt *)sp->sptr;
@@ -503,7 +566,7 @@ hash_table_foreach(struct rtpp_hash_table *self,
             mval = hte_ematch(CALL_SMETHOD(rptr, getdata), marg);
             RTPP_DBG_ASSERT(VDTE_MVAL(mval));
             if (mval & RTPP_HT_MATCH_DEL) {
-                hash_table_remove_locked(pvt, sp, sp->hash);
+                hash_table_remove_locked(pvt, sp);
                 RC_DECREF(rptr);
                 free(sp);
             }
@@ -523,18 +586,18 @@ hash_table_foreach_key(struct rtpp_hash_table *self, const void *key,
     struct rtpp_hash_table_priv *pvt;
     struct rtpp_refcnt *rptr;
     int mval;
-    uint8_t hash;
+    uint32_t hash;
 
     pvt = self->pvt;
     hash = rtpp_ht_hashkey(pvt, key);
     pthread_mutex_lock(&pvt->hash_table_lock);
-    if (pvt->hte_num == 0 || pvt->hash_table[hash] == NULL) {
+    if (pvt->hte_num == 0 || *rtpp_ht_bucket(pvt, hash) == NULL) {
         pthread_mutex_unlock(&pvt->hash_table_lock);
         return;
     }
-    for (sp = pvt->hash_table[hash]; sp != NULL; sp = sp_next) {
+    for (sp = *rtpp_ht_bucket(pvt, hash); sp != NULL; sp = sp_next) {
         sp_next = sp->next;
-        if (!rtpp_ht_cmpkey(pvt, sp, key)) {
+        if (!rtpp_ht_cmpkey(pvt, sp, key, hash)) {
             continue;
         }
         RTPP_DBG_ASSERT(sp->hte_type == rtpp_hte_refcnt_t);
@@ -542,7 +605,7 @@ hash_table_foreach_key(struct rtpp_hash_table *self, const void *key,
         mval = hte_ematch(CALL_SMETHOD(rptr, getdata), marg);
         RTPP_DBG_ASSERT(VDTE_MVAL(mval));
         if (mval & RTPP_HT_MATCH_DEL) {
-            hash_table_remove_locked(pvt, sp, sp->hash);
+            hash_table_remove_locked(pvt, sp);
             RC_DECREF(rptr);
             free(sp);
         }
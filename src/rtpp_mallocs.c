@@ -64,6 +64,56 @@ struct alig_help {
 
 #define PpP(p1, p2, type) (type)(((char *)p1) + ((size_t)p2))
 
+static size_t
+rtpp_rzmalloc_padsize(size_t msize)
+{
+    size_t pad_size;
+
+    if (offsetof(struct alig_help, b) > 1) {
+        pad_size = msize % offsetof(struct alig_help, b);
+        if (pad_size != 0) {
+            pad_size = offsetof(struct alig_help, b) - pad_size;
+        }
+    } else {
+        pad_size = 0;
+    }
+    return (pad_size);
+}
+
+/*
+ * Amount of memory that the object of the msize bytes together with its
+ * refcounter is going to take, rounded up so that the next object can be
+ * placed right after it.
+ */
+size_t
+rtpp_rzmalloc_psize(size_t msize)
+{
+    size_t asize;
+
+    asize = msize + rtpp_rzmalloc_padsize(msize) + rtpp_refcnt_osize();
+    return (asize + rtpp_rzmalloc_padsize(asize));
+}
+
+/*
+ * Same as rtpp_rzmalloc() but for an object placed into memory provided by
+ * the caller, normally a part of a bigger allocation owned by the parent
+ * object. The refcounter is of the "pa" kind, so when it drops to zero the
+ * object's dtor is called, but the memory is not freed.
+ */
+void *
+rtpp_rzmalloc_pa(void *pap, size_t msize, size_t rcntp_offs)
+{
+    struct rtpp_refcnt *rcnt;
+    void *rco;
+
+    RTPP_DBG_ASSERT(msize >= rcntp_offs + sizeof(struct rtpp_refcnt *));
+    memset(pap, '\0', rtpp_rzmalloc_psize(msize));
+    rco = (char *)pap + msize + rtpp_rzmalloc_padsize(msize);
+    rcnt = rtpp_refcnt_ctor_pa(rco);
+    *PpP(pap, rcntp_offs, struct rtpp_refcnt **) = rcnt;
+    return (pap);
+}
+
 void *
 #if !defined(RTPP_CHECK_LEAKS)
 rtpp_rzmalloc(size_t msize, size_t rcntp_offs)
@@ -78,14 +128,7 @@ rtpp_rzmalloc_memdeb(size_t msize, size_t rcntp_offs, void *memdeb_p,
     void *rco;
 
     RTPP_DBG_ASSERT(msize >= rcntp_offs + sizeof(struct rtpp_refcnt *));
-    if (offsetof(struct alig_help, b) > 1) {
-        pad_size = msize % offsetof(struct alig_help, b);
-        if (pad_size != 0) {
-            pad_size = offsetof(struct alig_help, b) - pad_size;
-        }
-    } else {
-        pad_size = 0;
-    }
+    pad_size = rtpp_rzmalloc_padsize(msize);
     asize = msize + pad_size + rtpp_refcnt_osize();
 #if !defined(RTPP_CHECK_LEAKS)
     rval = malloc(asize);
@@ -44,4 +44,7 @@ void *rtpp_rzmalloc_memdeb(size_t, size_t, void *, HERETYPE);
 void *rtpp_rzmalloc(size_t, size_t);
 #endif
 
+size_t rtpp_rzmalloc_psize(size_t);
+void *rtpp_rzmalloc_pa(void *, size_t, size_t);
+
 #endif
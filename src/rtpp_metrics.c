@@ -0,0 +1,452 @@
+/*
+ * Copyright (c) 2026 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "config.h"
+
+#include "rtpp_types.h"
+#include "rtpp_debug.h"
+#include "rtpp_log.h"
+#include "rtpp_log_obj.h"
+#include "rtpp_cfg.h"
+#include "rtpp_command.h"
+#include "rtpp_command_async.h"
+#include "rtpp_controlfd.h"
+#include "rtpp_mallocs.h"
+#include "rtpp_metrics.h"
+#include "rtpp_netio_async.h"
+#include "rtpp_proc_async.h"
+#include "rtpp_stats.h"
+#include "rtpp_time.h"
+#include "rtpp_weakref.h"
+
+/*
+ * Minimal HTTP/1.0 responder for OpenMetrics scrapers. Runs in its own
+ * thread, renders the metrics page at most once per RTPP_METRICS_TTL
+ * seconds and serves cached copy to everyone asking in between, so that
+ * the number of collectors does not affect the rest of the proxy.
+ * Up to RTPP_METRICS_MAXCONNS clients are multiplexed with non-blocking
+ * I/O, each one has RTPP_METRICS_CONN_TMO seconds to send a request and
+ * read the reply, so that a stuck or idle client can not hold off others.
+ * When out of slots the oldest client that is yet to send its request is
+ * dropped in favor of the new one.
+ */
+
+#define RTPP_METRICS_BUFLEN   (64 * 1024)
+#define RTPP_METRICS_TTL      1.0
+#define RTPP_METRICS_PFX      "rtpproxy_"
+#define RTPP_METRICS_NSNDRS   8
+#define RTPP_METRICS_MAXCONNS 16
+#define RTPP_METRICS_CONN_TMO 2.0
+
+#define TSTATE_RUN   0x0
+#define TSTATE_CEASE 0x1
+
+struct rtpp_metrics_conn {
+    int fd;
+    double deadline;
+    int rlen;
+    char req[1024];
+    /* Reply, once it has been generated */
+    char *obuf;
+    int olen;
+    int ooff;
+};
+
+struct rtpp_metrics_priv {
+    struct rtpp_metrics pub;
+    const struct rtpp_cfg *cfsp;
+    struct rtpp_ctrl_sock *csock;
+    int lfd;
+    pthread_t thread_id;
+    int started;
+    atomic_int tstate;
+    double last_render;
+    int blen;
+    int overflow;
+    char buf[RTPP_METRICS_BUFLEN];
+    int nconns;
+    struct rtpp_metrics_conn conns[RTPP_METRICS_MAXCONNS];
+    struct pollfd pfds[RTPP_METRICS_MAXCONNS + 1];
+};
+
+static int rtpp_metrics_start(struct rtpp_metrics *);
+static void rtpp_metrics_dtor(struct rtpp_metrics *);
+
+static void
+om_printf(struct rtpp_metrics_priv *pvt, const char *fmt, ...)
+{
+    va_list ap;
+    int rlen;
+
+    if (pvt->overflow)
+        return;
+    va_start(ap, fmt);
+    rlen = vsnprintf(pvt->buf + pvt->blen, sizeof(pvt->buf) - pvt->blen, fmt,
+      ap);
+    va_end(ap);
+    if (rlen < 0 || rlen >= (int)(sizeof(pvt->buf) - pvt->blen)) {
+        pvt->overflow = 1;
+        return;
+    }
+    pvt->blen += rlen;
+}
+
+static int
+rtpp_metrics_render(struct rtpp_metrics_priv *pvt)
+{
+    const struct rtpp_cfg *cfsp;
+    int i, nqlens, qlens[RTPP_METRICS_NSNDRS];
+
+    cfsp = pvt->cfsp;
+    pvt->overflow = 0;
+    pvt->blen = CALL_SMETHOD(cfsp->rtpp_stats, om_render, pvt->buf,
+      sizeof(pvt->buf), RTPP_METRICS_PFX);
+    if (pvt->blen < 0) {
+        pvt->blen = 0;
+        return (-1);
+    }
+    om_printf(pvt, "# TYPE " RTPP_METRICS_PFX "sessions_active gauge\n"
+      "# HELP " RTPP_METRICS_PFX "sessions_active Number of active sessions\n"
+      RTPP_METRICS_PFX "sessions_active %d\n",
+      CALL_METHOD(cfsp->sessions_wrt, get_length));
+    om_printf(pvt, "# TYPE " RTPP_METRICS_PFX "streams_active gauge\n"
+      "# HELP " RTPP_METRICS_PFX "streams_active Number of active streams\n"
+      RTPP_METRICS_PFX "streams_active{proto=\"rtp\"} %d\n"
+      RTPP_METRICS_PFX "streams_active{proto=\"rtcp\"} %d\n",
+      CALL_METHOD(cfsp->rtp_streams_wrt, get_length),
+      CALL_METHOD(cfsp->rtcp_streams_wrt, get_length));
+    om_printf(pvt, "# TYPE " RTPP_METRICS_PFX "loop_load gauge\n"
+      "# HELP " RTPP_METRICS_PFX "loop_load Average load of the processing "
+      "loop (0.0 - 1.0)\n"
+      RTPP_METRICS_PFX "loop_load{thread=\"command\"} %f\n"
+      RTPP_METRICS_PFX "loop_load{thread=\"forwarding\"} %f\n",
+      CALL_METHOD(cfsp->rtpp_cmd_cf, get_aload),
+      CALL_METHOD(cfsp->rtpp_proc_cf, get_aload));
+    om_printf(pvt, "# TYPE " RTPP_METRICS_PFX "overload_grade gauge\n"
+      "# HELP " RTPP_METRICS_PFX "overload_grade Current overload protection "
+      "grade (0 - no shedding)\n"
+      RTPP_METRICS_PFX "overload_grade %d\n",
+      CALL_METHOD(cfsp->rtpp_cmd_cf, chk_overload));
+    nqlens = rtpp_anetio_get_qlens(cfsp->rtpp_proc_cf->netio, qlens,
+      RTPP_METRICS_NSNDRS);
+    om_printf(pvt, "# TYPE " RTPP_METRICS_PFX "sender_queue_length gauge\n"
+      "# HELP " RTPP_METRICS_PFX "sender_queue_length Number of packets "
+      "waiting in the outbound queue\n");
+    for (i = 0; i < nqlens; i++) {
+        om_printf(pvt, RTPP_METRICS_PFX "sender_queue_length{sender=\"%d\"} %d\n",
+          i, qlens[i]);
+    }
+    om_printf(pvt, "# EOF\n");
+    if (pvt->overflow) {
+        pvt->blen = 0;
+        return (-1);
+    }
+    return (0);
+}
+
+static int
+rtpp_metrics_mkreply(struct rtpp_metrics_conn *conn, const char *status,
+  const char *body, int blen)
+{
+    char hdr[256];
+    int hlen;
+
+    if (body != NULL) {
+        hlen = snprintf(hdr, sizeof(hdr), "HTTP/1.0 %s\r\n"
+          "Content-Type: application/openmetrics-text; version=1.0.0; "
+          "charset=utf-8\r\nContent-Length: %d\r\nConnection: close\r\n\r\n",
+          status, blen);
+    } else {
+        hlen = snprintf(hdr, sizeof(hdr), "HTTP/1.0 %s\r\nContent-Length: 0\r\n"
+          "Connection: close\r\n\r\n", status);
+        blen = 0;
+    }
+    conn->obuf = malloc(hlen + blen);
+    if (conn->obuf == NULL)
+        return (-1);
+    memcpy(conn->obuf, hdr, hlen);
+    if (blen > 0)
+        memcpy(conn->obuf + hlen, body, blen);
+    conn->olen = hlen + blen;
+    conn->ooff = 0;
+    return (0);
+}
+
+static int
+rtpp_metrics_handle_req(struct rtpp_metrics_priv *pvt,
+  struct rtpp_metrics_conn *conn, double dtime)
+{
+    const char *req;
+
+    req = conn->req;
+    if (strncmp(req, "GET ", 4) != 0) {
+        return (rtpp_metrics_mkreply(conn, "405 Method Not Allowed", NULL, 0));
+    }
+    if (strncmp(req + 4, "/metrics", 8) != 0 ||
+      (req[12] != ' ' && req[12] != '?' && req[12] != '\r' &&
+      req[12] != '\n')) {
+        return (rtpp_metrics_mkreply(conn, "404 Not Found", NULL, 0));
+    }
+    if (pvt->blen == 0 || dtime - pvt->last_render >= RTPP_METRICS_TTL) {
+        if (rtpp_metrics_render(pvt) != 0) {
+            RTPP_LOG(pvt->cfsp->glog, RTPP_LOG_ERR,
+              "metrics: output buffer overflow");
+            return (rtpp_metrics_mkreply(conn, "500 Internal Server Error",
+              NULL, 0));
+        }
+        pvt->last_render = dtime;
+    }
+    return (rtpp_metrics_mkreply(conn, "200 OK", pvt->buf, pvt->blen));
+}
+
+/*
+ * Advance I/O on the connection, returns non-zero once it is done with,
+ * either because the reply has been sent out or due to an error.
+ */
+static int
+rtpp_metrics_conn_io(struct rtpp_metrics_priv *pvt,
+  struct rtpp_metrics_conn *conn, double dtime)
+{
+    ssize_t rval;
+
+    if (conn->obuf == NULL) {
+        rval = recv(conn->fd, conn->req + conn->rlen,
+          sizeof(conn->req) - 1 - conn->rlen, 0);
+        if (rval < 0)
+            return (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK);
+        if (rval == 0)
+            return (1);
+        conn->rlen += rval;
+        conn->req[conn->rlen] = '\0';
+        /* Only the request line matters, headers are not looked at */
+        if (strchr(conn->req, '\n') == NULL &&
+          conn->rlen < (int)sizeof(conn->req) - 1)
+            return (0);
+        if (rtpp_metrics_handle_req(pvt, conn, dtime) != 0)
+            return (1);
+    }
+    while (conn->ooff < conn->olen) {
+        rval = send(conn->fd, conn->obuf + conn->ooff, conn->olen - conn->ooff,
+          MSG_NOSIGNAL);
+        if (rval < 0) {
+            if (errno == EINTR)
+                continue;
+            return (errno != EAGAIN && errno != EWOULDBLOCK);
+        }
+        conn->ooff += rval;
+    }
+    return (1);
+}
+
+static void
+rtpp_metrics_conn_close(struct rtpp_metrics_priv *pvt, int i)
+{
+    struct rtpp_metrics_conn *conn;
+
+    conn = &pvt->conns[i];
+    close(conn->fd);
+    free(conn->obuf);
+    pvt->nconns -= 1;
+    if (i != pvt->nconns)
+        *conn = pvt->conns[pvt->nconns];
+}
+
+/*
+ * When all slots are taken, pick the oldest connection that has not sent
+ * a complete request yet to make room for a new one.
+ */
+static int
+rtpp_metrics_victim(struct rtpp_metrics_priv *pvt)
+{
+    int i, vi;
+
+    vi = -1;
+    for (i = 0; i < pvt->nconns; i++) {
+        if (pvt->conns[i].obuf != NULL)
+            continue;
+        if (vi < 0 || pvt->conns[i].deadline < pvt->conns[vi].deadline)
+            vi = i;
+    }
+    return (vi);
+}
+
+static void
+rtpp_metrics_accept(struct rtpp_metrics_priv *pvt, double dtime)
+{
+    struct rtpp_metrics_conn *conn;
+    int fd, flags, vi;
+
+    if (pvt->nconns == RTPP_METRICS_MAXCONNS) {
+        vi = rtpp_metrics_victim(pvt);
+        if (vi < 0)
+            return;
+        rtpp_metrics_conn_close(pvt, vi);
+    }
+    fd = accept(pvt->lfd, NULL, NULL);
+    if (fd < 0)
+        return;
+    flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        close(fd);
+        return;
+    }
+    conn = &pvt->conns[pvt->nconns];
+    memset(conn, '\0', sizeof(*conn));
+    conn->fd = fd;
+    conn->deadline = dtime + RTPP_METRICS_CONN_TMO;
+    pvt->nconns += 1;
+}
+
+static void
+rtpp_metrics_run(void *arg)
+{
+    struct rtpp_metrics_priv *pvt;
+    struct rtpp_metrics_conn *conn;
+    double dtime;
+    int i, npfds, nready;
+    short revents;
+
+    pvt = (struct rtpp_metrics_priv *)arg;
+    while (atomic_load(&pvt->tstate) == TSTATE_RUN) {
+        pvt->pfds[0].fd = pvt->lfd;
+        /* Stop accepting when busy, clients will wait in the backlog */
+        if (pvt->nconns < RTPP_METRICS_MAXCONNS || rtpp_metrics_victim(pvt) >= 0) {
+            pvt->pfds[0].events = POLLIN;
+        } else {
+            pvt->pfds[0].events = 0;
+        }
+        pvt->pfds[0].revents = 0;
+        for (i = 0; i < pvt->nconns; i++) {
+            conn = &pvt->conns[i];
+            pvt->pfds[i + 1].fd = conn->fd;
+            pvt->pfds[i + 1].events = (conn->obuf == NULL) ? POLLIN : POLLOUT;
+            pvt->pfds[i + 1].revents = 0;
+        }
+        npfds = pvt->nconns + 1;
+        nready = poll(pvt->pfds, npfds, 200);
+        if (nready < 0 && errno != EINTR)
+            break;
+        dtime = getdtime();
+        /* Go backwards, closing connection moves the last one into its slot */
+        for (i = pvt->nconns - 1; i >= 0; i--) {
+            conn = &pvt->conns[i];
+            revents = (nready > 0) ? pvt->pfds[i + 1].revents : 0;
+            if (revents != 0 && rtpp_metrics_conn_io(pvt, conn, dtime) != 0) {
+                rtpp_metrics_conn_close(pvt, i);
+                continue;
+            }
+            if (dtime >= conn->deadline)
+                rtpp_metrics_conn_close(pvt, i);
+        }
+        if (nready > 0 && (pvt->pfds[0].revents & POLLIN) != 0)
+            rtpp_metrics_accept(pvt, dtime);
+    }
+    while (pvt->nconns > 0)
+        rtpp_metrics_conn_close(pvt, pvt->nconns - 1);
+}
+
+struct rtpp_metrics *
+rtpp_metrics_ctor(const struct rtpp_cfg *cfsp, struct rtpp_ctrl_sock *csock)
+{
+    struct rtpp_metrics_priv *pvt;
+    int flags;
+
+    pvt = rtpp_zmalloc(sizeof(*pvt));
+    if (pvt == NULL)
+        goto e0;
+    pvt->cfsp = cfsp;
+    pvt->csock = csock;
+    pvt->lfd = rtpp_controlfd_listen(cfsp, csock);
+    if (pvt->lfd < 0)
+        goto e1;
+    flags = fcntl(pvt->lfd, F_GETFL);
+    if (flags < 0 || fcntl(pvt->lfd, F_SETFL, flags | O_NONBLOCK) < 0)
+        goto e2;
+    atomic_init(&pvt->tstate, TSTATE_RUN);
+    pvt->pub.start = &rtpp_metrics_start;
+    pvt->pub.dtor = &rtpp_metrics_dtor;
+    return (&pvt->pub);
+e2:
+    close(pvt->lfd);
+    if (RTPP_CTRL_ISUNIX(csock))
+        unlink(csock->cmd_sock);
+e1:
+    free(pvt);
+e0:
+    return (NULL);
+}
+
+/*
+ * The listening socket is created early so that it can bind to a
+ * privileged address, the thread is started separately once the rest of
+ * subsystems that it queries are up.
+ */
+static int
+rtpp_metrics_start(struct rtpp_metrics *pub)
+{
+    struct rtpp_metrics_priv *pvt;
+
+    PUB2PVT(pub, pvt);
+    RTPP_DBG_ASSERT(pvt->started == 0);
+    if (pthread_create(&pvt->thread_id, NULL,
+      (void *(*)(void *))&rtpp_metrics_run, pvt) != 0)
+        return (-1);
+    pvt->started = 1;
+    return (0);
+}
+
+static void
+rtpp_metrics_dtor(struct rtpp_metrics *pub)
+{
+    struct rtpp_metrics_priv *pvt;
+
+    PUB2PVT(pub, pvt);
+    if (pvt->started) {
+        atomic_store(&pvt->tstate, TSTATE_CEASE);
+        pthread_join(pvt->thread_id, NULL);
+    }
+    close(pvt->lfd);
+    if (RTPP_CTRL_ISUNIX(pvt->csock))
+        unlink(pvt->csock->cmd_sock);
+    free(pvt);
+}
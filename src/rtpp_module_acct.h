@@ -35,6 +35,7 @@ DEFINE_METHOD(rtpp_module_priv, rtpp_module_on_session_end, void,
   struct rtpp_acct *);
 DEFINE_METHOD(rtpp_module_priv, rtpp_module_on_rtcp_rcvd, void,
   struct rtpp_acct_rtcp *);
+DEFINE_METHOD(rtpp_module_priv, rtpp_module_on_batch_end, void);
 
 #define AAPI_FUNC(fname, asize) {.func = (fname), .argsize = (asize)}
 
@@ -48,9 +49,15 @@ struct api_on_rtcp_rcvd {
    rtpp_module_on_rtcp_rcvd_t func;
 };
 
+/*
+ * The on_batch_end handler, if present, is invoked after each batch of
+ * events pulled out of the module queue has been delivered, so that
+ * modules that accumulate output can push it out without extra timers.
+ */
 struct rtpp_acct_handlers {
     struct api_on_sess_end on_session_end;
     struct api_on_rtcp_rcvd on_rtcp_rcvd;
+    rtpp_module_on_batch_end_t on_batch_end;
 };
 
 #endif /* _RTPP_MODULE_ACCT_H */
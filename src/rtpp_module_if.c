@@ -344,45 +344,53 @@ rtpp_mif_kaput(struct rtpp_module_if *self)
     free(pvt);
 }
 
+#define RTPP_MIF_ACCT_BATCH 32
+
 static void
 rtpp_mif_run_acct(void *argp)
 {
     struct rtpp_module_if_priv *pvt;
-    struct rtpp_wi *wi;
-    int signum;
+    struct rtpp_wi *wis[RTPP_MIF_ACCT_BATCH], *wi;
+    int signum, i, nwis, done;
     const char *aname;
     const struct rtpp_acct_handlers *aap;
 
     pvt = (struct rtpp_module_if_priv *)argp;
     aap = pvt->mip->aapi;
-    for (;;) {
-        wi = rtpp_queue_get_item(pvt->mip->wthr.mod_q, 0);
-        if (rtpp_wi_get_type(wi) == RTPP_WI_TYPE_SGNL) {
-            signum = rtpp_wi_sgnl_get_signum(wi);
-            CALL_METHOD(wi, dtor);
-            if (signum == SIGTERM) {
-                break;
+    for (done = 0; done == 0;) {
+        nwis = rtpp_queue_get_items(pvt->mip->wthr.mod_q, wis,
+          RTPP_MIF_ACCT_BATCH, 0);
+        for (i = 0; i < nwis; i++) {
+            wi = wis[i];
+            if (rtpp_wi_get_type(wi) == RTPP_WI_TYPE_SGNL) {
+                signum = rtpp_wi_sgnl_get_signum(wi);
+                CALL_METHOD(wi, dtor);
+                if (signum == SIGTERM) {
+                    done = 1;
+                }
+                continue;
             }
-            continue;
-        }
-        aname = rtpp_wi_apis_getname(wi);
-        if (aname == do_acct_aname) {
-            struct rtpp_acct *rap;
-
-            rtpp_wi_apis_getnamearg(wi, (void **)&rap, sizeof(rap));
-            if (aap->on_session_end.func != NULL)
-                aap->on_session_end.func(pvt->mpvt, rap);
-            RTPP_OBJ_DECREF(rap);
-        }
-        if (aname == do_acct_rtcp_aname) {
-            struct rtpp_acct_rtcp *rapr;
+            aname = rtpp_wi_apis_getname(wi);
+            if (aname == do_acct_aname) {
+                struct rtpp_acct *rap;
+
+                rtpp_wi_apis_getnamearg(wi, (void **)&rap, sizeof(rap));
+                if (aap->on_session_end.func != NULL)
+                    aap->on_session_end.func(pvt->mpvt, rap);
+                RTPP_OBJ_DECREF(rap);
+            }
+            if (aname == do_acct_rtcp_aname) {
+                struct rtpp_acct_rtcp *rapr;
 
-            rtpp_wi_apis_getnamearg(wi, (void **)&rapr, sizeof(rapr));
-            if (aap->on_rtcp_rcvd.func != NULL)
-                aap->on_rtcp_rcvd.func(pvt->mpvt, rapr);
-            RTPP_OBJ_DECREF(rapr);
+                rtpp_wi_apis_getnamearg(wi, (void **)&rapr, sizeof(rapr));
+                if (aap->on_rtcp_rcvd.func != NULL)
+                    aap->on_rtcp_rcvd.func(pvt->mpvt, rapr);
+                RTPP_OBJ_DECREF(rapr);
+            }
+            CALL_METHOD(wi, dtor);
         }
-        CALL_METHOD(wi, dtor);
+        if (aap->on_batch_end != NULL)
+            aap->on_batch_end(pvt->mpvt);
     }
 }
 
@@ -459,11 +467,13 @@ rtpp_mif_start(struct rtpp_module_if *self, const struct rtpp_cfg *cfsp)
         return (0);
     if (pvt->mip->aapi != NULL) {
         if (pvt->mip->aapi->on_rtcp_rcvd.func != NULL) {
-            struct packet_observer_if acct_rtcp_poi;
+            struct packet_observer_if acct_rtcp_poi = {
+                .taste = packet_is_rtcp,
+                .enqueue = acct_rtcp_enqueue,
+                .pipes = PO_PIPE(PIPE_RTCP),
+                .arg = pvt
+            };
 
-            acct_rtcp_poi.taste = packet_is_rtcp;
-            acct_rtcp_poi.enqueue = acct_rtcp_enqueue;
-            acct_rtcp_poi.arg = pvt;
             if (CALL_METHOD(cfsp->observers, reg, &acct_rtcp_poi) < 0)
                 return (-1);
         }
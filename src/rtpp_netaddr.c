@@ -50,6 +50,7 @@ struct rtpp_netaddr_priv {
 
 static void rtpp_netaddr_set(struct rtpp_netaddr *, const struct sockaddr *, size_t);
 static void rtpp_netaddr_dtor(struct rtpp_netaddr_priv *);
+static void rtpp_netaddr_dtor_pa(struct rtpp_netaddr_priv *);
 static void rtpp_netaddr_set(struct rtpp_netaddr *, const struct sockaddr *, size_t);
 static int rtpp_netaddr_isempty(struct rtpp_netaddr *);
 static int rtpp_netaddr_cmp(struct rtpp_netaddr *, const struct sockaddr *, size_t);
@@ -95,6 +96,34 @@ e0:
     return (NULL);
 }
 
+size_t
+rtpp_netaddr_osize(void)
+{
+
+    return (rtpp_rzmalloc_psize(sizeof(struct rtpp_netaddr_priv)));
+}
+
+/*
+ * Construct object in the memory provided by the caller, which has to be
+ * at least rtpp_netaddr_osize() bytes and outlive the object.
+ */
+struct rtpp_netaddr *
+rtpp_netaddr_ctor_pa(void *pap)
+{
+    struct rtpp_netaddr_priv *pvt;
+
+    pvt = rtpp_rzmalloc_pa(pap, sizeof(struct rtpp_netaddr_priv),
+      PVT_RCOFFS(pvt));
+    if (pthread_mutex_init(&pvt->lock, NULL) != 0) {
+        RTPP_OBJ_DECREF(&(pvt->pub));
+        return (NULL);
+    }
+    pvt->pub.smethods = &rtpp_netaddr_smethods;
+    CALL_SMETHOD(pvt->pub.rcnt, attach,
+      (rtpp_refcnt_dtor_t)&rtpp_netaddr_dtor_pa, pvt);
+    return ((&pvt->pub));
+}
+
 static void
 rtpp_netaddr_set(struct rtpp_netaddr *self, const struct sockaddr *addr, size_t alen)
 {
@@ -110,11 +139,18 @@ rtpp_netaddr_set(struct rtpp_netaddr *self, const struct sockaddr *addr, size_t
 }
 
 static void
-rtpp_netaddr_dtor(struct rtpp_netaddr_priv *pvt)
+rtpp_netaddr_dtor_pa(struct rtpp_netaddr_priv *pvt)
 {
 
     rtpp_netaddr_fin(&(pvt->pub));
     pthread_mutex_destroy(&pvt->lock);
+}
+
+static void
+rtpp_netaddr_dtor(struct rtpp_netaddr_priv *pvt)
+{
+
+    rtpp_netaddr_dtor_pa(pvt);
     free(pvt);
 }
 
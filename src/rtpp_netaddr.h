@@ -65,4 +65,6 @@ struct rtpp_netaddr {
 };
 
 struct rtpp_netaddr *rtpp_netaddr_ctor(void);
+size_t rtpp_netaddr_osize(void);
+struct rtpp_netaddr *rtpp_netaddr_ctor_pa(void *);
 #endif
@@ -273,6 +273,24 @@ rtpp_anetio_pick_sender(struct rtpp_anetio_cf *netio_cf)
     return (sender);
 }
 
+int
+rtpp_anetio_get_qlens(struct rtpp_anetio_cf *netio_cf, int *qlens, int nqlens)
+{
+    int i;
+
+    for (i = 0; i < SEND_THREADS && i < nqlens; i++) {
+        qlens[i] = rtpp_queue_get_length(netio_cf->args[i].out_q);
+    }
+    return (i);
+}
+
+int
+rtpp_anetio_get_qcap(struct rtpp_anetio_cf *netio_cf)
+{
+
+    return (rtpp_queue_get_capacity(netio_cf->args[0].out_q));
+}
+
 struct rtpp_anetio_cf *
 rtpp_netio_async_init(const struct rtpp_cfg *cfsp, int qlen)
 {
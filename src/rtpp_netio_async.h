@@ -49,6 +49,8 @@ int rtpp_anetio_send_pkt_na(struct sthread_args *, int, \
 void rtpp_anetio_pump(struct rtpp_anetio_cf *);
 void rtpp_anetio_pump_q(struct sthread_args *);
 struct sthread_args *rtpp_anetio_pick_sender(struct rtpp_anetio_cf *);
+int rtpp_anetio_get_qlens(struct rtpp_anetio_cf *, int *, int);
+int rtpp_anetio_get_qcap(struct rtpp_anetio_cf *);
 
 struct rtpp_anetio_cf *rtpp_netio_async_init(const struct rtpp_cfg *, int);
 void rtpp_netio_async_destroy(struct rtpp_anetio_cf *);
@@ -34,6 +34,8 @@
 #include <netinet/in.h>
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stddef.h>
@@ -49,59 +51,138 @@
 #include "rtpp_network.h"
 #include "rtpp_notify.h"
 #include "rtpp_queue.h"
+#include "rtpp_time.h"
 #include "rtpp_tnotify_tgt.h"
 #include "rtpp_mallocs.h"
 #include "rtpp_wi.h"
 #include "rtpp_wi_data.h"
 #include "rtpp_wi_sgnl.h"
 
+/*
+ * Each target gets its own bounded output buffer and its own non-blocking
+ * connection, so that a single slow or dead target does not hold up the
+ * rest. Notifications queued for the same target between two writes are
+ * coalesced into a single send(2). Lost connections are re-established
+ * with an exponential backoff, notifications accumulated in the meantime
+ * are delivered once the target is back, or dropped if the buffer
+ * overflows.
+ */
+#define RTPP_NOTIFY_TGTS_MAX    64
+#define RTPP_NOTIFY_BUFLEN      (64 * 1024)
+#define RTPP_NOTIFY_BATCH       64
+#define RTPP_NOTIFY_POLL_IVAL   0.01
+#define RTPP_NOTIFY_BACKOFF_MIN 0.1
+#define RTPP_NOTIFY_BACKOFF_MAX 10.0
+#define RTPP_NOTIFY_CONN_TMO    5.0
+#define RTPP_NOTIFY_DRAIN_TMO   2.0
+
 struct rtpp_notify_wi
 {
     int len;
     struct rtpp_tnotify_target *rttp;
-    struct rtpp_log *glog;
     const char *ntype;
     char notify_buf[0];
 };
 
+enum rtpp_notify_cstate {RNC_IDLE, RNC_CONNECTING, RNC_CONNECTED};
+
+struct rtpp_notify_conn {
+    struct rtpp_tnotify_target *rttp;
+    enum rtpp_notify_cstate state;
+    const char *ntype;
+    double next_try;
+    double backoff;
+    int partial;
+    int dropped;
+    size_t blen;
+    char buf[RTPP_NOTIFY_BUFLEN];
+};
+
 struct rtpp_notify_priv {
     struct rtpp_notify pub;
     struct rtpp_queue *nqueue;
     struct rtpp_wi *sigterm;
     pthread_t thread_id;
     struct rtpp_log *glog;
+    struct rtpp_notify_conn *conns[RTPP_NOTIFY_TGTS_MAX];
+    int nconns;
 };
 
 static int rtpp_notify_schedule(struct rtpp_notify *,
   struct rtpp_tnotify_target *, const char *, const char *);
 static void rtpp_notify_dtor(struct rtpp_notify *);
-static void do_notification(struct rtpp_notify_wi *, int);
+static int rtpp_notify_enqueue(struct rtpp_notify_priv *,
+  const struct rtpp_notify_wi *);
+static int rtpp_notify_service(struct rtpp_notify_priv *, double, double *);
 
 static void
 rtpp_notify_queue_run(void *arg)
 {
-    struct rtpp_wi *wi;
+    struct rtpp_wi *wis[RTPP_NOTIFY_BATCH], *wi;
     struct rtpp_notify_wi *wi_data;
     struct rtpp_notify_priv *pvt;
+    int i, nwis, nactive, done;
+    double wake, deadline, dtime;
 
     pvt = (struct rtpp_notify_priv *)arg;
-    for (;;) {
-        wi = rtpp_queue_get_item(pvt->nqueue, 0);
-        if (rtpp_wi_get_type(wi) == RTPP_WI_TYPE_SGNL) {
+    nactive = 0;
+    wake = 0.0;
+    for (done = 0; done == 0;) {
+        /*
+         * With some outstanding I/O, only pick up whatever has been queued
+         * and go back to servicing connections. Otherwise block on the
+         * queue, until the nearest reconnect attempt is due if there are
+         * targets backing off.
+         */
+        if (nactive > 0) {
+            if (rtpp_queue_get_length(pvt->nqueue) > 0) {
+                nwis = rtpp_queue_get_items(pvt->nqueue, wis, RTPP_NOTIFY_BATCH, 0);
+            } else {
+                nwis = 0;
+            }
+        } else if (wake != 0.0) {
+            nwis = rtpp_queue_get_items_by(pvt->nqueue, wis, RTPP_NOTIFY_BATCH,
+              wake);
+        } else {
+            nwis = rtpp_queue_get_items(pvt->nqueue, wis, RTPP_NOTIFY_BATCH, 0);
+        }
+        for (i = 0; i < nwis; i++) {
+            wi = wis[i];
+            if (rtpp_wi_get_type(wi) == RTPP_WI_TYPE_SGNL) {
+                CALL_METHOD(wi, dtor);
+                done = 1;
+                continue;
+            }
+            wi_data = rtpp_wi_data_get_ptr(wi, sizeof(struct rtpp_notify_wi), 0);
+
+            /* main work here */
+            rtpp_notify_enqueue(pvt, wi_data);
+
+            /* deallocate wi */
             CALL_METHOD(wi, dtor);
-            break;
         }
-        wi_data = rtpp_wi_data_get_ptr(wi, sizeof(struct rtpp_notify_wi), 0);
-
-        /* main work here */
-        do_notification(wi_data, 3);
+        if (done == 0) {
+            nactive = rtpp_notify_service(pvt, RTPP_NOTIFY_POLL_IVAL, &wake);
+        }
+    }
 
-        /* deallocate wi */
-        RTPP_OBJ_DECREF(wi_data->glog);
-        CALL_METHOD(wi, dtor);
+    /*
+     * Give notifications that are still buffered a bounded amount of time
+     * to get out before we go away.
+     */
+    deadline = getdtime() + RTPP_NOTIFY_DRAIN_TMO;
+    for (;;) {
+        dtime = getdtime();
+        if (dtime >= deadline)
+            break;
+        nactive = rtpp_notify_service(pvt, deadline - dtime, &wake);
+        if (nactive > 0)
+            continue;
+        if (wake == 0.0 || wake >= deadline)
+            break;
+        usleep((useconds_t)((wake - dtime) * 1000000.0) + 1);
     }
 }
-
 struct rtpp_notify *
 rtpp_notify_ctor(struct rtpp_log *glog)
 {
@@ -122,18 +203,20 @@ rtpp_notify_ctor(struct rtpp_log *glog)
         goto e2;
     }
 
+    RTPP_OBJ_INCREF(glog);
+    pvt->glog = glog;
+
     if (pthread_create(&pvt->thread_id, NULL, (void *(*)(void *))&rtpp_notify_queue_run, pvt) != 0) {
         goto e3;
     }
 
-    RTPP_OBJ_INCREF(glog);
-    pvt->glog = glog;
     pvt->pub.schedule = &rtpp_notify_schedule;
     pvt->pub.dtor = &rtpp_notify_dtor;
 
     return (&pvt->pub);
 
 e3:
+    RTPP_OBJ_DECREF(pvt->glog);
     CALL_METHOD(pvt->sigterm, dtor);
 e2:
     rtpp_queue_destroy(pvt->nqueue);
@@ -147,12 +230,22 @@ static void
 rtpp_notify_dtor(struct rtpp_notify *pub)
 {
     struct rtpp_notify_priv *pvt;
+    struct rtpp_notify_conn *rncp;
+    int i;
 
     PUB2PVT(pub, pvt);
 
     rtpp_queue_put_item(pvt->sigterm, pvt->nqueue);
     pthread_join(pvt->thread_id, NULL);
     rtpp_queue_destroy(pvt->nqueue);
+    for (i = 0; i < pvt->nconns; i++) {
+        rncp = pvt->conns[i];
+        if (rncp->state == RNC_CONNECTING) {
+            close(rncp->rttp->fd);
+            rncp->rttp->fd = -1;
+        }
+        free(rncp);
+    }
     RTPP_OBJ_DECREF(pvt->glog);
     free(pvt);
 }
@@ -181,8 +274,6 @@ rtpp_notify_schedule(struct rtpp_notify *pub,
 
     wi_data->rttp = rttp;
     wi_data->len = len;
-    RTPP_OBJ_INCREF(pvt->glog);
-    wi_data->glog = pvt->glog;
     wi_data->ntype = notify_type;
 
     len = snprintf(wi_data->notify_buf, len, "%s\n", notify_tag);
@@ -191,68 +282,266 @@ rtpp_notify_schedule(struct rtpp_notify *pub,
     return (0);
 }
 
+static struct rtpp_notify_conn *
+rtpp_notify_getconn(struct rtpp_notify_priv *pvt, struct rtpp_tnotify_target *rttp)
+{
+    struct rtpp_notify_conn *rncp;
+    int i;
+
+    for (i = 0; i < pvt->nconns; i++) {
+        if (pvt->conns[i]->rttp == rttp)
+            return (pvt->conns[i]);
+    }
+    if (pvt->nconns == RTPP_NOTIFY_TGTS_MAX)
+        return (NULL);
+    rncp = rtpp_zmalloc(sizeof(struct rtpp_notify_conn));
+    if (rncp == NULL)
+        return (NULL);
+    rncp->rttp = rttp;
+    rncp->state = (rttp->connected != 0) ? RNC_CONNECTED : RNC_IDLE;
+    pvt->conns[pvt->nconns] = rncp;
+    pvt->nconns += 1;
+    return (rncp);
+}
+
+static int
+rtpp_notify_enqueue(struct rtpp_notify_priv *pvt, const struct rtpp_notify_wi *wi)
+{
+    struct rtpp_notify_conn *rncp;
+    size_t len;
+
+    rncp = rtpp_notify_getconn(pvt, wi->rttp);
+    if (rncp == NULL) {
+        RTPP_LOG(pvt->glog, RTPP_LOG_ERR, "unable to send %s notification: "
+          "too many targets", wi->ntype);
+        return (-1);
+    }
+    rncp->ntype = wi->ntype;
+    /* string and \n, no \0 */
+    len = wi->len - 1;
+    if (rncp->blen + len > sizeof(rncp->buf)) {
+        if (rncp->dropped == 0) {
+            RTPP_LOG(pvt->glog, RTPP_LOG_ERR, "unable to send %s notification: "
+              "output buffer is full", wi->ntype);
+        }
+        rncp->dropped += 1;
+        return (-1);
+    }
+    memcpy(rncp->buf + rncp->blen, wi->notify_buf, len);
+    rncp->blen += len;
+    return (0);
+}
+
 static void
-reconnect_handler(const struct rtpp_notify_wi *wi)
+rtpp_notify_disconnect(struct rtpp_notify_priv *pvt, struct rtpp_notify_conn *rncp,
+  double dtime)
 {
+    char *cp;
 
-    assert (wi->rttp->connected == 0);
+    if (rncp->rttp->fd != -1) {
+        close(rncp->rttp->fd);
+        rncp->rttp->fd = -1;
+    }
+    rncp->rttp->connected = 0;
+    rncp->state = RNC_IDLE;
+    if (rncp->backoff == 0.0) {
+        rncp->backoff = RTPP_NOTIFY_BACKOFF_MIN;
+    } else if (rncp->backoff < RTPP_NOTIFY_BACKOFF_MAX) {
+        rncp->backoff *= 2;
+    }
+    rncp->next_try = dtime + rncp->backoff;
+    if (rncp->partial) {
+        /* Don't send the tail of a half-written notification to a new peer */
+        cp = memchr(rncp->buf, '\n', rncp->blen);
+        assert(cp != NULL);
+        rncp->blen -= cp + 1 - rncp->buf;
+        memmove(rncp->buf, cp + 1, rncp->blen);
+        rncp->partial = 0;
+    }
+}
 
-    if (wi->rttp->fd == -1) {
-        RTPP_LOG(wi->glog, RTPP_LOG_DBUG, "connecting %s socket", wi->ntype);
+static void
+rtpp_notify_connect(struct rtpp_notify_priv *pvt, struct rtpp_notify_conn *rncp,
+  double dtime)
+{
+    struct rtpp_tnotify_target *rttp;
+    int flags;
+
+    rttp = rncp->rttp;
+    assert(rttp->connected == 0 && rttp->fd == -1);
+
+    if (rncp->backoff == 0.0) {
+        RTPP_LOG(pvt->glog, RTPP_LOG_DBUG, "connecting %s socket", rncp->ntype);
     } else {
-        RTPP_LOG(wi->glog, RTPP_LOG_DBUG, "reconnecting %s socket", wi->ntype);
-        close(wi->rttp->fd);
+        RTPP_LOG(pvt->glog, RTPP_LOG_DBUG, "reconnecting %s socket", rncp->ntype);
     }
-    wi->rttp->fd = socket(wi->rttp->socket_type, SOCK_STREAM, 0);
-    if (wi->rttp->fd == -1) {
-        RTPP_ELOG(wi->glog, RTPP_LOG_ERR, "can't create %s socket", wi->ntype);
-        return;
+    rttp->fd = socket(rttp->socket_type, SOCK_STREAM, 0);
+    if (rttp->fd == -1) {
+        RTPP_ELOG(pvt->glog, RTPP_LOG_ERR, "can't create %s socket", rncp->ntype);
+        goto e0;
+    }
+    flags = fcntl(rttp->fd, F_GETFL);
+    if (flags == -1 || fcntl(rttp->fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        RTPP_ELOG(pvt->glog, RTPP_LOG_ERR, "can't make %s socket non-blocking",
+          rncp->ntype);
+        goto e0;
     }
-    if (wi->rttp->local != NULL) {
-        if (bind(wi->rttp->fd, wi->rttp->local, SA_LEN(wi->rttp->local)) < 0) {
-            RTPP_ELOG(wi->glog, RTPP_LOG_ERR, "can't bind %s socket", wi->ntype);
+    if (rttp->local != NULL) {
+        if (bind(rttp->fd, rttp->local, SA_LEN(rttp->local)) < 0) {
+            RTPP_ELOG(pvt->glog, RTPP_LOG_ERR, "can't bind %s socket", rncp->ntype);
             goto e0;
         }
     }
-    if (connect(wi->rttp->fd, (struct sockaddr *)&(wi->rttp->remote), wi->rttp->remote_len) == -1) {
-        RTPP_ELOG(wi->glog, RTPP_LOG_ERR, "can't connect to %s socket", wi->ntype);
-        goto e0;
+    if (connect(rttp->fd, sstosa(&rttp->remote), rttp->remote_len) == -1) {
+        if (errno != EINPROGRESS && errno != EINTR) {
+            RTPP_ELOG(pvt->glog, RTPP_LOG_ERR, "can't connect to %s socket",
+              rncp->ntype);
+            goto e0;
+        }
+        rncp->state = RNC_CONNECTING;
+        rncp->next_try = dtime + RTPP_NOTIFY_CONN_TMO;
     } else {
-        wi->rttp->connected = 1;
+        rttp->connected = 1;
+        rncp->state = RNC_CONNECTED;
+        rncp->backoff = 0.0;
     }
     return;
 
 e0:
-    close(wi->rttp->fd);
-    wi->rttp->fd = -1;
+    rtpp_notify_disconnect(pvt, rncp, dtime);
     return;
 }
 
 static void
-do_notification(struct rtpp_notify_wi *wi, int retries)
+rtpp_notify_flush(struct rtpp_notify_priv *pvt, struct rtpp_notify_conn *rncp,
+  double dtime)
 {
-    int result;
+    ssize_t rlen;
 
-    if (wi->rttp->connected == 0) {
-        reconnect_handler(wi);
+    if (rncp->blen == 0)
+        return;
+    do {
+        rlen = send(rncp->rttp->fd, rncp->buf, rncp->blen, 0);
+    } while (rlen == -1 && errno == EINTR);
 
-        /* If connect fails, no notification will be sent */
-        if (wi->rttp->connected == 0) {
-            RTPP_LOG(wi->glog, RTPP_LOG_ERR, "unable to send %s notification",
-              wi->ntype);
+    if (rlen < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
             return;
-        }
+        RTPP_ELOG(pvt->glog, RTPP_LOG_ERR, "failed to send %s notification",
+          rncp->ntype);
+        rtpp_notify_disconnect(pvt, rncp, dtime);
+        return;
     }
+    if (rlen == 0)
+        return;
+    rncp->partial = (rncp->buf[rlen - 1] != '\n');
+    rncp->blen -= rlen;
+    if (rncp->blen > 0) {
+        memmove(rncp->buf, rncp->buf + rlen, rncp->blen);
+    } else if (rncp->dropped > 0) {
+        RTPP_LOG(pvt->glog, RTPP_LOG_ERR, "%d %s notifications have been dropped",
+          rncp->dropped, rncp->ntype);
+        rncp->dropped = 0;
+    }
+}
 
-    do {
-        result = send(wi->rttp->fd, wi->notify_buf, wi->len - 1, 0);
-    } while (result == -1 && errno == EINTR);
-
-    if (result < 0) {
-        wi->rttp->connected = 0;
-        RTPP_ELOG(wi->glog, RTPP_LOG_ERR, "failed to send %s notification",
-          wi->ntype);
-        if (retries > 0)
-            do_notification(wi, retries - 1);
+static void
+rtpp_notify_connected(struct rtpp_notify_priv *pvt, struct rtpp_notify_conn *rncp,
+  double dtime)
+{
+    int error;
+    socklen_t elen;
+
+    elen = sizeof(error);
+    if (getsockopt(rncp->rttp->fd, SOL_SOCKET, SO_ERROR, &error, &elen) == -1)
+        error = errno;
+    if (error != 0) {
+        errno = error;
+        RTPP_ELOG(pvt->glog, RTPP_LOG_ERR, "can't connect to %s socket",
+          rncp->ntype);
+        rtpp_notify_disconnect(pvt, rncp, dtime);
+        return;
+    }
+    rncp->rttp->connected = 1;
+    rncp->state = RNC_CONNECTED;
+    rncp->backoff = 0.0;
+}
+
+/*
+ * Push buffered notifications out to all targets, waiting for at most
+ * maxwait seconds for any of the sockets to become writable. Returns
+ * number of targets with I/O in progress, *wakep is set to the time of
+ * the nearest reconnect attempt of the targets that are backing off,
+ * or to 0.0 if there are none.
+ */
+static int
+rtpp_notify_service(struct rtpp_notify_priv *pvt, double maxwait, double *wakep)
+{
+    struct pollfd pfds[RTPP_NOTIFY_TGTS_MAX];
+    struct rtpp_notify_conn *pconns[RTPP_NOTIFY_TGTS_MAX], *rncp;
+    int i, npfds, nready;
+    double dtime, tmo;
+
+    dtime = getdtime();
+    tmo = maxwait;
+    npfds = 0;
+    *wakep = 0.0;
+    for (i = 0; i < pvt->nconns; i++) {
+        rncp = pvt->conns[i];
+        if (rncp->blen == 0 && rncp->state != RNC_CONNECTING)
+            continue;
+        switch (rncp->state) {
+        case RNC_IDLE:
+            if (dtime < rncp->next_try)
+                break;
+            rtpp_notify_connect(pvt, rncp, dtime);
+            if (rncp->state != RNC_CONNECTED)
+                break;
+            /* Fall through */
+        case RNC_CONNECTED:
+            rtpp_notify_flush(pvt, rncp, dtime);
+            break;
+
+        case RNC_CONNECTING:
+            if (dtime >= rncp->next_try) {
+                RTPP_LOG(pvt->glog, RTPP_LOG_ERR, "can't connect to %s socket: "
+                  "timeout", rncp->ntype);
+                rtpp_notify_disconnect(pvt, rncp, dtime);
+            }
+            break;
+        }
+        if (rncp->state == RNC_IDLE) {
+            if (rncp->blen > 0 && (*wakep == 0.0 || rncp->next_try < *wakep))
+                *wakep = rncp->next_try;
+            continue;
+        }
+        if (rncp->state == RNC_CONNECTED && rncp->blen == 0)
+            continue;
+        pfds[npfds].fd = rncp->rttp->fd;
+        pfds[npfds].events = POLLOUT;
+        pfds[npfds].revents = 0;
+        pconns[npfds] = rncp;
+        npfds += 1;
+    }
+    if (npfds == 0)
+        return (0);
+    if (*wakep != 0.0 && *wakep - dtime < tmo)
+        tmo = *wakep - dtime;
+
+    nready = poll(pfds, npfds, (int)(tmo * 1000.0) + 1);
+    if (nready <= 0)
+        return (npfds);
+    dtime = getdtime();
+    for (i = 0; i < npfds; i++) {
+        if (pfds[i].revents == 0)
+            continue;
+        rncp = pconns[i];
+        if (rncp->state == RNC_CONNECTING) {
+            rtpp_notify_connected(pvt, rncp, dtime);
+            if (rncp->state != RNC_CONNECTED)
+                continue;
+        }
+        rtpp_notify_flush(pvt, rncp, dtime);
     }
+    return (npfds);
 }
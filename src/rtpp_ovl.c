@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2026 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+
+#include <sys/socket.h>
+#include <stdint.h>
+
+#include "rtpp_cfg.h"
+#include "rtpp_ovl.h"
+
+void
+rtpp_ovl_setdefaults(struct overload_prot *opp)
+{
+
+    opp->low_trs[OVL_NEWSESS - 1] = 0.85;
+    opp->high_trs[OVL_NEWSESS - 1] = 0.90;
+    opp->low_trs[OVL_MEDIA - 1] = 0.90;
+    opp->high_trs[OVL_MEDIA - 1] = 0.95;
+    opp->low_trs[OVL_OBSRVS - 1] = 0.93;
+    opp->high_trs[OVL_OBSRVS - 1] = 0.98;
+}
+
+/*
+ * Move at most one grade per sample, so that the shedding ramps up and
+ * down gradually and each grade has its own hysteresis.
+ */
+int
+rtpp_ovl_update_grade(const struct overload_prot *opp, int grade,
+  double pressure)
+{
+
+    if (grade < OVL_NGRADES && pressure > opp->high_trs[grade])
+        return (grade + 1);
+    if (grade > OVL_NONE && pressure < opp->low_trs[grade - 1])
+        return (grade - 1);
+    return (grade);
+}
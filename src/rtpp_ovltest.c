@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2026 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+
+/*
+ * Drives the overload protection grade machine with synthetic pressure
+ * values against the default --overload_prot thresholds and checks that
+ * it moves one grade per sample and only leaves a grade once pressure
+ * drops below the grade's own (lower) leave threshold.
+ */
+
+/* Checks below are done with assert(), keep them in optimized builds */
+#undef NDEBUG
+
+#include <sys/socket.h>
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "rtpp_cfg.h"
+#include "rtpp_ovl.h"
+
+struct ovl_step {
+    double pressure;
+    int grade;
+};
+
+static int
+run_steps(const struct overload_prot *opp, int grade,
+  const struct ovl_step *sp, int nsteps)
+{
+    int i, ngrade;
+
+    for (i = 0; i < nsteps; i++) {
+        ngrade = rtpp_ovl_update_grade(opp, grade, sp[i].pressure);
+        if (ngrade != sp[i].grade) {
+            fprintf(stderr, "step %d: pressure=%f, grade %d -> %d, "
+              "expected %d\n", i, sp[i].pressure, grade, ngrade,
+              sp[i].grade);
+        }
+        assert(ngrade == sp[i].grade);
+        /* Never more than one grade at a time */
+        assert(ngrade - grade <= 1 && grade - ngrade <= 1);
+        grade = ngrade;
+    }
+    return (grade);
+}
+
+int
+main(void)
+{
+    struct overload_prot op;
+    int g;
+
+    /* Ramp up, saturation jumps up one grade per sample only */
+    static const struct ovl_step ramp_up[] = {
+        {0.50, OVL_NONE}, {0.90, OVL_NONE}, {0.91, OVL_NEWSESS},
+        {0.95, OVL_NEWSESS}, {1.50, OVL_MEDIA}, {1.50, OVL_OBSRVS},
+        {1.50, OVL_OBSRVS},
+    };
+    /* Ramp down, each grade is held until its leave threshold */
+    static const struct ovl_step ramp_down[] = {
+        {0.97, OVL_OBSRVS}, {0.93, OVL_OBSRVS}, {0.92, OVL_MEDIA},
+        {0.91, OVL_MEDIA}, {0.90, OVL_MEDIA}, {0.89, OVL_NEWSESS},
+        {0.0, OVL_NONE}, {0.0, OVL_NONE},
+    };
+    /* Pressure oscillating between the leave and enter thresholds */
+    static const struct ovl_step flap[] = {
+        {0.91, OVL_NEWSESS}, {0.86, OVL_NEWSESS}, {0.89, OVL_NEWSESS},
+        {0.86, OVL_NEWSESS}, {0.89, OVL_NEWSESS}, {0.84, OVL_NONE},
+        {0.89, OVL_NONE}, {0.86, OVL_NONE}, {0.89, OVL_NONE},
+    };
+
+    memset(&op, '\0', sizeof(op));
+    rtpp_ovl_setdefaults(&op);
+    for (g = 0; g < OVL_NGRADES; g++) {
+        /* Hysteresis requires a gap between leave and enter thresholds */
+        assert(op.low_trs[g] < op.high_trs[g]);
+        /* Entering a grade should not bring us below the previous one */
+        if (g > 0)
+            assert(op.low_trs[g] >= op.low_trs[g - 1]);
+    }
+
+    g = run_steps(&op, OVL_NONE, ramp_up,
+      sizeof(ramp_up) / sizeof(ramp_up[0]));
+    assert(g == OVL_OBSRVS);
+    g = run_steps(&op, g, ramp_down,
+      sizeof(ramp_down) / sizeof(ramp_down[0]));
+    assert(g == OVL_NONE);
+    g = run_steps(&op, g, flap, sizeof(flap) / sizeof(flap[0]));
+    assert(g == OVL_NONE);
+
+    printf("rtpp_ovltest: all grade transitions are as expected\n");
+    return (0);
+}
@@ -53,11 +53,24 @@ struct rtpp_pcnt_strm_priv {
 };
 
 static void rtpp_pcnt_strm_dtor(struct rtpp_pcnt_strm_priv *);
+static void rtpp_pcnt_strm_dtor_pa(struct rtpp_pcnt_strm_priv *);
 static void rtpp_pcnt_strm_get_stats(struct rtpp_pcnt_strm *,
   struct rtpp_pcnts_strm *);
 static void rtpp_pcnt_strm_reg_pktin(struct rtpp_pcnt_strm *,
   struct rtp_packet *);
 
+static int
+rtpp_pcnt_strm_init(struct rtpp_pcnt_strm_priv *pvt)
+{
+
+    if (pthread_mutex_init(&pvt->lock, NULL) != 0) {
+        return (-1);
+    }
+    pvt->pub.get_stats = &rtpp_pcnt_strm_get_stats;
+    pvt->pub.reg_pktin = &rtpp_pcnt_strm_reg_pktin;
+    return (0);
+}
+
 struct rtpp_pcnt_strm *
 rtpp_pcnt_strm_ctor(void)
 {
@@ -67,11 +80,9 @@ rtpp_pcnt_strm_ctor(void)
     if (pvt == NULL) {
         goto e0;
     }
-    if (pthread_mutex_init(&pvt->lock, NULL) != 0) {
+    if (rtpp_pcnt_strm_init(pvt) != 0) {
         goto e1;
     }
-    pvt->pub.get_stats = &rtpp_pcnt_strm_get_stats;
-    pvt->pub.reg_pktin = &rtpp_pcnt_strm_reg_pktin;
     CALL_SMETHOD(pvt->pub.rcnt, attach,
       (rtpp_refcnt_dtor_t)&rtpp_pcnt_strm_dtor, pvt);
     return ((&pvt->pub));
@@ -83,12 +94,46 @@ e0:
     return (NULL);
 }
 
+size_t
+rtpp_pcnt_strm_osize(void)
+{
+
+    return (rtpp_rzmalloc_psize(sizeof(struct rtpp_pcnt_strm_priv)));
+}
+
+/*
+ * Construct object in the memory provided by the caller, which has to be
+ * at least rtpp_pcnt_strm_osize() bytes and outlive the object.
+ */
+struct rtpp_pcnt_strm *
+rtpp_pcnt_strm_ctor_pa(void *pap)
+{
+    struct rtpp_pcnt_strm_priv *pvt;
+
+    pvt = rtpp_rzmalloc_pa(pap, sizeof(struct rtpp_pcnt_strm_priv),
+      PVT_RCOFFS(pvt));
+    if (rtpp_pcnt_strm_init(pvt) != 0) {
+        RTPP_OBJ_DECREF(&(pvt->pub));
+        return (NULL);
+    }
+    CALL_SMETHOD(pvt->pub.rcnt, attach,
+      (rtpp_refcnt_dtor_t)&rtpp_pcnt_strm_dtor_pa, pvt);
+    return ((&pvt->pub));
+}
+
 static void
-rtpp_pcnt_strm_dtor(struct rtpp_pcnt_strm_priv *pvt)
+rtpp_pcnt_strm_dtor_pa(struct rtpp_pcnt_strm_priv *pvt)
 {
 
     rtpp_pcnt_strm_fin(&(pvt->pub));
     pthread_mutex_destroy(&pvt->lock);
+}
+
+static void
+rtpp_pcnt_strm_dtor(struct rtpp_pcnt_strm_priv *pvt)
+{
+
+    rtpp_pcnt_strm_dtor_pa(pvt);
     free(pvt);
 }
 
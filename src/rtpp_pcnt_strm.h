@@ -46,4 +46,6 @@ struct rtpp_pcnt_strm {
 };
 
 struct rtpp_pcnt_strm *rtpp_pcnt_strm_ctor(void);
+size_t rtpp_pcnt_strm_osize(void);
+struct rtpp_pcnt_strm *rtpp_pcnt_strm_ctor_pa(void *);
 #endif
@@ -70,3 +70,47 @@ rtpp_pearson_hash8b(struct rtpp_pearson *rpp, const uint8_t *bp, size_t blen)
     }
     return res;
 }
+
+/*
+ * Wide (32-bit) variant: four Pearson lanes run in parallel over the same
+ * input, each seeded from a different table slot, and the results are
+ * concatenated. Suitable as a bucket index for tables with more than 256
+ * buckets.
+ */
+#define PH32_INIT(rpp, h) do { \
+    (h)[0] = (rpp)->rand_table[0]; (h)[1] = (rpp)->rand_table[1]; \
+    (h)[2] = (rpp)->rand_table[2]; (h)[3] = (rpp)->rand_table[3]; \
+} while (0)
+#define PH32_STEP(rpp, h, c) do { \
+    (h)[0] = (rpp)->rand_table[(h)[0] ^ (c)]; \
+    (h)[1] = (rpp)->rand_table[(h)[1] ^ (c)]; \
+    (h)[2] = (rpp)->rand_table[(h)[2] ^ (c)]; \
+    (h)[3] = (rpp)->rand_table[(h)[3] ^ (c)]; \
+} while (0)
+#define PH32_RES(h) (((uint32_t)(h)[3] << 24) | ((uint32_t)(h)[2] << 16) | \
+  ((uint32_t)(h)[1] << 8) | (uint32_t)(h)[0])
+
+uint32_t
+rtpp_pearson_hash32(struct rtpp_pearson *rpp, const char *bp, const char *ep)
+{
+    uint8_t h[4];
+
+    PH32_INIT(rpp, h);
+    for (; bp[0] != '\0' && bp != ep; bp++) {
+        PH32_STEP(rpp, h, (uint8_t)bp[0]);
+    }
+    return (PH32_RES(h));
+}
+
+uint32_t
+rtpp_pearson_hash32b(struct rtpp_pearson *rpp, const uint8_t *bp, size_t blen)
+{
+    uint8_t h[4];
+    const uint8_t *ep;
+
+    PH32_INIT(rpp, h);
+    for (ep = bp + blen; bp != ep; bp++) {
+        PH32_STEP(rpp, h, bp[0]);
+    }
+    return (PH32_RES(h));
+}
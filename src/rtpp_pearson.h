@@ -33,3 +33,5 @@ struct rtpp_pearson {
 void rtpp_pearson_shuffle(struct rtpp_pearson *);
 uint8_t rtpp_pearson_hash8(struct rtpp_pearson *, const char *, const char *);
 uint8_t rtpp_pearson_hash8b(struct rtpp_pearson *, const uint8_t *, size_t);
+uint32_t rtpp_pearson_hash32(struct rtpp_pearson *, const char *, const char *);
+uint32_t rtpp_pearson_hash32b(struct rtpp_pearson *, const uint8_t *, size_t);
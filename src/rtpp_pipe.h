@@ -31,6 +31,7 @@
 struct rtpp_stats;
 struct rtpp_pipe;
 struct rtpp_acct_pipe;
+struct rtpp_proc_servers;
 
 #define PIPE_RTP        1
 #define PIPE_RTCP       2
@@ -67,6 +68,7 @@ struct r_pipe_ctor_args {
     uint64_t seuid;
     struct rtpp_weakref_obj *streams_wrt;
     struct rtpp_weakref_obj *servers_wrt;
+    struct rtpp_proc_servers *proc_servers;
     struct rtpp_log *log;
     struct rtpp_stats *rtpp_stats;
     int pipe_type;
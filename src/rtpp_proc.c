@@ -57,12 +57,13 @@ struct rtpp_proc_ready_lst {
     struct rtpp_stream *stp;
 };
 
-static void send_packet(const struct rtpp_cfg *, struct rtpp_stream *,
+static void send_packet(struct rtpp_stream *, struct rtpp_stream *,
   struct rtp_packet *, struct sthread_args *, struct rtpp_proc_rstats *);
 
 static void
 rxmit_packets(const struct rtpp_cfg *cfsp, struct rtpp_stream *stp,
-  const struct rtpp_timestamp *dtime, int drain_repeat, struct sthread_args *sender,
+  struct rtpp_stream *stp_out, const struct rtpp_timestamp *dtime,
+  int drain_repeat, struct sthread_args *sender,
   struct rtpp_proc_rstats *rsp, const struct rtpp_session *sp)
 {
     int ndrain;
@@ -92,7 +93,7 @@ rxmit_packets(const struct rtpp_cfg *cfsp, struct rtpp_stream *stp,
         pktx.strmp = stp;
         pktx.pktp = packet;
         CALL_METHOD(cfsp->observers, observe, &pktx);
-        send_packet(cfsp, stp, packet, sender, rsp);
+        send_packet(stp, stp_out, packet, sender, rsp);
     } while (ndrain > 0);
     return;
 }
@@ -109,15 +110,13 @@ get_sender(const struct rtpp_cfg *cfsp, struct rtpp_stream *stp)
 }
 
 static void
-send_packet(const struct rtpp_cfg *cfsp, struct rtpp_stream *stp_in,
+send_packet(struct rtpp_stream *stp_in, struct rtpp_stream *stp_out,
   struct rtp_packet *packet, struct sthread_args *sender,
   struct rtpp_proc_rstats *rsp)
 {
-    struct rtpp_stream *stp_out;
 
     CALL_METHOD(stp_in->ttl, reset);
 
-    stp_out = get_sender(cfsp, stp_in);
     if (stp_out == NULL) {
         goto e0;
     }
@@ -133,17 +132,14 @@ send_packet(const struct rtpp_cfg *cfsp, struct rtpp_stream *stp_in,
      * sent out, drop otherwise.
      */
     if (!CALL_SMETHOD(stp_out, issendable) || CALL_SMETHOD(stp_out, isplayer_active)) {
-        goto e1;
+        goto e0;
     } else {
         CALL_SMETHOD(stp_out, send_pkt, sender, packet);
         CALL_METHOD(stp_in->pcount, reg_reld);
         rsp->npkts_relayed.cnt++;
     }
-    RTPP_OBJ_DECREF(stp_out);
     return;
 
-e1:
-    RTPP_OBJ_DECREF(stp_out);
 e0:
     RTPP_OBJ_DECREF(packet);
     CALL_METHOD(stp_in->pcount, reg_drop);
@@ -157,33 +153,35 @@ process_rtp_only(const struct rtpp_cfg *cfsp, struct rtpp_polltbl *ptbl,
 {
     int readyfd, ndrained;
     struct rtpp_session *sp;
-    struct rtpp_stream *stp;
+    struct rtpp_stream *stp, *stp_out;
     struct rtp_packet *packet;
     struct rtpp_socket *iskt;
 
     for (readyfd = 0; readyfd < ptbl->curlen; readyfd++) {
         if ((ptbl->pfds[readyfd].revents & POLLIN) == 0)
             continue;
-        stp = CALL_METHOD(ptbl->streams_wrt, get_by_idx,
-          ptbl->mds[readyfd].stuid);
-        if (stp == NULL)
-            continue;
+        /* The table holds a reference for as long as stream is in it */
+        stp = ptbl->mds[readyfd].stp;
         sp = CALL_METHOD(cfsp->sessions_wrt, get_by_idx, stp->seuid);
         if (sp == NULL) {
-            RTPP_OBJ_DECREF(stp);
             continue;
         }
         iskt = ptbl->mds[readyfd].skt;
         if (sp->complete != 0) {
-            rxmit_packets(cfsp, stp, dtime, drain_repeat, sender, rsp, sp);
+            /* Look up the other side once for all packets we are about to relay */
+            stp_out = get_sender(cfsp, stp);
+            rxmit_packets(cfsp, stp, stp_out, dtime, drain_repeat, sender, rsp, sp);
             RTPP_OBJ_DECREF(sp);
             if (stp->resizer != NULL) {
                 while ((packet = rtp_resizer_get(stp->resizer, dtime->mono)) != NULL) {
-                    send_packet(cfsp, stp, packet, sender, rsp);
+                    send_packet(stp, stp_out, packet, sender, rsp);
                     rsp->npkts_resizer_out.cnt++;
                     packet = NULL;
                 }
             }
+            if (stp_out != NULL) {
+                RTPP_OBJ_DECREF(stp_out);
+            }
         } else {
             const char *proto;
 
@@ -194,6 +192,5 @@ process_rtp_only(const struct rtpp_cfg *cfsp, struct rtpp_polltbl *ptbl,
                 rsp->npkts_discard.cnt += ndrained;
             }
         }
-        RTPP_OBJ_DECREF(stp);
     }
 }
@@ -49,14 +49,17 @@
 #include "rtpp_command_async.h"
 #include "rtpp_debug.h"
 #include "rtpp_netio_async.h"
+#include "rtpp_ovl.h"
 #include "rtpp_proc.h"
 #include "rtpp_proc_async.h"
 #include "rtpp_proc_servers.h"
 #include "rtpp_mallocs.h"
+#include "rtpp_math.h"
 #include "rtpp_sessinfo.h"
 #include "rtpp_stats.h"
 #include "rtpp_time.h"
 #include "rtpp_pipe.h"
+#include "advanced/po_manager.h"
 
 struct elp_data {
     void *obj;
@@ -72,6 +75,8 @@ struct rtpp_proc_async_cf {
     struct rtpp_proc_rstats rstats;
     const struct rtpp_cfg *cf_save;
     atomic_int tstate;
+    /* Last load reading of the forwarding loop, for monitoring */
+    _Atomic(double) aload;
     struct elp_data elp_fs;
     struct elp_data elp_lz;
 };
@@ -79,7 +84,25 @@ struct rtpp_proc_async_cf {
 #define TSTATE_RUN   0x0
 #define TSTATE_CEASE 0x1
 
+/*
+ * Overload protection inputs are normalized so that 1.0 means "saturated":
+ * forwarding loop load as is, sender queue depth relative to the capacity
+ * of its circular buffer and command processing latency relative to
+ * OVL_CMD_LAT_MAX. Sender queue is not bounded as such, once its buffer is
+ * full packets spill into the overflow list, meaning that the sender is
+ * not keeping up anymore.
+ */
+#define	OVL_CMD_LAT_MAX	0.1
+#define	OVL_NSNDRS	8
+
+struct ovl_inputs {
+    double fwd_load;
+    double sndq_load;
+    double cmd_load;
+};
+
 static void rtpp_proc_async_dtor(struct rtpp_proc_async *);
+static double rtpp_proc_async_get_aload(struct rtpp_proc_async *);
 
 #define FLUSH_STAT(sobj, st)	{ \
     if ((st).cnt > 0) { \
@@ -114,6 +137,25 @@ init_rstats(struct rtpp_stats *sobj, struct rtpp_proc_rstats *rsp)
     rsp->npkts_discard.cnt_idx = CALL_SMETHOD(sobj, getidxbyname, "npkts_discard");
 }
 
+static double
+ovl_get_pressure(const struct rtpp_cfg *cfsp, struct rtpp_proc_async_cf *proc_cf,
+  double lv, struct ovl_inputs *oip)
+{
+    int qlens[OVL_NSNDRS];
+    int i, nqlens, qlen_max, qcap;
+
+    oip->fwd_load = lv;
+    qlen_max = 0;
+    nqlens = rtpp_anetio_get_qlens(proc_cf->pub.netio, qlens, OVL_NSNDRS);
+    for (i = 0; i < nqlens; i++) {
+        qlen_max = MAX(qlen_max, qlens[i]);
+    }
+    qcap = rtpp_anetio_get_qcap(proc_cf->pub.netio);
+    oip->sndq_load = (double)qlen_max / (double)qcap;
+    oip->cmd_load = CALL_METHOD(cfsp->rtpp_cmd_cf, get_latency) / OVL_CMD_LAT_MAX;
+    return (MAX(oip->fwd_load, MAX(oip->sndq_load, oip->cmd_load)));
+}
+
 static void
 rtpp_proc_async_run(void *arg)
 {
@@ -154,18 +196,29 @@ rtpp_proc_async_run(void *arg)
             break;
         }
         edp->ncycles_ref = (long long)prdic_getncycles_ref(edp->obj);
-        if (cfsp->overload_prot.ecode != 0 && edp->ncycles_chk_ol <= edp->ncycles_ref) {
+        if (edp->ncycles_chk_ol <= edp->ncycles_ref) {
             double lv = prdic_getload(edp->obj);
 
-            if (overload  && lv < 0.85) {
-                overload = 0;
-                CALL_METHOD(cfsp->rtpp_cmd_cf, reg_overload, 0);
-            } else if (overload == 0 && lv > 0.9) {
-                overload = 1;
-                CALL_METHOD(cfsp->rtpp_cmd_cf, reg_overload, 1);
+            atomic_store_explicit(&proc_cf->aload, lv, memory_order_relaxed);
+            if (cfsp->overload_prot.ecode != 0 && cfsp->rtpp_cmd_cf != NULL) {
+                struct ovl_inputs oi;
+                double pressure;
+                int ngrade;
+
+                pressure = ovl_get_pressure(cfsp, proc_cf, lv, &oi);
+                ngrade = rtpp_ovl_update_grade(&cfsp->overload_prot, overload,
+                  pressure);
+                if (ngrade != overload) {
+                    RTPP_LOG(cfsp->glog, RTPP_LOG_WARN, "overload grade "
+                      "%d -> %d: forwarding load=%f, sender queue=%f, "
+                      "command latency=%f", overload, ngrade, oi.fwd_load,
+                      oi.sndq_load, oi.cmd_load);
+                    overload = ngrade;
+                    CALL_METHOD(cfsp->rtpp_cmd_cf, reg_overload, overload);
+                }
+                RTPP_LOG(cfsp->glog, RTPP_LOG_INFO, "ncycles=%lld load=%f "
+                  "pressure=%f", edp->ncycles_ref, lv, pressure);
             }
-            RTPP_LOG(cfsp->glog, RTPP_LOG_INFO, "ncycles=%lld load=%f",
-              edp->ncycles_ref, lv);
             edp->ncycles_chk_ol = ((edp->ncycles_ref / 200) + 1) * 200;
         }
         ndrain = ((edp->ncycles_ref - edp->ncycles_ref_last) * MAX_RTP_RATE) / edp->target_pfreq;
@@ -229,11 +282,13 @@ rtpp_proc_async_run(void *arg)
         if (nready_rtcp > 0 && rtp_only == 0) {
             process_rtp_only(cfsp, &ptbl_rtcp, &rtime, ndrain, sender, rstats);
         }
-
-        if (CALL_METHOD(cfsp->servers_wrt, get_length) > 0) {
-            rtpp_proc_servers(cfsp, rtime.mono, sender, rstats);
+        if (nready_rtp > 0 || nready_rtcp > 0) {
+            /* Hand whatever packet observers have collected to the workers */
+            CALL_METHOD(cfsp->observers, flush);
         }
 
+        rtpp_proc_servers(cfsp, rtime.mono, sender, rstats);
+
         rtpp_anetio_pump_q(sender);
         flush_rstats(stats_cf, rstats);
 
@@ -288,6 +343,7 @@ rtpp_proc_async_ctor(const struct rtpp_cfg *cfsp)
         goto e3;
     }
     proc_cf->pub.dtor = &rtpp_proc_async_dtor;
+    proc_cf->pub.get_aload = &rtpp_proc_async_get_aload;
     return (&proc_cf->pub);
 e3:
     prdic_free(proc_cf->elp_lz.obj);
@@ -316,3 +372,12 @@ rtpp_proc_async_dtor(struct rtpp_proc_async *pub)
     rtpp_netio_async_destroy(proc_cf->pub.netio);
     free(proc_cf);
 }
+
+static double
+rtpp_proc_async_get_aload(struct rtpp_proc_async *pub)
+{
+    struct rtpp_proc_async_cf *proc_cf;
+
+    PUB2PVT(pub, proc_cf);
+    return (atomic_load_explicit(&proc_cf->aload, memory_order_relaxed));
+}
@@ -28,13 +28,18 @@
 
 #include <sys/types.h>
 #include <netinet/in.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "rtpp_cfg.h"
 #include "rtpp_types.h"
 #include "rtpp_refcnt.h"
 #include "rtpp_weakref.h"
 #include "rtpp_hash_table.h"
+#include "rtpp_mallocs.h"
 #include "rtp.h"
 #include "rtpp_time.h"
 #include "rtp_packet.h"
@@ -43,40 +48,185 @@
 #include "rtpp_server.h"
 #include "rtpp_stream.h"
 
-struct foreach_args {
-    double dtime;
-    struct sthread_args *sender;
-    struct rtpp_proc_rstats *rsp;
-    struct rtpp_weakref_obj *rtp_streams_wrt;
-    struct rtpp_weakref_obj *rtcp_streams_wrt;
+/*
+ * Players are kept in a binary min-heap ordered by the time their next
+ * packet is due, so that each run only has to look at the ones that have
+ * something to send, not at every active player. The heap is only ever
+ * touched by the RTP processing thread. Newly started players are handed
+ * over from other threads via the pending list. Only the player's UID is
+ * kept, so a player stopped or destroyed in the meantime simply fails the
+ * lookup when its turn comes and is forgotten.
+ */
+struct rtpp_psched_ent {
+    double deadline;
+    uint64_t sruid;
+};
+
+struct rtpp_psched_list {
+    struct rtpp_psched_ent *ents;
+    int len;
+    int alen;
+};
+
+struct rtpp_proc_servers_priv {
+    struct rtpp_proc_servers pub;
+    struct rtpp_psched_list heap;
+    struct rtpp_psched_list pending;
+    pthread_mutex_t lock;
 };
 
+/* Re-check delay for the players whose stream is not available */
+#define RTPP_PSCHED_RETRY 0.01
+
+static int rtpp_proc_servers_reg(struct rtpp_proc_servers *,
+  struct rtpp_server *);
+static void rtpp_proc_servers_dtor(struct rtpp_proc_servers *);
+
+struct rtpp_proc_servers *
+rtpp_proc_servers_ctor(void)
+{
+    struct rtpp_proc_servers_priv *pvt;
+
+    pvt = rtpp_zmalloc(sizeof(*pvt));
+    if (pvt == NULL) {
+        goto e0;
+    }
+    if (pthread_mutex_init(&pvt->lock, NULL) != 0) {
+        goto e1;
+    }
+    pvt->pub.reg = &rtpp_proc_servers_reg;
+    pvt->pub.dtor = &rtpp_proc_servers_dtor;
+    return (&pvt->pub);
+
+e1:
+    free(pvt);
+e0:
+    return (NULL);
+}
+
+static void
+rtpp_proc_servers_dtor(struct rtpp_proc_servers *self)
+{
+    struct rtpp_proc_servers_priv *pvt;
+
+    PUB2PVT(self, pvt);
+    pthread_mutex_destroy(&pvt->lock);
+    free(pvt->heap.ents);
+    free(pvt->pending.ents);
+    free(pvt);
+}
+
 static int
-process_rtp_servers_foreach(void *dp, void *ap)
+rtpp_psched_list_grow(struct rtpp_psched_list *lp, int len)
+{
+    struct rtpp_psched_ent *ents;
+    int alen;
+
+    if (len <= lp->alen)
+        return (0);
+    alen = (lp->alen * 2 > len) ? lp->alen * 2 : len + 16;
+    ents = realloc(lp->ents, sizeof(lp->ents[0]) * alen);
+    if (ents == NULL)
+        return (-1);
+    lp->ents = ents;
+    lp->alen = alen;
+    return (0);
+}
+
+static void
+rtpp_psched_push(struct rtpp_psched_list *hp, const struct rtpp_psched_ent *ep)
+{
+    int i, pi;
+
+    for (i = hp->len; i > 0; i = pi) {
+        pi = (i - 1) / 2;
+        if (hp->ents[pi].deadline <= ep->deadline)
+            break;
+        hp->ents[i] = hp->ents[pi];
+    }
+    hp->ents[i] = *ep;
+    hp->len += 1;
+}
+
+static void
+rtpp_psched_pop(struct rtpp_psched_list *hp, struct rtpp_psched_ent *ep)
+{
+    struct rtpp_psched_ent *lp;
+    int i, ci;
+
+    *ep = hp->ents[0];
+    hp->len -= 1;
+    lp = &hp->ents[hp->len];
+    for (i = 0; (ci = i * 2 + 1) < hp->len; i = ci) {
+        if (ci + 1 < hp->len && hp->ents[ci + 1].deadline < hp->ents[ci].deadline)
+            ci += 1;
+        if (lp->deadline <= hp->ents[ci].deadline)
+            break;
+        hp->ents[i] = hp->ents[ci];
+    }
+    hp->ents[i] = *lp;
+}
+
+static int
+rtpp_proc_servers_reg(struct rtpp_proc_servers *self, struct rtpp_server *rsrv)
+{
+    struct rtpp_proc_servers_priv *pvt;
+    struct rtpp_psched_ent *ep;
+
+    PUB2PVT(self, pvt);
+    pthread_mutex_lock(&pvt->lock);
+    if (rtpp_psched_list_grow(&pvt->pending, pvt->pending.len + 1) != 0) {
+        pthread_mutex_unlock(&pvt->lock);
+        return (-1);
+    }
+    ep = &pvt->pending.ents[pvt->pending.len];
+    ep->deadline = CALL_SMETHOD(rsrv, get_deadline);
+    ep->sruid = rsrv->sruid;
+    pvt->pending.len += 1;
+    pthread_mutex_unlock(&pvt->lock);
+    return (0);
+}
+
+static void
+rtpp_psched_merge(struct rtpp_proc_servers_priv *pvt)
+{
+    int i;
+
+    pthread_mutex_lock(&pvt->lock);
+    if (pvt->pending.len == 0 ||
+      rtpp_psched_list_grow(&pvt->heap, pvt->heap.len + pvt->pending.len) != 0) {
+        pthread_mutex_unlock(&pvt->lock);
+        return;
+    }
+    for (i = 0; i < pvt->pending.len; i++)
+        rtpp_psched_push(&pvt->heap, &pvt->pending.ents[i]);
+    pvt->pending.len = 0;
+    pthread_mutex_unlock(&pvt->lock);
+}
+
+/*
+ * Send out whatever is due from the player, return 0 if it has to be
+ * scheduled again or -1 if it's done.
+ */
+static int
+process_rtp_server(const struct rtpp_cfg *cfsp, struct rtpp_server *rsrv,
+  double dtime, struct sthread_args *sender, struct rtpp_proc_rstats *rsp)
 {
-    struct foreach_args *fap;
-    struct rtpp_server *rsrv;
     struct rtp_packet *pkt;
     int len;
     struct rtpp_stream *rsop;
 
-    fap = (struct foreach_args *)ap;
-    /*
-     * This method does not need us to bump ref, since we are in the
-     * locked context of the rtpp_hash_table, which holds its own ref.
-     */
-    rsrv = (struct rtpp_server *)dp;
-    rsop = CALL_METHOD(fap->rtp_streams_wrt, get_by_idx, rsrv->stuid);
+    rsop = CALL_METHOD(cfsp->rtp_streams_wrt, get_by_idx, rsrv->stuid);
     if (rsop == NULL) {
-        return (RTPP_WR_MATCH_CONT);
+        return (0);
     }
     for (;;) {
-        pkt = CALL_SMETHOD(rsrv, get, fap->dtime, &len);
+        pkt = CALL_SMETHOD(rsrv, get, dtime, &len);
         if (pkt == NULL) {
             if (len == RTPS_EOF) {
                 CALL_SMETHOD(rsop, finish_playback, rsrv->sruid);
                 RTPP_OBJ_DECREF(rsop);
-                return (RTPP_WR_MATCH_DEL);
+                return (-1);
             } else if (len != RTPS_LATER) {
                 /* XXX some error, brag to logs */
             }
@@ -87,25 +237,44 @@ process_rtp_servers_foreach(void *dp, void *ap)
             RTPP_OBJ_DECREF(pkt);
             continue;
         }
-        CALL_SMETHOD(rsop, send_pkt, fap->sender, pkt);
-        fap->rsp->npkts_played.cnt++;
+        CALL_SMETHOD(rsop, send_pkt, sender, pkt);
+        rsp->npkts_played.cnt++;
     }
     RTPP_OBJ_DECREF(rsop);
-    return (RTPP_WR_MATCH_CONT);
+    return (0);
 }
 
 void
 rtpp_proc_servers(const struct rtpp_cfg *cfsp, double dtime, struct sthread_args *sender,
   struct rtpp_proc_rstats *rsp)
 {
-    struct foreach_args fargs;
-
-    fargs.dtime = dtime;
-    fargs.sender = sender;
-    fargs.rsp = rsp;
-    fargs.rtp_streams_wrt = cfsp->rtp_streams_wrt;
-    fargs.rtcp_streams_wrt = cfsp->rtcp_streams_wrt;
+    struct rtpp_proc_servers_priv *pvt;
+    struct rtpp_psched_ent ent;
+    struct rtpp_server *rsrv;
+    double deadline;
 
-    CALL_METHOD(cfsp->servers_wrt, foreach, process_rtp_servers_foreach,
-      &fargs);
+    PUB2PVT(cfsp->proc_servers, pvt);
+    rtpp_psched_merge(pvt);
+    while (pvt->heap.len > 0 && pvt->heap.ents[0].deadline <= dtime) {
+        rtpp_psched_pop(&pvt->heap, &ent);
+        rsrv = CALL_METHOD(cfsp->servers_wrt, get_by_idx, ent.sruid);
+        if (rsrv == NULL) {
+            /* Stopped or otherwise gone */
+            continue;
+        }
+        if (process_rtp_server(cfsp, rsrv, dtime, sender, rsp) != 0) {
+            CALL_METHOD(cfsp->servers_wrt, unreg, rsrv->sruid);
+            RTPP_OBJ_DECREF(rsrv);
+            continue;
+        }
+        deadline = CALL_SMETHOD(rsrv, get_deadline);
+        if (deadline <= dtime) {
+            /* Its stream is not there (yet) */
+            deadline = dtime + RTPP_PSCHED_RETRY;
+        }
+        ent.deadline = deadline;
+        /* Can't fail, the slot we've just popped it from is still there */
+        rtpp_psched_push(&pvt->heap, &ent);
+        RTPP_OBJ_DECREF(rsrv);
+    }
 }
@@ -1,2 +1,24 @@
+#ifndef _RTPP_PROC_SERVERS_H_
+#define _RTPP_PROC_SERVERS_H_
+
+struct rtpp_cfg;
+struct rtpp_proc_servers;
+struct rtpp_proc_rstats;
+struct rtpp_server;
+struct sthread_args;
+
+DEFINE_METHOD(rtpp_proc_servers, rtpp_proc_servers_reg, int,
+  struct rtpp_server *);
+DEFINE_METHOD(rtpp_proc_servers, rtpp_proc_servers_dtor, void);
+
+struct rtpp_proc_servers {
+    rtpp_proc_servers_reg_t reg;
+    rtpp_proc_servers_dtor_t dtor;
+};
+
+struct rtpp_proc_servers *rtpp_proc_servers_ctor(void);
+
 void rtpp_proc_servers(const struct rtpp_cfg *, double,
   struct sthread_args *, struct rtpp_proc_rstats *);
+
+#endif
@@ -31,17 +31,20 @@
 #endif
 
 #include <assert.h>
+#include <errno.h>
 #include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "rtpp_types.h"
 #include "rtpp_queue.h"
 #include "rtpp_mallocs.h"
 #include "rtpp_wi.h"
 #include "rtpp_debug.h"
+#include "rtpp_time.h"
 
 #define RTPQ_DEBUG 0
 
@@ -353,6 +356,31 @@ rtpp_queue_put_item(struct rtpp_wi *wi, struct rtpp_queue *queue)
     pthread_mutex_unlock(&queue->mutex);
 }
 
+/*
+ * Put a batch of items into the queue while holding the lock only once and
+ * waking up the consumer at most once. Unless qlen is 0 the batch is always
+ * signalled, as there is no later pump to rely on.
+ */
+void
+rtpp_queue_put_items(struct rtpp_wi **wis, int nwis, struct rtpp_queue *queue)
+{
+    int i;
+
+    if (nwis <= 0)
+        return;
+    pthread_mutex_lock(&queue->mutex);
+    for (i = 0; i < nwis; i++) {
+        if ((queue->length > 0) || (circ_buf_push(&queue->circb, wis[i]) != 0)) {
+            RTPPQ_APPEND(queue, wis[i]);
+        }
+    }
+    if (queue->qlen > 0) {
+        /* notify worker thread */
+        pthread_cond_signal(&queue->cond);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+}
+
 void
 rtpp_queue_pump(struct rtpp_queue *queue)
 {
@@ -397,19 +425,11 @@ rtpp_queue_get_item(struct rtpp_queue *queue, int return_on_wake)
     return (wi);
 }
 
-int
-rtpp_queue_get_items(struct rtpp_queue *queue, struct rtpp_wi **items, int ilen, int return_on_wake)
+static int
+rtpp_queue_popmany(struct rtpp_queue *queue, struct rtpp_wi **items, int ilen)
 {
     int i, j;
 
-    pthread_mutex_lock(&queue->mutex);
-    while (rtpp_queue_getclen(queue) == 0) {
-        pthread_cond_wait(&queue->cond, &queue->mutex);
-        if (rtpp_queue_getclen(queue) == 0 && return_on_wake != 0) {
-            pthread_mutex_unlock(&queue->mutex);
-            return (0);
-        }
-    }
     /* Pull out of circular buffer first */
     i = circ_buf_popmany(&queue->circb, items, ilen);
     if ((i == ilen) || (queue->length == 0))
@@ -428,6 +448,50 @@ rtpp_queue_get_items(struct rtpp_queue *queue, struct rtpp_wi **items, int ilen,
     queue->length -= j;
     i += j;
 done:
+    return (i);
+}
+
+int
+rtpp_queue_get_items(struct rtpp_queue *queue, struct rtpp_wi **items, int ilen, int return_on_wake)
+{
+    int i;
+
+    pthread_mutex_lock(&queue->mutex);
+    while (rtpp_queue_getclen(queue) == 0) {
+        pthread_cond_wait(&queue->cond, &queue->mutex);
+        if (rtpp_queue_getclen(queue) == 0 && return_on_wake != 0) {
+            pthread_mutex_unlock(&queue->mutex);
+            return (0);
+        }
+    }
+    i = rtpp_queue_popmany(queue, items, ilen);
+    pthread_mutex_unlock(&queue->mutex);
+
+    return (i);
+}
+
+/*
+ * Same as rtpp_queue_get_items(), but gives up and returns 0 once the
+ * deadline, expressed in the getdtime() time base, has passed.
+ */
+int
+rtpp_queue_get_items_by(struct rtpp_queue *queue, struct rtpp_wi **items, int ilen,
+  double deadline)
+{
+    struct timespec ts;
+    int i;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    dtime2mtimespec(timespec2dtime(&ts) + (deadline - getdtime()), &ts);
+    pthread_mutex_lock(&queue->mutex);
+    while (rtpp_queue_getclen(queue) == 0) {
+        if (pthread_cond_timedwait(&queue->cond, &queue->mutex, &ts) == ETIMEDOUT &&
+          rtpp_queue_getclen(queue) == 0) {
+            pthread_mutex_unlock(&queue->mutex);
+            return (0);
+        }
+    }
+    i = rtpp_queue_popmany(queue, items, ilen);
     pthread_mutex_unlock(&queue->mutex);
 
     return (i);
@@ -444,6 +508,17 @@ rtpp_queue_get_length(struct rtpp_queue *queue)
     return (length);
 }
 
+/*
+ * Number of items the queue holds in its circular buffer, anything put on
+ * top of that goes into the overflow list and takes the slow path.
+ */
+unsigned int
+rtpp_queue_get_capacity(const struct rtpp_queue *queue)
+{
+
+    return (queue->circb.buflen - 1);
+}
+
 #if 0
 int
 rtpp_queue_count_matching(struct rtpp_queue *queue, rtpp_queue_match_fn_t match_fn, void *fn_args)
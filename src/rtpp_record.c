@@ -39,9 +39,15 @@
 #include <netinet/ip.h>
 #include <netinet/ip6.h>
 #include <netinet/udp.h>
+#include <dirent.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <math.h>
 #include <netdb.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -68,32 +74,192 @@
 #include "rtpp_record_fin.h"
 #include "rtpp_record_adhoc.h"
 #include "rtpp_record_private.h"
+#include "rtpp_record_index.h"
 #include "rtpp_session.h"
+#include "rtpp_stats.h"
 #include "rtpp_stream.h"
 #include "rtpp_time.h"
 #include "rtpp_util.h"
 #include "rtpp_pipe.h"
 #include "rtpp_netaddr.h"
+#include "rtpp_queue.h"
+#include "rtpp_wi.h"
+#include "rtpp_wi_data.h"
+#include "rtpp_wi_sgnl.h"
 
 enum record_mode {MODE_LOCAL_PKT, MODE_REMOTE_RTP, MODE_LOCAL_PCAP}; /* MODE_LOCAL_RTP/MODE_REMOTE_PKT? */
 
+/*
+ * Local recordings are accumulated in a large per-channel buffer, which
+ * is handed over to the writer thread in its entirety once full, so that
+ * the forwarding thread never blocks on disk I/O. The buffer is embedded
+ * into the work item, once written out the writer thread returns it to
+ * the channel for reuse, so that normally the forwarding thread only
+ * allocates a new one when the writer is lagging behind.
+ */
+#define RTPP_RECORD_WBUF_LEN (64 * 1024)
+
+/*
+ * Buffers that have not filled up within RTPP_RECORD_FLUSH_AGE seconds
+ * are picked up by the writer thread anyway, so that a crash loses at
+ * most that much of the recording. At most RTPP_RECORD_WQ_MAX full buffers
+ * can be waiting to be written out, once the writer falls behind that
+ * much newly recorded data is dropped.
+ */
+#define RTPP_RECORD_FLUSH_AGE 1.0
+#define RTPP_RECORD_WQ_MAX   1024
+
+enum rtpp_record_jtype {RRJ_WRITE, RRJ_CLOSE, RRJ_SPLIT};
+
+struct rtpp_record_wjob {
+    enum rtpp_record_jtype type;
+    struct rtpp_wi *wi;
+    struct rtpp_record_channel *rrc;
+    double ctime;
+    int npkts;
+    size_t len;
+    char data[0];
+};
+
+/*
+ * In the spool mode data of all channels is appended to a large shared
+ * segment file instead of a file per channel. Each chunk is preceded by
+ * a frame header, so that segments are self-describing, the writer
+ * thread also keeps track of the extents belonging to each channel and
+ * copies them out into the per-channel file once the channel is closed.
+ * The copying is done RTPP_RECORD_SPLIT_CHUNK bytes at a time, with the
+ * job going back to the end of the queue in between, so that a long
+ * recording being split does not hold up write jobs of other channels.
+ * Segments are rotated once they grow over RTPP_RECORD_SEG_MAX and
+ * removed once no open channel has any data left in them.
+ *
+ * Segments left behind by a process that is no longer running are picked
+ * up at startup: recordings that have not been split out completely are
+ * recovered from them and the segments are removed.
+ */
+#define RTPP_RECORD_SEG_MAX  (256 * 1024 * 1024)
+#define RTPP_RECORD_SPLIT_CHUNK (16 * RTPP_RECORD_WBUF_LEN)
+#define RTPP_RECORD_SEG_PFX  ".rtpp_spool."
+
+#define RRS_MAGIC    0x52535046 /* "RSPF" */
+
+/*
+ * Open frame carries the spool and the permanent path of the recording,
+ * each one NUL-terminated, the latter is empty when the recording is not
+ * to be moved. Close frame is written once the channel is closed and
+ * done frame once its data is split out into the per-channel file.
+ */
+enum rtpp_record_sftype {RRS_FT_OPEN = 1, RRS_FT_DATA = 2, RRS_FT_CLOSE = 3,
+  RRS_FT_DONE = 4};
+
+/* Open frame flags */
+#define RRS_OF_PCAP  0x1
+
+struct rtpp_record_sframe {
+    uint32_t magic;
+    uint16_t type;
+    uint16_t flags;
+    uint32_t len;
+    uint32_t chan_id;
+};
+
+struct rtpp_record_seg {
+    struct rtpp_record_seg *next;
+    int fd;
+    off_t len;
+    int nrefs;
+    char path[PATH_MAX + 1];
+};
+
+struct rtpp_record_extent {
+    struct rtpp_record_seg *seg;
+    off_t off;
+    size_t len;
+};
+
+/* Seek table granularity of the sidecar index, seconds */
+#define RTPP_RECORD_IDX_IVAL 1.0
+
+/*
+ * Sidecar index is built up as packets are appended to the recording and
+ * is written out by the writer thread once the recording is complete.
+ */
+struct rtpp_record_idx {
+    struct rtpp_ridx_hdr hdr;
+    struct rtpp_ridx_ssrc *ssrcs;
+    unsigned int assrcs;
+    unsigned int lssrc;
+    struct rtpp_ridx_seek *seeks;
+    unsigned int aseeks;
+    double nseek;
+    int broken;
+};
+
+struct rtpp_record_writer_priv {
+    struct rtpp_record_writer pub;
+    struct rtpp_queue *wq;
+    struct rtpp_wi *sigterm;
+    pthread_t thread_id;
+    struct rtpp_log *log;
+    int spool;
+    const char *spool_dir;
+    atomic_uint chan_id;
+    atomic_int nqueued;
+    struct rtpp_stats *rtpp_stats;
+    int npkts_dropped_idx;
+    /* Open local channels, for the periodic flush */
+    pthread_mutex_t chans_lock;
+    struct rtpp_record_channel *chans;
+    /* Only accessed from the writer thread */
+    struct rtpp_record_seg *seg_cur;
+    unsigned int seg_num;
+    int nsplits;
+    char cbuf[RTPP_RECORD_WBUF_LEN];
+};
+
 struct rtpp_record_channel {
     struct rtpp_record pub;
     char spath[PATH_MAX + 1];
     char rpath[PATH_MAX + 1];
     int fd;
     int needspool;
-    char rbuf[4096];
-    int rbuf_len;
+    /*
+     * Buffer being filled. Whoever works on it takes it out of here with
+     * atomic exchange, which is how the forwarding thread and the writer
+     * thread flushing stale buffers avoid stepping on each other without
+     * taking a lock for every packet.
+     */
+    _Atomic(struct rtpp_record_wjob *) wbuf;
+    /* Written out buffer returned by the writer thread for reuse */
+    _Atomic(struct rtpp_record_wjob *) wspare;
+    /* Buffers queued to the writer thread and not written out yet */
+    atomic_int npending;
+    struct rtpp_record_channel *wprev;
+    struct rtpp_record_channel *wnext;
+    struct rtpp_wi *close_wi;
+    struct rtpp_record_writer *writer;
+    atomic_int werror;
+    int spooled;
+    unsigned int chan_id;
+    struct rtpp_record_extent *exts;
+    int nexts;
+    int aexts;
+    /* Progress of copying extents out into the per-channel file */
+    int split_ext;
+    off_t split_off;
     enum record_mode mode;
     int record_single_file;
     const char *proto;
     struct rtpp_log *log;
     struct rtpp_timestamp epoch;
+    struct rtpp_record_idx *idx;
 };
 
 static void rtpp_record_write(struct rtpp_record *, struct rtpp_stream *, struct rtp_packet *);
 static void rtpp_record_close(struct rtpp_record_channel *);
+static void rtpp_record_finalize(struct rtpp_record_channel *);
+static void rtpp_record_writer_link(struct rtpp_record_writer_priv *,
+  struct rtpp_record_channel *);
 static int get_hdr_size(const struct sockaddr *);
 
 #if HAVE_SO_TS_CLOCK
@@ -161,6 +327,46 @@ e0:
     return (-1);
 }
 
+static int
+open_record_file(const char *path, int pcap, struct rtpp_log *log)
+{
+    int fd, rval;
+    pcap_hdr_t pcap_hdr;
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, DEFFILEMODE);
+    if (fd == -1) {
+	RTPP_ELOG(log, RTPP_LOG_ERR, "can't open file %s for writing",
+	  path);
+        return (-1);
+    }
+
+    if (pcap != 0) {
+	pcap_hdr.magic_number = PCAP_MAGIC;
+	pcap_hdr.version_major = PCAP_VER_MAJR;
+	pcap_hdr.version_minor = PCAP_VER_MINR;
+	pcap_hdr.thiszone = 0;
+	pcap_hdr.sigfigs = 0;
+	pcap_hdr.snaplen = 65535;
+	pcap_hdr.network = PCAP_FORMAT;
+	rval = write(fd, &pcap_hdr, sizeof(pcap_hdr));
+	if (rval == -1) {
+	    RTPP_ELOG(log, RTPP_LOG_ERR, "%s: error writing header",
+	      path);
+            goto e0;
+	}
+	if (rval < sizeof(pcap_hdr)) {
+	    RTPP_LOG(log, RTPP_LOG_ERR, "%s: short write writing header",
+	      path);
+            goto e0;
+	}
+    }
+    return (fd);
+
+e0:
+    close(fd);
+    return (-1);
+}
+
 struct rtpp_record *
 rtpp_record_open(const struct rtpp_cfg *cfsp, struct rtpp_session *sp,
   char *rname, int orig, int record_type)
@@ -168,7 +374,8 @@ rtpp_record_open(const struct rtpp_cfg *cfsp, struct rtpp_session *sp,
     struct rtpp_record_channel *rrc;
     const char *sdir, *suffix1, *suffix2;
     int rval, remote;
-    pcap_hdr_t pcap_hdr;
+    struct rtpp_record_wjob *wjp;
+    struct rtpp_record_writer_priv *wpvt;
 
     remote = (rname != NULL && strncmp("udp:", rname, 4) == 0) ? 1 : 0;
 
@@ -186,6 +393,10 @@ rtpp_record_open(const struct rtpp_cfg *cfsp, struct rtpp_session *sp,
     }
     rrc->log = sp->log;
     RTPP_OBJ_INCREF(sp->log);
+    atomic_init(&rrc->werror, 0);
+    atomic_init(&rrc->wbuf, NULL);
+    atomic_init(&rrc->wspare, NULL);
+    atomic_init(&rrc->npending, 0);
     rrc->pub.pktwrite = &rtpp_record_write;
     if (remote) {
 	rval = ropen_remote_ctor_pa(rrc, sp->log, rname, (record_type == RECORD_RTCP));
@@ -236,41 +447,60 @@ rtpp_record_open(const struct rtpp_cfg *cfsp, struct rtpp_session *sp,
     } else {
 	sprintf(rrc->spath, "%s/%s%s", sdir, rname, suffix2);
     }
-    rrc->fd = open(rrc->spath, O_WRONLY | O_CREAT | O_TRUNC, DEFFILEMODE);
-    if (rrc->fd == -1) {
-	RTPP_ELOG(sp->log, RTPP_LOG_ERR, "can't open file %s for writing",
-	  rrc->spath);
-        goto e2;
+    if (cfsp->record_index != 0) {
+        rrc->idx = rtpp_zmalloc(sizeof(*rrc->idx));
+        if (rrc->idx == NULL) {
+            RTPP_ELOG(sp->log, RTPP_LOG_ERR, "can't allocate memory");
+            goto e2;
+        }
+        rrc->idx->hdr.magic = RTPP_RIDX_MAGIC;
+        rrc->idx->hdr.version = RTPP_RIDX_VERSION;
+        rrc->idx->hdr.ival = RTPP_RECORD_IDX_IVAL;
+        if (rrc->mode == MODE_LOCAL_PCAP) {
+            rrc->idx->hdr.format = RTPP_RIDX_FMT_PCAP;
+            rrc->idx->hdr.dlen = sizeof(pcap_hdr_t);
+        } else {
+            rrc->idx->hdr.format = RTPP_RIDX_FMT_ADHOC;
+        }
+    }
+    rrc->writer = cfsp->rtpp_recwr_cf;
+    PUB2PVT(rrc->writer, wpvt);
+    if (wpvt->spool != 0) {
+        /* Data goes into the shared segment, the file is created at close */
+        rrc->spooled = 1;
+        rrc->fd = -1;
+        rrc->chan_id = atomic_fetch_add(&wpvt->chan_id, 1);
+    } else {
+        rrc->fd = open_record_file(rrc->spath,
+          (rrc->mode == MODE_LOCAL_PCAP), sp->log);
+        if (rrc->fd == -1) {
+            goto e2;
+        }
     }
 
-    if (rrc->mode == MODE_LOCAL_PCAP) {
-	pcap_hdr.magic_number = PCAP_MAGIC;
-	pcap_hdr.version_major = PCAP_VER_MAJR;
-	pcap_hdr.version_minor = PCAP_VER_MINR;
-	pcap_hdr.thiszone = 0;
-	pcap_hdr.sigfigs = 0;
-	pcap_hdr.snaplen = 65535;
-	pcap_hdr.network = PCAP_FORMAT;
-	rval = write(rrc->fd, &pcap_hdr, sizeof(pcap_hdr));
-	if (rval == -1) {
-	    RTPP_ELOG(sp->log, RTPP_LOG_ERR, "%s: error writing header",
-	      rrc->spath);
-            goto e3;
-	}
-	if (rval < sizeof(pcap_hdr)) {
-	    RTPP_LOG(sp->log, RTPP_LOG_ERR, "%s: short write writing header",
-	      rrc->spath);
-            goto e3;
-	}
+    /* Pre-allocate close job, so that we don't have any malloc() in dtor() */
+    rrc->close_wi = rtpp_wi_malloc_udata((void **)&wjp,
+      sizeof(struct rtpp_record_wjob));
+    if (rrc->close_wi == NULL) {
+        RTPP_ELOG(sp->log, RTPP_LOG_ERR, "can't allocate memory");
+        goto e3;
     }
+    wjp->type = RRJ_CLOSE;
+    wjp->wi = rrc->close_wi;
+    wjp->rrc = rrc;
+    RTPP_OBJ_INCREF(rrc->writer);
+    rtpp_record_writer_link(wpvt, rrc);
 
     CALL_SMETHOD(rrc->pub.rcnt, attach, (rtpp_refcnt_dtor_t)&rtpp_record_close,
       rrc);
     return (&rrc->pub);
 
 e3:
-    close(rrc->fd);
+    if (rrc->fd != -1)
+        close(rrc->fd);
 e2:
+    if (rrc->idx != NULL)
+        free(rrc->idx);
     RTPP_OBJ_DECREF(rrc->log);
     RTPP_OBJ_DECREF(&(rrc->pub));
     free(rrc);
@@ -278,23 +508,823 @@ e0:
     return NULL;
 }
 
+static void
+rtpp_record_seg_unref(struct rtpp_record_writer_priv *pvt,
+  struct rtpp_record_seg *seg)
+{
+
+    seg->nrefs -= 1;
+    if (seg->nrefs > 0)
+        return;
+    close(seg->fd);
+    if (unlink(seg->path) == -1)
+        RTPP_ELOG(pvt->log, RTPP_LOG_ERR, "can't remove spool segment %s",
+          seg->path);
+    free(seg);
+}
+
+static struct rtpp_record_seg *
+rtpp_record_seg_get(struct rtpp_record_writer_priv *pvt)
+{
+    struct rtpp_record_seg *seg;
+
+    if (pvt->seg_cur != NULL && pvt->seg_cur->len < RTPP_RECORD_SEG_MAX)
+        return (pvt->seg_cur);
+    if (pvt->seg_cur != NULL) {
+        /* Drop the writer's own reference on the segment being rotated */
+        rtpp_record_seg_unref(pvt, pvt->seg_cur);
+        pvt->seg_cur = NULL;
+    }
+    seg = rtpp_zmalloc(sizeof(*seg));
+    if (seg == NULL) {
+        RTPP_ELOG(pvt->log, RTPP_LOG_ERR, "can't allocate memory");
+        return (NULL);
+    }
+    snprintf(seg->path, sizeof(seg->path), "%s/" RTPP_RECORD_SEG_PFX "%d.%u",
+      pvt->spool_dir, (int)getpid(), pvt->seg_num);
+    seg->fd = open(seg->path, O_RDWR | O_CREAT | O_TRUNC, DEFFILEMODE);
+    if (seg->fd == -1) {
+        RTPP_ELOG(pvt->log, RTPP_LOG_ERR, "can't open spool segment %s",
+          seg->path);
+        free(seg);
+        return (NULL);
+    }
+    pvt->seg_num += 1;
+    seg->nrefs = 1;
+    pvt->seg_cur = seg;
+    return (seg);
+}
+
 static int
-flush_rbuf(struct rtpp_record_channel *rrc)
+rtpp_record_spool_put(struct rtpp_record_writer_priv *pvt,
+  struct rtpp_record_channel *rrc, enum rtpp_record_sftype type,
+  const void *data, size_t len)
 {
-    int rval;
+    struct rtpp_record_seg *seg;
+    struct rtpp_record_sframe sf;
+    struct rtpp_record_extent *ep;
+    struct iovec v[2];
+    ssize_t rval;
+
+    seg = rtpp_record_seg_get(pvt);
+    if (seg == NULL)
+        return (-1);
+    if (type == RRS_FT_DATA && rrc->nexts == rrc->aexts) {
+        ep = realloc(rrc->exts, sizeof(rrc->exts[0]) * (rrc->aexts + 16));
+        if (ep == NULL) {
+            RTPP_ELOG(pvt->log, RTPP_LOG_ERR, "can't allocate memory");
+            return (-1);
+        }
+        rrc->exts = ep;
+        rrc->aexts += 16;
+    }
+    sf.magic = RRS_MAGIC;
+    sf.type = type;
+    sf.flags = 0;
+    if (type == RRS_FT_OPEN && rrc->mode == MODE_LOCAL_PCAP)
+        sf.flags |= RRS_OF_PCAP;
+    sf.len = len;
+    sf.chan_id = rrc->chan_id;
+    v[0].iov_base = &sf;
+    v[0].iov_len = sizeof(sf);
+    v[1].iov_base = (void *)data;
+    v[1].iov_len = len;
+    do {
+        rval = pwritev(seg->fd, v, 2, seg->len);
+    } while (rval == -1 && errno == EINTR);
+    if (rval != sizeof(sf) + len) {
+        RTPP_ELOG(pvt->log, RTPP_LOG_ERR, "error while writing spool segment %s",
+          seg->path);
+        /* Start over with a fresh segment on next write */
+        rtpp_record_seg_unref(pvt, seg);
+        pvt->seg_cur = NULL;
+        return (-1);
+    }
+    if (type == RRS_FT_DATA) {
+        if (rrc->nexts == 0 || rrc->exts[rrc->nexts - 1].seg != seg)
+            seg->nrefs += 1;
+        ep = &rrc->exts[rrc->nexts];
+        ep->seg = seg;
+        ep->off = seg->len + sizeof(sf);
+        ep->len = len;
+        rrc->nexts += 1;
+    }
+    seg->len += rval;
+    return (0);
+}
+
+static int
+rtpp_record_spool_open(struct rtpp_record_writer_priv *pvt,
+  struct rtpp_record_channel *rrc)
+{
+    char buf[sizeof(rrc->spath) + sizeof(rrc->rpath)];
+    size_t slen, rlen;
+
+    slen = strlen(rrc->spath) + 1;
+    rlen = (rrc->needspool != 0) ? strlen(rrc->rpath) + 1 : 1;
+    memcpy(buf, rrc->spath, slen);
+    if (rrc->needspool != 0)
+        memcpy(buf + slen, rrc->rpath, rlen);
+    else
+        buf[slen] = '\0';
+    return (rtpp_record_spool_put(pvt, rrc, RRS_FT_OPEN, buf, slen + rlen));
+}
 
-    rval = write(rrc->fd, rrc->rbuf, rrc->rbuf_len);
-    if (rval != -1) {
-	rrc->rbuf_len = 0;
-	return 0;
+/*
+ * Channel is closed: copy its data out of the spool segment(s) into the
+ * per-channel file and release segments. At most RTPP_RECORD_SPLIT_CHUNK
+ * bytes are copied per call, returns non-zero when there is more to do.
+ */
+static int
+rtpp_record_spool_split(struct rtpp_record_writer_priv *pvt,
+  struct rtpp_record_channel *rrc)
+{
+    struct rtpp_record_extent *ep;
+    size_t rlen, ncopied;
+    ssize_t rval;
+
+    if (rrc->split_ext == 0 && rrc->split_off == 0 && rrc->fd == -1) {
+        if (rrc->nexts == 0)
+            return (0);
+        rtpp_record_spool_put(pvt, rrc, RRS_FT_CLOSE, NULL, 0);
+        rrc->fd = open_record_file(rrc->spath,
+          (rrc->mode == MODE_LOCAL_PCAP), rrc->log);
+        if (rrc->fd == -1)
+            atomic_store(&rrc->werror, 1);
+    }
+    for (ncopied = 0; rrc->split_ext < rrc->nexts; rrc->split_ext++) {
+        ep = &rrc->exts[rrc->split_ext];
+        for (; rrc->fd != -1 && rrc->split_off < ep->len;
+          rrc->split_off += rlen) {
+            if (ncopied >= RTPP_RECORD_SPLIT_CHUNK)
+                return (1);
+            rlen = ep->len - rrc->split_off;
+            if (rlen > sizeof(pvt->cbuf))
+                rlen = sizeof(pvt->cbuf);
+            rval = pread(ep->seg->fd, pvt->cbuf, rlen,
+              ep->off + rrc->split_off);
+            if (rval != rlen || write(rrc->fd, pvt->cbuf, rlen) != rlen) {
+                RTPP_ELOG(rrc->log, RTPP_LOG_ERR, "error while recording "
+                  "session (%s)", rrc->proto);
+                atomic_store(&rrc->werror, 1);
+                close(rrc->fd);
+                rrc->fd = -1;
+            }
+            ncopied += rlen;
+        }
+        rrc->split_off = 0;
+        if (rrc->split_ext == rrc->nexts - 1 ||
+          rrc->exts[rrc->split_ext + 1].seg != ep->seg)
+            rtpp_record_seg_unref(pvt, ep->seg);
+    }
+    if (rrc->fd != -1)
+        rtpp_record_spool_put(pvt, rrc, RRS_FT_DONE, NULL, 0);
+    free(rrc->exts);
+    rrc->exts = NULL;
+    rrc->nexts = rrc->aexts = 0;
+    return (0);
+}
+
+static void
+rtpp_record_wjob_write(struct rtpp_record_writer_priv *pvt,
+  struct rtpp_record_wjob *wjp)
+{
+    struct rtpp_record_channel *rrc;
+    ssize_t rval;
+    size_t off;
+
+    rrc = wjp->rrc;
+    if (rrc->spooled) {
+        if (atomic_load(&rrc->werror) != 0)
+            return;
+        if (rrc->nexts == 0 && rtpp_record_spool_open(pvt, rrc) != 0)
+            goto e0;
+        if (rtpp_record_spool_put(pvt, rrc, RRS_FT_DATA, wjp->data,
+          wjp->len) != 0)
+            goto e0;
+        return;
+    }
+    if (rrc->fd == -1)
+        return;
+    for (off = 0; off < wjp->len; off += rval) {
+        rval = write(rrc->fd, wjp->data + off, wjp->len - off);
+        if (rval == -1 && errno == EINTR) {
+            rval = 0;
+            continue;
+        }
+        if (rval <= 0) {
+            RTPP_ELOG(rrc->log, RTPP_LOG_ERR, "error while recording session (%s)",
+              rrc->proto);
+            /* Prevent futher writing if error happens */
+            atomic_store(&rrc->werror, 1);
+            close(rrc->fd);
+            rrc->fd = -1;
+            return;
+        }
     }
+    return;
 
-    RTPP_ELOG(rrc->log, RTPP_LOG_ERR, "error while recording session (%s)",
-      rrc->proto);
+e0:
     /* Prevent futher writing if error happens */
-    close(rrc->fd);
-    rrc->fd = -1;
-    return -1;
+    atomic_store(&rrc->werror, 1);
+}
+
+static void
+rtpp_record_writer_link(struct rtpp_record_writer_priv *pvt,
+  struct rtpp_record_channel *rrc)
+{
+
+    pthread_mutex_lock(&pvt->chans_lock);
+    rrc->wprev = NULL;
+    rrc->wnext = pvt->chans;
+    if (pvt->chans != NULL)
+        pvt->chans->wprev = rrc;
+    pvt->chans = rrc;
+    pthread_mutex_unlock(&pvt->chans_lock);
+}
+
+static void
+rtpp_record_writer_unlink(struct rtpp_record_writer_priv *pvt,
+  struct rtpp_record_channel *rrc)
+{
+
+    pthread_mutex_lock(&pvt->chans_lock);
+    if (rrc->wprev != NULL)
+        rrc->wprev->wnext = rrc->wnext;
+    else
+        pvt->chans = rrc->wnext;
+    if (rrc->wnext != NULL)
+        rrc->wnext->wprev = rrc->wprev;
+    pthread_mutex_unlock(&pvt->chans_lock);
+}
+
+/* Give written out (or dropped) buffer back to the channel for reuse */
+static void
+rtpp_record_wbuf_put(struct rtpp_record_channel *rrc,
+  struct rtpp_record_wjob *wjp)
+{
+    struct rtpp_record_wjob *nullp;
+
+    wjp->len = 0;
+    wjp->npkts = 0;
+    nullp = NULL;
+    if (!atomic_compare_exchange_strong(&rrc->wspare, &nullp, wjp))
+        CALL_METHOD(wjp->wi, dtor);
+}
+
+static void
+rtpp_record_wbuf_submit(struct rtpp_record_writer_priv *pvt,
+  struct rtpp_record_channel *rrc, struct rtpp_record_wjob *wjp)
+{
+
+    atomic_fetch_add(&pvt->nqueued, 1);
+    atomic_fetch_add(&rrc->npending, 1);
+    rtpp_queue_put_item(wjp->wi, pvt->wq);
+}
+
+/*
+ * Take partially filled buffers that have been sitting around for too long
+ * away from the forwarding thread and write them out. That is only done
+ * when the channel has nothing else queued, so that they don't overtake
+ * buffers of the same channel that are waiting to be written, anything the
+ * forwarding thread submits after the buffer has been taken is newer.
+ */
+static void
+rtpp_record_writer_scan(struct rtpp_record_writer_priv *pvt, double dtime)
+{
+    struct rtpp_record_channel *rrc;
+    struct rtpp_record_wjob *wjp, *nullp;
+
+    pthread_mutex_lock(&pvt->chans_lock);
+    for (rrc = pvt->chans; rrc != NULL; rrc = rrc->wnext) {
+        wjp = atomic_exchange(&rrc->wbuf, NULL);
+        if (wjp == NULL)
+            continue;
+        if (wjp->len > 0 && dtime - wjp->ctime >= RTPP_RECORD_FLUSH_AGE &&
+          atomic_load(&rrc->npending) == 0) {
+            rtpp_record_wjob_write(pvt, wjp);
+            wjp->len = 0;
+            wjp->npkts = 0;
+        }
+        nullp = NULL;
+        if (atomic_compare_exchange_strong(&rrc->wbuf, &nullp, wjp))
+            continue;
+        /*
+         * Forwarding thread has started a new buffer in the meantime, so
+         * this one has to go ahead of it.
+         */
+        if (wjp->len > 0)
+            rtpp_record_wbuf_submit(pvt, rrc, wjp);
+        else
+            rtpp_record_wbuf_put(rrc, wjp);
+    }
+    pthread_mutex_unlock(&pvt->chans_lock);
+}
+
+/*
+ * Channel is being closed, anything the scan has left in its write buffer
+ * is newer than all the data queued before the close job.
+ */
+static void
+rtpp_record_wbuf_drain(struct rtpp_record_writer_priv *pvt,
+  struct rtpp_record_channel *rrc)
+{
+    struct rtpp_record_wjob *wjp;
+
+    wjp = atomic_exchange(&rrc->wbuf, NULL);
+    if (wjp != NULL) {
+        if (wjp->len > 0)
+            rtpp_record_wjob_write(pvt, wjp);
+        CALL_METHOD(wjp->wi, dtor);
+    }
+    wjp = atomic_exchange(&rrc->wspare, NULL);
+    if (wjp != NULL)
+        CALL_METHOD(wjp->wi, dtor);
+}
+
+static void
+rtpp_record_writer_run(void *arg)
+{
+    struct rtpp_record_writer_priv *pvt;
+    struct rtpp_wi *wis[RTPQ_SMALL_CB_LEN], *wi;
+    struct rtpp_record_wjob *wjp;
+    int i, nwis, done;
+    double dtime, next_scan;
+
+    pvt = (struct rtpp_record_writer_priv *)arg;
+    next_scan = getdtime() + (RTPP_RECORD_FLUSH_AGE / 2.0);
+    /* Channels still being split out are finished before exiting */
+    for (done = 0; done == 0 || pvt->nsplits > 0;) {
+        nwis = rtpp_queue_get_items_by(pvt->wq, wis, RTPQ_SMALL_CB_LEN,
+          next_scan);
+        for (i = 0; i < nwis; i++) {
+            wi = wis[i];
+            if (rtpp_wi_get_type(wi) == RTPP_WI_TYPE_SGNL) {
+                CALL_METHOD(wi, dtor);
+                done = 1;
+                continue;
+            }
+            wjp = rtpp_wi_data_get_ptr(wi, sizeof(struct rtpp_record_wjob), 0);
+            switch (wjp->type) {
+            case RRJ_WRITE:
+                rtpp_record_wjob_write(pvt, wjp);
+                atomic_fetch_sub(&wjp->rrc->npending, 1);
+                atomic_fetch_sub(&pvt->nqueued, 1);
+                rtpp_record_wbuf_put(wjp->rrc, wjp);
+                break;
+
+            case RRJ_CLOSE:
+                rtpp_record_writer_unlink(pvt, wjp->rrc);
+                rtpp_record_wbuf_drain(pvt, wjp->rrc);
+                if (!wjp->rrc->spooled) {
+                    /* Frees the channel along with the close_wi */
+                    rtpp_record_finalize(wjp->rrc);
+                    break;
+                }
+                pvt->nsplits += 1;
+                wjp->type = RRJ_SPLIT;
+                /* FALLTHROUGH */
+
+            case RRJ_SPLIT:
+                if (rtpp_record_spool_split(pvt, wjp->rrc) != 0) {
+                    /* Let the others in, continue once they are done */
+                    rtpp_queue_put_item(wi, pvt->wq);
+                    break;
+                }
+                pvt->nsplits -= 1;
+                rtpp_record_finalize(wjp->rrc);
+                break;
+            }
+        }
+        dtime = getdtime();
+        if (dtime >= next_scan) {
+            rtpp_record_writer_scan(pvt, dtime);
+            next_scan = dtime + (RTPP_RECORD_FLUSH_AGE / 2.0);
+        }
+    }
+}
+
+static void
+rtpp_record_writer_dtor(struct rtpp_record_writer_priv *pvt)
+{
+
+    rtpp_queue_put_item(pvt->sigterm, pvt->wq);
+    pthread_join(pvt->thread_id, NULL);
+    rtpp_queue_destroy(pvt->wq);
+    if (pvt->seg_cur != NULL)
+        rtpp_record_seg_unref(pvt, pvt->seg_cur);
+    pthread_mutex_destroy(&pvt->chans_lock);
+    RTPP_OBJ_DECREF(pvt->rtpp_stats);
+    RTPP_OBJ_DECREF(pvt->log);
+    free(pvt);
+}
+
+/* Segment left behind by a process that is gone */
+struct rtpp_record_oseg {
+    int pid;
+    unsigned int num;
+    char *path;
+};
+
+/* Channel found in the orphaned segments */
+struct rtpp_record_ochan {
+    uint32_t chan_id;
+    int flags;
+    int done;
+    int failed;
+    int fd;
+    char *spath;
+    char *rpath;
+};
+
+struct rtpp_record_recover {
+    struct rtpp_record_writer_priv *pvt;
+    struct rtpp_record_ochan *chans;
+    int nchans;
+    int achans;
+    int failed;
+};
+
+static struct rtpp_record_ochan *
+rtpp_record_ochan_find(struct rtpp_record_recover *rp, uint32_t chan_id)
+{
+    int i;
+
+    for (i = rp->nchans - 1; i >= 0; i--) {
+        if (rp->chans[i].chan_id == chan_id)
+            return (&rp->chans[i]);
+    }
+    return (NULL);
+}
+
+static int
+rtpp_record_ochan_add(struct rtpp_record_recover *rp,
+  const struct rtpp_record_sframe *sfp, const char *data)
+{
+    struct rtpp_record_ochan *cp;
+    const char *rpath;
+
+    /* Both paths have to be there and be NUL-terminated */
+    rpath = memchr(data, '\0', sfp->len);
+    if (rpath == NULL || memchr(rpath + 1, '\0',
+      sfp->len - (rpath + 1 - data)) == NULL)
+        return (-1);
+    rpath += 1;
+    if (rp->nchans == rp->achans) {
+        cp = realloc(rp->chans, sizeof(rp->chans[0]) * (rp->achans + 16));
+        if (cp == NULL)
+            return (-1);
+        rp->chans = cp;
+        rp->achans += 16;
+    }
+    cp = &rp->chans[rp->nchans];
+    memset(cp, '\0', sizeof(*cp));
+    cp->chan_id = sfp->chan_id;
+    cp->flags = sfp->flags;
+    cp->fd = -1;
+    cp->spath = strdup(data);
+    cp->rpath = strdup(rpath);
+    if (cp->spath == NULL || cp->rpath == NULL) {
+        free(cp->spath);
+        free(cp->rpath);
+        return (-1);
+    }
+    rp->nchans += 1;
+    return (0);
+}
+
+static void
+rtpp_record_ochan_copy(struct rtpp_record_recover *rp,
+  struct rtpp_record_ochan *cp, int sfd, off_t off, size_t len)
+{
+    struct rtpp_record_writer_priv *pvt;
+    size_t rlen;
+
+    pvt = rp->pvt;
+    if (cp->fd == -1) {
+        cp->fd = open_record_file(cp->spath, (cp->flags & RRS_OF_PCAP),
+          pvt->log);
+        if (cp->fd == -1)
+            goto e0;
+    }
+    for (; len > 0; off += rlen, len -= rlen) {
+        rlen = (len > sizeof(pvt->cbuf)) ? sizeof(pvt->cbuf) : len;
+        if (pread(sfd, pvt->cbuf, rlen, off) != rlen ||
+          write(cp->fd, pvt->cbuf, rlen) != rlen) {
+            RTPP_ELOG(pvt->log, RTPP_LOG_ERR, "error while recovering "
+              "session record %s", cp->spath);
+            close(cp->fd);
+            cp->fd = -1;
+            goto e0;
+        }
+    }
+    return;
+e0:
+    cp->failed = 1;
+    rp->failed = 1;
+}
+
+/*
+ * Go through the frames in the segment: on the first pass collect the
+ * channels and find out which ones have been split out already, on the
+ * second one copy data of the others out. Anything past the first
+ * incomplete frame is what the process was writing when it died.
+ */
+static void
+rtpp_record_oseg_walk(struct rtpp_record_recover *rp,
+  const struct rtpp_record_oseg *osp, int pass)
+{
+    struct rtpp_record_writer_priv *pvt;
+    struct rtpp_record_sframe sf;
+    struct rtpp_record_ochan *cp;
+    struct stat st;
+    char *data;
+    off_t off;
+    int fd;
+
+    pvt = rp->pvt;
+    fd = open(osp->path, O_RDONLY);
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        RTPP_ELOG(pvt->log, RTPP_LOG_ERR, "can't open spool segment %s",
+          osp->path);
+        if (fd != -1)
+            close(fd);
+        rp->failed = 1;
+        return;
+    }
+    for (off = 0; off + (off_t)sizeof(sf) <= st.st_size;
+      off += sizeof(sf) + sf.len) {
+        if (pread(fd, &sf, sizeof(sf), off) != sizeof(sf) ||
+          sf.magic != RRS_MAGIC ||
+          off + (off_t)sizeof(sf) + sf.len > st.st_size)
+            break;
+        switch (sf.type) {
+        case RRS_FT_OPEN:
+            if (pass != 0 || sf.len > sizeof(pvt->cbuf))
+                break;
+            data = pvt->cbuf;
+            if (pread(fd, data, sf.len, off + sizeof(sf)) != sf.len ||
+              rtpp_record_ochan_add(rp, &sf, data) != 0) {
+                RTPP_LOG(pvt->log, RTPP_LOG_ERR, "%s: bad open frame at "
+                  "%lld", osp->path, (long long)off);
+                rp->failed = 1;
+            }
+            break;
+
+        case RRS_FT_DONE:
+            if (pass == 0 && (cp = rtpp_record_ochan_find(rp,
+              sf.chan_id)) != NULL)
+                cp->done = 1;
+            break;
+
+        case RRS_FT_DATA:
+            if (pass == 0)
+                break;
+            cp = rtpp_record_ochan_find(rp, sf.chan_id);
+            if (cp == NULL || cp->done != 0 || cp->failed != 0)
+                break;
+            rtpp_record_ochan_copy(rp, cp, fd, off + sizeof(sf), sf.len);
+            break;
+        }
+    }
+    close(fd);
+}
+
+static int
+rtpp_record_oseg_cmp(const void *a, const void *b)
+{
+    const struct rtpp_record_oseg *osa, *osb;
+
+    osa = (const struct rtpp_record_oseg *)a;
+    osb = (const struct rtpp_record_oseg *)b;
+    if (osa->pid != osb->pid)
+        return ((osa->pid < osb->pid) ? -1 : 1);
+    if (osa->num != osb->num)
+        return ((osa->num < osb->num) ? -1 : 1);
+    return (0);
+}
+
+/* Recover recordings from all segments of one dead process */
+static void
+rtpp_record_oseg_recover(struct rtpp_record_writer_priv *pvt,
+  const struct rtpp_record_oseg *osegs, int nsegs)
+{
+    struct rtpp_record_recover rr;
+    struct rtpp_record_ochan *cp;
+    int i, pass, nrecovered;
+
+    memset(&rr, '\0', sizeof(rr));
+    rr.pvt = pvt;
+    for (pass = 0; pass < 2; pass++) {
+        for (i = 0; i < nsegs; i++)
+            rtpp_record_oseg_walk(&rr, &osegs[i], pass);
+    }
+    nrecovered = 0;
+    for (i = 0; i < rr.nchans; i++) {
+        cp = &rr.chans[i];
+        if (cp->fd != -1) {
+            close(cp->fd);
+            if (cp->rpath[0] != '\0' && rename(cp->spath, cp->rpath) == -1)
+                RTPP_ELOG(pvt->log, RTPP_LOG_ERR, "can't move session "
+                  "record %s into permanent storage", cp->spath);
+            nrecovered += 1;
+        }
+        free(cp->spath);
+        free(cp->rpath);
+    }
+    free(rr.chans);
+    RTPP_LOG(pvt->log, RTPP_LOG_INFO, "recovered %d session record(s) from "
+      "%d spool segment(s) left by the process %d", nrecovered, nsegs,
+      osegs[0].pid);
+    if (rr.failed != 0) {
+        RTPP_LOG(pvt->log, RTPP_LOG_ERR, "recovery from spool segments "
+          "of the process %d has not been complete, keeping them",
+          osegs[0].pid);
+        return;
+    }
+    for (i = 0; i < nsegs; i++) {
+        if (unlink(osegs[i].path) == -1)
+            RTPP_ELOG(pvt->log, RTPP_LOG_ERR, "can't remove spool "
+              "segment %s", osegs[i].path);
+    }
+}
+
+static void
+rtpp_record_spool_recover(struct rtpp_record_writer_priv *pvt)
+{
+    DIR *dp;
+    struct dirent *dep;
+    struct rtpp_record_oseg *osegs, *osp;
+    int i, j, pid, nsegs, asegs, n;
+    unsigned int num;
+    char path[PATH_MAX + 1];
+
+    dp = opendir(pvt->spool_dir);
+    if (dp == NULL) {
+        RTPP_ELOG(pvt->log, RTPP_LOG_ERR, "can't open spool directory %s",
+          pvt->spool_dir);
+        return;
+    }
+    osegs = NULL;
+    nsegs = asegs = 0;
+    while ((dep = readdir(dp)) != NULL) {
+        n = 0;
+        if (sscanf(dep->d_name, RTPP_RECORD_SEG_PFX "%d.%u%n", &pid, &num,
+          &n) != 2 || n == 0 || dep->d_name[n] != '\0')
+            continue;
+        /* Leave segments of the processes that are still running alone */
+        if (pid <= 0 || pid == getpid() || kill(pid, 0) == 0 ||
+          errno != ESRCH)
+            continue;
+        if (nsegs == asegs) {
+            osp = realloc(osegs, sizeof(osegs[0]) * (asegs + 16));
+            if (osp == NULL)
+                goto e0;
+            osegs = osp;
+            asegs += 16;
+        }
+        if (snprintf(path, sizeof(path), "%s/%s", pvt->spool_dir,
+          dep->d_name) >= sizeof(path))
+            continue;
+        osp = &osegs[nsegs];
+        osp->path = strdup(path);
+        if (osp->path == NULL)
+            goto e0;
+        osp->pid = pid;
+        osp->num = num;
+        nsegs += 1;
+    }
+    closedir(dp);
+    dp = NULL;
+    qsort(osegs, nsegs, sizeof(osegs[0]), rtpp_record_oseg_cmp);
+    for (i = 0; i < nsegs; i = j) {
+        for (j = i + 1; j < nsegs && osegs[j].pid == osegs[i].pid; j++)
+            continue;
+        rtpp_record_oseg_recover(pvt, &osegs[i], j - i);
+    }
+    goto out;
+e0:
+    RTPP_ELOG(pvt->log, RTPP_LOG_ERR, "can't allocate memory");
+out:
+    if (dp != NULL)
+        closedir(dp);
+    for (i = 0; i < nsegs; i++)
+        free(osegs[i].path);
+    free(osegs);
+}
+
+struct rtpp_record_writer *
+rtpp_record_writer_ctor(const struct rtpp_cfg *cfsp)
+{
+    struct rtpp_record_writer_priv *pvt;
+
+    pvt = rtpp_rzmalloc(sizeof(*pvt), PVT_RCOFFS(pvt));
+    if (pvt == NULL) {
+        goto e0;
+    }
+    pvt->wq = rtpp_queue_init(RTPQ_SMALL_CB_LEN, "rtpp_record_writer");
+    if (pvt->wq == NULL) {
+        goto e1;
+    }
+    pvt->sigterm = rtpp_wi_malloc_sgnl(SIGTERM, NULL, 0);
+    if (pvt->sigterm == NULL) {
+        goto e2;
+    }
+    if (pthread_mutex_init(&pvt->chans_lock, NULL) != 0) {
+        goto e3;
+    }
+    pvt->log = cfsp->glog;
+    RTPP_OBJ_INCREF(pvt->log);
+    pvt->rtpp_stats = cfsp->rtpp_stats;
+    RTPP_OBJ_INCREF(pvt->rtpp_stats);
+    pvt->npkts_dropped_idx = CALL_SMETHOD(pvt->rtpp_stats, getidxbyname,
+      "nrec_pkts_dropped");
+    if (cfsp->record_spool != 0) {
+        pvt->spool = 1;
+        pvt->spool_dir = (cfsp->sdir != NULL) ? cfsp->sdir : cfsp->rdir;
+        rtpp_record_spool_recover(pvt);
+    }
+    atomic_init(&pvt->chan_id, 0);
+    atomic_init(&pvt->nqueued, 0);
+    if (pthread_create(&pvt->thread_id, NULL,
+      (void *(*)(void *))&rtpp_record_writer_run, pvt) != 0) {
+        goto e4;
+    }
+    CALL_SMETHOD(pvt->pub.rcnt, attach, (rtpp_refcnt_dtor_t)&rtpp_record_writer_dtor,
+      pvt);
+    return (&pvt->pub);
+
+e4:
+    RTPP_OBJ_DECREF(pvt->rtpp_stats);
+    RTPP_OBJ_DECREF(pvt->log);
+    pthread_mutex_destroy(&pvt->chans_lock);
+e3:
+    CALL_METHOD(pvt->sigterm, dtor);
+e2:
+    rtpp_queue_destroy(pvt->wq);
+e1:
+    RTPP_OBJ_DECREF(&(pvt->pub));
+    free(pvt);
+e0:
+    return (NULL);
+}
+
+static void
+rtpp_record_submit(struct rtpp_record_writer *pub, struct rtpp_wi *wi)
+{
+    struct rtpp_record_writer_priv *pvt;
+
+    PUB2PVT(pub, pvt);
+    rtpp_queue_put_item(wi, pvt->wq);
+}
+
+/*
+ * Hand the buffer over to the writer thread. Returns the same buffer
+ * emptied if it had to be dropped, NULL otherwise.
+ */
+static struct rtpp_record_wjob *
+flush_rbuf(struct rtpp_record_channel *rrc, struct rtpp_record_wjob *wjp)
+{
+    struct rtpp_record_writer_priv *wpvt;
+
+    PUB2PVT(rrc->writer, wpvt);
+    if (atomic_load(&wpvt->nqueued) >= RTPP_RECORD_WQ_MAX) {
+        CALL_SMETHOD(wpvt->rtpp_stats, updatebyidx, wpvt->npkts_dropped_idx,
+          wjp->npkts);
+        /* Offsets in the index are no good once there is a gap */
+        if (rrc->idx != NULL)
+            rrc->idx->broken = 1;
+        wjp->len = 0;
+        wjp->npkts = 0;
+        return (wjp);
+    }
+    rtpp_record_wbuf_submit(wpvt, rrc, wjp);
+    return (NULL);
+}
+
+/*
+ * Get an empty buffer: the one returned by the writer thread if there is
+ * any, a new one otherwise.
+ */
+static struct rtpp_record_wjob *
+rtpp_record_wbuf_get(struct rtpp_record_channel *rrc)
+{
+    struct rtpp_record_wjob *wjp;
+    struct rtpp_wi *wi;
+
+    wjp = atomic_exchange(&rrc->wspare, NULL);
+    if (wjp != NULL)
+        return (wjp);
+    wi = rtpp_wi_malloc_udata((void **)&wjp,
+      sizeof(struct rtpp_record_wjob) + RTPP_RECORD_WBUF_LEN);
+    if (wi == NULL)
+        return (NULL);
+    wjp->type = RRJ_WRITE;
+    wjp->wi = wi;
+    wjp->rrc = rrc;
+    wjp->npkts = 0;
+    wjp->len = 0;
+    return (wjp);
 }
 
 union anyhdr {
@@ -547,22 +1577,110 @@ get_hdr_size(const struct sockaddr *raddr)
     return (hdr_size);
 }
 
+static int
+rtpp_record_idx_grow(void **ap, unsigned int *alenp, unsigned int len,
+  size_t esize)
+{
+    void *np;
+
+    if (len < *alenp)
+        return (0);
+    np = realloc(*ap, esize * (*alenp + 64));
+    if (np == NULL)
+        return (-1);
+    *ap = np;
+    *alenp += 64;
+    return (0);
+}
+
+static void
+rtpp_record_idx_update(struct rtpp_record_idx *idx,
+  const struct rtp_packet *packet, double atime, int hdr_size)
+{
+    struct rtpp_ridx_hdr *hp;
+    struct rtpp_ridx_ssrc *ssp;
+    struct rtpp_ridx_seek *skp;
+    const rtp_hdr_t *rhp;
+    uint64_t off;
+    uint32_t ssrc;
+    unsigned int i;
+
+    hp = &idx->hdr;
+    off = hp->dlen;
+    hp->dlen += hdr_size + packet->size;
+    if (idx->broken)
+        return;
+    if (hp->npkts == 0) {
+        hp->btime = atime;
+        idx->nseek = atime;
+    }
+    if (atime > hp->etime)
+        hp->etime = atime;
+    hp->npkts += 1;
+    if (atime >= idx->nseek) {
+        if (rtpp_record_idx_grow((void **)&idx->seeks, &idx->aseeks,
+          hp->nseeks, sizeof(idx->seeks[0])) != 0)
+            goto e0;
+        skp = &idx->seeks[hp->nseeks];
+        skp->time = atime;
+        skp->off = off;
+        hp->nseeks += 1;
+        idx->nseek = hp->btime + hp->ival *
+          (floor((atime - hp->btime) / hp->ival) + 1);
+    }
+
+    /* Only RTP packets go into the SSRC table, RTCP ones are told apart
+     * by the packet type, as per RFC5761 */
+    rhp = (const rtp_hdr_t *)packet->data.buf;
+    if (packet->size < sizeof(*rhp) || rhp->version != 2 ||
+      (packet->data.buf[1] >= 192 && packet->data.buf[1] <= 223))
+        return;
+    ssrc = ntohl(rhp->ssrc);
+    if (idx->lssrc < hp->nssrcs && idx->ssrcs[idx->lssrc].ssrc == ssrc) {
+        i = idx->lssrc;
+    } else {
+        for (i = 0; i < hp->nssrcs; i++) {
+            if (idx->ssrcs[i].ssrc == ssrc)
+                break;
+        }
+    }
+    if (i == hp->nssrcs) {
+        if (rtpp_record_idx_grow((void **)&idx->ssrcs, &idx->assrcs,
+          hp->nssrcs, sizeof(idx->ssrcs[0])) != 0)
+            goto e0;
+        ssp = &idx->ssrcs[i];
+        memset(ssp, '\0', sizeof(*ssp));
+        ssp->ssrc = ssrc;
+        ssp->btime = atime;
+        ssp->boff = off;
+        hp->nssrcs += 1;
+    }
+    ssp = &idx->ssrcs[i];
+    ssp->etime = atime;
+    ssp->pcount += 1;
+    idx->lssrc = i;
+    return;
+
+e0:
+    /* Incomplete index is worse than none at all */
+    idx->broken = 1;
+}
+
 static void
 rtpp_record_write(struct rtpp_record *self, struct rtpp_stream *stp,
   struct rtp_packet *packet)
 {
-    struct iovec v[2];
-    int rval, hdr_size;
+    int hdr_size;
     prepare_pkt_hdr_t prepare_pkt_hdr;
-    const char *proto;
     struct sockaddr_storage daddr;
     struct rtpp_record_channel *rrc;
     struct rtpp_netaddr *rem_addr;
+    struct rtpp_record_wjob *wjp;
     size_t dalen;
 
     PUB2PVT(self, rrc);
 
-    if (rrc->fd == -1)
+    if (atomic_load(&rrc->werror) != 0)
 	return;
 
     rem_addr = CALL_SMETHOD(stp, get_rem_addr, 0);
@@ -600,13 +1718,26 @@ rtpp_record_write(struct rtpp_record *self, struct rtpp_stream *stp,
         abort();
     }
 
+    wjp = atomic_exchange(&rrc->wbuf, NULL);
     /* Check if the write buffer has necessary space, and flush if not */
-    if ((rrc->rbuf_len + hdr_size + packet->size > sizeof(rrc->rbuf)) && rrc->rbuf_len > 0)
-	if (flush_rbuf(rrc) != 0)
-	    return;
+    if (wjp != NULL && wjp->len + hdr_size + packet->size >
+      RTPP_RECORD_WBUF_LEN)
+        wjp = flush_rbuf(rrc, wjp);
+
+    if (wjp == NULL) {
+        wjp = rtpp_record_wbuf_get(rrc);
+        if (wjp == NULL) {
+            RTPP_ELOG(stp->log, RTPP_LOG_ERR, "can't allocate memory");
+            return;
+        }
+    }
+    if (wjp->len == 0)
+        wjp->ctime = getdtime();
+    RTPP_DBG_ASSERT(hdr_size + packet->size <= RTPP_RECORD_WBUF_LEN);
 
     struct prepare_pkt_hdr_args pargs = {
       .packet = packet,
+      .hdrp = (void *)(wjp->data + wjp->len),
       .ldaddr = stp->laddr,
       .ldport = stp->port,
       .daddr = sstosa(&daddr),
@@ -614,53 +1745,115 @@ rtpp_record_write(struct rtpp_record *self, struct rtpp_stream *stp,
       .atime_wall = ARRIVAL_TIME(rrc, packet)
     };
 
-    /* Check if received packet doesn't fit into the buffer, do synchronous write  if so */
-    if (rrc->rbuf_len + hdr_size + packet->size > sizeof(rrc->rbuf)) {
-        union anyhdr hdr;
-        pargs.hdrp = &hdr;
+    if (prepare_pkt_hdr(&pargs) != 0)
+	goto out;
+    if (rrc->idx != NULL)
+        rtpp_record_idx_update(rrc->idx, packet, pargs.atime_wall, hdr_size);
+    wjp->len += hdr_size;
+    memcpy(wjp->data + wjp->len, packet->data.buf, packet->size);
+    wjp->len += packet->size;
+    wjp->npkts += 1;
+out:
+    atomic_store(&rrc->wbuf, wjp);
+}
 
-	if (prepare_pkt_hdr(&pargs) != 0)
-	    return;
+static void
+rtpp_record_close(struct rtpp_record_channel *rrc)
+{
+    struct rtpp_record_writer *writer;
+    struct rtpp_record_wjob *wjp;
 
-	v[0].iov_base = (void *)&hdr;
-	v[0].iov_len = hdr_size;
-	v[1].iov_base = packet->data.buf;
-	v[1].iov_len = packet->size;
+    rtpp_record_fin(&rrc->pub);
+    if (rrc->mode == MODE_REMOTE_RTP) {
+        if (rrc->fd != -1)
+            close(rrc->fd);
+        RTPP_OBJ_DECREF(rrc->log);
+        free(rrc);
+        return;
+    }
+    /*
+     * Hand everything over to the writer thread, the file is closed and
+     * the channel is freed there once all pending data is written out.
+     */
+    wjp = atomic_exchange(&rrc->wbuf, NULL);
+    if (wjp != NULL) {
+        if (wjp->len > 0)
+            wjp = flush_rbuf(rrc, wjp);
+        if (wjp != NULL)
+            rtpp_record_wbuf_put(rrc, wjp);
+    }
+    writer = rrc->writer;
+    rtpp_record_submit(writer, rrc->close_wi);
+    /* rrc could be gone already at this point */
+    RTPP_OBJ_DECREF(writer);
+}
 
-	rval = writev(rrc->fd, v, 2);
-	if (rval != -1)
-	    return;
+static int
+rtpp_record_idx_save(struct rtpp_record_channel *rrc)
+{
+    struct rtpp_record_idx *idx;
+    char ipath[PATH_MAX + 1];
+    struct iovec v[3];
+    ssize_t len, rval;
+    int fd;
 
-        proto = CALL_SMETHOD(stp, get_proto);
-	RTPP_ELOG(stp->log, RTPP_LOG_ERR, "error while recording session (%s)",
-	  proto);
-	/* Prevent futher writing if error happens */
-	close(rrc->fd);
-	rrc->fd = -1;
-	return;
+    idx = rrc->idx;
+    if (snprintf(ipath, sizeof(ipath), "%s%s", rrc->spath,
+      RTPP_RIDX_SUFFIX) >= sizeof(ipath)) {
+        RTPP_LOG(rrc->log, RTPP_LOG_ERR, "%s: index file name is too long, "
+          "not writing index", rrc->spath);
+        return (-1);
     }
-    pargs.hdrp = (void *)rrc->rbuf + rrc->rbuf_len;
-    if (prepare_pkt_hdr(&pargs) != 0)
-	return;
-    rrc->rbuf_len += hdr_size;
-    memcpy(rrc->rbuf + rrc->rbuf_len, packet->data.buf, packet->size);
-    rrc->rbuf_len += packet->size;
+    fd = open(ipath, O_WRONLY | O_CREAT | O_TRUNC, DEFFILEMODE);
+    if (fd == -1) {
+        RTPP_ELOG(rrc->log, RTPP_LOG_ERR, "can't open file %s for writing",
+          ipath);
+        return (-1);
+    }
+    v[0].iov_base = &idx->hdr;
+    v[0].iov_len = sizeof(idx->hdr);
+    v[1].iov_base = idx->ssrcs;
+    v[1].iov_len = sizeof(idx->ssrcs[0]) * idx->hdr.nssrcs;
+    v[2].iov_base = idx->seeks;
+    v[2].iov_len = sizeof(idx->seeks[0]) * idx->hdr.nseeks;
+    len = v[0].iov_len + v[1].iov_len + v[2].iov_len;
+    do {
+        rval = writev(fd, v, 3);
+    } while (rval == -1 && errno == EINTR);
+    close(fd);
+    if (rval != len) {
+        RTPP_ELOG(rrc->log, RTPP_LOG_ERR, "error while writing index %s",
+          ipath);
+        unlink(ipath);
+        return (-1);
+    }
+    return (0);
 }
 
 static void
-rtpp_record_close(struct rtpp_record_channel *rrc)
+rtpp_record_idx_free(struct rtpp_record_idx *idx)
 {
-    static int keep = 1;
 
-    rtpp_record_fin(&rrc->pub);
-    if (rrc->mode != MODE_REMOTE_RTP && rrc->rbuf_len > 0)
-	flush_rbuf(rrc);
+    free(idx->ssrcs);
+    free(idx->seeks);
+    free(idx);
+}
 
-    if (rrc->fd != -1)
-	close(rrc->fd);
+static void
+rtpp_record_finalize(struct rtpp_record_channel *rrc)
+{
+    static int keep = 1;
+    char ipath[PATH_MAX + 1], irpath[PATH_MAX + 1];
+    int hasidx;
 
-    if (rrc->mode == MODE_REMOTE_RTP)
-	goto done;
+    hasidx = 0;
+    if (rrc->fd != -1) {
+	close(rrc->fd);
+	/* The index is only any good if the whole recording has made it */
+	if (keep != 0 && rrc->idx != NULL && rrc->idx->broken == 0 &&
+	  atomic_load(&rrc->werror) == 0)
+	    hasidx = (rtpp_record_idx_save(rrc) == 0);
+    }
 
     if (keep == 0) {
 	if (unlink(rrc->spath) == -1)
@@ -670,8 +1863,22 @@ rtpp_record_close(struct rtpp_record_channel *rrc)
 	if (rename(rrc->spath, rrc->rpath) == -1)
 	    RTPP_ELOG(rrc->log, RTPP_LOG_ERR, "can't move "
 	      "session record from spool into permanent storage");
+	if (hasidx && snprintf(ipath, sizeof(ipath), "%s%s", rrc->spath,
+	  RTPP_RIDX_SUFFIX) < sizeof(ipath)) {
+	    if (snprintf(irpath, sizeof(irpath), "%s%s", rrc->rpath,
+	      RTPP_RIDX_SUFFIX) >= sizeof(irpath)) {
+		RTPP_LOG(rrc->log, RTPP_LOG_ERR, "%s: index file name is "
+		  "too long, dropping index", rrc->rpath);
+		unlink(ipath);
+	    } else if (rename(ipath, irpath) == -1) {
+		RTPP_ELOG(rrc->log, RTPP_LOG_ERR, "can't move "
+		  "session record index from spool into permanent storage");
+	    }
+	}
     }
-done:
+    if (rrc->idx != NULL)
+        rtpp_record_idx_free(rrc->idx);
+    CALL_METHOD(rrc->close_wi, dtor);
     RTPP_OBJ_DECREF(rrc->log);
 
     free(rrc);
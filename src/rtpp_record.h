@@ -42,6 +42,10 @@ struct rtpp_record {
     METHOD_ENTRY(rtpp_record_write, pktwrite);
 };
 
+struct rtpp_record_writer {
+    struct rtpp_refcnt *rcnt;
+};
+
 #define RECORD_RTP  0
 #define RECORD_RTCP 1
 #define RECORD_BOTH 2
@@ -49,5 +53,6 @@ struct rtpp_record {
 /* Function prototypes */
 struct rtpp_record *rtpp_record_open(const struct rtpp_cfg *,
   struct rtpp_session *, char *, int, int);
+struct rtpp_record_writer *rtpp_record_writer_ctor(const struct rtpp_cfg *);
 
 #endif
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2024 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#ifndef _RTPP_RECORD_INDEX_H_
+#define _RTPP_RECORD_INDEX_H_
+
+/*
+ * Sidecar index written next to the local recording (with the
+ * RTPP_RIDX_SUFFIX appended to its name) once the recording is closed.
+ * The header is followed by nssrcs SSRC entries and nseeks seek table
+ * entries. The seek table has an entry for the first packet arriving in
+ * each ival seconds long interval since the start of the recording, which
+ * allows readers to skip straight to the part they are interested in.
+ * All offsets are from the beginning of the recording, all times are the
+ * same as in the per-packet headers. Values are in the host byte order.
+ */
+#define RTPP_RIDX_MAGIC   0x58444952 /* "RIDX" */
+#define RTPP_RIDX_VERSION 1
+#define RTPP_RIDX_SUFFIX  ".idx"
+
+#define RTPP_RIDX_FMT_ADHOC 1
+#define RTPP_RIDX_FMT_PCAP  2
+
+struct rtpp_ridx_hdr {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t format;            /* RTPP_RIDX_FMT_XXX */
+    uint32_t nssrcs;
+    uint32_t nseeks;
+    double ival;                /* Seek table granularity, seconds */
+    double btime;               /* Arrival time of the first packet */
+    double etime;               /* Arrival time of the last packet */
+    uint64_t npkts;             /* Number of packets in the recording */
+    uint64_t dlen;              /* Length of the recording */
+};
+
+struct rtpp_ridx_ssrc {
+    uint32_t ssrc;
+    uint32_t pcount;
+    double btime;
+    double etime;
+    uint64_t boff;              /* Offset of the first packet */
+};
+
+struct rtpp_ridx_seek {
+    double time;
+    uint64_t off;
+};
+
+#endif /* _RTPP_RECORD_INDEX_H_ */
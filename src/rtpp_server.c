@@ -27,9 +27,11 @@
  */
 
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <netinet/in.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -55,13 +57,44 @@
 
 #define RTPS_SRATE      8000
 
+/*
+ * Prompts are read in whole on the command path, cap the size so that
+ * a stray large file can not stall command processing for long or eat
+ * up the memory. That is more than half an hour of G.711.
+ */
+#define RTPS_SRC_MAX    (16 * 1024 * 1024)
+
+/*
+ * Encoded prompt data, loaded once and shared by all the players of the
+ * same file, so that playing the same announcement (e.g. music on hold)
+ * to many streams does not cost a file descriptor and a read(2) per
+ * packet for each of them. Entries are identified by the file identity
+ * and modification time, so that updating a prompt on disk takes effect
+ * for the players started after that.
+ */
+struct rtpp_server_src {
+    struct rtpp_server_src *next;
+    int nrefs;
+    dev_t dev;
+    ino_t ino;
+    time_t mtime;
+    size_t len;
+    unsigned char data[0];
+};
+
+static struct {
+    pthread_mutex_t lock;
+    struct rtpp_server_src *first;
+} rtpp_server_srcs = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
 struct rtpp_server_priv {
     struct rtpp_server pub;
     double btime;
     unsigned char buf[1024];
     rtp_hdr_t *rtp;
     unsigned char *pload;
-    int fd;
+    struct rtpp_server_src *src;
+    size_t off;
     int loop;
     uint64_t dts;
     int ptime;
@@ -75,6 +108,7 @@ static void rtpp_server_set_ssrc(struct rtpp_server *, uint32_t);
 static uint16_t rtpp_server_get_seq(struct rtpp_server *);
 static void rtpp_server_set_seq(struct rtpp_server *, uint16_t);
 static void rtpp_server_start(struct rtpp_server *, double);
+static double rtpp_server_get_deadline(struct rtpp_server *);
 
 static const struct rtpp_server_smethods rtpp_server_smethods = {
     .get = &rtpp_server_get,
@@ -82,20 +116,102 @@ static const struct rtpp_server_smethods rtpp_server_smethods = {
     .set_ssrc = &rtpp_server_set_ssrc,
     .get_seq = &rtpp_server_get_seq,
     .set_seq = &rtpp_server_set_seq,
-    .start = &rtpp_server_start
+    .start = &rtpp_server_start,
+    .get_deadline = &rtpp_server_get_deadline
 };
 
+static struct rtpp_server_src *
+rtpp_server_src_get(const char *path, int *result)
+{
+    struct rtpp_server_src *src;
+    struct stat sb;
+    ssize_t rlen;
+    size_t len;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        *result = RTPP_SERV_NOENT;
+        return (NULL);
+    }
+    if (fstat(fd, &sb) == -1 || !S_ISREG(sb.st_mode)) {
+        *result = RTPP_SERV_NOENT;
+        goto e0;
+    }
+    if (sb.st_size > RTPS_SRC_MAX) {
+        *result = RTPP_SERV_TOOBIG;
+        goto e0;
+    }
+    pthread_mutex_lock(&rtpp_server_srcs.lock);
+    for (src = rtpp_server_srcs.first; src != NULL; src = src->next) {
+        if (src->dev == sb.st_dev && src->ino == sb.st_ino &&
+          src->mtime == sb.st_mtime && src->len == (size_t)sb.st_size) {
+            src->nrefs += 1;
+            pthread_mutex_unlock(&rtpp_server_srcs.lock);
+            close(fd);
+            return (src);
+        }
+    }
+    pthread_mutex_unlock(&rtpp_server_srcs.lock);
+
+    src = rtpp_zmalloc(sizeof(*src) + sb.st_size);
+    if (src == NULL) {
+        *result = RTPP_SERV_NOMEM;
+        goto e0;
+    }
+    for (len = 0; len < (size_t)sb.st_size; len += rlen) {
+        rlen = read(fd, src->data + len, sb.st_size - len);
+        if (rlen <= 0)
+            break;
+    }
+    close(fd);
+    src->nrefs = 1;
+    src->dev = sb.st_dev;
+    src->ino = sb.st_ino;
+    src->mtime = sb.st_mtime;
+    src->len = len;
+    /*
+     * Two players could have loaded the same file concurrently, that's
+     * harmless, the lookup will just find the most recent copy.
+     */
+    pthread_mutex_lock(&rtpp_server_srcs.lock);
+    src->next = rtpp_server_srcs.first;
+    rtpp_server_srcs.first = src;
+    pthread_mutex_unlock(&rtpp_server_srcs.lock);
+    return (src);
+e0:
+    close(fd);
+    return (NULL);
+}
+
+static void
+rtpp_server_src_put(struct rtpp_server_src *src)
+{
+    struct rtpp_server_src **spp;
+
+    pthread_mutex_lock(&rtpp_server_srcs.lock);
+    src->nrefs -= 1;
+    if (src->nrefs > 0) {
+        pthread_mutex_unlock(&rtpp_server_srcs.lock);
+        return;
+    }
+    for (spp = &rtpp_server_srcs.first; *spp != src; spp = &(*spp)->next)
+        continue;
+    *spp = src->next;
+    pthread_mutex_unlock(&rtpp_server_srcs.lock);
+    free(src);
+}
+
 struct rtpp_server *
 rtpp_server_ctor(struct rtpp_server_ctor_args *ap)
 {
     struct rtpp_server_priv *rp;
-    int fd;
+    struct rtpp_server_src *src;
     char path[PATH_MAX + 1];
 
     sprintf(path, "%s.%d", ap->name, ap->codec);
-    fd = open(path, O_RDONLY);
-    if (fd == -1) {
-        ap->result = RTPP_SERV_NOENT;
+    src = rtpp_server_src_get(path, &ap->result);
+    if (src == NULL) {
 	goto e0;
     }
 
@@ -106,7 +222,7 @@ rtpp_server_ctor(struct rtpp_server_ctor_args *ap)
     }
 
     rp->dts = 0;
-    rp->fd = fd;
+    rp->src = src;
     rp->loop = (ap->loop > 0) ? ap->loop - 1 : ap->loop;
     rp->ptime = (ap->ptime > 0) ? ap->ptime : RTPS_TICKS_MIN;
 
@@ -130,7 +246,7 @@ rtpp_server_ctor(struct rtpp_server_ctor_args *ap)
     ap->result = RTPP_SERV_OK;
     return (&rp->pub);
 e1:
-    close(fd);
+    rtpp_server_src_put(src);
 e0:
     return (NULL);
 }
@@ -140,7 +256,7 @@ rtpp_server_dtor(struct rtpp_server_priv *rp)
 {
 
     rtpp_server_fin(&rp->pub);
-    close(rp->fd);
+    rtpp_server_src_put(rp->src);
     free(rp);
 }
 
@@ -210,16 +326,19 @@ rtpp_server_get(struct rtpp_server *self, double dtime, int *rval)
     }
     hlen = RTP_HDR_LEN(rp->rtp);
 
-    if (read(rp->fd, pkt->data.buf + hlen, rlen) != rlen) {
-	if (rp->loop == 0 || lseek(rp->fd, 0, SEEK_SET) == -1 ||
-	  read(rp->fd, pkt->data.buf + hlen, rlen) != rlen) {
+    if (rp->off + rlen > rp->src->len) {
+	/* Incomplete tail is dropped, same as if it was read(2) */
+	if (rp->loop == 0 || (size_t)rlen > rp->src->len) {
 	    *rval = RTPS_EOF;
             RTPP_OBJ_DECREF(pkt);
             return (NULL);
         }
+	rp->off = 0;
 	if (rp->loop != -1)
 	    rp->loop -= 1;
     }
+    memcpy(pkt->data.buf + hlen, rp->src->data + rp->off, rlen);
+    rp->off += rlen;
 
     memcpy(&pkt->data.header, rp->rtp, hlen);
 
@@ -281,3 +400,13 @@ rtpp_server_start(struct rtpp_server *self, double dtime)
     rp->btime = dtime;
     rp->started = 1;
 }
+
+/* Time when the next packet is due to be sent */
+static double
+rtpp_server_get_deadline(struct rtpp_server *self)
+{
+    struct rtpp_server_priv *rp;
+
+    PUB2PVT(self, rp);
+    return (rp->btime + ((double)rp->dts / 1000.0));
+}
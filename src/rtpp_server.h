@@ -40,6 +40,7 @@ DEFINE_METHOD(rtpp_server, rtpp_server_set_ssrc, void, uint32_t);
 DEFINE_METHOD(rtpp_server, rtpp_server_get_seq, uint16_t);
 DEFINE_METHOD(rtpp_server, rtpp_server_set_seq, void, uint16_t);
 DEFINE_METHOD(rtpp_server, rtpp_server_start, void, double);
+DEFINE_METHOD(rtpp_server, rtpp_server_get_deadline, double);
 
 struct rtpp_server_smethods {
     /* Static methods */
@@ -49,6 +50,7 @@ struct rtpp_server_smethods {
     METHOD_ENTRY(rtpp_server_get_seq, get_seq);
     METHOD_ENTRY(rtpp_server_set_seq, set_seq);
     METHOD_ENTRY(rtpp_server_start, start);
+    METHOD_ENTRY(rtpp_server_get_deadline, get_deadline);
 };
 
 #define	RTPS_LATER	(0)
@@ -82,6 +84,7 @@ struct rtpp_server_ctor_args;
 #define RTPP_SERV_OK     0
 #define RTPP_SERV_NOENT -1
 #define RTPP_SERV_NOMEM -2
+#define RTPP_SERV_TOOBIG -3
 
 struct rtpp_server *rtpp_server_ctor(struct rtpp_server_ctor_args *);
 
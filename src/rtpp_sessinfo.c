@@ -52,6 +52,7 @@ struct rtpp_polltbl_hst_ent {
    uint64_t stuid;
    enum polltbl_hst_ops op;
    struct rtpp_socket *skt;
+   struct rtpp_stream *stp;
 };
 
 struct rtpp_polltbl_hst {
@@ -102,6 +103,9 @@ rtpp_polltbl_hst_dtor(struct rtpp_polltbl_hst *hp)
         if (hep->skt != NULL) {
             RTPP_OBJ_DECREF(hep->skt);
         }
+        if (hep->stp != NULL) {
+            RTPP_OBJ_DECREF(hep->stp);
+        }
     }
     if (hp->alen > 0) {
         free(hp->clog);
@@ -125,18 +129,23 @@ rtpp_polltbl_hst_extend(struct rtpp_polltbl_hst *hp)
 
 static void
 rtpp_polltbl_hst_record(struct rtpp_polltbl_hst *hp, enum polltbl_hst_ops op,
-  uint64_t stuid, struct rtpp_socket *skt)
+  struct rtpp_stream *stp, struct rtpp_socket *skt)
 {
     struct rtpp_polltbl_hst_ent *hpe;
 
     hpe = hp->clog + hp->ulen;
     hpe->op = op;
-    hpe->stuid = stuid;
+    hpe->stuid = stp->stuid;
     hpe->skt = skt;
+    hpe->stp = NULL;
     hp->ulen += 1;
     if (skt != NULL) {
         RTPP_OBJ_INCREF(skt);
     }
+    if (op == HST_ADD) {
+        RTPP_OBJ_INCREF(stp);
+        hpe->stp = stp;
+    }
 }
 
 struct rtpp_sessinfo *
@@ -213,10 +222,10 @@ rtpp_sinfo_append(struct rtpp_sessinfo *sessinfo, struct rtpp_session *sp,
     }
     rtp = sp->rtp->stream[index];
     CALL_SMETHOD(rtp, set_skt, new_fds[0]);
-    rtpp_polltbl_hst_record(&pvt->hst_rtp, HST_ADD, rtp->stuid, new_fds[0]);
+    rtpp_polltbl_hst_record(&pvt->hst_rtp, HST_ADD, rtp, new_fds[0]);
     rtcp = sp->rtcp->stream[index];
     CALL_SMETHOD(rtcp, set_skt, new_fds[1]);
-    rtpp_polltbl_hst_record(&pvt->hst_rtcp, HST_ADD, rtcp->stuid, new_fds[1]);
+    rtpp_polltbl_hst_record(&pvt->hst_rtcp, HST_ADD, rtcp, new_fds[1]);
 
     pthread_mutex_unlock(&pvt->lock);
     return (0);
@@ -262,18 +271,18 @@ rtpp_sinfo_update(struct rtpp_sessinfo *sessinfo, struct rtpp_session *sp,
     rtp = sp->rtp->stream[index];
     old_fd = CALL_SMETHOD(rtp, update_skt, new_fds[0]);
     if (old_fd != NULL) {
-        rtpp_polltbl_hst_record(&pvt->hst_rtp, HST_UPD, rtp->stuid, new_fds[0]);
+        rtpp_polltbl_hst_record(&pvt->hst_rtp, HST_UPD, rtp, new_fds[0]);
         RTPP_OBJ_DECREF(old_fd);
     } else {
-        rtpp_polltbl_hst_record(&pvt->hst_rtp, HST_ADD, rtp->stuid, new_fds[0]);
+        rtpp_polltbl_hst_record(&pvt->hst_rtp, HST_ADD, rtp, new_fds[0]);
     }
     rtcp = sp->rtcp->stream[index];
     old_fd = CALL_SMETHOD(rtcp, update_skt, new_fds[1]);
     if (old_fd != NULL) {
-        rtpp_polltbl_hst_record(&pvt->hst_rtcp, HST_UPD, rtcp->stuid, new_fds[1]);
+        rtpp_polltbl_hst_record(&pvt->hst_rtcp, HST_UPD, rtcp, new_fds[1]);
         RTPP_OBJ_DECREF(old_fd);
     } else {
-        rtpp_polltbl_hst_record(&pvt->hst_rtcp, HST_ADD, rtcp->stuid, new_fds[1]);
+        rtpp_polltbl_hst_record(&pvt->hst_rtcp, HST_ADD, rtcp, new_fds[1]);
     }
 
 e0:
@@ -304,13 +313,13 @@ rtpp_sinfo_remove(struct rtpp_sessinfo *sessinfo, struct rtpp_session *sp,
     rtp = sp->rtp->stream[index];
     fd = CALL_SMETHOD(rtp, get_skt);
     if (fd != NULL) {
-        rtpp_polltbl_hst_record(&pvt->hst_rtp, HST_DEL, rtp->stuid, NULL);
+        rtpp_polltbl_hst_record(&pvt->hst_rtp, HST_DEL, rtp, NULL);
         RTPP_OBJ_DECREF(fd);
     }
     rtcp = sp->rtcp->stream[index];
     fd = CALL_SMETHOD(rtcp, get_skt);
     if (fd != NULL) {
-        rtpp_polltbl_hst_record(&pvt->hst_rtcp, HST_DEL, rtcp->stuid, NULL);
+        rtpp_polltbl_hst_record(&pvt->hst_rtcp, HST_DEL, rtcp, NULL);
         RTPP_OBJ_DECREF(fd);
     }
 
@@ -324,15 +333,18 @@ rtpp_polltbl_free(struct rtpp_polltbl *ptbl)
     int i;
 
     if (ptbl->aloclen == 0) {
+        free(ptbl->gc);
         return;
     }
     if (ptbl->curlen > 0) {
         for (i = 0; i < ptbl->curlen; i++) {
             RTPP_OBJ_DECREF(ptbl->mds[i].skt);
+            RTPP_OBJ_DECREF(ptbl->mds[i].stp);
         }
     }
     free(ptbl->pfds);
     free(ptbl->mds);
+    free(ptbl->gc);
 }
 
 static int
@@ -342,8 +354,9 @@ rtpp_sinfo_sync_polltbl(struct rtpp_sessinfo *sessinfo,
     struct rtpp_sessinfo_priv *pvt;
     struct pollfd *pfds;
     struct rtpp_polltbl_mdata *mds;
+    struct rtpp_stream **gc;
     struct rtpp_polltbl_hst *hp;
-    int i;
+    int i, ngc;
 
     PUB2PVT(sessinfo, pvt);
 
@@ -360,6 +373,10 @@ rtpp_sinfo_sync_polltbl(struct rtpp_sessinfo *sessinfo,
 
         pfds = realloc(ptbl->pfds, (alen * sizeof(struct pollfd)));
         mds = realloc(ptbl->mds, (alen * sizeof(struct rtpp_polltbl_mdata)));
+        gc = realloc(ptbl->gc, (alen * sizeof(struct rtpp_stream *)));
+        if (gc != NULL) {
+            ptbl->gc = gc;
+        }
         if (pfds != NULL) {
             if (mds == NULL && ptbl->mds == NULL && ptbl->pfds == NULL) {
                 free(pfds);
@@ -376,12 +393,13 @@ rtpp_sinfo_sync_polltbl(struct rtpp_sessinfo *sessinfo,
                 ptbl->mds = mds;
             }
         }
-        if (pfds == NULL || mds == NULL) {
+        if (pfds == NULL || mds == NULL || gc == NULL) {
             goto e0;
         }
         ptbl->aloclen = alen;
     }
 
+    ngc = 0;
     for (i = 0; i < hp->ulen; i++) {
         struct rtpp_polltbl_hst_ent *hep;
         int session_index, movelen;
@@ -396,6 +414,7 @@ rtpp_sinfo_sync_polltbl(struct rtpp_sessinfo *sessinfo,
             ptbl->pfds[session_index].fd = CALL_METHOD(hep->skt, getfd);
             ptbl->pfds[session_index].events = POLLIN;
             ptbl->pfds[session_index].revents = 0;
+            ptbl->mds[session_index].stp = hep->stp;
             ptbl->mds[session_index].stuid = hep->stuid;
             ptbl->mds[session_index].skt = hep->skt;
             ptbl->curlen++;
@@ -406,6 +425,11 @@ rtpp_sinfo_sync_polltbl(struct rtpp_sessinfo *sessinfo,
             session_index = find_polltbl_idx(ptbl, hep->stuid);
             assert(session_index > -1);
             RTPP_OBJ_DECREF(ptbl->mds[session_index].skt);
+            /*
+             * Releasing the stream may end up running its dtor, don't
+             * do that while holding the lock.
+             */
+            ptbl->gc[ngc++] = ptbl->mds[session_index].stp;
             movelen = (ptbl->curlen - session_index - 1);
             if (movelen > 0) {
                 memmove(&ptbl->pfds[session_index], &ptbl->pfds[session_index + 1],
@@ -433,6 +457,9 @@ rtpp_sinfo_sync_polltbl(struct rtpp_sessinfo *sessinfo,
 
     ptbl->streams_wrt = hp->streams_wrt;
     pthread_mutex_unlock(&pvt->lock);
+    for (i = 0; i < ngc; i++) {
+        RTPP_OBJ_DECREF(ptbl->gc[i]);
+    }
     return (1);
 e0:
     for (i = 0; i < hp->ulen; i++) {
@@ -442,6 +469,9 @@ e0:
         if (hep->skt != NULL) {
             RTPP_OBJ_DECREF(hep->skt);
         }
+        if (hep->stp != NULL) {
+            RTPP_OBJ_DECREF(hep->stp);
+        }
     }
     hp->ulen = 0;
     pthread_mutex_unlock(&pvt->lock);
@@ -30,6 +30,7 @@ struct pollfd;
 struct rtpp_session;
 struct rtpp_sessinfo;
 struct rtpp_socket;
+struct rtpp_stream;
 struct rtpp_polltbl;
 struct rtpp_weakref_obj;
 struct rtpp_cfg;
@@ -45,7 +46,13 @@ DEFINE_METHOD(rtpp_sessinfo, rtpp_si_sync_polltbl, int, struct rtpp_polltbl *,
 
 struct rtpp_polltbl_mdata;
 
+/*
+ * Per-descriptor data, kept in step with the pfds array. The table holds
+ * a reference to the stream itself, so that the forwarding thread can go
+ * from the ready descriptor to the stream without a weakref lookup.
+ */
 struct rtpp_polltbl_mdata {
+    struct rtpp_stream *stp;
     uint64_t stuid;
     struct rtpp_socket *skt;
 };
@@ -53,6 +60,8 @@ struct rtpp_polltbl_mdata {
 struct rtpp_polltbl {
     struct pollfd *pfds;
     struct rtpp_polltbl_mdata *mds;
+    /* Streams dropped from the table, released after the sync is done */
+    struct rtpp_stream **gc;
     int curlen;
     int aloclen;
     uint64_t revision;
@@ -67,6 +67,8 @@ struct rtpp_session_priv
     struct rtpp_sessinfo *sessinfo;
     struct rtpp_modman *module_cf;
     struct rtpp_acct *acct;
+    /* Storage for the call_id, tag and tag_nomedianum */
+    char strbuf[0];
 };
 
 static void rtpp_session_dtor(struct rtpp_session_priv *);
@@ -82,8 +84,12 @@ rtpp_session_ctor(const struct rtpp_cfg *cfs, struct common_cmd_args *ccap,
     struct r_pipe_ctor_args pipe_cfg;
     int i;
     char *cp;
+    size_t cidlen, ftlen;
 
-    pvt = rtpp_rzmalloc(sizeof(struct rtpp_session_priv), PVT_RCOFFS(pvt));
+    cidlen = strlen(ccap->call_id) + 1;
+    ftlen = strlen(ccap->from_tag) + 1;
+    pvt = rtpp_rzmalloc(sizeof(struct rtpp_session_priv) + cidlen + (ftlen * 2),
+      PVT_RCOFFS(pvt));
     if (pvt == NULL) {
         goto e0;
     }
@@ -99,7 +105,7 @@ rtpp_session_ctor(const struct rtpp_cfg *cfs, struct common_cmd_args *ccap,
     CALL_METHOD(log, setlevel, cfs->log_level);
     pipe_cfg = (struct r_pipe_ctor_args){.seuid = pub->seuid,
       .streams_wrt = cfs->rtp_streams_wrt, .servers_wrt = cfs->servers_wrt,
-      .log = log, .rtpp_stats = cfs->rtpp_stats, .pipe_type = PIPE_RTP,
+      .proc_servers = cfs->proc_servers, .log = log, .rtpp_stats = cfs->rtpp_stats, .pipe_type = PIPE_RTP,
       .nmodules  = cfs->modules_cf->count.total};
     pub->rtp = rtpp_pipe_ctor(&pipe_cfg);
     if (pub->rtp == NULL) {
@@ -118,18 +124,10 @@ rtpp_session_ctor(const struct rtpp_cfg *cfs, struct common_cmd_args *ccap,
     }
     pvt->acct->init_ts->wall = dtime->wall;
     pvt->acct->init_ts->mono = dtime->mono;
-    pub->call_id = strdup(ccap->call_id);
-    if (pub->call_id == NULL) {
-        goto e5;
-    }
-    pub->tag = strdup(ccap->from_tag);
-    if (pub->tag == NULL) {
-        goto e6;
-    }
-    pub->tag_nomedianum = strdup(ccap->from_tag);
-    if (pub->tag_nomedianum == NULL) {
-        goto e7;
-    }
+    pub->init_ts = pvt->acct->init_ts;
+    pub->call_id = memcpy(pvt->strbuf, ccap->call_id, cidlen);
+    pub->tag = memcpy(pub->call_id + cidlen, ccap->from_tag, ftlen);
+    pub->tag_nomedianum = memcpy(pub->tag + ftlen, ccap->from_tag, ftlen);
     cp = strrchr(pub->tag_nomedianum, ';');
     if (cp != NULL)
         *cp = '\0';
@@ -149,7 +147,7 @@ rtpp_session_ctor(const struct rtpp_cfg *cfs, struct common_cmd_args *ccap,
         if (i == 0 || cfs->ttl_mode == TTL_INDEPENDENT) {
             pub->rtp->stream[i]->ttl = rtpp_ttl_ctor(cfs->max_setup_ttl);
             if (pub->rtp->stream[i]->ttl == NULL) {
-                goto e8;
+                goto e5;
             }
         } else {
             pub->rtp->stream[i]->ttl = pub->rtp->stream[0]->ttl;
@@ -178,12 +176,6 @@ rtpp_session_ctor(const struct rtpp_cfg *cfs, struct common_cmd_args *ccap,
       pvt);
     return (&pvt->pub);
 
-e8:
-    free(pub->tag_nomedianum);
-e7:
-    free(pub->tag);
-e6:
-    free(pub->call_id);
 e5:
     RTPP_OBJ_DECREF(pvt->acct);
 e4:
@@ -225,10 +217,16 @@ rtpp_session_dtor(struct rtpp_session_priv *pvt)
     CALL_SMETHOD(pub->rtpp_stats, updatebyname_d, "total_duration",
       session_time);
     if (pvt->module_cf != NULL) {
-        pvt->acct->call_id = pvt->pub.call_id;
-        pvt->pub.call_id = NULL;
-        pvt->acct->from_tag = pvt->pub.tag;
-        pvt->pub.tag = NULL;
+        pvt->acct->call_id = strdup(pvt->pub.call_id);
+        pvt->acct->from_tag = strdup(pvt->pub.tag);
+        if (pvt->acct->call_id == NULL || pvt->acct->from_tag == NULL) {
+            RTPP_LOG(pub->log, RTPP_LOG_ERR, "can't allocate memory, "
+              "skipping session accounting");
+            RTPP_OBJ_DECREF(pvt->module_cf);
+            pvt->module_cf = NULL;
+        }
+    }
+    if (pvt->module_cf != NULL) {
         CALL_METHOD(pub->rtp->stream[0]->analyzer, get_stats, \
           pvt->acct->rasto);
         CALL_METHOD(pub->rtp->stream[1]->analyzer, get_stats, \
@@ -246,13 +244,6 @@ rtpp_session_dtor(struct rtpp_session_priv *pvt)
     RTPP_OBJ_DECREF(pvt->pub.log);
     if (pvt->pub.timeout_data != NULL)
         RTPP_OBJ_DECREF(pvt->pub.timeout_data);
-    if (pvt->pub.call_id != NULL)
-        free(pvt->pub.call_id);
-    if (pvt->pub.tag != NULL)
-        free(pvt->pub.tag);
-    if (pvt->pub.tag_nomedianum != NULL)
-        free(pvt->pub.tag_nomedianum);
-
     RTPP_OBJ_DECREF(pvt->pub.rtcp);
     RTPP_OBJ_DECREF(pvt->pub.rtp);
     free(pvt);
@@ -50,6 +50,8 @@ struct rtpp_session {
     struct rtpp_timeout_data *timeout_data;
     /* UID */
     uint64_t seuid;
+    /* Creation time, storage is owned by the accounting object */
+    const struct rtpp_timestamp *init_ts;
 
     struct rtpp_stats *rtpp_stats;
     struct rtpp_weakref_obj *servers_wrt;
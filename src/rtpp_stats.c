@@ -26,19 +26,26 @@
  */
 
 #include <sys/types.h>
+#include <sys/mman.h>
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
+#include "rtpp_debug.h"
 #include "rtpp_types.h"
 #include "rtpp_pearson_perfect.h"
 #include "rtpp_refcnt.h"
 #include "rtpp_stats.h"
 #include "rtpp_stats_fin.h"
+#include "rtpp_stats_shm.h"
 #include "rtpp_time.h"
 #include "rtpp_mallocs.h"
 
@@ -88,6 +95,7 @@ static struct rtpp_stat_descr default_stats[] = {
     {.name = "nsess_owrtcp",         .descr = "Number of sessions that had one-way RTCP only", .type = RTPP_CNT_U64}, 
     {.name = "nplrs_created",        .descr = "Number of RTP players created", .type = RTPP_CNT_U64},
     {.name = "nplrs_destroyed",      .descr = "Number of RTP players destroyed", .type = RTPP_CNT_U64},
+    {.name = "nrec_pkts_dropped",    .descr = "Number of recorded packets dropped because the recording writer could not keep up", .type = RTPP_CNT_U64},
     {.name = "npkts_rcvd",           .descr = "Total number of RTP/RTPC packets received", .type = RTPP_CNT_U64},
     {.name = "npkts_played",         .descr = "Total number of RTP packets locally generated (played out)", .type = RTPP_CNT_U64},
     {.name = "npkts_relayed",        .descr = "Total number of RTP/RTPC packets relayed", .type = RTPP_CNT_U64},
@@ -101,6 +109,10 @@ static struct rtpp_stat_descr default_stats[] = {
     {.name = "ncmds_succd",          .descr = "Total number of control commands successfully processed", .type = RTPP_CNT_U64},
     {.name = "ncmds_errs",           .descr = "Total number of control commands ended up with an error", .type = RTPP_CNT_U64},
     {.name = "ncmds_repld",          .descr = "Total number of control commands that had a reply generated", .type = RTPP_CNT_U64},
+    {.name = "ncmds_shed_newsess",   .descr = "Total number of new sessions rejected due to overload", .type = RTPP_CNT_U64},
+    {.name = "ncmds_shed_media",     .descr = "Total number of record/copy/play commands rejected due to overload", .type = RTPP_CNT_U64},
+    {.name = "ncmds_shed_obsrvs",    .descr = "Total number of U/L subcommands rejected due to overload", .type = RTPP_CNT_U64},
+    {.name = "nrcache_evicted",      .descr = "Total number of cached replies evicted before expiration due to memory limit", .type = RTPP_CNT_U64},
     {.name = "rtpa_nsent",           .descr = "Total number of uniqie RTP packets sent to us based on SEQ tracking", .type = RTPP_CNT_U64},
     {.name = "rtpa_nrcvd",           .descr = "Total number of unique RTP packets received by us based on SEQ tracking", .type = RTPP_CNT_U64},
     {.name = "rtpa_ndups",           .descr = "Total number of duplicate RTP packets received by us based on SEQ tracking", .type = RTPP_CNT_U64},
@@ -116,6 +128,11 @@ struct rtpp_stats_priv
     struct rtpp_stat *stats;
     struct rtpp_stat_derived *dstats;
     struct rtpp_pearson_perfect *rppp;
+    struct rtpp_stats_shm_hdr *shm;
+    size_t shm_len;
+    char *shm_path;
+    struct rtpp_stats_shm_gauges gauges;
+    pthread_mutex_t gauges_lock;
 };
 
 struct rtpp_stats_full
@@ -133,6 +150,10 @@ static int64_t rtpp_stats_getlvalbyname(struct rtpp_stats *, const char *);
 static int rtpp_stats_nstr(struct rtpp_stats *, char *, int, const char *);
 static int rtpp_stats_getnstats(struct rtpp_stats *);
 static void rtpp_stats_update_derived(struct rtpp_stats *, double);
+static int rtpp_stats_shm_attach(struct rtpp_stats *, const char *);
+static void rtpp_stats_set_gauges(struct rtpp_stats *,
+  const struct rtpp_stats_shm_gauges *);
+static int rtpp_stats_om_render(struct rtpp_stats *, char *, int, const char *);
 
 const struct rtpp_stats_smethods rtpp_stats_smethods = {
     .getidxbyname = &rtpp_stats_getidxbyname,
@@ -142,7 +163,10 @@ const struct rtpp_stats_smethods rtpp_stats_smethods = {
     .getlvalbyname = &rtpp_stats_getlvalbyname,
     .getnstats = &rtpp_stats_getnstats,
     .nstr = &rtpp_stats_nstr,
-    .update_derived = &rtpp_stats_update_derived
+    .update_derived = &rtpp_stats_update_derived,
+    .shm_attach = &rtpp_stats_shm_attach,
+    .set_gauges = &rtpp_stats_set_gauges,
+    .om_render = &rtpp_stats_om_render
 };
 
 static const char *
@@ -372,6 +396,12 @@ rtpp_stats_dtor(struct rtpp_stats_full *fp)
     struct rtpp_stat *st;
 
     pvt = &fp->pvt;
+    if (pvt->shm != NULL) {
+        munmap(pvt->shm, pvt->shm_len);
+        unlink(pvt->shm_path);
+        free(pvt->shm_path);
+        pthread_mutex_destroy(&pvt->gauges_lock);
+    }
     for (i = 0; i < pvt->nstats; i++) {
         st = &pvt->stats[i];
         pthread_mutex_destroy(&st->mutex);
@@ -392,6 +422,38 @@ rtpp_stats_getnstats(struct rtpp_stats *self)
     return (self->pvt->nstats);
 }
 
+static void
+rtpp_stats_shm_publish(struct rtpp_stats_priv *pvt, double dtime)
+{
+    struct rtpp_stats_shm_hdr *shm;
+    struct rtpp_stat *st;
+    struct rtpp_timestamp ts;
+    uint64_t seq;
+    int i;
+
+    shm = pvt->shm;
+    seq = atomic_load_explicit(&shm->seq, memory_order_relaxed);
+    atomic_store_explicit(&shm->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    for (i = 0; i < pvt->nstats; i++) {
+        st = &pvt->stats[i];
+        pthread_mutex_lock(&st->mutex);
+        if (st->descr->type == RTPP_CNT_U64) {
+            shm->slots[i].val.u64 = st->cnt.u64;
+        } else {
+            shm->slots[i].val.d = st->cnt.d;
+        }
+        pthread_mutex_unlock(&st->mutex);
+    }
+    pthread_mutex_lock(&pvt->gauges_lock);
+    shm->gauges = pvt->gauges;
+    pthread_mutex_unlock(&pvt->gauges_lock);
+    rtpp_timestamp_get(&ts);
+    shm->mono_ts = dtime;
+    shm->wall_ts = ts.wall;
+    atomic_store_explicit(&shm->seq, seq + 2, memory_order_release);
+}
+
 static void
 rtpp_stats_update_derived(struct rtpp_stats *self, double dtime)
 {
@@ -420,4 +482,126 @@ rtpp_stats_update_derived(struct rtpp_stats *self, double dtime)
         pthread_mutex_unlock(&dst->derive_to->mutex);
         dst->last_ts = dtime;
     }
+    if (pvt->shm != NULL) {
+        rtpp_stats_shm_publish(pvt, dtime);
+    }
+}
+
+static void
+rtpp_stats_set_gauges(struct rtpp_stats *self,
+  const struct rtpp_stats_shm_gauges *gp)
+{
+    struct rtpp_stats_priv *pvt;
+
+    pvt = self->pvt;
+    if (pvt->shm == NULL)
+        return;
+    pthread_mutex_lock(&pvt->gauges_lock);
+    pvt->gauges = *gp;
+    pthread_mutex_unlock(&pvt->gauges_lock);
+}
+
+/*
+ * Render all counters in the OpenMetrics text format, derived values
+ * (rates) are exported as gauges, everything else as counters. Returns
+ * number of bytes written or -1 if the buffer is too small.
+ */
+static int
+rtpp_stats_om_render(struct rtpp_stats *self, char *buf, int len,
+  const char *prefix)
+{
+    struct rtpp_stats_priv *pvt;
+    struct rtpp_stat *st;
+    union rtpp_stat_cnt cnt;
+    int i, rlen, olen;
+    const char *name;
+
+    pvt = self->pvt;
+    olen = 0;
+    for (i = 0; i < pvt->nstats; i++) {
+        st = &pvt->stats[i];
+        name = st->descr->name;
+        pthread_mutex_lock(&st->mutex);
+        cnt = st->cnt;
+        pthread_mutex_unlock(&st->mutex);
+        if (st->descr->derive_from != NULL) {
+            rlen = snprintf(buf + olen, len - olen, "# TYPE %s%s gauge\n"
+              "# HELP %s%s %s\n%s%s %f\n", prefix, name, prefix, name,
+              st->descr->descr, prefix, name, cnt.d);
+        } else if (st->descr->type == RTPP_CNT_U64) {
+            rlen = snprintf(buf + olen, len - olen, "# TYPE %s%s counter\n"
+              "# HELP %s%s %s\n%s%s_total %" PRIu64 "\n", prefix, name,
+              prefix, name, st->descr->descr, prefix, name, cnt.u64);
+        } else {
+            rlen = snprintf(buf + olen, len - olen, "# TYPE %s%s counter\n"
+              "# HELP %s%s %s\n%s%s_total %f\n", prefix, name, prefix, name,
+              st->descr->descr, prefix, name, cnt.d);
+        }
+        if (rlen >= len - olen)
+            return (-1);
+        olen += rlen;
+    }
+    return (olen);
+}
+
+static int
+rtpp_stats_shm_attach(struct rtpp_stats *self, const char *path)
+{
+    struct rtpp_stats_priv *pvt;
+    struct rtpp_stats_shm_hdr *shm;
+    struct rtpp_stats_shm_slot *slot;
+    size_t shm_len;
+    int fd, i;
+
+    pvt = self->pvt;
+    RTPP_DBG_ASSERT(pvt->shm == NULL);
+    shm_len = sizeof(*shm) + sizeof(shm->slots[0]) * pvt->nstats;
+    /*
+     * Never follow symlinks or reuse somebody else's file, a stale page
+     * left by a previous instance is removed and created anew.
+     */
+    if (unlink(path) != 0 && errno != ENOENT)
+        goto e0;
+    fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW, 0644);
+    if (fd < 0)
+        goto e0;
+    if (ftruncate(fd, shm_len) != 0)
+        goto e1;
+    shm = mmap(NULL, shm_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (shm == MAP_FAILED)
+        goto e1;
+    pvt->shm_path = strdup(path);
+    if (pvt->shm_path == NULL)
+        goto e2;
+    if (pthread_mutex_init(&pvt->gauges_lock, NULL) != 0)
+        goto e3;
+    close(fd);
+    for (i = 0; i < pvt->nstats; i++) {
+        slot = &shm->slots[i];
+        assert(strlen(pvt->stats[i].descr->name) < sizeof(slot->name));
+        strcpy(slot->name, pvt->stats[i].descr->name);
+        slot->type = (pvt->stats[i].descr->type == RTPP_CNT_U64) ?
+          RTPP_STATS_SHM_U64 : RTPP_STATS_SHM_DBL;
+    }
+    shm->hdr_size = sizeof(*shm);
+    shm->slot_size = sizeof(shm->slots[0]);
+    shm->nslots = pvt->nstats;
+    shm->version = RTPP_STATS_SHM_VERSION;
+    atomic_store_explicit(&shm->seq, 0, memory_order_relaxed);
+    /* Make the page recognizable only after it is fully initialized */
+    atomic_thread_fence(memory_order_release);
+    shm->magic = RTPP_STATS_SHM_MAGIC;
+    pvt->shm_len = shm_len;
+    pvt->shm = shm;
+    return (0);
+e3:
+    free(pvt->shm_path);
+    pvt->shm_path = NULL;
+e2:
+    munmap(shm, shm_len);
+e1:
+    close(fd);
+    unlink(path);
+e0:
+    return (-1);
 }
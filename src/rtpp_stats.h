@@ -26,6 +26,7 @@
  */
 
 struct rtpp_stats;
+struct rtpp_stats_shm_gauges;
 
 #if !defined(DEFINE_METHOD)
 #error "rtpp_types.h" needs to be included
@@ -39,6 +40,10 @@ DEFINE_METHOD(rtpp_stats, rtpp_stats_getlvalbyname, int64_t, const char *);
 DEFINE_METHOD(rtpp_stats, rtpp_stats_nstr, int, char *, int, const char *);
 DEFINE_METHOD(rtpp_stats, rtpp_stats_getnstats, int);
 DEFINE_METHOD(rtpp_stats, rtpp_stats_update_derived, void, double);
+DEFINE_METHOD(rtpp_stats, rtpp_stats_shm_attach, int, const char *);
+DEFINE_METHOD(rtpp_stats, rtpp_stats_set_gauges, void,
+  const struct rtpp_stats_shm_gauges *);
+DEFINE_METHOD(rtpp_stats, rtpp_stats_om_render, int, char *, int, const char *);
 
 struct rtpp_stats_smethods
 {
@@ -50,6 +55,9 @@ struct rtpp_stats_smethods
     METHOD_ENTRY(rtpp_stats_getnstats, getnstats);
     METHOD_ENTRY(rtpp_stats_nstr, nstr);
     METHOD_ENTRY(rtpp_stats_update_derived, update_derived);
+    METHOD_ENTRY(rtpp_stats_shm_attach, shm_attach);
+    METHOD_ENTRY(rtpp_stats_set_gauges, set_gauges);
+    METHOD_ENTRY(rtpp_stats_om_render, om_render);
 };
 
 struct rtpp_stats_priv;
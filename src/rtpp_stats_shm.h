@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2026 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef _RTPP_STATS_SHM_H_
+#define _RTPP_STATS_SHM_H_
+
+/*
+ * Layout of the memory-mapped stats page (--stats_shm option). The page
+ * is re-published by the proxy once per second and is meant to be read
+ * by external monitoring tools without going through the control socket.
+ *
+ * Consistency is provided by a sequence lock: the writer makes seq odd
+ * before updating the values and even again after it is done. Readers
+ * should load seq (acquire), retry if it is odd, copy the values out,
+ * then load seq again (after an acquire fence) and retry if it has
+ * changed. Names and types of the slots never change once the page is
+ * created.
+ */
+
+#define RTPP_STATS_SHM_MAGIC   0x53505452 /* "RTPS" */
+#define RTPP_STATS_SHM_VERSION 2
+#define RTPP_STATS_SHM_NAMELEN 32
+#define RTPP_STATS_SHM_NSNDRS  8
+
+#define RTPP_STATS_SHM_U64     0
+#define RTPP_STATS_SHM_DBL     1
+
+struct rtpp_stats_shm_slot {
+    char name[RTPP_STATS_SHM_NAMELEN];
+    uint32_t type;
+    uint32_t _pad;
+    union {
+        uint64_t u64;
+        double d;
+    } val;
+};
+
+/*
+ * Point-in-time state of the processing threads, published along with
+ * the counters.
+ */
+struct rtpp_stats_shm_gauges {
+    /* Average load of the command and forwarding loops (0.0 - 1.0) */
+    double cmd_aload;
+    double proc_aload;
+    /* Number of packets waiting in each of the nsndrs outbound queues */
+    uint32_t nsndrs;
+    uint32_t _pad;
+    uint32_t sndr_qlen[RTPP_STATS_SHM_NSNDRS];
+};
+
+struct rtpp_stats_shm_hdr {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t hdr_size;
+    uint32_t slot_size;
+    uint32_t nslots;
+    uint32_t _pad;
+    _Atomic(uint64_t) seq;
+    /* Time of the last update, monotonic and wall clock */
+    double mono_ts;
+    double wall_ts;
+    struct rtpp_stats_shm_gauges gauges;
+    struct rtpp_stats_shm_slot slots[0];
+};
+
+#endif
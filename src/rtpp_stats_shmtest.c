@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2026 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Exercises the --stats_shm page the way an external monitoring tool
+ * would: the page is mapped read-only by a reader thread that keeps
+ * taking seqlock-protected snapshots while the writer publishes, and
+ * every snapshot it manages to take is checked to be consistent.
+ */
+
+/* Checks below are done with assert(), keep them in optimized builds */
+#undef NDEBUG
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "rtpp_types.h"
+#include "rtpp_refcnt.h"
+#include "rtpp_stats.h"
+#include "rtpp_stats_shm.h"
+#include "rtpp_time.h"
+
+#define NPUBLISH 20000
+
+struct reader_args {
+    const char *path;
+    atomic_bool done;
+    uint64_t nreads;
+    uint64_t nretries;
+};
+
+static void
+check_hdr(const struct rtpp_stats_shm_hdr *shm, int nstats)
+{
+    int i;
+
+    assert(shm->magic == RTPP_STATS_SHM_MAGIC);
+    assert(shm->version == RTPP_STATS_SHM_VERSION);
+    assert(shm->hdr_size == sizeof(*shm));
+    assert(shm->slot_size == sizeof(shm->slots[0]));
+    assert(shm->nslots == (uint32_t)nstats);
+    for (i = 0; i < nstats; i++) {
+        assert(shm->slots[i].name[0] != '\0');
+        assert(strlen(shm->slots[i].name) < sizeof(shm->slots[i].name));
+        assert(shm->slots[i].type == RTPP_STATS_SHM_U64 ||
+          shm->slots[i].type == RTPP_STATS_SHM_DBL);
+    }
+}
+
+static int
+find_slot(const struct rtpp_stats_shm_hdr *shm, const char *name)
+{
+    uint32_t i;
+
+    for (i = 0; i < shm->nslots; i++) {
+        if (strcmp(shm->slots[i].name, name) == 0)
+            return (i);
+    }
+    return (-1);
+}
+
+static const struct rtpp_stats_shm_hdr *
+map_page(const char *path, size_t *lenp)
+{
+    const struct rtpp_stats_shm_hdr *shm;
+    struct stat sb;
+    int fd;
+
+    fd = open(path, O_RDONLY | O_NOFOLLOW);
+    assert(fd >= 0);
+    assert(fstat(fd, &sb) == 0);
+    assert(S_ISREG(sb.st_mode));
+    shm = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    assert(shm != MAP_FAILED);
+    close(fd);
+    assert((size_t)sb.st_size == shm->hdr_size + shm->slot_size * shm->nslots);
+    *lenp = sb.st_size;
+    return (shm);
+}
+
+static void *
+reader_run(void *ap)
+{
+    struct reader_args *rap;
+    const struct rtpp_stats_shm_hdr *shm;
+    struct rtpp_stats_shm_gauges g;
+    uint64_t s1, s2, cnt, last_cnt;
+    double last_load;
+    size_t len;
+    int idx, i;
+
+    rap = (struct reader_args *)ap;
+    shm = map_page(rap->path, &len);
+    idx = find_slot(shm, "npkts_rcvd");
+    assert(idx >= 0);
+    last_cnt = 0;
+    last_load = 0.0;
+    while (!atomic_load(&rap->done)) {
+        s1 = atomic_load_explicit(&shm->seq, memory_order_acquire);
+        if (s1 & 1) {
+            rap->nretries++;
+            continue;
+        }
+        g = shm->gauges;
+        cnt = shm->slots[idx].val.u64;
+        atomic_thread_fence(memory_order_acquire);
+        s2 = atomic_load_explicit(&shm->seq, memory_order_relaxed);
+        if (s1 != s2) {
+            rap->nretries++;
+            continue;
+        }
+        /* Writer keeps all of them in lockstep */
+        assert(g.proc_aload == g.cmd_aload);
+        assert(g.nsndrs == RTPP_STATS_SHM_NSNDRS);
+        for (i = 0; i < RTPP_STATS_SHM_NSNDRS; i++) {
+            assert(g.sndr_qlen[i] == (uint32_t)g.proc_aload);
+        }
+        assert(cnt == (uint64_t)g.proc_aload);
+        assert(cnt >= last_cnt && g.proc_aload >= last_load);
+        last_cnt = cnt;
+        last_load = g.proc_aload;
+        rap->nreads++;
+    }
+    munmap((void *)shm, len);
+    return (NULL);
+}
+
+int
+main(int argc, char **argv)
+{
+    struct rtpp_stats *rsp;
+    const struct rtpp_stats_shm_hdr *shm;
+    struct rtpp_stats_shm_gauges g;
+    struct reader_args ra;
+    pthread_t rthr;
+    const char *path, *vpath;
+    char buf[16];
+    double dtime;
+    size_t len;
+    int fd, i, j;
+
+    path = (argc > 1) ? argv[1] : "rtpp_stats_shmtest.page";
+    vpath = (argc > 2) ? argv[2] : "rtpp_stats_shmtest.victim";
+
+    /* Existing symlink must be replaced, not followed */
+    unlink(path);
+    fd = open(vpath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    assert(fd >= 0);
+    assert(write(fd, "victim", 6) == 6);
+    close(fd);
+    assert(symlink(vpath, path) == 0);
+
+    rsp = rtpp_stats_ctor();
+    assert(rsp != NULL);
+    assert(CALL_SMETHOD(rsp, shm_attach, path) == 0);
+
+    fd = open(vpath, O_RDONLY);
+    assert(fd >= 0);
+    assert(read(fd, buf, sizeof(buf)) == 6 && memcmp(buf, "victim", 6) == 0);
+    close(fd);
+    unlink(vpath);
+
+    memset(&g, '\0', sizeof(g));
+    g.nsndrs = RTPP_STATS_SHM_NSNDRS;
+    dtime = getdtime() + 1.0;
+    CALL_SMETHOD(rsp, set_gauges, &g);
+    CALL_SMETHOD(rsp, update_derived, dtime);
+
+    memset(&ra, '\0', sizeof(ra));
+    ra.path = path;
+    atomic_init(&ra.done, false);
+    assert(pthread_create(&rthr, NULL, reader_run, &ra) == 0);
+
+    for (i = 1; i <= NPUBLISH; i++) {
+        CALL_SMETHOD(rsp, updatebyname, "npkts_rcvd", 1);
+        g.cmd_aload = g.proc_aload = i;
+        for (j = 0; j < RTPP_STATS_SHM_NSNDRS; j++)
+            g.sndr_qlen[j] = i;
+        CALL_SMETHOD(rsp, set_gauges, &g);
+        CALL_SMETHOD(rsp, update_derived, dtime + i * 0.001);
+        /* Give reader a chance to get a consistent snapshot */
+        if ((i % 10) == 0)
+            usleep(50);
+    }
+    atomic_store(&ra.done, true);
+    pthread_join(rthr, NULL);
+    assert(ra.nreads > 0);
+
+    shm = map_page(path, &len);
+    check_hdr(shm, CALL_SMETHOD(rsp, getnstats));
+    assert((atomic_load(&shm->seq) & 1) == 0);
+    assert(shm->slots[find_slot(shm, "npkts_rcvd")].val.u64 == NPUBLISH);
+    assert(shm->gauges.proc_aload == NPUBLISH);
+    munmap((void *)shm, len);
+
+    RTPP_OBJ_DECREF(rsp);
+    assert(access(path, F_OK) != 0);
+    printf("rtpp_stats_shmtest: %d updates published, %llu consistent "
+      "reads, %llu retries\n", NPUBLISH, (unsigned long long)ra.nreads,
+      (unsigned long long)ra.nretries);
+    return (0);
+}
@@ -62,6 +62,7 @@
 #include "rtpp_pcount.h"
 #include "rtpp_pcnt_strm.h"
 #include "rtpp_proc.h"
+#include "rtpp_proc_servers.h"
 #include "rtpp_record.h"
 #include "rtpp_stats.h"
 #include "rtpp_stream.h"
@@ -76,6 +77,7 @@
 #include "rtpp_acct_pipe.h"
 
 #define  SEQ_SYNC_IVAL   1.0    /* in seconds */
+#define  RTPP_STREAM_ALIGN(x) (((x) + sizeof(intmax_t) - 1) & ~(sizeof(intmax_t) - 1))
 
 struct rtpps_latch {
     int latched;
@@ -92,25 +94,30 @@ struct rtps {
 struct rtpp_stream_priv
 {
     struct rtpp_stream pub;
-    struct rtpp_weakref_obj *servers_wrt;
-    struct rtpp_stats *rtpp_stats;
+    /*
+     * Fields up to the raddr_prev are consulted for every packet received
+     * or sent, keep them together.
+     */
     pthread_mutex_t lock;
+    /* Descriptor */
+    struct rtpp_socket *fd;
+    /* Remote source address */
+    struct rtpp_netaddr *rem_addr;
+    /* Flag which tells if we are allowed to update address with RTP src IP */
+    struct rtpps_latch latch_info;
     /* Weak reference to the "rtpp_server" (player) */
     struct rtps rtps;
-    /* Timestamp of the last session update */
-    double last_update;
     /* Flag that indicates whether or not address supplied by client can't be trusted */
     int untrusted_addr;
+    /* Timestamp of the last session update */
+    double last_update;
     /* Save previous address when doing update */
     struct rtpp_netaddr *raddr_prev;
-    /* Flag which tells if we are allowed to update address with RTP src IP */
-    struct rtpps_latch latch_info;
     /* Structure to track hold requests */
     struct rtpp_acct_hold hld_stat;
-    /* Descriptor */
-    struct rtpp_socket *fd;
-    /* Remote source address */
-    struct rtpp_netaddr *rem_addr;
+    struct rtpp_weakref_obj *servers_wrt;
+    struct rtpp_proc_servers *proc_servers;
+    struct rtpp_stats *rtpp_stats;
     /* Placeholder for per-module structures */
     struct pmod_data pmod_data;
 };
@@ -175,10 +182,22 @@ struct rtpp_stream *
 rtpp_stream_ctor(const struct r_stream_ctor_args *ap)
 {
     struct rtpp_stream_priv *pvt;
-    size_t alen;
+    size_t alen, pcnt_offs, rprev_offs, ra_offs;
 
     alen = offsetof(struct rtpp_stream_priv, pmod_data.adp) + 
       (ap->nmodules * sizeof(pvt->pmod_data.adp[0]));
+    /*
+     * Sub-objects that are private to the stream and are touched for every
+     * packet it receives live in the same memory block, right after the
+     * stream itself.
+     */
+    pcnt_offs = RTPP_STREAM_ALIGN(alen);
+    rprev_offs = pcnt_offs + rtpp_pcnt_strm_osize();
+    ra_offs = rprev_offs + rtpp_netaddr_osize();
+    alen = ra_offs;
+    if (ap->pipe_type == PIPE_RTP) {
+        alen += rtpp_analyzer_osize();
+    }
     pvt = rtpp_rzmalloc(alen, PVT_RCOFFS(pvt));
     if (pvt == NULL) {
         goto e0;
@@ -187,16 +206,17 @@ rtpp_stream_ctor(const struct r_stream_ctor_args *ap)
         goto e1;
     }
     if (ap->pipe_type == PIPE_RTP) {
-        pvt->pub.analyzer = rtpp_analyzer_ctor(ap->log);
+        pvt->pub.analyzer = rtpp_analyzer_ctor_pa((char *)pvt + ra_offs,
+          ap->log);
         if (pvt->pub.analyzer == NULL) {
             goto e3;
         }
     }
-    pvt->pub.pcnt_strm = rtpp_pcnt_strm_ctor();
+    pvt->pub.pcnt_strm = rtpp_pcnt_strm_ctor_pa((char *)pvt + pcnt_offs);
     if (pvt->pub.pcnt_strm == NULL) {
         goto e4;
     }
-    pvt->raddr_prev = rtpp_netaddr_ctor();
+    pvt->raddr_prev = rtpp_netaddr_ctor_pa((char *)pvt + rprev_offs);
     if (pvt->raddr_prev == NULL) {
         goto e5;
     }
@@ -205,6 +225,7 @@ rtpp_stream_ctor(const struct r_stream_ctor_args *ap)
         goto e6;
     }
     pvt->servers_wrt = ap->servers_wrt;
+    pvt->proc_servers = ap->proc_servers;
     pvt->rtpp_stats = ap->rtpp_stats;
     pvt->pub.log = ap->log;
     RTPP_OBJ_INCREF(ap->log);
@@ -377,6 +398,8 @@ rtpp_stream_handle_play(struct rtpp_stream *self, const char *codecs,
             plerror = "rtpp_server_ctor() failed";
             if (sca.result == RTPP_SERV_NOENT)
                 continue;
+            if (sca.result == RTPP_SERV_TOOBIG)
+                plerror = "prompt file is too large";
             break;
         }
         rsrv->stuid = self->stuid;
@@ -390,6 +413,13 @@ rtpp_stream_handle_play(struct rtpp_stream *self, const char *codecs,
         }
         if (pvt->rtps.inact == 0) {
             CALL_SMETHOD(rsrv, start, cmd->dtime->mono);
+            if (CALL_METHOD(pvt->proc_servers, reg, rsrv) != 0) {
+                CALL_METHOD(pvt->servers_wrt, unreg, rsrv->sruid);
+                pvt->rtps.uid = RTPP_UID_NONE;
+                RTPP_OBJ_DECREF(rsrv);
+                plerror = "proc_servers->reg() method failed";
+                break;
+            }
         }
         pthread_mutex_unlock(&pvt->lock);
         cmd->csp->nplrs_created.cnt++;
@@ -591,6 +621,12 @@ _rtpp_stream_plr_start(struct rtpp_stream_priv *pvt, double dtime)
         return;
     }
     CALL_SMETHOD(rsrv, start, dtime);
+    if (CALL_METHOD(pvt->proc_servers, reg, rsrv) != 0) {
+        RTPP_LOG(pvt->pub.log, RTPP_LOG_ERR, "can't start player at port %d: "
+          "proc_servers->reg() method failed", pvt->pub.port);
+        CALL_METHOD(pvt->servers_wrt, unreg, rsrv->sruid);
+        pvt->rtps.uid = RTPP_UID_NONE;
+    }
     RTPP_OBJ_DECREF(rsrv);
     pvt->rtps.inact = 0;
 }
@@ -30,6 +30,7 @@
 
 struct rtpp_stream;
 struct rtpp_weakref_obj;
+struct rtpp_proc_servers;
 struct rtpp_stats;
 struct rtpp_log;
 struct rtpp_command;
@@ -104,51 +105,56 @@ struct pmod_data {
 };
 
 struct rtpp_stream {
+    /*
+     * Members used by the forwarding path for every packet go first, so
+     * that they share as few cache lines as possible.
+     */
+    /* Public methods */
+    const struct rtpp_stream_smethods *smethods;
+    /* Refcounter */
+    struct rtpp_refcnt *rcnt;
     /* ttl for stream */
     struct rtpp_ttl *ttl;
+    /* Copy of the per-pipe counters */
+    struct rtpp_pcount *pcount;
+    /* Per-stream counters */
+    struct rtpp_pcnt_strm *pcnt_strm;
+    struct rtpp_analyzer *analyzer;
+    struct rtp_resizer *resizer;
+    /* Pointer to rtpp_record's opaque data type */
+    struct rtpp_record *rrc;
+    /* UID of the session we belong to, read-only */
+    uint64_t seuid;
+    /* UID of the associated "sending" stream, read-only */
+    uint64_t stuid_sendr;
+    /* Type of pipe we are associated with, read-only */
+    int pipe_type;
+    int asymmetric;
+    /* Placeholder for per-module structures */
+    struct pmod_data *pmod_datap;
+    struct rtpp_log *log;
     /* Local listen address/port */
     const struct sockaddr *laddr;
     int port;
-    int asymmetric;
     enum rtpp_stream_side side;
     /* Flags: strong create/delete; weak ones */
     int weak;
-    /* Pointer to rtpp_record's opaque data type */
-    struct rtpp_record *rrc;
-    struct rtp_resizer *resizer;
-    struct rtpp_analyzer *analyzer;
     /* Supported codecs */
     char *codecs;
     /* Requested ptime */
     int ptime;
-    /* Refcounter */
-    struct rtpp_refcnt *rcnt;
     /* UID, read-only */
     uint64_t stuid;
-    /* UID of the session we belong to, read-only */
-    uint64_t seuid;
-    /* UID of the associated "sending" stream, read-only */
-    uint64_t stuid_sendr;
     /* UID of the associated "RTCP" stream, read-only */
     uint64_t stuid_rtcp;
     /* UID of the associated "RTP" stream, read-only */
     uint64_t stuid_rtp;
-    /* Type of pipe we are associated with, read-only */
-    int pipe_type;
-    struct rtpp_log *log;
-    /* Copy of the per-pipe counters */
-    struct rtpp_pcount *pcount;
-    /* Per-stream counters */
-    struct rtpp_pcnt_strm *pcnt_strm;
-    /* Public methods */
-    const struct rtpp_stream_smethods *smethods;
-    /* Placeholder for per-module structures */
-    struct pmod_data *pmod_datap;
 };
 
 struct r_stream_ctor_args {
     struct rtpp_log *log;
     struct rtpp_weakref_obj *servers_wrt;
+    struct rtpp_proc_servers *proc_servers;
     struct rtpp_stats *rtpp_stats;
     enum rtpp_stream_side side;
     int pipe_type;
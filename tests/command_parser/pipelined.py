@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+#
+# Sends a batch of cookie-prefixed commands over a single pipelined
+# (pcunix:, ptcp:, ptcp6:) control connection in one go, only then starts
+# reading, and checks that every command got exactly one reply carrying
+# its cookie and that replies for the same Call-ID came back in order.
+
+import re
+import socket
+import sys
+import time
+
+NCALLS = 20
+TIMEOUT = 10.0
+
+def connect(spec):
+    if spec.startswith('pcunix:'):
+        s = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        s.connect(spec[7:])
+        return s
+    if spec.startswith('ptcp6:'):
+        family, addr = socket.AF_INET6, spec[6:]
+    elif spec.startswith('ptcp:'):
+        family, addr = socket.AF_INET, spec[5:]
+    else:
+        raise ValueError('unsupported socket: %s' % spec)
+    host, port = addr.rsplit(':', 1)
+    s = socket.socket(family, socket.SOCK_STREAM)
+    s.connect((host.strip('[]'), int(port)))
+    return s
+
+def main(spec):
+    cmds = []
+    for i in range(NCALLS):
+        cid = 'pl_call_%d' % i
+        cmds.append(('%d_u' % i, 'U %s 127.0.0.1 %d ft_%d' % (cid, 13000 + i * 2, i), r'[0-9]+', cid))
+        cmds.append(('%d_v' % i, 'V', '20040107', None))
+        cmds.append(('%d_vf' % i, 'VF 20040107', '1', None))
+        cmds.append(('%d_d' % i, 'D %s ft_%d' % (cid, i), '0', cid))
+        cmds.append(('%d_dd' % i, 'D %s ft_%d' % (cid, i), 'E[0-9]+', cid))
+    s = connect(spec)
+    s.sendall(''.join('%s %s\n' % (c[0], c[1]) for c in cmds).encode())
+    expect = dict((c[0], c) for c in cmds)
+    seen = {}
+    order = []
+    buf = b''
+    deadline = time.time() + TIMEOUT
+    while len(seen) < len(cmds):
+        if time.time() > deadline:
+            sys.stderr.write('%s: timeout, got %d replies out of %d\n' %
+              (spec, len(seen), len(cmds)))
+            return 1
+        s.settimeout(max(deadline - time.time(), 0.1))
+        data = s.recv(65536)
+        if not data:
+            sys.stderr.write('%s: connection closed\n' % spec)
+            return 1
+        buf += data
+        while b'\n' in buf:
+            line, buf = buf.split(b'\n', 1)
+            cookie, reply = line.decode().split(' ', 1)
+            if cookie not in expect:
+                sys.stderr.write('%s: unexpected cookie in "%s"\n' % (spec, line))
+                return 1
+            if cookie in seen:
+                sys.stderr.write('%s: duplicate reply for "%s"\n' % (spec, cookie))
+                return 1
+            if re.fullmatch(expect[cookie][2], reply) is None:
+                sys.stderr.write('%s: bad reply for "%s": "%s"\n' %
+                  (spec, expect[cookie][1], reply))
+                return 1
+            seen[cookie] = reply
+            order.append(cookie)
+    s.close()
+    # Commands on the same call must not be reordered
+    for i in range(NCALLS):
+        pos = [order.index('%d_%s' % (i, t)) for t in ('u', 'd', 'dd')]
+        if pos != sorted(pos):
+            sys.stderr.write('%s: replies for pl_call_%d are out of order\n' %
+              (spec, i))
+            return 1
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1]))
@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+#
+# Creates spool segments as if left behind by an rtpproxy process that
+# is gone ("mk") and checks what has been recovered from them once a new
+# one has been started on the same directory ("check"). Segments of a
+# process that is still alive have to be left alone.
+
+import os
+import struct
+import subprocess
+import sys
+
+RRS_MAGIC = 0x52535046
+RRS_FT_OPEN, RRS_FT_DATA, RRS_FT_CLOSE, RRS_FT_DONE = 1, 2, 3, 4
+RRS_OF_PCAP = 0x1
+PCAP_MAGIC = 0xa1b2c3d4
+PCAP_HDR_LEN = 24
+SEG_PFX = '.rtpp_spool.'
+LIVE_PID = 1
+
+def frame(ftype, chan_id, data = b'', flags = 0):
+    return struct.pack('=IHHII', RRS_MAGIC, ftype, flags, len(data),
+      chan_id) + data
+
+def oframe(chan_id, spath, rpath, flags = 0):
+    data = spath.encode() + b'\0' + rpath.encode() + b'\0'
+    return frame(RRS_FT_OPEN, chan_id, data, flags)
+
+def payload(chan_id, n):
+    return bytes((chan_id * 16 + n + i) & 0xff for i in range(100 + n))
+
+def paths(rdir):
+    return {
+      'a':(os.path.join(rdir, 'rec_a.tmp'), os.path.join(rdir, 'rec_a.o.rtp')),
+      'b':(os.path.join(rdir, 'rec_b.o.rtp'), ''),
+      'c':(os.path.join(rdir, 'rec_c.pcap'), ''),
+      'l':(os.path.join(rdir, 'rec_l.o.rtp'), ''),
+    }
+
+def dead_pid():
+    p = subprocess.Popen(['true'])
+    p.wait()
+    return p.pid
+
+def mk(rdir):
+    ps = paths(rdir)
+    pid = dead_pid()
+    # Channel 1 is spread over two segments and is to be moved
+    # into the permanent storage, channel 2 has been split out completely
+    # already, channel 3 is a pcap one with a torn frame at the end.
+    seg0 = oframe(1, *ps['a']) + frame(RRS_FT_DATA, 1, payload(1, 0)) + \
+      oframe(2, *ps['b']) + frame(RRS_FT_DATA, 2, payload(2, 0)) + \
+      oframe(3, *ps['c'], flags = RRS_OF_PCAP) + \
+      frame(RRS_FT_DATA, 1, payload(1, 1)) + \
+      frame(RRS_FT_DATA, 3, payload(3, 0))
+    seg1 = frame(RRS_FT_DATA, 2, payload(2, 1)) + frame(RRS_FT_CLOSE, 2) + \
+      frame(RRS_FT_DONE, 2) + frame(RRS_FT_DATA, 1, payload(1, 2)) + \
+      frame(RRS_FT_DATA, 3, payload(3, 1)) + \
+      frame(RRS_FT_DATA, 3, payload(3, 2))[:-10]
+    segl = oframe(1, *ps['l']) + frame(RRS_FT_DATA, 1, payload(1, 0))
+    for name, data in ((SEG_PFX + '%d.0' % pid, seg0),
+      (SEG_PFX + '%d.1' % pid, seg1), (SEG_PFX + '%d.0' % LIVE_PID, segl)):
+        with open(os.path.join(rdir, name), 'wb') as f:
+            f.write(data)
+    return 0
+
+def fail(msg):
+    sys.stderr.write('%s\n' % msg)
+    return 1
+
+def check(rdir):
+    ps = paths(rdir)
+    with open(ps['a'][1], 'rb') as f:
+        if f.read() != payload(1, 0) + payload(1, 1) + payload(1, 2):
+            return fail('%s: wrong content' % ps['a'][1])
+    if os.path.exists(ps['a'][0]):
+        return fail('%s: has not been moved' % ps['a'][0])
+    if os.path.exists(ps['b'][0]):
+        return fail('%s: split out channel recovered' % ps['b'][0])
+    with open(ps['c'][0], 'rb') as f:
+        data = f.read()
+    if len(data) < PCAP_HDR_LEN or \
+      struct.unpack('=I', data[:4])[0] != PCAP_MAGIC:
+        return fail('%s: no pcap header' % ps['c'][0])
+    if data[PCAP_HDR_LEN:] != payload(3, 0) + payload(3, 1):
+        return fail('%s: wrong content' % ps['c'][0])
+    if os.path.exists(ps['l'][0]):
+        return fail('%s: recovered from a live process' % ps['l'][0])
+    segs = sorted(x for x in os.listdir(rdir) if x.startswith(SEG_PFX))
+    if segs != [SEG_PFX + '%d.0' % LIVE_PID]:
+        return fail('unexpected segments left: %s' % ', '.join(segs))
+    return 0
+
+if __name__ == '__main__':
+    if len(sys.argv) != 3 or sys.argv[1] not in ('mk', 'check'):
+        sys.stderr.write('usage: spool_recover.py mk|check dir\n')
+        sys.exit(2)
+    sys.exit(mk(sys.argv[2]) if sys.argv[1] == 'mk' else check(sys.argv[2]))